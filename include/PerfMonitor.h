@@ -23,7 +23,9 @@
 #include <cstdio>
 #include <cstdlib>
 #include <map>
+#include <vector>
 #include <list>
+#include <pthread.h>
 
 #ifdef DISABLE_MPI
 #include "mpi_stubs.h"
@@ -32,10 +34,94 @@
 #endif
 
 #include "PerfWatch.h"
+#include "pmlib_series.h"
 #include "pmVersion.h"
 
 namespace pm_lib {
 
+  /**
+   * 測定区間PerfWatchインスタンスのslab配列
+   *
+   * @note PerfWatchはPm_watch_slab_size個ずつcache line境界に揃えたslabに確保される。
+   *	区間数が増えた場合はslabのポインタ表だけを拡張し、既存のPerfWatchは移動・コピーしない。
+   *	ポインタ表は倍々に拡張するので、区間の追加は区間数によらず平均O(1)である。
+   *	従って m_watchArray[i] の参照は区間追加後も有効である。
+   */
+  const int Pm_watch_slab_shift = 4;
+  const int Pm_watch_slab_size = (1 << Pm_watch_slab_shift);
+
+  class PerfWatchSlabs {
+  private:
+    PerfWatch** m_slabs;       ///< slabのポインタ表
+    int m_nslabs;              ///< 確保済みslab数
+    int m_ntable;              ///< slabのポインタ表の長さ
+
+  public:
+    PerfWatchSlabs() : m_slabs(0), m_nslabs(0), m_ntable(0) {}
+
+    PerfWatch& operator[] (int i) {
+      return m_slabs[i >> Pm_watch_slab_shift][i & (Pm_watch_slab_size-1)];
+    }
+
+    /// 確保済みの区間数
+    int capacity(void) const { return m_nslabs * Pm_watch_slab_size; }
+
+    /// 少なくとも n 区間分のPerfWatchを確保する
+    ///
+    ///   @return true: 成功, false: メモリ確保に失敗
+    ///
+    bool reserve(int n);
+  };
+
+
+  /// PMLIB_POWER_SAMPLE サンプラの標本リングと区間境界のキュー. See src_pmlib/PerfPowerSampler.cpp
+  struct pm_power_sampler;
+
+  /// PMLIB_POWER_TUNE 電力ノブの候補と区間毎の選択. See src_pmlib/PerfPowerTune.cpp
+  struct pm_power_setting;
+  struct pm_power_tune_section;
+  struct pm_power_tuner;
+
+  /// PMmpi_auto 区間と呼び出し種別毎のMPI呼び出しの積算表. See src_pmlib/PerfMpiAuto.cpp
+  struct pm_mpi_auto;
+
+  /// PMLIB_IMBALANCE_TIMESTEP 区間の各呼び出しの時間. See src_pmlib/PerfImbalance.cpp
+  struct pm_imbalance_steps;
+
+
+  /**
+   * 入れ子になった測定区間のスタック要素
+   *
+   * @note PerfMonitor::start()で積まれ、PerfMonitor::stop()で降ろされる。
+   *	降ろす時に直下の子区間の時間とHWPC計数を親区間に加算するので、
+   *	各区間の包含(inclusive)と排他(exclusive)の測定値が区別される。
+   */
+  const int Pm_max_nest_depth = 32;
+
+  struct pm_nest_frame {
+    int id;                    ///< 区間番号
+    bool has_child;            ///< この区間の内部で他の区間がstop済みか
+    double time_child;         ///< 直下の子区間の時間の合計
+    long long hwpc_child[Max_group_events]; ///< 直下の子区間のHWPC計数の合計
+  };
+
+
+  /**
+   * C/Fortranインタフェイスのラベル文字列と区間番号の対応表の要素
+   *
+   * @note PerfMonitor::find_section_label() が引数のアドレスと文字数で引く。
+   *	文字列リテラルや同じ文字型変数のラベルは毎回同じアドレスで渡されるので、
+   *	std::string を生成せずに区間番号が得られる。
+   */
+  const int Pm_label_cache_size = 64;
+
+  struct pm_label_cache_entry {
+    const char* label;         ///< 渡されたラベルのアドレス. 空の場合はNULL
+    int len;                   ///< ラベルの文字数
+    int id;                    ///< 区間番号
+  };
+
+
   /**
    * PerfMonitor クラス 計算性能測定を行うクラス関数と変数
    */
@@ -93,28 +179,91 @@ namespace pm_lib {
     bool is_POWER_enabled;     ///< PMlibの対応動作可能フラグ:Power API
     bool is_OTF_enabled;       ///< PMlibの対応動作可能フラグ:OTF tracing 出力
     bool is_Root_active;       ///< 背景区間(Root区間)の動作フラグ
-    bool is_exclusive_construct; ///< 測定区間の重なり状態検出フラグ
+    pm_nest_frame m_nest_stack[Pm_max_nest_depth]; ///< 実行中の測定区間のスタック(スレッド毎)
+    int m_nest_depth;          ///< スタックの深さ. Pm_max_nest_depthを越えた分は記録しない
+    bool is_nest_warned;       ///< 入れ子になっていないstart/stopを警告済みか
+    pm_label_cache_entry m_label_cache[Pm_label_cache_size]; ///< C/Fortranのラベルと区間番号の対応表(スレッド毎)
+    bool is_hwpc_rotated;      ///< HWPC_CHOOSER=ROTATE で複数のHWPCグループを切り替えて計測するか
+    bool is_rank_gathered;     ///< 各区間のプロセス別測定値がランク0に集約済みか
+    bool is_node_comm_set;     ///< m_node_comm, m_leader_comm が作成済みか
+    MPI_Comm m_node_comm;      ///< 同一ノード内のプロセスのcommunicator
+    MPI_Comm m_leader_comm;    ///< 各ノードの代表プロセス(node rank 0)のcommunicator
+
+    // PMLIB_SERIES 時系列スナップショット. See src_pmlib/PerfSeries.cpp
+    int series_mode;           ///< pm_series_mode, PMLIB_SERIES が無い場合は(-1)
+    double series_interval;    ///< スナップショットの間隔. 秒または呼び出し回数
+    std::string series_label;  ///< Series_calls で呼び出し回数を数える区間のラベル
+    int series_section;        ///< その区間番号. 未作成の場合は(-1)
+    long series_calls;         ///< 前回のスナップショット以後の呼び出し回数
+    int series_nlabeled;       ///< ラベルをファイルに出力済みの区間数
+    double series_origin;      ///< 時刻の原点. initializeSeries()の時刻
+    FILE* series_fp;           ///< <PMLIB_SERIES_FILE>_<rank>.pmts
+    char* series_buffer;       ///< ファイルに書き出す前のバッファ
+    size_t series_used;        ///< バッファの使用量(Byte)
+    bool is_series_thread;     ///< サンプラスレッドが動作中か
+    bool series_quit;          ///< サンプラスレッドへの終了要求
+    pthread_t series_thread;   ///< Series_time のサンプラスレッド
+    pthread_mutex_t series_lock; ///< サンプラスレッドと区間の追加を排他する
+    pthread_cond_t series_cond;  ///< サンプラスレッドの待機と終了要求
+
+    // PMLIB_POWER_SAMPLE 電力の周期サンプリング. See src_pmlib/PerfPowerSampler.cpp
+    double power_interval;     ///< サンプリングの間隔(秒). PMLIB_POWER_SAMPLE が無い場合は0
+    pm_power_sampler* power_state; ///< 標本リングとキュー. マスタースレッド以外はNULL
+    bool is_power_thread;      ///< 電力サンプラスレッドが動作中か
+    bool power_quit;           ///< 電力サンプラスレッドへの終了要求
+    pthread_t power_thread;    ///< 電力サンプラスレッド
+    pthread_mutex_t power_lock; ///< 電力サンプラスレッドと区間の追加を排他する
+    pthread_cond_t power_cond;  ///< 電力サンプラスレッドの待機と終了要求
+
+    // PMLIB_POWER_TUNE 電力ノブの自動調整. See src_pmlib/PerfPowerTune.cpp
+    pm_power_tuner* power_tuner; ///< 調整する区間とその測定値. 調整しない場合はNULL
+
+    // PMmpi_auto MPI通信の自動計測. See src_pmlib/PerfMpiAuto.cpp
+    pm_mpi_auto* mpi_auto;     ///< MPI呼び出しの積算表. libPMmpi_auto.a をリンクしない場合はNULL
+
+    // PMLIB_REPORT=IMBALANCE 負荷不均衡の解析. See src_pmlib/PerfImbalance.cpp
+    std::string imbalance_label;  ///< PMLIB_IMBALANCE_TIMESTEP の区間のラベル
+    int imbalance_section;        ///< その区間番号. 未作成または指定が無い場合は(-1)
+    pm_imbalance_steps* imbalance_steps; ///< 区間の各呼び出しの時間. 指定が無い場合はNULL
+
+    // report_async() 非同期レポート. See src_pmlib/PerfReportAsync.cpp
+    bool is_async_active;      ///< report_async() の集約が完了待ちか
+    bool is_async_thread;      ///< ランク0のレポート作成スレッドが動作中か
+    pthread_t async_thread;    ///< ランク0のレポート作成スレッド
+    FILE* async_fp;            ///< report_async() の出力ファイルポインタ
+    int async_n_pack;          ///< gatherPack() の1プロセス分の長さ
+    int async_n_hwpc;          ///< selfPack() のHWPC値の個数
+    int* async_offset;         ///< 各区間の gatherPack() の位置 [m_nWatch+1]
+    double* async_send;        ///< MPI_Igather の送信バッファ
+    double* async_recv;        ///< MPI_Igather の受信バッファ(ランク0)
+    double* async_self;        ///< MPI_Ireduce の送信バッファ
+    double* async_sum;         ///< MPI_Ireduce の受信バッファ(ランク0)
+    MPI_Request async_req[2];  ///< MPI_Igather, MPI_Ireduce のリクエスト
 
     std::string parallel_mode; /*!< 並列動作モード
       // {Serial| OpenMP| FlatMPI| Hybrid} */
     std::string env_str_hwpc;  /*!< 環境変数 HWPC_CHOOSERの値
-      // {FLOPS| BANDWIDTH| VECTOR| CACHE| CYCLE| LOADSTORE| USER} */
+      // {FLOPS| BANDWIDTH| VECTOR| CACHE| CYCLE| LOADSTORE| ROTATE| ROOFLINE| USER} */
     std::string env_str_report;  /*!< 環境変数 PMLIB_REPORTの値
-      // {BASIC| DETAIL| FULL} */
+      // {BASIC| DETAIL| FULL| IMBALANCE} */
+    std::string env_str_format;  /*!< 環境変数 PMLIB_REPORT_FORMATの値
+      // {JSON| CSV}, 指定が無い場合は空文字列 */
 
-    PerfWatch* m_watchArray;   /*!< 測定区間の配列
+    PerfWatchSlabs m_watchArray; /*!< 測定区間の配列
       // @note PerfWatchのインスタンスは全部で m_nWatch 生成される。<br>
       // m_watchArray[0] :PMlibが定義するRoot区間、<br>
       // m_watchArray[1 .. m_nWatch] :ユーザーが定義する各区間 */
 
     unsigned* m_order;         ///< 測定区間ソート用のリスト m_order[m_nWatch]
+    int m_order_size;          ///< m_order の確保済みの長さ
 
     std::map<std::string, int > m_map_sections; /// map of section name and ID
+    std::vector<const std::string*> m_section_labels; ///< 区間番号で引くラベル. m_map_sections のキーを指す
 
 
   public:
     /// コンストラクタ.
-    PerfMonitor() : my_rank(-1), m_watchArray(0) {
+    PerfMonitor() : my_rank(-1) {
 		#ifdef DEBUG_PRINT_MONITOR
 		//	if (my_rank == 0) {
 		fprintf(stderr, "<PerfMonitor> constructor \n");
@@ -125,7 +274,6 @@ namespace pm_lib {
 /***
     /// We should let the default destructor handle the clean up
     ~PerfMonitor() {
-		if (m_watchArray) delete[] m_watchArray;
 		if (m_order) delete[] m_order;
 		#ifdef DEBUG_PRINT_MONITOR
 		//	if (my_rank == 0) {
@@ -163,7 +311,10 @@ namespace pm_lib {
     ///   第１引数は必須。第２引数は明示的な自己申告モードの場合に必須。
     ///   第３引数は省略可
     ///
-    void setProperties(const std::string& label, Type type=CALC, bool exclusive=true);
+    ///   @return 区間番号 the section ID (handle) of the label, which can be
+    ///		given to start(int)/stop(int, ...). (-1) if the call failed.
+    ///
+    int setProperties(const std::string& label, Type type=CALC, bool exclusive=true);
 
 
     /// Read the current value for the given power control knob
@@ -215,6 +366,16 @@ namespace pm_lib {
     void start (const std::string& label);
 
 
+    /// 測定区間スタート, overload version using the section ID
+    ///
+    ///   @param[in] id 区間番号。setProperties()の返り値
+    ///
+    ///   @note the label lookup is skipped. id is valid only for the
+    ///		PerfMonitor object (i.e. thread) which returned it.
+    ///
+    void start (int id);
+
+
     /// 測定区間ストップ
     ///
     ///   @param[in] label ラベル文字列。測定区間を識別するために用いる。
@@ -246,6 +407,15 @@ namespace pm_lib {
     void stop(const std::string& label, double flopPerTask=0.0, unsigned iterationCount=1);
 
 
+    /// 測定区間ストップ, overload version using the section ID
+    ///
+    ///   @param[in] id 区間番号。setProperties()の返り値
+    ///   @param[in] flopPerTask 測定区間の計算量(演算量Flopまたは通信量Byte):省略値0
+    ///   @param[in] iterationCount  計算量の乗数（反復回数）:省略値1
+    ///
+    void stop(int id, double flopPerTask=0.0, unsigned iterationCount=1);
+
+
     /// 測定区間のリセット
     ///
     ///   @param[in] label ラベル文字列。測定区間を識別するために用いる。
@@ -253,6 +423,17 @@ namespace pm_lib {
     void reset (const std::string& label);
 
 
+    /// 測定区間のHWPCサンプリング間隔を設定する
+    ///
+    ///   @param[in] label ラベル文字列。setProperties()で設定済みの区間
+    ///   @param[in] interval  HWPCを読み取る呼び出し間隔. 1は毎回読み取る
+    ///
+    ///   @note  環境変数PMLIB_SAMPLEで与えた全区間共通の既定値を区間毎に変更する。
+    ///          OpenMP並列領域内の区間では、各スレッドが呼び出す。
+    ///
+    void setSampleInterval (const std::string& label, int interval);
+
+
     /// 全測定区間のリセット
     ///
     ///
@@ -327,6 +508,46 @@ namespace pm_lib {
     void report(FILE* fp);
 
 
+    /// report() の非同期版. 集約を開始して直ちに戻る
+    ///   @brief
+    /// - [1] stop the Root section and merge thread serial/parallel sections
+    /// - [2] start MPI_Igather/MPI_Ireduce of the section records
+    /// - [3] rank 0 formats the report on a helper thread, if MPI_THREAD_MULTIPLE is provided
+    ///
+    /// @param[in] FILE* fp     output file pointer. must stay open until report_wait() returns
+    ///
+    /// @note 全プロセスが呼び出し、MPI_Finalize() の前に report_wait() を呼び出す。
+    ///   その間アプリケーションは終了処理を続けてよいが、PMlibの他のAPIは呼び出さない。
+    /// @note PMLIB_REPORT=FULL のスレッド別レポートは作成しない(DETAILとして出力)。
+    ///   HWPC_CHOOSER=ROTATE の場合は最初のグループのみを出力する。
+    ///
+    void report_async(FILE* fp);
+
+
+    /// report_async() の完了を待つ
+    ///
+    /// @note ランク0のレポートはこの呼び出しまでに出力される。
+    ///   report_async() が呼ばれていない場合は何もしない。
+    ///
+    void report_wait(void);
+
+
+    /// MPI呼び出し1回の時間と通信量を実行中の区間に積算する
+    ///
+    ///   @param[in] call   呼び出し種別 (pmlib_mpi_auto.h の pm_mpi_auto_call)
+    ///   @param[in] t0     呼び出し前の時刻
+    ///   @param[in] t1     呼び出し後の時刻
+    ///   @param[in] bytes  通信量(バイト)
+    ///
+    ///   @note 利用者は呼び出さない。libPMmpi_auto.a のPMPIラッパーが呼ぶ。
+    ///
+    void mpi_auto_add(int call, double t0, double t1, double bytes);
+
+    /// PerfWatch::getTime() の時刻. libPMmpi_auto.a のPMPIラッパーが呼ぶ
+    ///
+    double mpi_auto_time(void);
+
+
 
     /// 出力する性能統計レポートの種類を選択し、ファイルへの出力を開始する。
     ///
@@ -340,6 +561,8 @@ namespace pm_lib {
 	///   PMLIB_REPORT=DETAIL: MPIランク別に経過時間、頻度、HWPC統計情報の詳細レポートを出力する。
 	///   PMLIB_REPORT=FULL： BASICとDETAILのレポートに加えて、
 	///		各MPIランクが生成した各並列スレッド毎にHWPC統計情報の詳細レポートを出力する。
+	///   PMLIB_DUMP=<prefix> の場合はレポートを出力せず、各プロセスが測定値を
+	///		<prefix>_<rank>.pmrec に書き出す。レポートはジョブ終了後に pm_merge で作成する。
     ///   @note  
     ///  通常このAPIはPMlib内部で自動的に実行され、利用者が呼び出す必要はない。
     ///
@@ -466,10 +689,106 @@ namespace pm_lib {
     /// Additional class function to check-in, check-out performance records
     ///
 	void save_pm_records(void);
-	void load_pm_records(void);
+	bool load_pm_records(void);
+	char* pack_pm_records(size_t& total_size);
+	bool dump_pm_records(FILE* fp);
+	void remove_pm_records(void);
+	void stop_active_sections(void);
     void pm_storage_file_name(std::string& pm_file_name);
     void pm_storage_dir_name(std::string& pm_dir_name);
 
+    /// ShellPM daemon mode. See src_pmlib/PerfDaemon.cpp
+    ///
+    void pm_daemon_socket_name(std::string& pm_socket_name);
+    int  pm_daemon_send(const std::string& message, FILE* fp_reply);
+    void pm_daemon_serve(void);
+
+    /// PMLIB_OVERHEAD PMlib自身のstart/stopのコストの較正. See src_pmlib/PerfCalibrate.cpp
+    ///
+    ///   @note initialize() の最後に呼ばれる。
+    ///
+    void calibrateOverhead(void);
+
+    /// PMLIB_SERIES 時系列スナップショット. See src_pmlib/PerfSeries.cpp
+    ///
+    ///   @note initializeSeries() は initialize() から、finalizeSeries() は
+    ///		report() から呼ばれる。series_sampler() はサンプラスレッドの本体。
+    ///
+    void initializeSeries(void);
+    void finalizeSeries(void);
+    void series_snapshot(void);
+    void series_append(const void* p, size_t n);
+    void series_flush(void);
+    static void* series_sampler(void* arg);
+
+    /// PMLIB_POWER_SAMPLE 電力の周期サンプリング. See src_pmlib/PerfPowerSampler.cpp
+    ///
+    ///   @note initializePowerSampler() は initialize() から、finalizePowerSampler() は
+    ///		stopRoot() から呼ばれる。区間は power_mark() で時刻のみを記録し、
+    ///		電力量はサンプラスレッドが power_drain() で区間に配分する。
+    ///
+    void initializePowerSampler(void);
+    void finalizePowerSampler(void);
+    void power_mark(int id, bool is_start);
+    void power_take_sample(void);
+    void power_drain(bool is_final);
+    static void* power_sampler(void* arg);
+
+    /// PMLIB_POWER_TUNE 電力ノブの自動調整. See src_pmlib/PerfPowerTune.cpp
+    ///
+    ///   @note initializePowerTune() は initialize() から、finalizePowerTune() は
+    ///		stopRoot() から、printPowerTune() は printBasicPower() から呼ばれる。
+    ///		power_tune_start()/power_tune_stop() は調整する区間の start()/stop() の外側で呼ばれる。
+    ///
+    void initializePowerTune(void);
+    void finalizePowerTune(void);
+    void power_tune_register(int id, const std::string& label);
+    bool power_tune_apply(const pm_power_setting& knob);
+    void power_tune_start(int id);
+    void power_tune_stop(int id);
+    void power_tune_choose(pm_power_tune_section& s);
+    void printPowerTune(FILE* fp, int maxLabelLen);
+
+    /// PMmpi_auto MPI通信の自動計測. See src_pmlib/PerfMpiAuto.cpp
+    ///
+    ///   @note initializeMpiAuto() は initialize() から、mpi_auto_fold() は集約の最初に、
+    ///		printMpiAuto() は printBasicTable() から呼ばれる。
+    ///
+    void initializeMpiAuto(void);
+    void mpi_auto_fold(void);
+    void printMpiAuto(FILE* fp, int maxLabelLen);
+
+    /// PMLIB_REPORT=IMBALANCE 負荷不均衡とクリティカルパスのレポート. See src_pmlib/PerfImbalance.cpp
+    ///
+    ///   @note initializeImbalance() は initialize() から、imbalance_step() は stop() から、
+    ///		printImbalance() は selectReport() から全プロセスが呼ぶ。
+    ///
+    void initializeImbalance(void);
+    void imbalance_step(int id);
+    void printImbalance(FILE* fp);
+
+    /// report_async() でランク0のレポートを作成する. See src_pmlib/PerfReportAsync.cpp
+    ///
+    ///   @note async_format() は集約の完了を待ってからレポートを出力する。
+    ///		async_formatter() はランク0のレポート作成スレッドの本体。
+    ///
+    void async_format(void);
+    static void* async_formatter(void* arg);
+
+    /// C/Fortranのラベル文字列から登録済みの区間番号を取得する
+    ///
+    ///   @param[in] label  ラベル文字列. NUL終端でなくてよい
+    ///   @param[in] len    ラベルの文字数
+    ///
+    ///   @return 区間番号. 未登録の場合やPMlibが無効な場合は(-1)
+    ///
+    ///   @note 対応表に無い場合のみ std::string を生成して m_map_sections を検索する。
+    ///		対応表の区間番号はラベルと m_watchArray[id].m_label を比較して確かめるので、
+    ///		同じアドレスの文字列が書き換えられても誤った区間は返さない。
+    ///		C/Fortranインタフェイスの start/stop から呼ばれる。
+    ///
+    int find_section_label(const char* label, int len);
+
 
 
   private:
@@ -490,7 +809,7 @@ namespace pm_lib {
     ///
     ///	  @return the section ID
     ///
-    int find_section_object(std::string arg_st);
+    int find_section_object(const std::string& arg_st);
 
     /// 測定区間の区間番号に対応するラベルを取得
     /// Search the section ID in the map and return the label string
@@ -527,10 +846,67 @@ namespace pm_lib {
     ///    各測定区間のHWPCイベントの統計値を取得する。
     void gather_and_stats(void);
 
+    /// 全プロセスの測定結果の統計量のみを集約する
+    ///
+    ///   @note  BASICレポート用。プロセス別の測定値は保持しない。
+    ///    ノード内で集約した後にノード代表プロセス間で集約する2段階の
+    ///    reductionで、平均値・標準偏差はWelford法により逐次的に合成する。
+    ///
+    void gather_and_reduce(void);
+
+    /// ランク0が計算した統計量を全プロセスに配布する
+    ///
+    void bcast_stats(void);
+
+    /// 入れ子区間を除いた排他時間・HWPC値のプロセス平均をランク0に集約する
+    ///
+    void reduce_self_stats(void);
+
+    /// 区間スタックを積む/降ろす
+    ///
+    void push_nest_frame(int id);
+    void pop_nest_frame(int id);
+
+    /// HWPC_CHOOSER=ROTATE で計測するHWPCグループを次のグループに切り替える
+    ///
+    ///   @note 直列領域のstop()から呼ばれる。測定中の区間は切り替えの前後で中断・再開する。
+    ///
+    void rotate_hwpc_group(void);
+
     /// 経過時間でソートした測定区間のリストm_order[m_nWatch] を作成する。
     ///
     void sort_m_order(void);
 
+    /// report() と report_async() の前処理. Root区間を停止し、スレッドの測定値を集約する
+    ///
+    void prepareReport(void);
+
+    /// 集約済みの統計量から基本統計レポートの表を出力する. ランク0のみが呼び出す
+    ///
+    ///   @param[in] fp       出力ファイルポインタ
+    ///   @param[in] hostname ホスト名(省略時はrank 0 実行ホスト名)
+    ///   @param[in] comments 任意のコメント
+    ///   @param[in] op_sort  測定区間の表示順 (0:経過時間順、1:登録順)
+    ///
+    ///   @return ラベル文字長
+    ///
+    int printBasicTable(FILE* fp, std::string hostname, const std::string comments, int op_sort=0);
+
+    /// 集約済みのプロセス別測定値から詳細レポートを出力する. ランク0のみが呼び出す
+    ///
+    ///   @param[in] fp       出力ファイルポインタ
+    ///   @param[in] op_sort  測定区間の表示順 (0:経過時間順、1:登録順)
+    ///
+    void printDetailTable(FILE* fp, int op_sort=0);
+
+    /// PMLIB_REPORT_FORMAT の機械可読レポートを出力する. See src_pmlib/PerfReportFormat.cpp
+    ///
+    ///   @note printFormatted() は全プロセスが呼び出し、スレッド別の値を集約する。
+    ///		writeFormatted() はランク0のみが呼び出す。
+    ///
+    void printFormatted(void);
+    void writeFormatted(const double* p_threads, int n_raw);
+
     /// 基本統計レポートのヘッダ部分を出力。
     ///
     ///   @param[in] fp       出力ファイルポインタ
@@ -590,6 +966,29 @@ namespace pm_lib {
 	void printBasicHWPC (FILE* fp, int maxLabelLen, int op_sort=0);
 
 
+	/// Report the BASIC HWPC statistics of all the groups counted by HWPC_CHOOSER=ROTATE
+	///
+	///   @param[in] fp       	report file pointer
+	///   @param[in] maxLabelLen    maximum label string field length
+	///   @param[in] op_sort 	sorting option (0:sorted by seconds, 1:listed order)
+	///
+	///	  @note   collective. all the processes must call this routine.
+	///		The statistics are gathered again for each of the groups.
+	///
+	void printRotatedHWPC (FILE* fp, int maxLabelLen, int op_sort=0);
+
+
+	/// Report the arithmetic intensity and the roofline of the sections for HWPC_CHOOSER=ROOFLINE
+	///
+	///   @param[in] fp       	report file pointer
+	///   @param[in] maxLabelLen    maximum label string field length
+	///   @param[in] op_sort 	sorting option (0:sorted by seconds, 1:listed order)
+	///
+	///	  @note   rank 0 only. called by printRotatedHWPC(). See src_pmlib/PerfRoofline.cpp
+	///
+	void printRoofline (FILE* fp, int maxLabelLen, int op_sort=0);
+
+
 	/// Report the BASIC power consumption statistics of the master node
 	///
 	///   @param[in] fp         report file pointer
@@ -37,6 +37,8 @@
 #include "pmlib_papi.h"
 #include "pmlib_power.h"
 #include "pmlib_otf.h"
+#include "pmlib_record.h"
+#include "pmlib_series.h"
 
 #ifndef _WIN32
 #include <sys/time.h>
@@ -46,6 +48,46 @@
 
 namespace pm_lib {
 
+  /// timer source of PerfWatch::getTime(), selected by PMLIB_TIMER environment variable
+  ///
+  ///	@note the tick based sources are calibrated at initialization and are
+  ///		anchored to CLOCK_MONOTONIC, so that the time values of different
+  ///		processes on the same node (e.g. start_pm and stop_pm) can be compared.
+  ///
+  enum pmlib_timer_source {
+	Timer_monotonic = 0,	///< clock_gettime(CLOCK_MONOTONIC) via vDSO. default
+	Timer_monotonic_raw,	///< clock_gettime(CLOCK_MONOTONIC_RAW)
+	Timer_gettimeofday,		///< gettimeofday() micro second resolution
+	Timer_tsc,				///< x86 invariant TSC, rdtsc
+	Timer_tsc_lfence,		///< x86 invariant TSC, lfence + rdtsc
+	Timer_tscp,				///< x86 invariant TSC, rdtscp
+	Timer_cntvct,			///< Arm generic timer cntvct_el0
+	Timer_mach,				///< macOS mach_absolute_time()
+	Timer_gettod,			///< Fujitsu __gettod()
+  };
+
+  struct pmlib_timer_chooser {
+	int source;				///< pmlib_timer_source
+	std::string name;		///< name of the source, i.e. PMLIB_TIMER value
+	double second_per_tick;	///< calibrated period of the tick based sources
+	unsigned long long tick_base;	///< tick value at the anchor
+	double time_base;		///< CLOCK_MONOTONIC time at the anchor
+	double overhead;		///< measured cost of one getTime() call [sec]
+	bool is_set;			///< initialization is done
+	int calibrate;			///< PMLIB_OVERHEAD 0:OFF, 1:REPORT, 2:SUBTRACT
+	double pair_serial;		///< cost of one start/stop pair in serial region [sec]
+	double pair_parallel;	///< cost of one start/stop pair in parallel region [sec]
+	double bias_serial;		///< part of pair_serial measured inside the section [sec]
+	double bias_parallel;	///< part of pair_parallel measured inside the section [sec]
+	bool is_subtracted;		///< bias_* is subtracted from each stop() interval
+  };
+
+  /// statsPack()/statsUnpack() の要素数
+  const int Pm_stats_pack_size = 7;
+
+  /// reducePack()/reduceUnpack() のHWPC値を除く要素数
+  const int Pm_reduce_base_size = 8;
+
   /// デバッグ用マクロ
 #define PM_Exit(x) \
 ((void)fprintf(stderr, "*** continue from <%s> line:%u\n", __FILE__, __LINE__))
@@ -77,6 +119,11 @@ namespace pm_lib {
     double m_flop;         ///< 浮動小数点演算量or通信量(バイト)
     double m_percentage;   ///< Percentage of vectorization or cache hit
 
+    // 入れ子区間の積算量. PerfMonitorの区間スタックが設定する
+    double m_time_child;   ///< 直下の入れ子区間の時間の合計
+    long long m_hwpc_child[Max_group_events]; ///< 直下の入れ子区間のHWPCイベント数の合計
+    bool m_child_in_parallel; ///< 並列領域の入れ子区間を含む. m_hwpc_child[]はマスタースレッド分のみ
+
     // 統計量(全プロセスに関する統計量でランク0のみが保持する)
     long m_count_sum;    ///< 測定回数 (全プロセスの合計値)
     long m_count_av;     ///< 測定回数の平均値
@@ -85,6 +132,10 @@ namespace pm_lib {
     double m_flop_av;    ///< 浮動小数点演算量or通信量の平均値
     double m_flop_sd;    ///< 浮動小数点演算量or通信量の標準偏差
     double m_time_comm;  ///< 通信部分の最大値
+    double m_time_self_av; ///< 入れ子区間を除いた排他時間の平均値
+    double m_rot_error_max; ///< HWPC_CHOOSER=ROTATE 推定値の相対誤差(%)の全プロセスの最大値
+    double m_roof_flop;   ///< HWPC_CHOOSER=ROOFLINE 浮動小数点演算数の平均値. 未集計の場合は(-1)
+    double m_roof_bytes;  ///< HWPC_CHOOSER=ROOFLINE メモリ転送量(バイト)の平均値. 未集計の場合は(-1)
 
     int level_POWER;	///< 電力情報レベル 0(no), 1(NODE), 2(NUMA), 3(PARTS)
     double m_power_av;    ///< average value of power consumption meter reading
@@ -113,10 +164,25 @@ namespace pm_lib {
     double* m_flopArray;         ///< 「浮動小数点演算量or通信量」集計用配列
     long* m_countArray; ///< 「測定回数」集計用配列
     double* m_sortedArrayHWPC;   ///< 集計後ソートされたHWPC配列のポインタ
+    double m_sortedAverageHWPC[Max_group_events]; ///< gather_and_reduce()で集約したHWPC値のプロセス平均
+    double m_sortedSelfHWPC[Max_group_events]; ///< 入れ子区間を除いたHWPC値. ランク0では集約後のプロセス平均
+
+    // HWPCサンプリング測定の補助変数
+    int m_sample_interval; ///< HWPCを読み取る呼び出し間隔 (1:毎回)
+    long m_count_sampled;  ///< HWPCを読み取った測定回数
+    bool m_sample_now;     ///< 現在のstart/stopの組でHWPCを読み取るかどうか
+
+    // HWPC_CHOOSER=ROTATE の補助変数. 添字 k は k 番目に計測するHWPCグループ
+    bool m_rotated;        ///< HWPCグループを切り替えながら計測するかどうか
+    double m_rot_mark;     ///< 現在のグループで計測を始めた時刻
+    double m_rot_time[Max_hwpc_output_group];  ///< グループ毎のHWPC計測時間
+    long m_rot_calls[Max_hwpc_output_group];   ///< グループ毎のHWPC計測回数
+    double m_rot_mean[Max_hwpc_output_group];  ///< グループ先頭イベントの計数率の平均
+    double m_rot_m2[Max_hwpc_output_group];    ///< グループ先頭イベントの計数率の偏差平方和
+    double m_rot_error[Max_hwpc_output_group]; ///< 計測時間の比で補正した推定値の相対誤差(%)
 
     /// 測定区間に関する各種の判定フラグ ：  bool値(true|false)
     bool m_is_set;         /// 測定区間がプロパティ設定済みかどうか
-    bool m_is_healthy;     /// 測定区間に排他性・非排他性の矛盾がないか
     bool m_threads_merged; /// 全スレッドの情報をマスタースレッドに集約済みか
     bool m_gathered;       /// 全プロセスの結果をランク0に集計済みかどうか
     bool m_started;        /// 測定区間がstart済みかどうか
@@ -128,8 +194,11 @@ namespace pm_lib {
     /// コンストラクタ.
     PerfWatch() : m_time(0.0), m_flop(0.0), m_count(0), m_started(false),
       my_rank(-1), m_timeArray(0), m_flopArray(0), m_countArray(0),
-      m_sortedArrayHWPC(0), m_is_set(false), m_is_healthy(true),
-      m_in_parallel(false) {
+      m_sortedArrayHWPC(0), m_is_set(false),
+      m_in_parallel(false), m_time_child(0.0), m_time_self_av(0.0),
+      m_rot_error_max(0.0), m_roof_flop(-1.0), m_roof_bytes(-1.0),
+      m_sample_interval(1), m_count_sampled(0), m_sample_now(true), m_rotated(false), m_rot_mark(0.0),
+      m_gathered(false) {
 	#ifdef DEBUG_PRINT_WATCH
 		int i_thread_constractor;
 		#ifdef _OPENMP
@@ -171,6 +240,12 @@ namespace pm_lib {
     ///
     void setProperties(const std::string label, int id, int typeCalc, int nPEs, int my_rank, int num_threads, bool exclusive);
 
+    /// setProperties() で確保したスレッド別のHWPC配列を開放する
+    ///
+    ///   @note m_watchArray に登録しない一時的なインスタンスが破棄される前に呼ぶ。
+    ///
+    void releaseThreadArrays(void);
+
     /// HWPCイベントを初期化する
     ///
     void initializeHWPC(void);
@@ -209,6 +284,110 @@ namespace pm_lib {
     ///
     void reset(void);
 
+    /// HWPCのサンプリング間隔を設定する
+    ///
+    ///   @param[in] interval  HWPCを読み取る呼び出し間隔. 1以下は毎回読み取る
+    ///
+    ///   @note  HWPCモードでは interval 回に1回だけ start/stop の組でHWPCを読み取り、
+    ///          読み取らなかった呼び出しのイベント数は測定回数の比で外挿する。
+    ///          時間と測定回数は毎回測定する。既定値は環境変数PMLIB_SAMPLEで与える。
+    ///
+    void setSampleInterval(int interval);
+
+    /// HWPC値がサンプリングからの外挿値かどうか
+    ///
+    bool is_sampled(void) const { return (m_sample_interval > 1) && (m_count_sampled < m_count); }
+
+    /// HWPC_CHOOSER=ROTATE で順に計測するHWPCグループの数. それ以外は0
+    ///
+    int rotateGroups(void);
+
+    /// 集計・出力するHWPCグループを選択する
+    ///
+    ///   @param[in] k  グループ番号 0 <= k < rotateGroups()
+    ///
+    void selectReportGroup(int k);
+
+    /// 計測するHWPCグループを切り替える時期かどうか. 直前のstop()の時刻で判定する
+    ///
+    bool rotateDue(void);
+
+    /// 計測するHWPCグループを全スレッドで次のグループに切り替える
+    ///
+    ///   @note  直列領域から呼び出す。測定中の区間は前後で
+    ///          suspendRotatedHWPC(), resumeRotatedHWPC() を呼び出す。
+    ///
+    void rotateHWPC(void);
+
+    /// 測定中の区間のHWPC値をグループ切り替えの前に積算し、切り替えの後に再開する
+    ///
+    void suspendRotatedHWPC(void);
+    void resumeRotatedHWPC(void);
+
+    /// HWPC_CHOOSER=ROTATE で外挿したグループ k のHWPC値の相対誤差(%)
+    ///
+    double rotateError(int k);
+
+    /// HWPC_CHOOSER=ROOFLINE 集計したグループの演算数またはメモリ転送量を m_roof_flop, m_roof_bytes に写す
+    ///
+    ///   @note printRotatedHWPC() でグループ毎の集約後にランク0が呼び出す。See src_pmlib/PerfRoofline.cpp
+    ///
+    void rooflineCollect(void);
+
+    /// 入れ子区間の測定値を持つかどうか
+    ///
+    bool has_nested(void) const { return (m_time_child > 0.0); }
+
+    /// 入れ子区間として積算するHWPCイベント数. HWPC_CHOOSER=ROTATE では積算しない
+    ///
+    int num_child_events(void) const { return m_rotated ? 0 : my_papi.num_events; }
+
+    /// 入れ子区間を除いたHWPC値が定義されるかどうか
+    ///
+    bool has_self_HWPC(void) const;
+
+    /// 入れ子区間を除いた演算量と比率のプロセス平均値
+    ///
+    ///   @param[out] flop        演算量or通信量. printBasicSections()が積算する値
+    ///   @param[out] percentage  HWPC_CHOOSER=VECTOR, CACHE, LOADSTORE の比率(%)
+    ///   @retval false 入れ子区間を除いた値が定義されない
+    ///
+    ///   @note ランク0で reduce_self_stats() の後に呼び出す。
+    ///
+    bool selfFlop(double& flop, double& percentage);
+
+    /// 直前のstart/stopの組で測定した時間とHWPCイベント数
+    ///
+    ///   @param[out] t     時間(秒)
+    ///   @param[out] hwpc  HWPCイベント数(全スレッドの合計). num_child_events() 要素
+    ///
+    void lastDelta(double& t, long long* hwpc);
+
+    /// 直前のstart/stopの開始時刻と終了時刻. start()の直後は終了時刻は前回の値
+    ///
+    ///   @param[out] t_start  開始時刻(秒)
+    ///   @param[out] t_stop   終了時刻(秒)
+    ///
+    void lastInterval(double& t_start, double& t_stop) const
+    {
+      t_start = m_startTime;
+      t_stop = m_stopTime;
+    }
+
+    /// 入れ子区間の測定値を加算する
+    ///
+    ///   @param[in] t     入れ子区間の時間(秒)
+    ///   @param[in] hwpc  入れ子区間のHWPCイベント数
+    ///
+    void addChildDelta(double t, const long long* hwpc);
+
+    /// 入れ子区間を除いた排他時間とHWPC値を集約用に pack/unpack する
+    ///
+    ///   @param[in,out] p  1 + n_hwpc 要素の領域
+    ///
+    void selfPack(double* p, int n_hwpc);
+    void selfUnpack(const double* p, int n_hwpc);
+
     /// 測定結果情報をランク０プロセスに集約.
     ///
     void gather(void);
@@ -217,6 +396,44 @@ namespace pm_lib {
     ///
     void gatherHWPC(void);
 
+    /// PerfMonitor::gather_and_stats()が全区間を一括して集約する際の送信データ長
+    ///
+    ///   @return m_time, m_flop, m_count, HWPC sorted values の要素数
+    ///
+    int gatherPackSize(void);
+
+    /// 送信データを詰める
+    ///
+    ///   @param[out] p  gatherPackSize() 要素の領域
+    ///
+    void gatherPack(double* p);
+
+    /// ランク0で受信データを取り出す
+    ///
+    ///   @param[in] p_all   全プロセスの受信データ [num_process][stride]
+    ///   @param[in] stride  1プロセスあたりの受信データ長
+    ///   @param[in] offset  本区間の送信データの先頭位置
+    ///
+    void gatherUnpack(const double* p_all, int stride, int offset);
+
+    /// 統計量 m_count_sum, m_*_av, m_*_sd, m_time_comm を詰める/取り出す
+    ///
+    ///   @param[in,out] p  Pm_stats_pack_size 要素の領域
+    ///
+    void statsPack(double* p);
+    void statsUnpack(const double* p);
+
+    /// PerfMonitor::gather_and_reduce()のreduction用レコードを詰める/取り出す
+    ///
+    ///   @param[in,out] p      Pm_reduce_base_size + n_hwpc 要素の領域
+    ///   @param[in]     n_hwpc レコード中のHWPC値の要素数
+    ///
+    ///   @note  レコードは{n, time mean, time M2, time max, time min,
+    ///            flop mean, flop M2, count sum, HWPC sum[n_hwpc]} の順。
+    ///
+    void reducePack(double* p, int n_hwpc);
+    void reduceUnpack(const double* p, int n_hwpc);
+
     /// HWPCにより測定したスレッドレベルのイベントカウンター測定値を収集する
     ///
     void gatherThreadHWPC(void);
@@ -243,6 +460,14 @@ namespace pm_lib {
 	///
 	void power_stop(PWR_Cntxt pacntxt, PWR_Cntxt extcntxt, PWR_Obj obj_array[], PWR_Obj obj_ext[]);
 
+	/// read the accumulated energy of the power objects. The section is not changed.
+	///
+	///   @param[out] w_joule  energy (J) of my_power.num_power_stats parts
+	///
+	///   @note used by the PMLIB_POWER_SAMPLE sampler thread. See src_pmlib/PerfPowerSampler.cpp
+	///
+	void power_sample(PWR_Cntxt pacntxt, PWR_Cntxt extcntxt, PWR_Obj obj_array[], PWR_Obj obj_ext[], double w_joule[]);
+
     /// gather the estimated power consumption of all processes
     ///
     void gatherPOWER(void);
@@ -329,6 +554,36 @@ namespace pm_lib {
     ///
     void printDetailThreads(FILE* fp, int rank_ID);
 
+    /// PMLIB_REPORT_FORMAT のスレッド別の値を詰める. See src_pmlib/PerfReportFormat.cpp
+    ///
+    ///   @param[out] p      [num_threads][3+n_raw] 呼び出し回数、時間、演算量、HWPCイベント数
+    ///   @param[in]  n_raw  HWPCイベント数
+    ///
+    void formatThreadPack(double* p, int n_raw);
+
+    /// PMLIB_REPORT_FORMAT の区間の統計値、ランク別、スレッド別の値を出力する
+    ///
+    ///   @param[in] fp         出力ファイルポインタ
+    ///   @param[in] p_threads  この区間のランク0のスレッド別の値. NULLの場合は出力しない
+    ///   @param[in] n_process  p_threads のプロセス間の間隔
+    ///   @param[in] n_hwpc     CSVのHWPC列の個数
+    ///   @param[in] n_raw      スレッド別のHWPCイベント数
+    ///
+    ///   @note ランク0のみが呼び出す。
+    ///
+    void printFormattedJSON(FILE* fp, const double* p_threads, size_t n_process, int n_raw);
+    void printFormattedCSV(FILE* fp, const double* p_threads, size_t n_process, int n_hwpc, int n_raw);
+
+    /// PMLIB_REPORT=IMBALANCE のプロセス間の時間の最大値と平均値. See src_pmlib/PerfImbalance.cpp
+    ///
+    ///   @param[out] t_max  最も遅いプロセスの時間
+    ///   @param[out] t_avg  全プロセスの平均時間
+    ///   @param[out] r_max  最も遅いプロセスのランク番号
+    ///
+    ///   @note gather() の後でランク0のみが呼び出す。
+    ///
+    void imbalanceProcess(double& t_max, double& t_avg, int& r_max);
+
     /// Show the header line for the averaged HWPC statistics in the Basic report
     ///
     ///   @param[in] fp         report file pointer
@@ -369,15 +624,18 @@ namespace pm_lib {
     ///
     ///   @return 時刻値(秒)
     ///
-    ///   @note 京コンピュータ、FX100、Intel Xeonでは専用の高精度タイマー
-    ///         を呼び出す。
-    ///         一般のUnix/Linuxではgettimeofdayシステムコールを呼び出す。
+    ///   @note 環境変数PMLIB_TIMERで選択したタイマーを呼び出す。
+    ///         省略時はclock_gettime(CLOCK_MONOTONIC)を呼び出す。
+    ///         See pmlib_timer_source
     ///
     double getTime();
 
-    ///   CPU動作周波数を読み出して内部保存する。
+    ///   PMLIB_TIMERを解析し、選択したタイマーの周波数較正と呼び出しコストの測定を行う。
     ///
-    void read_cpu_clock_freq();
+    ///   @note  replaces the former read_cpu_clock_freq(), which used the
+    ///          current "cpu MHz" value of /proc/cpuinfo as the TSC rate.
+    ///
+    void initializeTimer();
 
     ///	copy in HWPC values from master thread to shared "papi" struct
     ///
@@ -397,8 +655,35 @@ namespace pm_lib {
 
 	/// Additional class function to check-in, check-out performance records
 	///
-    void save_pm_records(FILE* fp);
-    void load_pm_records(FILE* fp);
+	///   @param[out] p_sec     section table entry of the record
+	///   @param[out] p_values  counter block of this section [2][nthreads][nevents]
+	///   @param[out] p_threads calls, time, operations of each thread [nthreads][3]
+	///   @param[in]  nthreads  number of threads in the record
+	///   @param[in]  nevents   number of HWPC events in the record
+	///
+    void save_pm_records(pm_record_section* p_sec, long long* p_values, double* p_threads, int nthreads, int nevents);
+
+	///   @param[in] p_sec     section table entry of the record
+	///   @param[in] p_values  counter block of this section [2][nthreads][nevents]
+	///   @param[in] nthreads  number of threads in the record
+	///   @param[in] nevents   number of HWPC events in the record
+	///
+	///   @return true if the record has been restored, false if rejected
+	///
+    bool load_pm_records(const pm_record_section* p_sec, const long long* p_values, int nthreads, int nevents);
+
+    /// PMLIB_SERIES スナップショットの区間の積算値
+    ///
+    ///   @param[out] e     区間の積算値
+    ///   @param[out] hwpc  HWPCイベント数(全スレッドの合計). my_papi.num_events 要素
+    ///
+    ///   @note 積算値はリセットしない。サンプリング中の区間は読み取った回数分の値を返す。
+    ///
+    void seriesPack(pm_series_entry* e, int64_t* hwpc);
+
+	/// check if the section is in the middle of start/stop pair
+	///
+    bool is_started(void) const { return m_started; }
 
   private:
     /// エラーメッセージ出力.
@@ -418,6 +703,14 @@ namespace pm_lib {
 	/// HWPC related internal functions
 	void identifyARMplatform (void);
 	void createPapiCounterList (void);
+	void initializeRoofline (void);
+	void attachHWPC (void);
+	void allocateThreadArrays (struct pmlib_papi_chooser& p, int nthreads);
+	bool allocateSampledArray (void);
+	void extrapolateSampledHWPC (void);
+	void rotateAccount (double t_end);
+	bool is_scaled (void) const { return (m_sample_interval > 1) || m_rotated; }
+	void sortSelfHWPC (void);
 	void sortPapiCounterList (void);
 	void outputPapiCounterHeader (FILE* fp, std::string s_label);
 	void outputPapiCounterList (FILE* fp);
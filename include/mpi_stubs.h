@@ -40,9 +40,17 @@ namespace pm_lib {
   typedef int MPI_Datatype;
   typedef int MPI_Op;
   typedef int MPI_Group;
+  typedef int MPI_Request;
+  typedef int MPI_Status;
 
 #define MPI_SUCCESS true
+#define MPI_MAX (MPI_Op)(0x58000001)
+#define MPI_MIN (MPI_Op)(0x58000002)
 #define MPI_SUM (MPI_Op)(0x58000003)
+#define MPI_REQUEST_NULL 0
+#define MPI_STATUSES_IGNORE (MPI_Status*)0
+#define MPI_THREAD_SINGLE 0
+#define MPI_THREAD_MULTIPLE 3
 
 
   inline bool MPI_Init(int* argc, char*** argv) { return true; }
@@ -79,12 +87,44 @@ namespace pm_lib {
     return 0;
   }
 
+  inline int MPI_Bcast(void *buffer, int count, MPI_Datatype datatype,
+                        int root, MPI_Comm comm)
+  {
+    return 0;
+  }
+
   inline int MPI_Reduce(void *sendbuf, void *recvbuf, int count,
                   MPI_Datatype datatype, MPI_Op op, int root, MPI_Comm comm)
   {
     return 0;
   }
 
+  inline int MPI_Igather(void *sendbuf, int sendcnt, MPI_Datatype sendtype,
+                        void *recvbuf, int recvcnt, MPI_Datatype recvtype,
+                        int root, MPI_Comm comm, MPI_Request *request)
+  {
+    *request = MPI_REQUEST_NULL;
+    return 0;
+  }
+
+  inline int MPI_Ireduce(void *sendbuf, void *recvbuf, int count,
+                  MPI_Datatype datatype, MPI_Op op, int root, MPI_Comm comm, MPI_Request *request)
+  {
+    *request = MPI_REQUEST_NULL;
+    return 0;
+  }
+
+  inline int MPI_Waitall(int count, MPI_Request *requests, MPI_Status *statuses)
+  {
+    return 0;
+  }
+
+  inline int MPI_Query_thread(int *provided)
+  {
+    *provided = MPI_THREAD_MULTIPLE;
+    return 0;
+  }
+
   inline int MPI_Allreduce(void *sendbuf, void *recvbuf, int count,
                   MPI_Datatype datatype, MPI_Op op, MPI_Comm comm)
   {
@@ -5,8 +5,14 @@ extern void C_pm_initialize (int init_nWatch);
 extern void C_pm_start (char* fc);
 extern void C_pm_stop (char* fc);
 extern void C_pm_stop_usermode (char* fc, double fpt, unsigned tic);
+extern int C_pm_sectionid (char* fc);
+extern void C_pm_start_id (int id);
+extern void C_pm_stop_id (int id);
+extern void C_pm_stop_usermode_id (int id, double fpt, unsigned tic);
 extern void C_pm_report (char* fc);
 extern void C_pm_select_report (char* fc);
+extern void C_pm_report_async (char* fc);
+extern void C_pm_report_wait (void);
 extern void C_pm_print (char* fc, char* fh, char* fcmt, int fp_sort);
 extern void C_pm_printdetail (char* fc, int legend, int fp_sort);
 extern void C_pm_printthreads (char* fc, int rank_ID, int fp_sort);
@@ -15,7 +21,7 @@ extern void C_pm_printprogress (char* fc, char* comments, int fp_sort);
 extern void C_pm_posttrace (void);
 extern void C_pm_reset (char* fc);
 extern void C_pm_resetall (void);
-extern void C_pm_setproperties (char* fc, int f_type, int f_exclusive);
+extern int C_pm_setproperties (char* fc, int f_type, int f_exclusive);
 extern void C_pm_gather (void);
 extern void C_pm_sections (int *nSections);
 extern void C_pm_serial_parallel (int id, int *mid, int *inside);
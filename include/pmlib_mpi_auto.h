@@ -0,0 +1,81 @@
+#ifndef _PM_MPI_AUTO_H_
+#define _PM_MPI_AUTO_H_
+
+/*
+###################################################################################
+#
+# PMlib - Performance Monitor Library
+#
+# Copyright (c) 2010-2011 VCAD System Research Program, RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2012-2020 Advanced Institute for Computational Science(AICS), RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2016-2020 Research Institute for Information Technology(RIIT), Kyushu University.
+# All rights reserved.
+#
+###################################################################################
+ */
+
+/// PMmpi_auto PMPI ラッパーと PerfMonitor の間のインタフェイス
+///
+/// @file pmlib_mpi_auto.h
+/// @brief Header block for the automatic MPI communication sections
+///
+/// @note libPMmpi_auto.a の MPI_XXX() は PMPI_XXX() を呼び、時間と通信量を
+///	PerfMonitor::mpi_auto_add() で実行中の利用者区間と呼び出し種別毎に積算する。
+///	積算値はレポートの集約時に "MPI_XXX" という名前の COMM 区間に変換される。
+///
+
+#include <pthread.h>
+
+namespace pm_lib {
+
+  class PerfMonitor;
+
+  /// 計測するMPI関数の種別
+  enum pm_mpi_auto_call {
+	Pm_mpi_send = 0,
+	Pm_mpi_recv,
+	Pm_mpi_isend,
+	Pm_mpi_irecv,
+	Pm_mpi_sendrecv,
+	Pm_mpi_wait,
+	Pm_mpi_waitall,
+	Pm_mpi_waitany,
+	Pm_mpi_barrier,
+	Pm_mpi_bcast,
+	Pm_mpi_reduce,
+	Pm_mpi_allreduce,
+	Pm_mpi_gather,
+	Pm_mpi_allgather,
+	Pm_mpi_alltoall,
+	Pm_mpi_alltoallv,
+	Max_mpi_auto_calls
+  };
+
+  /// 種別毎の区間名
+  extern const char* pm_mpi_auto_label[Max_mpi_auto_calls];
+
+  /// MPI呼び出しを積算するPerfMonitor. PerfMonitor::initialize() が設定する
+  extern PerfMonitor* pm_mpi_auto_monitor;
+
+  /// pm_mpi_auto_monitor を初期化したスレッド. 他スレッドのMPI呼び出しは積算しない
+  extern pthread_t pm_mpi_auto_owner;
+
+  /// libPMmpi_auto.a がリンクされているか. ラッパーの静的初期化で true になる
+  extern bool pm_mpi_auto_linked;
+
+  /// 呼び出したスレッドが積算の対象であれば pm_mpi_auto_monitor を返す
+  ///
+  inline PerfMonitor* pm_mpi_auto_current(void)
+  {
+	PerfMonitor* pm = pm_mpi_auto_monitor;
+	if ((pm == NULL) || !pthread_equal(pthread_self(), pm_mpi_auto_owner)) return NULL;
+	return pm;
+  }
+
+} /* namespace pm_lib */
+
+#endif // _PM_MPI_AUTO_H_
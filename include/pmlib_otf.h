@@ -33,6 +33,22 @@ extern "C" void my_otf_event_label (int, int, int, const char*, int, int);
 extern "C" void my_otf_finalize    (int, int, int, const char*, const char*, const char*, const char*);
 #endif
 
+#ifdef USE_OTF2
+namespace pm_lib {
+  /// OTF2 トレースのイベントの種類
+  enum pm_trace_event_type {
+	Pm_trace_enter = 0,			///< 区間の開始
+	Pm_trace_leave,				///< 区間の終了
+	Pm_trace_leave_metric		///< 区間の終了とカウンター値
+  };
+
+  void pm_trace_initialize (int, int, int, const char*, double);
+  void pm_trace_event      (int, double, int, double);
+  void pm_trace_label      (int, const char*);
+  void pm_trace_finalize   (const char*, const char*);
+}
+#endif
+
 //	struct otf_group_chooser {
 //		int number[Max_otf_output_group];
 //		int index[Max_otf_output_group];
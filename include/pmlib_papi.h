@@ -38,6 +38,9 @@ extern "C" int my_papi_add_events ( int *, int);
 
 extern "C" void my_papi_name_to_code ( const char *, int *);
 extern "C" void my_papi_internal_free ( void );
+extern "C" int my_papi_fast_read ( void );
+extern "C" int my_papi_switch_events ( int *, int );
+extern "C" int my_papi_attach_inherit ( int );
 #endif
 
 /// HWPC counter情報の記憶配列
@@ -70,13 +73,48 @@ struct hwpc_group_chooser {
 		// 99:processor is not supported
 	std::string platform;	// "Xeon", "SPARC64", "ARM", "unsupported_hardware"
 	std::string env_str_hwpc;
-		// USER or one of FLOPS, BANDWIDTH, VECTOR, CACHE, CYCLE, LOADSTORE
+		// USER or one of FLOPS, BANDWIDTH, VECTOR, CACHE, CYCLE, LOADSTORE, ROTATE, ROOFLINE
 	double coreGHz;
 	double corePERF;
+	double coreBW;		// nominal memory bandwidth per core [B/s]. the socket bandwidth / cores. 0 if unknown
+
+	// HWPC_CHOOSER=ROOFLINE rotates FLOPS and BANDWIDTH groups, and places the sections
+	// against the ceilings of the process. PMLIB_ROOFLINE_PEAK=<GFlops>,<GB/s> overrides them.
+	double roof_PERF;	// peak performance of the process [Flops]. corePERF * threads
+	double roof_BW;		// peak memory bandwidth of the process [B/s]. coreBW * threads
+	int sample_interval;	// PMLIB_SAMPLE. HWPC is read once per sample_interval calls
+	bool serial_master_only;	// PMLIB_SERIAL_HWPC=MASTER. serial sections read the master thread HWPC only
+	int attach_pid;		// PMLIB_HWPC_PID. the master thread counts the process tree of this pid. 0: self
+
+	// HWPC_CHOOSER=ROTATE counts the groups in turn. The event lists of all the groups are
+	// concatenated in papi.events[], and number[], index[] above show the group being reported.
+	int n_rotate;		// number of the rotated groups. 0 unless HWPC_CHOOSER=ROTATE
+	int i_rotate;		// the rotated group being counted now
+	int i_report;		// the rotated group being reported now
+	int rotate_group[Max_hwpc_output_group];	// hwpc_output_group of the rotated groups
+	int rotate_index[Max_hwpc_output_group];	// the first event of the group in papi.events[]
+	int rotate_number[Max_hwpc_output_group];	// number of events of the group
+	std::string rotate_name[Max_hwpc_output_group];	// FLOPS, BANDWIDTH, ...
+	int rotate_calls;		// PMLIB_ROTATE=<N>  : rotate after N stop() calls in serial region
+	double rotate_slice;	// PMLIB_ROTATE=<T>s : rotate after T seconds
+	long rotate_count;		// stop() calls since the last rotation
+	double rotate_time;		// time of the last rotation
+	int read_index;			// the first event read by start/stop. 0 unless rotating
+	int read_number;		// number of events read by start/stop
 };
 
-const int Max_chooser_events=12;
-const int Max_nthreads=48;
+const int Max_group_events=16;		// >= the events and the sorted outputs of one group. See HL_MAX_EVENTS
+const int Max_chooser_events=48;	// >= the sum of the events of all groups, for HWPC_CHOOSER=ROTATE
+
+// Thread x event array whose row length is decided at run time.
+// a[j][i] addresses the event i of the thread j, as the former fixed size array did.
+// The storage is allocated by PerfWatch::allocateThreadArrays()
+template <typename T> struct pmlib_thread_array {
+	T* data;
+	int stride;				// row length. padded to the cache line size
+	pmlib_thread_array() : data(0), stride(0) {}
+	T* operator[] (int j) const { return data + (size_t)j*stride; }
+};
 
 struct pmlib_papi_chooser {
 	int num_events;				// number of PAPI events
@@ -96,11 +134,17 @@ struct pmlib_papi_chooser {
 	//	th_v_sorted[my_thread][2] = m_flop;
 	// After sortPapiCounterList() is called, they will keep HWPC and sorted values
 
-	long long th_values[Max_nthreads][Max_chooser_events];	// values per thread
-	long long th_accumu[Max_nthreads][Max_chooser_events];	// accumu per thread
-	double th_v_sorted[Max_nthreads][Max_chooser_events];	// sorted values per thread
-	// Note 1. Exchanged dimension [Max_chooser_events] <-> [Max_nthreads]
+	// The arrays are sized [th_nthreads][max(num_events,3)] when the section is created.
+	int th_nthreads;		// number of the allocated thread rows
+	pmlib_thread_array<long long> th_values;	// values per thread
+	pmlib_thread_array<long long> th_accumu;	// accumu per thread
+	pmlib_thread_array<double> th_v_sorted;		// sorted values per thread
+	pmlib_thread_array<long long> th_sampled;	// accumu of the sampled calls per thread
+			// allocated by PerfWatch::setSampleInterval() only if the section is sampled
+	// Note 1. Exchanged dimension [Max_chooser_events] <-> [nthreads]
 	// Note 2. Shall we change the name from th_v_sorted[][] to th_user[][] ? To be checked.
+
+	pmlib_papi_chooser() : num_events(0), num_sorted(0), th_nthreads(0) {}
 };
 
 #endif // _PM_PAPI_H_
@@ -0,0 +1,42 @@
+#ifndef _PM_PMPI_H_
+#define _PM_PMPI_H_
+
+/*
+###################################################################################
+#
+# PMlib - Performance Monitor Library
+#
+# Copyright (c) 2010-2011 VCAD System Research Program, RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2012-2020 Advanced Institute for Computational Science(AICS), RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2016-2020 Research Institute for Information Technology(RIIT), Kyushu University.
+# All rights reserved.
+#
+###################################################################################
+ */
+
+/// PMlib 内部の通信を PMPI で行う
+///
+/// @file pmlib_pmpi.h
+/// @brief PMlib internal MPI calls bypass the PMmpi_auto wrappers
+///
+/// @note src_pmlib/ のソースが mpi.h の後でインクルードする。インストールしない。
+///	libPMmpi_auto.a がラップしている関数のうち PMlib が使うものを列挙する。
+///	PMlib のレポート集約などの通信が利用者区間の通信として積算されないようにする。
+///
+
+#ifndef DISABLE_MPI
+#define MPI_Barrier   PMPI_Barrier
+#define MPI_Bcast     PMPI_Bcast
+#define MPI_Reduce    PMPI_Reduce
+#define MPI_Allreduce PMPI_Allreduce
+#define MPI_Gather    PMPI_Gather
+#define MPI_Allgather PMPI_Allgather
+#define MPI_Wait      PMPI_Wait
+#define MPI_Waitall   PMPI_Waitall
+#endif
+
+#endif // _PM_PMPI_H_
@@ -0,0 +1,93 @@
+#ifndef _PM_RECORD_H_
+#define _PM_RECORD_H_
+
+///
+/// @file pmlib_record.h
+///
+/// @brief record layout of the ShellPM check-in/check-out file
+///
+///	start_pm/stop_pm save the state of the measuring sections into the record file,
+///	and the next start_pm/stop_pm/report_pm maps the file and restores the state,
+///	so that the sections accumulate over many invocations in one job shell.
+///	With PMLIB_DUMP=<prefix>, report() of each process writes the same record to
+///	<prefix>_<rank>.pmrec instead of the collective report, and pm_merge command
+///	produces the report from the files after the job.
+///	The record is a fixed layout binary file composed of 4 parts.
+///
+///	@verbatim
+///  +-----------------------------+
+///  | pm_record_header            |  magic, version, sizes, HWPC_CHOOSER, rank, event names
+///  +-----------------------------+
+///  | pm_record_section [0]       |  section table : num_sections entries
+///  | ...                         |
+///  | pm_record_section [n-1]     |
+///  +-----------------------------+
+///  | long long [n][2][nthr][ne]  |  packed th_values[][], th_accumu[][] counter block
+///  +-----------------------------+
+///  | double [n][nthr][3]         |  calls, time, operations of each thread
+///  +-----------------------------+
+///	@endverbatim
+///
+/// @note the record is read back by the same build of ShellPM or pm_merge
+///		on the same kind of system.
+///		So the native byte order and native struct alignment are used.
+///
+
+#include <stdint.h>
+#include "pmlib_papi.h"
+
+namespace pm_lib {
+
+const char Pm_record_magic[8] = { 'S','H','E','L','L','P','M','\0' };
+const int Pm_record_version = 7;
+const int Pm_record_label_size = 128;	// including the terminating NUL
+const int Pm_record_chooser_size = 32;	// including the terminating NUL
+const int Pm_record_event_size = 32;	// HWPC event name including the terminating NUL
+const int Pm_record_thread_size = 3;	// calls, time, operations of each thread
+
+struct pm_record_header {
+	char magic[8];			// Pm_record_magic
+	int32_t version;		// Pm_record_version
+	int32_t header_size;	// sizeof(pm_record_header)
+	int32_t section_size;	// sizeof(pm_record_section)
+	int32_t num_sections;	// number of entries in the section table
+	int32_t num_threads;	// number of threads in the counter block
+	int32_t num_events;		// number of HWPC events in the counter block
+	char hwpc_chooser[Pm_record_chooser_size];	// HWPC_CHOOSER value at start_pm
+	int32_t nest_depth;		// PerfMonitor::m_nest_depth, number of the open nested sections
+	int32_t timer_source;	// pmlib_timer_source of the saved start_time values
+	int64_t total_size;		// total size of the record file in Byte
+	int32_t rank;			// MPI rank of the process
+	int32_t num_process;	// number of processes
+	char event_name[Max_chooser_events][Pm_record_event_size];	// HWPC event names
+};
+
+struct pm_record_section {
+	char label[Pm_record_label_size];	// section label
+	int32_t id;				// section ID when saved
+	int32_t started;		// 1 if the section was active when saved
+	int32_t exclusive;		// m_exclusive of the section
+	int32_t type_calc;		// m_typeCalc of the section
+	int32_t in_parallel;	// m_in_parallel of the section
+	int32_t child_in_parallel;	// m_child_in_parallel of the section
+	double start_time;		// m_startTime of the section
+	int64_t count;			// accumulated m_count
+	double time;			// accumulated m_time
+	double flop;			// accumulated m_flop
+	int64_t count_sampled;	// m_count_sampled, the calls whose HWPC were read
+	double time_child;		// accumulated m_time_child
+	int64_t hwpc_child[Max_group_events];	// accumulated m_hwpc_child
+	int32_t nest_level;		// position in the section stack, or (-1) if not on the stack
+	int32_t nest_has_child;	// the open frame has closed child sections
+	double time_child_open;	// child time accumulated in the open frame
+	int64_t hwpc_child_open[Max_group_events];	// child HWPC accumulated in the open frame
+	double rot_mark;		// m_rot_mark, HWPC_CHOOSER=ROTATE
+	double rot_time[Max_hwpc_output_group];		// m_rot_time[], time counted with each group
+	int64_t rot_calls[Max_hwpc_output_group];	// m_rot_calls[]
+	double rot_mean[Max_hwpc_output_group];		// m_rot_mean[]
+	double rot_m2[Max_hwpc_output_group];		// m_rot_m2[]
+};
+
+} /* namespace pm_lib */
+
+#endif // _PM_RECORD_H_
@@ -0,0 +1,48 @@
+#ifndef _PM_REGISTRY_H_
+#define _PM_REGISTRY_H_
+
+///
+/// @file pmlib_registry.h
+///
+/// @brief process wide registry of the shared section labels
+///
+///	All the threadprivate PerfMonitor instances register their section labels
+///	in this registry. The registry is append-only: each label is interned once
+///	and receives a shared section ID in the order of the first registration.
+///	Insertion and lookup are lock-free (compare-and-swap on the hash slots),
+///	so that the threads creating sections inside of a parallel region do not
+///	serialize on a critical section.
+///
+/// @note internal header of PMlib. not installed.
+///
+
+#include <string>
+
+namespace pm_lib {
+
+	/// register the label and return its shared section ID
+	///
+	///   @param[in] label   the section label
+	///   @return the shared section ID. the same ID is returned for the same label.
+	///
+	int shared_section_insert (const std::string& label);
+
+	/// search the label
+	///
+	///   @return the shared section ID, or (-1) if the label is not registered
+	///
+	int shared_section_find (const std::string& label);
+
+	/// number of the registered shared sections
+	///
+	int shared_section_count (void);
+
+	/// the label of the shared section ID
+	///
+	///   @return pointer to the interned label, or NULL if id is out of range
+	///
+	const std::string* shared_section_label (int id);
+
+} /* namespace pm_lib */
+
+#endif // _PM_REGISTRY_H_
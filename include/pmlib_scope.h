@@ -0,0 +1,167 @@
+#ifndef _PM_SCOPE_H_
+#define _PM_SCOPE_H_
+
+/*
+###################################################################################
+#
+# PMlib - Performance Monitor Library
+#
+# Copyright (c) 2010-2011 VCAD System Research Program, RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2012-2020 Advanced Institute for Computational Science(AICS), RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2016-2020 Research Institute for Information Technology(RIIT), Kyushu University.
+# All rights reserved.
+#
+###################################################################################
+ */
+
+/// PM_SCOPE ブロック単位で測定区間を開始・終了する C++ インタフェイス
+///
+/// @file pmlib_scope.h
+/// @brief Header only RAII guard of the PMlib sections
+///
+/// @note PM_SCOPE("label") はブロックの中で区間を開始し、ブロックを抜ける時に
+///	区間を終了する。早期の return や例外でも stop() が呼ばれる。
+///	ラベルは最初の実行時に一度だけ setProperties() で登録し、区間番号を静的な
+///	ハンドルに保持する。以降の呼び出しは start(int)/stop(int) のみで、
+///	std::string の生成とラベルの検索を行わない。
+///	PerfMonitor::initialize() の後で使用すること。
+///
+///	@verbatim
+///	PM_SCOPE("label")                          : PerfMonitor PM の区間
+///	PM_SCOPE_AT(monitor, "label")              : 指定した PerfMonitor の区間
+///	PM_SCOPE_POLICY(monitor, "label", policy)  : 区間の属性を policy で与える
+///	@endverbatim
+///
+///	PMLIB_SCOPE_DISABLE を定義してコンパイルすると PM_SCOPE は何も生成しない。
+///	policy の Enabled が false の区間もコンパイル時に取り除かれる。
+///	PMLIB_SCOPE_MONITOR は PM_SCOPE が使う PerfMonitor の名前で、既定値はC/Fortran
+///	インタフェイスと同じ PM である。
+///
+///	OpenMP のスレッド毎の PerfMonitor (threadprivate) では区間番号がスレッド毎に
+///	異なるので、ハンドルはスレッド毎に持つ。
+///
+
+#include "PerfMonitor.h"
+
+#ifndef PMLIB_SCOPE_MONITOR
+#define PMLIB_SCOPE_MONITOR PM
+#endif
+
+#ifdef _OPENMP
+#define PMLIB_SCOPE_TLS thread_local
+#else
+#define PMLIB_SCOPE_TLS
+#endif
+
+namespace pm_lib {
+
+  /// PM_SCOPE の区間の属性
+  ///
+  ///   @tparam T          測定計算量のタイプ (PerfMonitor::CALC, PerfMonitor::COMM)
+  ///   @tparam Exclusive  排他測定区間か
+  ///   @tparam Sample     HWPCを読み取る呼び出し間隔. 0はPMLIB_SAMPLEの既定値
+  ///   @tparam Enabled    false の区間はコンパイル時に取り除かれる
+  ///
+  template <PerfMonitor::Type T = PerfMonitor::CALC, bool Exclusive = true, int Sample = 0, bool Enabled = true>
+  struct PerfScopePolicy
+  {
+	static const PerfMonitor::Type type = T;
+	static const bool exclusive = Exclusive;
+	static const int sample = Sample;
+	static const bool enabled = Enabled;
+  };
+
+  typedef PerfScopePolicy<> pm_scope_calc;			///< 演算の区間. PM_SCOPE の既定値
+  typedef PerfScopePolicy<PerfMonitor::COMM> pm_scope_comm;	///< データ移動の区間
+  typedef PerfScopePolicy<PerfMonitor::CALC, true, 100> pm_scope_hot;	///< 頻繁に呼ぶ区間. HWPCは100回に1回読み取る
+  typedef PerfScopePolicy<PerfMonitor::CALC, true, 0, false> pm_scope_off;	///< 取り除く区間
+
+
+  /// PM_SCOPE の区間番号を保持する静的なハンドル
+  ///
+  /// @note 静的なゼロ初期化のみで動的な初期化を伴わないように、集成体とする。
+  ///
+  struct PerfScopeHandle
+  {
+	PerfMonitor* pm;	///< 区間を登録した PerfMonitor. 未登録の場合は NULL
+	int id;			///< 区間番号. 登録に失敗した場合は(-1)
+  };
+
+
+  /// 測定区間の RAII ガード. 生成時に start(int)、破棄時に stop(int) を呼ぶ
+  ///
+  template <class Policy = pm_scope_calc, bool Enabled = Policy::enabled>
+  class PerfScope
+  {
+  public:
+	/// 区間を開始する. 最初の呼び出しでラベルを登録する
+	///
+	///   @param[in] pm     PerfMonitor
+	///   @param[in] h      この区間の静的なハンドル
+	///   @param[in] label  ラベル文字列
+	///
+	PerfScope(PerfMonitor& pm, PerfScopeHandle& h, const char* label) : m_pm(pm), m_id(h.id)
+	{
+		if (h.pm != &pm) m_id = registerLabel(pm, h, label);
+		if (m_id > 0) m_pm.start(m_id);
+	}
+
+	/// 区間を終了する
+	///
+	~PerfScope()
+	{
+		if (m_id > 0) m_pm.stop(m_id);
+	}
+
+  private:
+	PerfMonitor& m_pm;
+	int m_id;
+
+	PerfScope(const PerfScope&);
+	PerfScope& operator=(const PerfScope&);
+
+	/// ラベルを Policy の属性で登録し、区間番号をハンドルに保持する
+	///
+	static int registerLabel(PerfMonitor& pm, PerfScopeHandle& h, const char* label)
+	{
+		int id = pm.setProperties(label, Policy::type, Policy::exclusive);
+		if ((id > 0) && (Policy::sample > 0)) pm.setSampleInterval(label, Policy::sample);
+		h.pm = &pm;
+		h.id = id;
+		return id;
+	}
+  };
+
+
+  /// Enabled が false の区間. 何も行わない
+  ///
+  template <class Policy>
+  class PerfScope<Policy, false>
+  {
+  public:
+	PerfScope(PerfMonitor&, PerfScopeHandle&, const char*) {}
+  };
+
+} /* namespace pm_lib */
+
+
+#define PMLIB_SCOPE_CAT2(a, b) a##b
+#define PMLIB_SCOPE_CAT(a, b) PMLIB_SCOPE_CAT2(a, b)
+#define PMLIB_SCOPE_NAME(x) PMLIB_SCOPE_CAT(x, __LINE__)
+
+#ifdef PMLIB_SCOPE_DISABLE
+#define PM_SCOPE_POLICY(monitor, label, policy) ((void)0)
+#else
+#define PM_SCOPE_POLICY(monitor, label, policy) \
+	static PMLIB_SCOPE_TLS pm_lib::PerfScopeHandle PMLIB_SCOPE_NAME(pm_scope_handle_); \
+	pm_lib::PerfScope< policy > PMLIB_SCOPE_NAME(pm_scope_guard_)((monitor), PMLIB_SCOPE_NAME(pm_scope_handle_), (label))
+#endif
+
+#define PM_SCOPE_AT(monitor, label) PM_SCOPE_POLICY(monitor, label, pm_lib::pm_scope_calc)
+#define PM_SCOPE(label) PM_SCOPE_AT(PMLIB_SCOPE_MONITOR, label)
+
+#endif // _PM_SCOPE_H_
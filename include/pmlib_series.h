@@ -0,0 +1,82 @@
+#ifndef _PM_SERIES_H_
+#define _PM_SERIES_H_
+
+///
+/// @file pmlib_series.h
+///
+/// @brief record layout of the PMLIB_SERIES time series file
+///
+///	When PMLIB_SERIES is set, each process takes periodic snapshots of the
+///	accumulated values of its sections, and appends them to its own file
+///	<PMLIB_SERIES_FILE>_<rank>.pmts. The accumulators are never reset, so that
+///	the rate of any interval is the difference of two snapshots divided by
+///	the interval. pm_series command prints the interval rates.
+///
+///	@verbatim
+///  +-----------------------------+
+///  | pm_series_header            |  magic, version, rank, mode, event count
+///  | char [num_events][32]       |  HWPC event names
+///  +-----------------------------+
+///  | pm_series_tag + label       |  Pm_series_label : a section is added
+///  | pm_series_tag + snapshot    |  Pm_series_snapshot : the time and
+///  | ...                         |    n_sections x (pm_series_entry, int64_t [num_events])
+///  +-----------------------------+
+///	@endverbatim
+///
+/// @note the file is read back by pm_series on the same kind of system.
+///		So the native byte order and native struct alignment are used.
+///
+
+#include <stdint.h>
+
+namespace pm_lib {
+
+const char Pm_series_magic[8] = { 'P','M','S','E','R','I','E','\0' };
+const int Pm_series_version = 1;
+const int Pm_series_name_size = 32;		// HWPC event name including the terminating NUL
+const int Pm_series_buffer_size = 1 << 20;	// bytes buffered before written to the file
+
+enum pm_series_mode {
+	Series_time = 0,	// snapshot every PMLIB_SERIES=<T>s seconds by the sampler thread
+	Series_calls,		// snapshot every PMLIB_SERIES=<N> calls of PMLIB_SERIES_SECTION
+};
+
+enum pm_series_type {
+	Pm_series_label = 1,	// int32_t id, followed by the label characters without NUL
+	Pm_series_snapshot,		// pm_series_snapshot_head, followed by the section entries
+};
+
+struct pm_series_header {
+	char magic[8];			// Pm_series_magic
+	int32_t version;		// Pm_series_version
+	int32_t rank;			// MPI rank of the process
+	int32_t num_process;	// number of processes
+	int32_t num_threads;	// number of threads
+	int32_t num_events;		// number of HWPC events in each entry
+	int32_t mode;			// pm_series_mode
+	double interval;		// seconds for Series_time, calls for Series_calls
+	double time_origin;		// getTime() value when the series started in PerfMonitor::initialize()
+	char hwpc_chooser[32];	// HWPC_CHOOSER value
+};
+
+struct pm_series_tag {
+	int32_t type;			// pm_series_type
+	int32_t size;			// size of the data following the tag in Byte
+};
+
+struct pm_series_snapshot_head {
+	double time;			// snapshot time measured from time_origin
+	int32_t n_sections;		// number of the entries following
+	int32_t reserved;
+};
+
+struct pm_series_entry {
+	int64_t count;			// accumulated m_count
+	int64_t count_sampled;	// m_count_sampled, the calls whose HWPC were read
+	double time;			// accumulated m_time
+	double flop;			// accumulated m_flop
+};
+
+} /* namespace pm_lib */
+
+#endif // _PM_SERIES_H_
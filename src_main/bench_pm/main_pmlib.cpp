@@ -0,0 +1,291 @@
+#include <PerfMonitor.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+using namespace pm_lib;
+
+//	pm_bench
+//	measure the cost of the PMlib hot paths and write the result as JSON.
+//
+//	usage: pm_bench [-p pairs] [-o file]
+//		-p pairs : number of start/stop pairs per measurement. default 100000
+//		-o file  : write the JSON to <file>. default stdout
+//
+//	The PMlib configuration is read from the environment as usual, so that
+//	HWPC_CHOOSER=USER and HWPC_CHOOSER=FLOPS etc. are compared by two runs, and
+//	the rank count scaling of gather()/report() by runs with different -np.
+//	Each JSON has the configuration of the run. The PMlib report itself is
+//	discarded.
+//
+//	PM is threadprivate as in the C/Fortran interface, so that each thread of
+//	the parallel measurement starts and stops the sections of its own instance.
+//	The parallel measurement is skipped if the compiler does not support the
+//	threadprivate class variables.
+
+#ifndef _OPENMP
+PerfMonitor PM;
+
+#else
+// compilers support OpenMP through different implementations
+
+#if defined (__INTEL_COMPILER)	|| \
+	defined (__CLANG_FUJITSU)	|| \
+	defined (__PGI)
+
+	PerfMonitor PM;
+	#pragma omp threadprivate(PM)
+	#define PM_BENCH_PARALLEL
+
+#elif defined (__FUJITSU)
+	//  Fujitsu traditional C++ without threadprivate class support
+	PerfMonitor PM;
+
+#elif defined (__GXX_ABI_VERSION)
+	// GNU g++ is not fully compliant with OpenMP threadprivate class support
+	// this is a work around. https://gcc.gnu.org/bugzilla/show_bug.cgi?id=27557
+	extern PerfMonitor PM;
+	#pragma omp threadprivate(PM)
+	PerfMonitor PM;
+	#define PM_BENCH_PARALLEL
+
+#else
+	PerfMonitor PM;
+	#pragma omp threadprivate(PM)
+	#define PM_BENCH_PARALLEL
+#endif
+#endif
+
+static bool is_pm_initialized = false;	///< PM of this thread is initialized
+#ifdef PM_BENCH_PARALLEL
+#pragma omp threadprivate(is_pm_initialized)
+#endif
+
+static int my_rank = 0;
+static int num_process = 1;
+
+static double wtime(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1.0e-9;
+}
+
+static double max_over_ranks(double t)
+{
+	double t_max = t;
+	MPI_Reduce(&t, &t_max, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+	return t_max;
+}
+
+static const char* env_or(const char* name, const char* s_default)
+{
+	const char* cp_env = getenv(name);
+	return (cp_env == NULL) ? s_default : cp_env;
+}
+
+int main (int argc, char *argv[])
+{
+	long n_pairs = 100000;
+	const char* s_output = NULL;
+	for (int i=1; i<argc; i++) {
+		if ((strcmp(argv[i], "-p") == 0) && (i+1 < argc)) {
+			n_pairs = atol(argv[++i]);
+		} else if ((strcmp(argv[i], "-o") == 0) && (i+1 < argc)) {
+			s_output = argv[++i];
+		} else {
+			fprintf(stderr, "usage: pm_bench [-p pairs] [-o file]\n");
+			return 1;
+		}
+	}
+	if (n_pairs < 1) n_pairs = 1;
+
+#ifndef DISABLE_MPI
+	MPI_Init(&argc, &argv);
+#endif
+	MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+	MPI_Comm_size(MPI_COMM_WORLD, &num_process);
+
+	int max_threads = 1;
+#ifdef _OPENMP
+	max_threads = omp_get_max_threads();
+#endif
+
+	PM.initialize();
+	is_pm_initialized = true;
+
+	const int n_sizes = 4;
+	const int n_sections[n_sizes] = { 10, 100, 1000, 10000 };
+	double t_create[n_sizes];
+	double t_label[n_sizes];
+	double t_id[n_sizes];
+	long n_done[n_sizes];
+
+//	setProperties() growth and start/stop throughput by the section count
+	int n_total = 0;
+	for (int k=0; k<n_sizes; k++) {
+		int n = n_sections[k];
+		std::vector<std::string> label(n);
+		std::vector<int> id(n);
+		char name[64];
+		for (int i=0; i<n; i++) {
+			snprintf(name, sizeof(name), "section_%d_%d", n, i);
+			label[i] = name;
+		}
+		double t0 = wtime();
+		for (int i=0; i<n; i++) {
+			id[i] = PM.setProperties(label[i]);
+		}
+		t_create[k] = (wtime() - t0) / (double)n;
+		n_total += n;
+
+		long n_reps = std::max(1L, n_pairs / n);
+		n_done[k] = n_reps * n;
+		t0 = wtime();
+		for (long r=0; r<n_reps; r++) {
+		for (int i=0; i<n; i++) {
+			PM.start(label[i]);
+			PM.stop(label[i]);
+		}
+		}
+		t_label[k] = (wtime() - t0) / (double)n_done[k];
+
+		t0 = wtime();
+		for (long r=0; r<n_reps; r++) {
+		for (int i=0; i<n; i++) {
+			PM.start(id[i]);
+			PM.stop(id[i]);
+		}
+		}
+		t_id[k] = (wtime() - t0) / (double)n_done[k];
+	}
+
+//	serial region and parallel region with 1, 2, 4, ... max_threads threads
+	std::vector<int> n_threads;
+	for (int t=1; t<max_threads && t<128; t*=2) n_threads.push_back(t);
+	n_threads.push_back(std::min(max_threads, 128));
+
+	double t0 = wtime();
+	for (long r=0; r<n_pairs; r++) {
+		PM.start("serial");
+		PM.stop("serial");
+	}
+	double t_serial = (wtime() - t0) / (double)n_pairs;
+
+	n_total += 2;	// "Root Section" and "serial"
+
+	std::vector<double> t_parallel(n_threads.size(), 0.0);
+#ifdef PM_BENCH_PARALLEL
+	n_total += (int)n_threads.size();
+	for (size_t k=0; k<n_threads.size(); k++) {
+		char name[64];
+		snprintf(name, sizeof(name), "parallel_%d", n_threads[k]);
+		std::string s_label = name;
+		double t_begin = 0.0;
+		#pragma omp parallel num_threads(n_threads[k])
+		{
+		if (!is_pm_initialized) {
+			PM.initialize();
+			is_pm_initialized = true;
+		}
+		PM.start(s_label);
+		PM.stop(s_label);
+		#pragma omp barrier
+		#pragma omp master
+		t_begin = wtime();
+		for (long r=0; r<n_pairs; r++) {
+			PM.start(s_label);
+			PM.stop(s_label);
+		}
+		#pragma omp barrier
+		#pragma omp master
+		t_parallel[k] = (wtime() - t_begin) / (double)n_pairs;
+		}
+	}
+#else
+	n_threads.assign(1, 1);
+	t_parallel.assign(1, t_serial);
+#endif
+
+//	gather() and report() latency
+	const int n_gather = 5;
+	double v_gather[n_gather];
+	for (int i=0; i<n_gather; i++) {
+		MPI_Barrier(MPI_COMM_WORLD);
+		t0 = wtime();
+		PM.gather();
+		v_gather[i] = max_over_ranks(wtime() - t0);
+	}
+	std::sort(v_gather, v_gather+n_gather);
+
+	FILE* fp_null = fopen("/dev/null", "w");
+	if (fp_null == NULL) fp_null = stderr;
+	MPI_Barrier(MPI_COMM_WORLD);
+	t0 = wtime();
+	PM.report(fp_null);
+	double t_report = max_over_ranks(wtime() - t0);
+	if (fp_null != stderr) fclose(fp_null);
+
+	if (my_rank == 0) {
+		FILE* fp = stdout;
+		if (s_output != NULL) {
+			fp = fopen(s_output, "w");
+			if (fp == NULL) {
+				fprintf(stderr, "\t<pm_bench> can not open %s\n", s_output);
+				fp = stdout;
+			}
+		}
+		fprintf(fp, "{\n");
+		fprintf(fp, "  \"pmlib_version\": \"%s\",\n", PM.getVersionInfo().c_str());
+		fprintf(fp, "  \"num_process\": %d,\n", num_process);
+		fprintf(fp, "  \"max_threads\": %d,\n", max_threads);
+#ifdef USE_PAPI
+		fprintf(fp, "  \"papi\": true,\n");
+#else
+		fprintf(fp, "  \"papi\": false,\n");
+#endif
+		fprintf(fp, "  \"hwpc_chooser\": \"%s\",\n", env_or("HWPC_CHOOSER", "FLOPS"));
+		fprintf(fp, "  \"pmlib_timer\": \"%s\",\n", env_or("PMLIB_TIMER", "MONOTONIC"));
+		fprintf(fp, "  \"pmlib_overhead\": \"%s\",\n", env_or("PMLIB_OVERHEAD", "REPORT"));
+		fprintf(fp, "  \"pairs\": %ld,\n", n_pairs);
+		fprintf(fp, "  \"set_properties\": [\n");
+		int n_before = 1;	// "Root Section"
+		for (int k=0; k<n_sizes; k++) {
+			fprintf(fp, "    {\"sections_before\": %d, \"sections_added\": %d, \"sec_per_call\": %.6e}%s\n",
+				n_before, n_sections[k], t_create[k], (k < n_sizes-1) ? "," : "");
+			n_before += n_sections[k];
+		}
+		fprintf(fp, "  ],\n");
+		fprintf(fp, "  \"start_stop\": [\n");
+		for (int k=0; k<n_sizes; k++) {
+			fprintf(fp, "    {\"sections\": %d, \"pairs\": %ld, \"label_sec_per_pair\": %.6e, \"id_sec_per_pair\": %.6e}%s\n",
+				n_sections[k], n_done[k], t_label[k], t_id[k], (k < n_sizes-1) ? "," : "");
+		}
+		fprintf(fp, "  ],\n");
+		fprintf(fp, "  \"serial\": {\"sec_per_pair\": %.6e},\n", t_serial);
+		fprintf(fp, "  \"parallel\": [\n");
+		for (size_t k=0; k<n_threads.size(); k++) {
+			fprintf(fp, "    {\"threads\": %d, \"sec_per_pair\": %.6e, \"pairs_per_sec\": %.6e}%s\n",
+				n_threads[k], t_parallel[k],
+				(t_parallel[k] > 0.0) ? (double)n_threads[k] / t_parallel[k] : 0.0,
+				(k < n_threads.size()-1) ? "," : "");
+		}
+		fprintf(fp, "  ],\n");
+		fprintf(fp, "  \"gather\": {\"sections\": %d, \"calls\": %d, \"sec_min\": %.6e, \"sec_median\": %.6e, \"sec_max\": %.6e},\n",
+			n_total, n_gather, v_gather[0], v_gather[n_gather/2], v_gather[n_gather-1]);
+		fprintf(fp, "  \"report\": {\"sec\": %.6e}\n", t_report);
+		fprintf(fp, "}\n");
+		if (fp != stdout) fclose(fp);
+	}
+
+#ifndef DISABLE_MPI
+	MPI_Finalize();
+#endif
+	return 0;
+}
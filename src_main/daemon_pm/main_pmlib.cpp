@@ -0,0 +1,53 @@
+#include <PerfMonitor.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <math.h>
+#include <string>
+#include <sstream>
+using namespace pm_lib;
+PerfMonitor PM;
+
+//	shellpm_daemon          : run the ShellPM agent for this job shell
+//	shellpm_daemon report   : let the agent print the report and exit
+//	shellpm_daemon quit     : let the agent exit without report
+//
+//	The agent should be started in background from the job shell, i.e.
+//	the same parent process as the following start_pm/stop_pm commands.
+//		shellpm_daemon &
+//
+//	The agent counts HWPC of the job shell and all its children started after
+//	the agent, i.e. the workload run between start_pm and stop_pm.
+//	PMLIB_HWPC_PID=<pid> can be set to count another process tree instead.
+
+int main (int argc, char *argv[])
+{
+	if (argc > 1) {
+		std::string s_command = argv[1];
+		if ((s_command != "report") && (s_command != "quit")) {
+			fprintf(stderr, "usage: %s [report|quit]\n", argv[0]);
+			return 1;
+		}
+		int iret = PM.pm_daemon_send(s_command, stdout);
+		if (iret == 1) {
+			fprintf(stderr, "\t<ShellPM> agent is not running\n");
+		}
+		return (iret == 0) ? 0 : 1;
+	}
+
+	if (PM.pm_daemon_send("ping", NULL) != 1) {
+		fprintf(stderr, "\t<ShellPM> agent is already running\n");
+		return 1;
+	}
+
+	//	count the job shell workload, unless PMLIB_HWPC_PID is given
+	setenv("PMLIB_HWPC_PID", std::to_string(getppid()).c_str(), 0);
+
+	fprintf(stderr, "\t<ShellPM> agent starts\n");
+	PM.initialize();
+	PM.pm_daemon_serve();
+	return 0;
+}
@@ -0,0 +1,843 @@
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <pmlib_record.h>
+#include <pmVersion.h>
+using namespace pm_lib;
+
+//	pm_merge
+//	produce the PMlib reports from the per process record files written by report()
+//	with PMLIB_DUMP=<prefix>. No collective is needed inside of the job.
+//
+//	usage: pm_merge [-d] [-t rank] [-g first:last] [-o 1] [-j n] <prefix>_0.pmrec ...
+//		(none)        : BASIC report, as print()
+//		-d            : process report for all the ranks, as printDetail()
+//		-t rank       : thread report of the rank, as printThreads(). may be repeated
+//		-g first:last : process report of the ranks first..last, as printGroup(). may be repeated
+//		-o 1          : list the sections in the registered order. default is sorted by time
+//		-j n          : number of reader threads. default is the number of online CPUs
+//
+//	The files are read by the reader threads one at a time, and are unmapped immediately.
+//	The BASIC report keeps the running statistics of each section only. -d and -g keep
+//	(3 + events) values per rank and section. -t reads the file of the rank again.
+//
+//	The HWPC values are reported as the raw event counts of all the threads of the process.
+//	The derived metrics such as GFlops or hit% depend on the hardware of the run,
+//	so that they are left to the report() inside of the job.
+
+static const size_t n_row_base = 3;		// calls, time, operations of the per rank row
+
+struct merge_file {
+	const pm_record_header* p_head;
+	const pm_record_section* p_table;
+	const long long* p_block;
+	const double* p_threads;
+	void* p_map;
+	size_t size;
+};
+
+// statistics of one section accumulated over the processes
+struct merge_section {
+	std::string label;
+	int id;					// the smallest section ID among the processes
+	int exclusive;
+	int type_calc;
+	int in_parallel;
+	double n;				// number of the processes merged
+	double time_mean, time_m2;
+	double flop_mean, flop_m2;
+	long long count_sum;
+	double self_sum;		// time excluding the nested sections
+	bool has_nested;
+	bool is_sampled;
+	std::vector<double> hwpc_sum;	// process values summed over the processes
+};
+
+struct merge_state {
+	std::vector<std::string> files;
+	size_t next_file;
+	bool keep_rows;
+	pthread_mutex_t lock;
+
+	// set by the first record, and checked against the others
+	int num_process;
+	int num_threads;
+	int num_events;
+	std::string hwpc_chooser;
+	std::vector<std::string> s_event;
+
+	std::map<std::string, int> map_label;	// label -> global section index
+	std::vector<double*> rows;				// [section][rank][n_row_base + num_events]
+	std::vector<int> rank_file;				// file index of each rank, (-1) if missing
+	int n_errors;
+};
+
+struct merge_worker {
+	merge_state* st;
+	std::vector<merge_section> sec;
+	pthread_t thread;
+};
+
+static merge_state g_state;
+
+
+static void init_section(merge_section& s, int n_events)
+{
+	s.id = -1;
+	s.exclusive = 1;
+	s.type_calc = 1;
+	s.in_parallel = 0;
+	s.n = 0.0;
+	s.time_mean = s.time_m2 = 0.0;
+	s.flop_mean = s.flop_m2 = 0.0;
+	s.count_sum = 0;
+	s.self_sum = 0.0;
+	s.has_nested = false;
+	s.is_sampled = false;
+	s.hwpc_sum.assign(n_events, 0.0);
+}
+
+
+// merge b into a, by the parallel variant of Welford's algorithm
+static void merge_stats(merge_section& a, const merge_section& b)
+{
+	if (b.n == 0.0) return;
+	if ((a.id < 0) || ((b.id >= 0) && (b.id < a.id))) a.id = b.id;
+	a.exclusive = a.exclusive && b.exclusive;	// inclusive on any rank stays inclusive
+	a.type_calc = b.type_calc;
+	a.in_parallel |= b.in_parallel;
+	double n = a.n + b.n;
+	double d_time = b.time_mean - a.time_mean;
+	double d_flop = b.flop_mean - a.flop_mean;
+	a.time_m2 += b.time_m2 + d_time * d_time * a.n * b.n / n;
+	a.flop_m2 += b.flop_m2 + d_flop * d_flop * a.n * b.n / n;
+	a.time_mean += d_time * b.n / n;
+	a.flop_mean += d_flop * b.n / n;
+	a.n = n;
+	a.count_sum += b.count_sum;
+	a.self_sum += b.self_sum;
+	a.has_nested |= b.has_nested;
+	a.is_sampled |= b.is_sampled;
+	for (size_t i=0; i<a.hwpc_sum.size() && i<b.hwpc_sum.size(); i++) {
+		a.hwpc_sum[i] += b.hwpc_sum[i];
+	}
+}
+
+
+static bool open_record(const char* file_name, merge_file& f)
+{
+	f.p_map = NULL;
+	int fd = open(file_name, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "\t<pm_merge> can not open %s\n", file_name);
+		return false;
+	}
+	struct stat sb;
+	if ((fstat(fd, &sb) != 0) || ((size_t)sb.st_size < sizeof(pm_record_header))) {
+		fprintf(stderr, "\t<pm_merge> %s is not a PMlib record\n", file_name);
+		close(fd);
+		return false;
+	}
+	f.size = sb.st_size;
+	f.p_map = mmap(NULL, f.size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (f.p_map == MAP_FAILED) {
+		fprintf(stderr, "\t<pm_merge> mmap failed %s\n", file_name);
+		f.p_map = NULL;
+		return false;
+	}
+
+	const char* p_buf = (const char*)f.p_map;
+	f.p_head = (const pm_record_header*)p_buf;
+	const pm_record_header* h = f.p_head;
+	bool is_valid = (memcmp(h->magic, Pm_record_magic, sizeof(h->magic)) == 0)
+		&& (h->version == Pm_record_version)
+		&& (h->header_size == (int)sizeof(pm_record_header))
+		&& (h->section_size == (int)sizeof(pm_record_section))
+		&& (h->num_sections >= 0) && (h->num_threads >= 0)
+		&& (h->num_events >= 0) && (h->num_events <= Max_chooser_events)
+		&& (h->rank >= 0) && (h->rank < h->num_process);
+	if (is_valid) {
+		size_t n_counter = (size_t)h->num_threads * (size_t)h->num_events;
+		size_t expected_size = sizeof(pm_record_header)
+					+ (size_t)h->num_sections * sizeof(pm_record_section)
+					+ (size_t)h->num_sections * 2 * n_counter * sizeof(long long)
+					+ (size_t)h->num_sections * h->num_threads * Pm_record_thread_size * sizeof(double);
+		is_valid = ((size_t)h->total_size == f.size) && (expected_size == f.size);
+	}
+	if (!is_valid) {
+		fprintf(stderr, "\t<pm_merge> %s is not a PMlib record of version %d, or is truncated\n",
+			file_name, Pm_record_version);
+		munmap(f.p_map, f.size);
+		f.p_map = NULL;
+		return false;
+	}
+	f.p_table = (const pm_record_section*)(p_buf + sizeof(pm_record_header));
+	f.p_block = (const long long*)(f.p_table + h->num_sections);
+	f.p_threads = (const double*)(f.p_block + (size_t)h->num_sections * 2 * h->num_threads * h->num_events);
+	return true;
+}
+
+
+static void close_record(merge_file& f)
+{
+	if (f.p_map != NULL) munmap(f.p_map, f.size);
+	f.p_map = NULL;
+}
+
+
+static std::string record_label(const pm_record_section& r)
+{
+	return std::string(r.label, strnlen(r.label, Pm_record_label_size));
+}
+
+
+// the process value of each event, as the sum of all the threads.
+// the sampled sections are scaled by the ratio of the call counts.
+static void process_hwpc(const merge_file& f, int k, double* v)
+{
+	const pm_record_header* h = f.p_head;
+	const pm_record_section& r = f.p_table[k];
+	int ne = h->num_events;
+	const long long* p_accumu = f.p_block + ((size_t)k*2 + 1) * h->num_threads * ne;
+
+	double scale = 1.0;
+	if ((r.count_sampled > 0) && (r.count_sampled < r.count)) scale = (double)r.count / (double)r.count_sampled;
+	for (int i=0; i<ne; i++) {
+		double sum = 0.0;
+		for (int j=0; j<h->num_threads; j++) sum += (double)p_accumu[j*ne+i];
+		v[i] = sum * scale;
+	}
+}
+
+
+// check the record against the first one, and register the rank
+static bool accept_record(merge_state* st, const merge_file& f, size_t i_file)
+{
+	const pm_record_header* h = f.p_head;
+	const char* file_name = st->files[i_file].c_str();
+	bool is_accepted = true;
+
+	pthread_mutex_lock(&st->lock);
+	if (st->num_process < 0) {
+		st->num_process = h->num_process;
+		st->num_threads = h->num_threads;
+		st->num_events = h->num_events;
+		st->hwpc_chooser.assign(h->hwpc_chooser, strnlen(h->hwpc_chooser, Pm_record_chooser_size));
+		for (int i=0; i<h->num_events; i++) {
+			st->s_event.push_back(std::string(h->event_name[i], strnlen(h->event_name[i], Pm_record_event_size)));
+		}
+		st->rank_file.assign(h->num_process, -1);
+	}
+	if ((h->num_process != st->num_process) || (h->num_events != st->num_events)
+		|| (strncmp(h->hwpc_chooser, st->hwpc_chooser.c_str(), Pm_record_chooser_size) != 0)) {
+		fprintf(stderr, "\t<pm_merge> %s is not a record of the same run. skipped.\n", file_name);
+		is_accepted = false;
+	} else if (st->rank_file[h->rank] >= 0) {
+		fprintf(stderr, "\t<pm_merge> %s has the same rank %d as %s. skipped.\n",
+			file_name, h->rank, st->files[st->rank_file[h->rank]].c_str());
+		is_accepted = false;
+	} else {
+		st->rank_file[h->rank] = (int)i_file;
+	}
+	if (!is_accepted) st->n_errors++;
+	pthread_mutex_unlock(&st->lock);
+	return is_accepted;
+}
+
+
+// the global index of the section, and its per rank rows if they are kept
+static int section_index(merge_state* st, const std::string& s_label, double** pp_rows)
+{
+	pthread_mutex_lock(&st->lock);
+	std::map<std::string, int>::iterator it = st->map_label.find(s_label);
+	int g;
+	if (it == st->map_label.end()) {
+		g = (int)st->map_label.size();
+		st->map_label[s_label] = g;
+		double* p = NULL;
+		if (st->keep_rows) {
+			size_t n = (size_t)st->num_process * (n_row_base + st->num_events);
+			p = new double[n];
+			for (size_t i=0; i<n; i++) p[i] = 0.0;
+		}
+		st->rows.push_back(p);
+	} else {
+		g = it->second;
+	}
+	*pp_rows = st->rows[g];
+	pthread_mutex_unlock(&st->lock);
+	return g;
+}
+
+
+static void* merge_reader(void* arg)
+{
+	merge_worker* w = static_cast<merge_worker*>(arg);
+	merge_state* st = w->st;
+	std::vector<double> v_hwpc(Max_chooser_events);
+
+	while (true) {
+		pthread_mutex_lock(&st->lock);
+		size_t i_file = st->next_file++;
+		pthread_mutex_unlock(&st->lock);
+		if (i_file >= st->files.size()) break;
+
+		merge_file f;
+		if (!open_record(st->files[i_file].c_str(), f)) {
+			pthread_mutex_lock(&st->lock);
+			st->n_errors++;
+			pthread_mutex_unlock(&st->lock);
+			continue;
+		}
+		if (!accept_record(st, f, i_file)) {
+			close_record(f);
+			continue;
+		}
+
+		const pm_record_header* h = f.p_head;
+		int ne = h->num_events;
+		size_t n_row = n_row_base + ne;
+		for (int k=0; k<h->num_sections; k++) {
+			const pm_record_section& r = f.p_table[k];
+			std::string s_label = record_label(r);
+			if (s_label.empty()) continue;
+			double* p_rows;
+			int g = section_index(st, s_label, &p_rows);
+			if ((int)w->sec.size() <= g) {
+				size_t n_old = w->sec.size();
+				w->sec.resize(g+1);
+				for (size_t m=n_old; m<w->sec.size(); m++) init_section(w->sec[m], ne);
+			}
+			process_hwpc(f, k, &v_hwpc[0]);
+
+			//	a single process record merged by Welford's algorithm
+			merge_section one;
+			init_section(one, ne);
+			one.label = s_label;
+			one.id = r.id;
+			one.exclusive = r.exclusive;
+			one.type_calc = r.type_calc;
+			one.in_parallel = r.in_parallel;
+			one.n = 1.0;
+			one.time_mean = r.time;
+			one.flop_mean = r.flop;
+			one.count_sum = r.count;
+			one.self_sum = std::max(r.time - r.time_child, 0.0);
+			one.has_nested = (r.time_child > 0.0);
+			one.is_sampled = (r.count_sampled > 0) && (r.count_sampled < r.count);
+			for (int i=0; i<ne; i++) one.hwpc_sum[i] = v_hwpc[i];
+			if (w->sec[g].label.empty()) w->sec[g].label = s_label;
+			merge_stats(w->sec[g], one);
+
+			if (p_rows != NULL) {
+				double* p = p_rows + (size_t)h->rank * n_row;
+				p[0] = (double)r.count;
+				p[1] = r.time;
+				p[2] = r.flop;
+				for (int i=0; i<ne; i++) p[n_row_base+i] = v_hwpc[i];
+			}
+		}
+		close_record(f);
+	}
+	return NULL;
+}
+
+
+// the values of the merged section as the report of PMlib shows them
+struct report_section {
+	merge_section s;
+	int g;
+	long count_av;
+	double time_av, time_sd;
+	double flop_av, flop_sd;
+	double self_av;
+};
+
+
+static double unit_flop(double fops, std::string& unit, int is_unit)
+{
+	const double K = 1000.0, M = K*K, G = M*K, T = G*K, P = T*K;
+	const char* s_bytes[] = {"PB/sec", "TB/sec", "GB/sec", "MB/sec"};
+	const char* s_flops[] = {"Pflops", "Tflops", "Gflops", "Mflops"};
+	const char** s = (is_unit == 0) ? s_bytes : s_flops;
+	if (fops > P) { unit = s[0]; return fops / P; }
+	if (fops > T) { unit = s[1]; return fops / T; }
+	if (fops > G) { unit = s[2]; return fops / G; }
+	unit = s[3];
+	return fops / M;
+}
+
+
+static std::string decorated(const merge_section& s)
+{
+	std::string p_label = s.label;
+	if (!s.exclusive) { p_label = s.label + " (*)"; }
+	if (s.in_parallel) { p_label = s.label + " (+)"; }
+	return p_label;
+}
+
+
+static std::string event_symbol(const std::string& s_name)
+{
+	size_t kp = s_name.find_last_of(':');
+	return (kp == std::string::npos) ? s_name : s_name.substr(kp+1);
+}
+
+
+static void print_basic(FILE* fp, const merge_state* st, const std::vector<report_section>& sec,
+	const std::vector<int>& order, int n_ranks, double tot)
+{
+	struct tm *date;
+	time_t now;
+	time(&now);
+	date = localtime(&now);
+
+	int np = st->num_process;
+	int nt = st->num_threads;
+	fprintf(fp, "\n# PMlib Basic Report ------------------------------------------------------------- #\n");
+	fprintf(fp, "\n");
+	fprintf(fp, "\tPerformance Statistics Report from PMlib version %s\n", PM_VERSION);
+	fprintf(fp, "\tMerged by pm_merge from %d of %d process records written with PMLIB_DUMP\n", n_ranks, np);
+	fprintf(fp, "\tDate      : %04d/%02d/%02d : %02d:%02d:%02d\n", date->tm_year+1900, date->tm_mon+1,
+		date->tm_mday, date->tm_hour, date->tm_min, date->tm_sec);
+	if ((np > 1) && (nt > 1)) {
+		fprintf(fp, "\tParallel Mode:   Hybrid (%d processes x %d threads)\n", np, nt);
+	} else if (np > 1) {
+		fprintf(fp, "\tParallel Mode:   FlatMPI (%d processes)\n", np);
+	} else if (nt > 1) {
+		fprintf(fp, "\tParallel Mode:   OpenMP (%d threads)\n", nt);
+	} else {
+		fprintf(fp, "\tParallel Mode:   Serial \n");
+	}
+	fprintf(fp, "\t\tHWPC_CHOOSER=%s \n", st->hwpc_chooser.c_str());
+	fprintf(fp, "\tActive PMlib elapsed time (from initialize to report/print) = %9.3e [sec]\n", tot);
+	fprintf(fp, "\tBasic process stats as the average of all the processes are reported below.\n");
+	fprintf(fp, "\tSee Legend page if the section name is annotated with special symbols such as (*),(+).\n");
+	fprintf(fp, "\n");
+
+	int maxLabelLen = 0;
+	for (size_t i=0; i<sec.size(); i++) {
+		int labelLen = sec[i].s.label.size();
+		if (!sec[i].s.exclusive) labelLen += 4;
+		if (sec[i].s.in_parallel) labelLen += 4;
+		maxLabelLen = std::max(maxLabelLen, labelLen);
+	}
+	maxLabelLen++;
+
+	fprintf(fp, "%-*s| number of| measured | weight| time per| std.dv of ", maxLabelLen, "Section");
+	fprintf(fp, "| user defined numerical performance\n");
+	fprintf(fp, "%-*s|   calls  | time[sec]   [%%]   call[sec]    time    ", maxLabelLen, "Label");
+	fprintf(fp, "| operations  std.dv  performance\n");
+	for (int i = 0; i < maxLabelLen; i++) fputc('-', fp);
+	fprintf(fp,       "+----------+----------------------------------------+--------------------------------\n");
+
+	double sum_time_comm = 0.0, sum_time_flop = 0.0;
+	double sum_comm = 0.0, sum_flop = 0.0;
+	std::string unit;
+
+	for (size_t j=0; j<order.size(); j++) {
+		const report_section& w = sec[order[j]];
+		if (w.s.id == 0) continue;
+		if (!(w.s.count_sum > 0)) continue;
+
+		double tav;
+		if (w.count_av != 0) {
+			tav = w.time_av/(double)w.count_av;
+		} else {
+			tav = (double)n_ranks*w.time_av/(double)w.s.count_sum;
+		}
+		int is_unit = (w.s.type_calc == 0) ? 0 : 1;
+
+		fprintf(fp, "%-*s: %8ld   %9.3e %6.2f  %9.3e  %8.2e",
+			maxLabelLen, decorated(w.s).c_str(), w.count_av, w.time_av, 100*w.time_av/tot, tav, w.time_sd);
+
+		double fops = ((w.time_av == 0.0) || (w.count_av == 0)) ? 0.0 : w.flop_av/w.time_av;
+		double uF = unit_flop(fops, unit, is_unit);
+		std::string p_unit = unit;
+		if (!w.s.exclusive)  { p_unit = p_unit + "(*)"; }
+		if (w.s.in_parallel) { p_unit = p_unit + "(+)"; }
+		fprintf(fp, "    %8.3e  %8.2e %6.2f %s\n", w.flop_av, w.flop_sd, uF, p_unit.c_str());
+
+		if (w.s.has_nested && !w.s.in_parallel) {
+			fprintf(fp, "%-*s: %8s   %9.3e %6.2f  %9.3e\n",
+				maxLabelLen, "  (self)", "", w.self_av, 100*w.self_av/tot,
+				(w.count_av != 0) ? w.self_av/(double)w.count_av : 0.0);
+		}
+
+		if (w.s.exclusive) {
+			if (is_unit == 0) {
+				sum_time_comm += w.time_av;
+				sum_comm += w.flop_av;
+			} else {
+				sum_time_flop += w.time_av;
+				sum_flop += w.flop_av;
+			}
+		}
+	}
+
+	for (int i = 0; i < maxLabelLen; i++) fputc('-', fp);
+	fprintf(fp,       "+----------+----------------------------------------+--------------------------------\n");
+	if (sum_time_comm > 0.0) {
+		fprintf(fp, "%-*s   %9.3e %6.2f ", maxLabelLen+10, "Sum of exclusive sections", sum_time_comm, 100*sum_time_comm/tot);
+		double comm_serial = unit_flop(sum_comm/sum_time_comm, unit, 0);
+		fprintf(fp, "%22s  %8.3e          %7.2f %s\n", " ", sum_comm, comm_serial, unit.c_str());
+	}
+	if (sum_time_flop > 0.0) {
+		fprintf(fp, "%-*s   %9.3e %6.2f ", maxLabelLen+10, "Sum of exclusive sections", sum_time_flop, 100*sum_time_flop/tot);
+		double flop_serial = unit_flop(sum_flop/sum_time_flop, unit, 1);
+		fprintf(fp, "%22s  %8.3e          %7.2f %s\n", " ", sum_flop, flop_serial, unit.c_str());
+	}
+	if (sum_time_comm > 0.0) {
+		double sum_comm_job = (double)n_ranks*sum_comm;
+		double comm_job = unit_flop(sum_comm_job/sum_time_comm, unit, 0);
+		fprintf(fp, "%-*s %16s", maxLabelLen+10, "[sum of all processes]", " " );
+		fprintf(fp, "%22s     %8.3e          %7.2f %s\n", "", sum_comm_job, comm_job, unit.c_str());
+	}
+	if (sum_time_flop > 0.0) {
+		double sum_flop_job = (double)n_ranks*sum_flop;
+		double flop_job = unit_flop(sum_flop_job/sum_time_flop, unit, 1);
+		fprintf(fp, "%-*s %16s", maxLabelLen+10, "[sum of all processes]", " " );
+		fprintf(fp, "%22s     %8.3e          %7.2f %s\n", "", sum_flop_job, flop_job, unit.c_str());
+	}
+	for (int i = 0; i < maxLabelLen; i++) fputc('-', fp);
+	fprintf(fp,       "+----------+----------------------------------------+--------------------------------\n");
+	fprintf(fp, "%-*s   %9.3e %6.2f \n", maxLabelLen+10, "[active PMlib elapsed time]", tot, 100.0);
+
+	//	HWPC report of the averaged process
+	int ne = st->num_events;
+	if ((ne == 0) || (st->hwpc_chooser == "USER")) return;
+	fprintf(fp, "\n");
+	fprintf(fp, "\n# PMlib hardware performance counter (HWPC) report of the averaged process ------- #\n");
+	fprintf(fp, "\n");
+	fprintf(fp, "\tRaw event counts for option HWPC_CHOOSER=%s are reported.\n\n", st->hwpc_chooser.c_str());
+	fprintf(fp, "Section"); for (int i=7; i< maxLabelLen; i++) { fputc(' ', fp); } fputc('|', fp);
+	for (int i=0; i<ne; i++) fprintf(fp, " %10.10s", event_symbol(st->s_event[i]).c_str());
+	fprintf(fp, "\n");
+	for (int i=0; i< maxLabelLen; i++) { fputc('-', fp); }  fputc('+', fp);
+	for (int i=0; i<(ne*11); i++) { fputc('-', fp); } fprintf(fp, "\n");
+	for (size_t j=0; j<order.size(); j++) {
+		const report_section& w = sec[order[j]];
+		if (w.s.id == 0) continue;
+		if (w.s.count_sum == 0) continue;
+		fprintf(fp, "%-*s:", maxLabelLen, decorated(w.s).c_str());
+		for (int i=0; i<ne; i++) fprintf(fp, "  %9.3e", w.s.hwpc_sum[i] / n_ranks);
+		if (w.s.is_sampled) fprintf(fp, " (s)");
+		fprintf(fp, "%s\n", !w.s.exclusive ? " (*)" : (w.s.in_parallel ? " (+)" : ""));
+	}
+	for (int i=0; i< maxLabelLen; i++) { fputc('-', fp); }  fputc('+', fp);
+	for (int i=0; i<(ne*11); i++) { fputc('-', fp); } fprintf(fp, "\n");
+}
+
+
+// the per rank tables of printDetail() (group == 0) or printGroup()
+static void print_ranks(FILE* fp, const merge_state* st, const std::vector<report_section>& sec,
+	const std::vector<int>& order, double tot, int first, int last, int group)
+{
+	int ne = st->num_events;
+	bool is_hwpc = (ne > 0) && (st->hwpc_chooser != "USER");
+	size_t n_row = n_row_base + ne;
+
+	if (group == 0) {
+		if (st->num_process > 1) {
+			fprintf(fp, "\n## PMlib Process Report --- Elapsed time for individual MPI ranks ------\n\n");
+		} else {
+			fprintf(fp, "\n## PMlib Process Report ------------------------------------------------\n\n");
+		}
+	} else {
+		fprintf(fp, "\n## PMlib Process Group [%5d] Elapsed time for individual MPI ranks --------\n\n", group);
+	}
+
+	for (size_t j=0; j<order.size(); j++) {
+		const report_section& w = sec[order[j]];
+		if (w.s.id == 0) continue;
+		if ((group != 0) && !w.s.exclusive) continue;
+		const double* p_rows = st->rows[w.g];
+
+		double tMax = 0.0;
+		long total_count = 0;
+		for (int i=first; i<=last; i++) {
+			if (st->rank_file[i] < 0) continue;
+			tMax = std::max(tMax, p_rows[i*n_row+1]);
+			total_count += lround(p_rows[i*n_row]);
+		}
+		if (total_count == 0) continue;
+		std::string unit = (w.s.type_calc == 0) ? "B/sec" : "Flops";
+
+		if (group == 0) {
+			fprintf(fp, "Section : %s%s%s\n", w.s.label.c_str(), w.s.exclusive? "":" (*)" , w.s.in_parallel? " (+)":"" );
+		} else {
+			fprintf(fp, "Section Label : %s%s\n", w.s.label.c_str(), w.s.exclusive ? "" : "(*)" );
+		}
+		if (is_hwpc) {
+			fprintf(fp, "MPI rankID :     call   time[s] time[%%]  t_wait[s]  t[s]/call   \n");
+		} else if (group == 0) {
+			fprintf(fp, "MPI rankID :     call   time[s] time[%%]  t_wait[s]  t[s]/call   counter     speed              \n");
+		} else {
+			fprintf(fp, "MPI rankID :     call   time[s] time[%%]  t_wait[s]  t[s]/call   operations  performance\n");
+		}
+		for (int i=first; i<=last; i++) {
+			if (st->rank_file[i] < 0) continue;
+			const double* p = p_rows + i*n_row;
+			long count = lround(p[0]);
+			double t_per_call = (count==0) ? 0.0: p[1]/count;
+			if (is_hwpc) {
+				fprintf(fp, "Rank %5d : %8ld  %9.3e  %5.1f  %9.3e  %9.3e  \n",
+					i, count, p[1], 100*p[1]/tot, tMax-p[1], t_per_call);
+			} else {
+				double perf_rate = ((count==0) || (p[1]==0.0)) ? 0.0 : p[2]/p[1];
+				fprintf(fp, "Rank %5d : %8ld  %9.3e  %5.1f  %9.3e  %9.3e  %9.3e  %9.3e %s\n",
+					i, count, p[1], 100*p[1]/tot, tMax-p[1], t_per_call, p[2], perf_rate, unit.c_str());
+			}
+		}
+	}
+
+	if (!is_hwpc) return;
+	if (group == 0) {
+		fprintf(fp, "\n## PMlib hardware performance counter (HWPC) report for individual MPI ranks ---------\n\n");
+		fprintf(fp, "\tRaw event counts for option HWPC_CHOOSER=%s are reported.\n\n", st->hwpc_chooser.c_str());
+	} else {
+		fprintf(fp, "\n## PMlib Process Group [%5d] hardware performance counter (HWPC) Report ---\n", group);
+	}
+	for (size_t j=0; j<order.size(); j++) {
+		const report_section& w = sec[order[j]];
+		if ((group != 0) && !w.s.exclusive) continue;
+		if (w.s.count_sum == 0) continue;
+		const double* p_rows = st->rows[w.g];
+		fprintf(fp, "Section : %s%s%s\n", w.s.label.c_str(), w.s.exclusive? "":" (*)" , w.s.in_parallel? " (+)":"" );
+		fprintf(fp, "MPI rankID :");
+		for (int i=0; i<ne; i++) fprintf(fp, " %10.10s", event_symbol(st->s_event[i]).c_str());
+		fprintf(fp, "\n");
+		for (int i=first; i<=last; i++) {
+			if (st->rank_file[i] < 0) continue;
+			fprintf(fp, "Rank %5d :", i);
+			for (int n=0; n<ne; n++) fprintf(fp, "  %9.3e", p_rows[i*n_row + n_row_base + n]);
+			fprintf(fp, "\n");
+		}
+	}
+}
+
+
+// the thread report of printThreads(). the file of the rank is read again.
+static void print_threads(FILE* fp, const merge_state* st, const std::vector<report_section>& sec,
+	const std::vector<int>& order, int rank_ID)
+{
+	if ((rank_ID < 0) || (rank_ID >= st->num_process) || (st->rank_file[rank_ID] < 0)) {
+		fprintf(stderr, "\t<pm_merge> the record of rank %d is not merged. no thread report.\n", rank_ID);
+		return;
+	}
+	merge_file f;
+	if (!open_record(st->files[st->rank_file[rank_ID]].c_str(), f)) return;
+	const pm_record_header* h = f.p_head;
+	int ne = h->num_events;
+	int nt = h->num_threads;
+	bool is_hwpc = (ne > 0) && (st->hwpc_chooser != "USER");
+
+	if (st->num_process > 1) {
+		fprintf(fp, "\n## PMlib Thread Report for MPI rank %d  ----------------------\n\n", rank_ID);
+	} else {
+		fprintf(fp, "\n## PMlib Thread Report for the single process run ---------------------\n\n");
+	}
+
+	std::map<std::string, int> map_k;
+	for (int k=0; k<h->num_sections; k++) map_k[record_label(f.p_table[k])] = k;
+
+	for (size_t j=0; j<order.size(); j++) {
+		const report_section& w = sec[order[j]];
+		if (w.s.id == 0) continue;
+		if (!(w.s.count_sum > 0)) continue;
+		std::map<std::string, int>::iterator it = map_k.find(w.s.label);
+		if (it == map_k.end()) continue;
+		int k = it->second;
+		const pm_record_section& r = f.p_table[k];
+		const double* p_thr = f.p_threads + (size_t)k * nt * Pm_record_thread_size;
+		const long long* p_accumu = f.p_block + ((size_t)k*2 + 1) * nt * ne;
+		std::string unit = (r.type_calc == 0) ? "B/sec" : "Flops";
+
+		fprintf(fp, "Section : %s%s%s\n", w.s.label.c_str(), w.s.exclusive? "":" (*)" , w.s.in_parallel? " (+)":"" );
+		if (is_hwpc) {
+			fprintf(fp, "Thread  call  time[s]  t/tav[%%]");
+			for (int i=0; i<ne; i++) fprintf(fp, " %10.10s", event_symbol(st->s_event[i]).c_str());
+			fprintf(fp, "\n");
+		} else {
+			fprintf(fp, "Thread  call  time[s]  t/tav[%%]  operations  performance\n");
+		}
+
+		for (int i_th=0; i_th<nt; i_th++) {
+			if (!r.in_parallel && !is_hwpc) {
+				if (i_th == 1) {
+					fprintf(fp, " %3d\t\t user mode worksharing threads are represented by thread 0\n", i_th);
+					continue;
+				}
+				if (i_th >= 1) {
+					fprintf(fp, " %3d\t\t ditto\n", i_th);
+					continue;
+				}
+			}
+			//	the serial sections keep their values in the row of thread 0
+			const double* p = p_thr + (r.in_parallel ? i_th : 0) * Pm_record_thread_size;
+			long count = lround(p[0]);
+			double t_ratio = (w.time_av > 0.0) ? 100*p[1]/w.time_av : 0.0;
+			if (is_hwpc) {
+				fprintf(fp, " %3d%8ld  %9.3e  %5.1f ", i_th, count, p[1], t_ratio);
+				double scale = 1.0;
+				if ((r.count_sampled > 0) && (r.count_sampled < r.count)) scale = (double)r.count / (double)r.count_sampled;
+				for (int n=0; n<ne; n++) fprintf(fp, "  %9.3e", (double)p_accumu[i_th*ne+n] * scale);
+				fprintf(fp, "\n");
+			} else {
+				double perf_rate = ((count==0) || (p[1]==0.0)) ? 0.0 : p[2]/p[1];
+				fprintf(fp, " %3d%8ld  %9.3e  %5.1f   %9.3e  %9.3e %s\n",
+					i_th, count, p[1], t_ratio, p[2], perf_rate, unit.c_str());
+			}
+		}
+	}
+	close_record(f);
+}
+
+
+static void print_legend(FILE* fp)
+{
+	fprintf(fp, "\n# PMlib Legend - the symbols used in the reports  ----------------------\n");
+	fprintf(fp, "\t(*) : inclusive section, which may contain other sections\n");
+	fprintf(fp, "\t(+) : section defined inside of parallel region\n");
+	fprintf(fp, "\t(s) : HWPC values are extrapolated from the sampled calls (PMLIB_SAMPLE)\n");
+	fprintf(fp, "\t(self) : time of the section excluding the nested sections\n");
+}
+
+
+int main (int argc, char *argv[])
+{
+	bool is_detail = false;
+	int op_sort = 0;
+	int n_readers = 0;
+	std::vector<int> thread_ranks;
+	std::vector<std::pair<int,int> > groups;
+	merge_state* st = &g_state;
+
+	for (int i=1; i<argc; i++) {
+		std::string s = argv[i];
+		if (s == "-d") {
+			is_detail = true;
+		} else if ((s == "-t") && (i+1 < argc)) {
+			thread_ranks.push_back(atoi(argv[++i]));
+		} else if ((s == "-g") && (i+1 < argc)) {
+			int first, last;
+			if (sscanf(argv[++i], "%d:%d", &first, &last) != 2 || first < 0 || last < first) {
+				fprintf(stderr, "\t<pm_merge> invalid group %s. use -g first:last\n", argv[i]);
+				return 1;
+			}
+			groups.push_back(std::make_pair(first, last));
+		} else if ((s == "-o") && (i+1 < argc)) {
+			op_sort = atoi(argv[++i]);
+		} else if ((s == "-j") && (i+1 < argc)) {
+			n_readers = atoi(argv[++i]);
+		} else {
+			st->files.push_back(s);
+		}
+	}
+	if (st->files.empty()) {
+		fprintf(stderr, "usage: %s [-d] [-t rank] [-g first:last] [-o 1] [-j n] <prefix>_<rank>.pmrec ...\n", argv[0]);
+		return 1;
+	}
+	if (n_readers <= 0) n_readers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	n_readers = std::max(1, std::min(n_readers, std::min((int)st->files.size(), 64)));
+
+	st->next_file = 0;
+	st->keep_rows = is_detail || !groups.empty();
+	st->num_process = -1;
+	st->num_threads = 0;
+	st->num_events = 0;
+	st->n_errors = 0;
+	pthread_mutex_init(&st->lock, NULL);
+
+	std::vector<merge_worker> workers(n_readers);
+	for (int k=0; k<n_readers; k++) {
+		workers[k].st = st;
+		if (pthread_create(&workers[k].thread, NULL, merge_reader, &workers[k]) != 0) {
+			fprintf(stderr, "\t<pm_merge> the reader thread could not be created\n");
+			return 1;
+		}
+	}
+	for (int k=0; k<n_readers; k++) pthread_join(workers[k].thread, NULL);
+	pthread_mutex_destroy(&st->lock);
+
+	int n_ranks = 0;
+	for (size_t i=0; i<st->rank_file.size(); i++) {
+		if (st->rank_file[i] >= 0) n_ranks++;
+	}
+	if (n_ranks == 0) {
+		fprintf(stderr, "\t<pm_merge> no record is merged\n");
+		return 1;
+	}
+	if (n_ranks != st->num_process) {
+		fprintf(stderr, "\t<pm_merge> %d of %d processes are merged. the others are not included in the report.\n",
+			n_ranks, st->num_process);
+	}
+
+	//	combine the readers, and take the statistics over the merged processes
+	std::vector<report_section> sec(st->map_label.size());
+	for (size_t g=0; g<sec.size(); g++) {
+		init_section(sec[g].s, st->num_events);
+		sec[g].g = (int)g;
+		for (int k=0; k<n_readers; k++) {
+			if (g < workers[k].sec.size()) {
+				if (sec[g].s.label.empty()) sec[g].s.label = workers[k].sec[g].label;
+				merge_stats(sec[g].s, workers[k].sec[g]);
+			}
+		}
+		//	the processes without the section count as zero, as in PerfWatch::statsAverage()
+		merge_section& s = sec[g].s;
+		double n_all = (double)n_ranks;
+		double time_m2 = s.time_m2 + s.time_mean * s.time_mean * s.n * (n_all - s.n) / n_all;
+		double flop_m2 = s.flop_m2 + s.flop_mean * s.flop_mean * s.n * (n_all - s.n) / n_all;
+		sec[g].time_av = s.time_mean * s.n / n_all;
+		sec[g].flop_av = s.flop_mean * s.n / n_all;
+		sec[g].time_sd = (n_ranks > 1) ? sqrt(std::max(time_m2, 0.0) / (n_all - 1.0)) : 0.0;
+		sec[g].flop_sd = (n_ranks > 1) ? sqrt(std::max(flop_m2, 0.0) / (n_all - 1.0)) : 0.0;
+		sec[g].count_av = lround((double)s.count_sum / n_all);
+		sec[g].self_av = s.self_sum / n_all;
+	}
+
+	//	listed order is the order of the section IDs. Root section has ID 0.
+	std::vector<int> order(sec.size());
+	for (size_t i=0; i<order.size(); i++) order[i] = (int)i;
+	std::stable_sort(order.begin(), order.end(), [&sec](int a, int b) {
+		if (sec[a].s.id != sec[b].s.id) return sec[a].s.id < sec[b].s.id;
+		return sec[a].s.label < sec[b].s.label;
+	});
+	double tot = 0.0;
+	if (!order.empty() && (sec[order[0]].s.id == 0)) tot = sec[order[0]].time_av;
+	if (op_sort == 0) {
+		std::stable_sort(order.begin(), order.end(), [&sec](int a, int b) {
+			return sec[a].time_av > sec[b].time_av;
+		});
+	}
+
+	FILE* fp = stdout;
+	print_basic(fp, st, sec, order, n_ranks, tot);
+	if (is_detail) {
+		print_ranks(fp, st, sec, order, tot, 0, st->num_process-1, 0);
+	}
+	for (size_t k=0; k<groups.size(); k++) {
+		int last = std::min(groups[k].second, st->num_process-1);
+		print_ranks(fp, st, sec, order, tot, groups[k].first, last, (int)k+1);
+	}
+	for (size_t k=0; k<thread_ranks.size(); k++) {
+		print_threads(fp, st, sec, order, thread_ranks[k]);
+	}
+	print_legend(fp);
+
+	for (size_t g=0; g<st->rows.size(); g++) delete [] st->rows[g];
+	return (st->n_errors == 0) ? 0 : 1;
+}
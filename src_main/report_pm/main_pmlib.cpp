@@ -0,0 +1,33 @@
+#include <PerfMonitor.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include <stdio.h>
+#include <math.h>
+#include <string>
+#include <sstream>
+using namespace pm_lib;
+PerfMonitor PM;
+
+//	shellpm_report
+//	stop the sections still active, print the cumulative report of all the
+//	sections measured since the first shellpm_start, and delete the record.
+
+int main (int argc, char *argv[])
+{
+
+	//	If the ShellPM agent (shellpm_daemon) is running, it prints the report and exits.
+	int iret = PM.pm_daemon_send("report", stdout);
+	if (iret != 1) return (iret == 0) ? 0 : 1;
+
+	fprintf(stderr, "\t<ShellPM> stop and report\n");
+	PM.initialize();
+	if (!PM.load_pm_records()) {
+		fprintf(stderr, "\t<ShellPM> no valid record. shellpm_start has not been called.\n");
+		return 1;
+	}
+	PM.stop_active_sections();
+	PM.report(stdout);
+	PM.remove_pm_records();
+	return 0;
+}
@@ -0,0 +1,163 @@
+#include <pmlib_series.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+using namespace pm_lib;
+
+//	pm_series
+//	print the per interval rates of the sections from the PMLIB_SERIES files.
+//	each line is the difference of two consecutive snapshots of one section.
+//
+//	usage: pm_series [-s label] pmlib_series_0.pmts [pmlib_series_1.pmts ...]
+//		-s label : print the section <label> only
+//
+//	the time of a call is added to the interval in which the call stops, so a
+//	call longer than the interval would exceed 100% busy. busy[%] is clipped to
+//	the interval length, and is not shown for the Root section, whose time is
+//	accumulated when it stops at the report.
+
+struct series_snapshot {
+	double time;
+	std::vector<pm_series_entry> entry;
+	std::vector<int64_t> hwpc;
+};
+
+static bool read_block(FILE* fp, void* p, size_t n)
+{
+	return (fread(p, 1, n, fp) == n);
+}
+
+static int print_series(const char* file_name, const char* s_select)
+{
+	FILE* fp = fopen(file_name, "rb");
+	if (fp == NULL) {
+		fprintf(stderr, "\t<pm_series> can not open %s\n", file_name);
+		return 1;
+	}
+
+	pm_series_header head;
+	if (!read_block(fp, &head, sizeof(head))
+		|| (memcmp(head.magic, Pm_series_magic, sizeof(head.magic)) != 0)
+		|| (head.version != Pm_series_version)
+		|| (head.num_events < 0)) {
+		fprintf(stderr, "\t<pm_series> %s is not a PMLIB_SERIES file of version %d\n", file_name, Pm_series_version);
+		fclose(fp);
+		return 1;
+	}
+	int n_events = head.num_events;
+	std::vector<std::string> s_event(n_events);
+	for (int i=0; i<n_events; i++) {
+		char name[Pm_series_name_size];
+		if (!read_block(fp, name, sizeof(name))) break;
+		name[sizeof(name)-1] = '\0';
+		s_event[i] = name;
+	}
+
+	fprintf(stdout, "# %s : rank %d of %d, %d threads, HWPC_CHOOSER=%s, snapshot every %g %s\n",
+		file_name, head.rank, head.num_process, head.num_threads, head.hwpc_chooser,
+		head.interval, (head.mode == Series_time) ? "seconds" : "calls");
+	fprintf(stdout, "# rank   t_begin     t_end  section  calls  time[s]  busy[%%]  flop/s");
+	for (int i=0; i<n_events; i++) {
+		fprintf(stdout, "  %s/s", s_event[i].c_str());
+	}
+	fprintf(stdout, "\n");
+
+	std::vector<std::string> s_label;
+	series_snapshot prev, curr;
+	bool has_prev = false;
+	pm_series_tag tag;
+
+	while (read_block(fp, &tag, sizeof(tag))) {
+		if (tag.type == Pm_series_label) {
+			int32_t id;
+			std::vector<char> chars(tag.size - sizeof(id));
+			if (!read_block(fp, &id, sizeof(id))) break;
+			if (!chars.empty() && !read_block(fp, &chars[0], chars.size())) break;
+			if ((int)s_label.size() <= id) s_label.resize(id+1);
+			s_label[id].assign(chars.begin(), chars.end());
+
+		} else if (tag.type == Pm_series_snapshot) {
+			pm_series_snapshot_head sh;
+			if (!read_block(fp, &sh, sizeof(sh))) break;
+			curr.time = sh.time;
+			curr.entry.resize(sh.n_sections);
+			curr.hwpc.resize((size_t)sh.n_sections * n_events);
+			bool is_read = true;
+			for (int k=0; k<sh.n_sections && is_read; k++) {
+				is_read = read_block(fp, &curr.entry[k], sizeof(pm_series_entry));
+				if (is_read && n_events > 0) {
+					is_read = read_block(fp, &curr.hwpc[(size_t)k*n_events], n_events*sizeof(int64_t));
+				}
+			}
+			if (!is_read) break;
+
+			if (has_prev) {
+				double dt = curr.time - prev.time;
+				for (size_t k=0; k<curr.entry.size(); k++) {
+					pm_series_entry e0 = {0, 0, 0.0, 0.0};
+					if (k < prev.entry.size()) e0 = prev.entry[k];
+					const pm_series_entry& e1 = curr.entry[k];
+					long long d_count = e1.count - e0.count;
+					double d_time = e1.time - e0.time;
+					if ((d_count == 0) && (d_time == 0.0)) continue;
+					std::string s = (k < s_label.size()) ? s_label[k] : "?";
+					if ((s_select != NULL) && (s != s_select)) continue;
+
+					//	the sampled sections are scaled by the ratio of the call counts
+					long long d_sampled = e1.count_sampled - e0.count_sampled;
+					double scale = (d_sampled > 0) ? (double)d_count / (double)d_sampled : 0.0;
+					double r_time = (dt > 0.0) ? 1.0/dt : 0.0;
+
+					fprintf(stdout, "%6d %9.3f %9.3f  %s  %lld  %9.3e",
+						head.rank, prev.time, curr.time, s.c_str(), d_count, d_time);
+					if (k == 0) {
+						fprintf(stdout, "  %6s", "-");
+					} else {
+						fprintf(stdout, "  %6.2f", std::min(d_time * r_time, 1.0) * 100.0);
+					}
+					fprintf(stdout, "  %9.3e", (e1.flop - e0.flop) * r_time);
+					for (int i=0; i<n_events; i++) {
+						int64_t h0 = (k < prev.entry.size()) ? prev.hwpc[k*n_events+i] : 0;
+						int64_t h1 = curr.hwpc[k*n_events+i];
+						fprintf(stdout, "  %9.3e", (double)(h1 - h0) * scale * r_time);
+					}
+					fprintf(stdout, "\n");
+				}
+			}
+			prev.time = curr.time;
+			prev.entry.swap(curr.entry);
+			prev.hwpc.swap(curr.hwpc);
+			has_prev = true;
+
+		} else {
+			fprintf(stderr, "\t<pm_series> unknown record type %d in %s\n", tag.type, file_name);
+			break;
+		}
+	}
+	fclose(fp);
+	return 0;
+}
+
+
+int main (int argc, char *argv[])
+{
+	const char* s_select = NULL;
+	int n_files = 0;
+	int iret = 0;
+
+	for (int i=1; i<argc; i++) {
+		if ((strcmp(argv[i], "-s") == 0) && (i+1 < argc)) {
+			s_select = argv[++i];
+			continue;
+		}
+		iret |= print_series(argv[i], s_select);
+		n_files++;
+	}
+	if (n_files == 0) {
+		fprintf(stderr, "usage: %s [-s label] pmlib_series_<rank>.pmts ...\n", argv[0]);
+		return 1;
+	}
+	return iret;
+}
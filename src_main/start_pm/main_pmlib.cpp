@@ -12,9 +12,18 @@ int my_id, npes, num_threads;
 
 PerfMonitor PM;
 
+//	shellpm_start [label]
+//	start the measuring section "label". The default label is "ShellPM".
+//	The sections accumulate over many start/stop pairs until shellpm_report.
+
 int main (int argc, char *argv[])
 {
 	int num_threads;
+	std::string s_label = "ShellPM";
+	if (argc > 1) s_label = argv[1];
+
+	//	If the ShellPM agent (shellpm_daemon) is running, just mark the beginning
+	if (PM.pm_daemon_send("begin " + s_label, NULL) == 0) return 0;
 
 #ifdef _OPENMP
 	char* c_env = std::getenv("OMP_NUM_THREADS");
@@ -30,11 +39,15 @@ int main (int argc, char *argv[])
 	num_threads  = 1;
 #endif
 
-	fprintf(stderr, "\t<ShellPM> starts. max_threads=%d\n", num_threads);
+	fprintf(stderr, "\t<ShellPM> starts [%s]. max_threads=%d\n", s_label.c_str(), num_threads);
+	char* c_hwpc = std::getenv("HWPC_CHOOSER");
+	if ((c_hwpc != NULL) && (std::string(c_hwpc) != "USER")) {
+		fprintf(stderr, "\t<ShellPM> HWPC of the shell workload is counted by the agent only. start shellpm_daemon & beforehand.\n");
+	}
 
 	PM.initialize();
-	PM.start("ShellPM");
+	(void) PM.load_pm_records();	// continue the sections of the previous invocations, if any
+	PM.start(s_label);
 	PM.save_pm_records();
 	return 0;
 }
-
@@ -9,15 +9,25 @@
 using namespace pm_lib;
 PerfMonitor PM;
 
+//	shellpm_stop [label]
+//	stop the measuring section "label". The default label is "ShellPM".
+//	The report is produced once by shellpm_report.
+
 int main (int argc, char *argv[])
 {
+	std::string s_label = "ShellPM";
+	if (argc > 1) s_label = argv[1];
+
+	//	If the ShellPM agent (shellpm_daemon) is running, just mark the end.
+	if (PM.pm_daemon_send("end " + s_label, NULL) == 0) return 0;
 
-	fprintf(stderr, "\t<ShellPM> stop and report\n");
+	fprintf(stderr, "\t<ShellPM> stops [%s]\n", s_label.c_str());
 	PM.initialize();
-	PM.start("ShellPM");
-	PM.load_pm_records();
-	PM.stop("ShellPM");
-	PM.report(stdout);
+	if (!PM.load_pm_records()) {
+		fprintf(stderr, "\t<ShellPM> no valid record. shellpm_start has not been called.\n");
+		return 1;
+	}
+	PM.stop(s_label);
+	PM.save_pm_records();
 	return 0;
 }
-
@@ -24,6 +24,7 @@
 
 #define HL_STOP		0
 #define HL_START	1
+#define HL_MAX_EVENTS	16	/* >= the events of one HWPC group in pmlib_papi.h */
 
 typedef struct _HighLevelInfo
 {
@@ -35,10 +36,23 @@ typedef struct _HighLevelInfo
 	long long last_real_time;		  /**< Previous value of real time */
 	long long last_proc_time;		  /**< Previous value of processor time */
 	long long total_ins;			    /**< Total instructions */
+	long long last_values[HL_MAX_EVENTS];	/**< counter values at the previous start/stop */
+	int attach_pid;					      /**< the EventSet counts the process tree of this pid. 0: self */
 } HighLevelInfo;
 
+//
+// The counters are started once per thread by my_papi_bind_start() and keep running.
+// Sections take PAPI_read() deltas, so that no counter is reprogrammed at section boundaries.
+// The HighLevelInfo pointer of the thread is cached in the compiler TLS,
+// since PAPI_get_thr_specific() is a table lookup on every call.
+//
+#if defined(USE_COMPILER_TLS)
+static __thread HighLevelInfo *my_tls_state = NULL;
+#endif
+
 void my_internal_cleanup_hl_info( HighLevelInfo * state );
 int my_internal_check_state( HighLevelInfo ** state );
+int my_internal_attach_state( HighLevelInfo * state );
 
 
 void print_state_HighLevelInfo(HighLevelInfo *state)
@@ -61,6 +75,10 @@ int my_papi_add_events ( int *events, int num_events)
 	if ( num_events == 0 ) {
 		return PAPI_OK;
 	}
+	if ( num_events > HL_MAX_EVENTS ) {
+		fprintf(stderr,"*** error. <my_papi_add_events> num_events=%d exceeds %d\n", num_events, HL_MAX_EVENTS);
+		return PAPI_EINVAL;
+	}
 	#ifdef DEBUG_PRINT_PAPI_EXT
 	fprintf(stderr,"\t <my_papi_add_events> num_events=%d\n", num_events);
 	for (i=0; i<num_events; i++){
@@ -88,6 +106,37 @@ int my_papi_add_events ( int *events, int num_events)
 }
 
 
+//
+// attach the EventSet of the calling thread to the process pid, with the inherit
+// option. The children forked by pid after this call are counted too, and their
+// counts are added to the EventSet when they exit. Must be called before
+// my_papi_add_events(). Used by ShellPM agent to count the job shell workload.
+//
+int my_papi_attach_inherit ( int pid )
+{
+	HighLevelInfo *state = NULL;
+	int retval;
+
+	if ( pid <= 0 ) {
+		return PAPI_OK;
+	}
+	#ifdef DEBUG_PRINT_PAPI_EXT
+	fprintf(stderr,"\t <my_papi_attach_inherit> pid=%d\n", pid);
+	#endif
+
+	if ( ( retval = my_internal_check_state( &state ) ) != PAPI_OK ) {
+		fprintf(stderr,"*** error. <my_papi_attach_inherit> :: <_check_state>\n");
+		return retval;
+	}
+	state->attach_pid = pid;
+	if ( ( retval = my_internal_attach_state( state ) ) != PAPI_OK ) {
+		state->attach_pid = 0;
+		return retval;
+	}
+	return PAPI_OK;
+}
+
+
 int my_papi_bind_start ( long long *values, int num_events)
 {
 	HighLevelInfo *state = NULL;
@@ -117,10 +166,19 @@ int my_papi_bind_start ( long long *values, int num_events)
 	}
 	state->running = HL_START;
 
+	if ( ( retval = PAPI_read( state->EventSet, state->last_values ) ) != PAPI_OK ) {
+		fprintf(stderr,"*** error. <my_papi_bind_start> :: <PAPI_read>\n");
+		return retval;
+	}
+
 	return PAPI_OK;
 }
 
 
+//
+// my_papi_bind_stop() is not called by PMlib sections, which read the running
+// counters with my_papi_bind_read(). It is kept for the external callers.
+//
 int my_papi_bind_stop ( long long *values, int num_events)
 {
 	HighLevelInfo *state = NULL;
@@ -137,14 +195,106 @@ int my_papi_bind_stop ( long long *values, int num_events)
 		fprintf(stderr,"*** error. <my_papi_bind_stop> :: <_check_state>\n");
 		return retval;
 	}
-	if ( ( retval = PAPI_stop( state->EventSet, values ) ) != PAPI_OK ) {
-		fprintf(stderr,"*** error. <my_papi_bind_stop> :: <PAPI_stop>\n");
+	if ( num_events > HL_MAX_EVENTS ) {
+		fprintf(stderr,"*** error. <my_papi_bind_stop> num_events=%d exceeds %d\n", num_events, HL_MAX_EVENTS);
+		return PAPI_EINVAL;
+	}
+
+	//	values[] returns the counts since the previous start/stop, as PAPI_stop() + PAPI_start() did.
+	//	The counters keep running.
+	long long now[HL_MAX_EVENTS];
+	int i;
+	if ( ( retval = PAPI_read( state->EventSet, now ) ) != PAPI_OK ) {
+		fprintf(stderr,"*** error. <my_papi_bind_stop> :: <PAPI_read>\n");
+		return retval;
+	}
+	for (i=0; i<num_events; i++) {
+		values[i] = now[i] - state->last_values[i];
+		state->last_values[i] = now[i];
+	}
+	return PAPI_OK;
+}
+
+
+//
+// returns 1 if the counters are read from user space with rdpmc instruction,
+// i.e. PAPI_read() does not make a system call. returns 0 otherwise.
+// The rdpmc read is provided by the perf_event component of PAPI on Linux x86.
+//
+int my_papi_fast_read ( void )
+{
+	const PAPI_component_info_t *cmpinfo;
+	int cid;
+
+	cid = PAPI_get_component_index("perf_event");
+	if ( cid < 0 ) return 0;
+	cmpinfo = PAPI_get_component_info(cid);
+	if ( cmpinfo == NULL ) return 0;
+	return ( cmpinfo->fast_counter_read ? 1 : 0 );
+}
+
+
+//
+// replace the events of the thread EventSet with the new events, for HWPC_CHOOSER=ROTATE.
+// The new counters are started, and the following reads count from this call.
+//
+int my_papi_switch_events ( int *events, int num_events)
+{
+	HighLevelInfo *state = NULL;
+	int retval;
+
+	#ifdef DEBUG_PRINT_PAPI_EXT
+	fprintf(stderr,"\t <my_papi_switch_events> num_events=%d\n", num_events);
+	#endif
+
+	if ( ( retval = my_internal_check_state( &state ) ) != PAPI_OK ) {
+		fprintf(stderr,"*** error. <my_papi_switch_events> :: <_check_state>\n");
+		return retval;
+	}
+	if ( num_events > HL_MAX_EVENTS ) {
+		fprintf(stderr,"*** error. <my_papi_switch_events> num_events=%d exceeds %d\n", num_events, HL_MAX_EVENTS);
+		return PAPI_EINVAL;
+	}
+	if ( state->running == HL_START ) {
+		if ( ( retval = PAPI_stop( state->EventSet, NULL ) ) != PAPI_OK ) {
+			fprintf(stderr,"*** error. <my_papi_switch_events> :: <PAPI_stop>\n");
+			return retval;
+		}
 		state->running = HL_STOP;
+	}
+	if ( ( retval = PAPI_cleanup_eventset( state->EventSet ) ) != PAPI_OK ) {
+		fprintf(stderr,"*** error. <my_papi_switch_events> :: <PAPI_cleanup_eventset>\n");
+		return retval;
+	}
+	if ( state->attach_pid > 0 ) {
+		//	The attached EventSet is created again, so that the attach and inherit options hold.
+		if ( ( retval = PAPI_destroy_eventset( &state->EventSet ) ) != PAPI_OK ) {
+			fprintf(stderr,"*** error. <my_papi_switch_events> :: <PAPI_destroy_eventset>\n");
+			return retval;
+		}
+		state->EventSet = PAPI_NULL;
+		if ( ( retval = PAPI_create_eventset( &state->EventSet ) ) != PAPI_OK ) {
+			fprintf(stderr,"*** error. <my_papi_switch_events> :: <PAPI_create_eventset>\n");
+			return retval;
+		}
+		if ( ( retval = my_internal_attach_state( state ) ) != PAPI_OK ) {
+			return retval;
+		}
+	}
+	if ( num_events == 0 ) {
+		return PAPI_OK;
+	}
+	if ( ( retval = PAPI_add_events( state->EventSet, events, num_events ) ) != PAPI_OK ) {
+		fprintf(stderr,"*** error. <my_papi_switch_events> :: <PAPI_add_events> num_events=%d\n", num_events);
 		return retval;
 	}
 	if ( ( retval = PAPI_start( state->EventSet ) ) != PAPI_OK ) {
-		fprintf(stderr,"*** error. <my_papi_bind_stop> :: <PAPI_start>\n");
-		state->running = HL_STOP;
+		fprintf(stderr,"*** error. <my_papi_switch_events> :: <PAPI_start>\n");
+		return retval;
+	}
+	state->running = HL_START;
+	if ( ( retval = PAPI_read( state->EventSet, state->last_values ) ) != PAPI_OK ) {
+		fprintf(stderr,"*** error. <my_papi_switch_events> :: <PAPI_read>\n");
 		return retval;
 	}
 	return PAPI_OK;
@@ -205,6 +355,13 @@ int my_internal_check_state( HighLevelInfo ** hlstate )
 	int retval;
 	int p_get;
 	HighLevelInfo *state = NULL;
+
+	#if defined(USE_COMPILER_TLS)
+	if ( my_tls_state != NULL ) {
+		*hlstate = my_tls_state;
+		return PAPI_OK;
+	}
+	#endif
 	//
 	//  Starting from PAPI 6.0, defined macro PAPI_HIGH_LEVEL_TLS is deleted from papi.h
 	//
@@ -227,10 +384,40 @@ int my_internal_check_state( HighLevelInfo ** hlstate )
 		if ( (retval = PAPI_set_thr_specific(PAPI_USR1_TLS, state)) != PAPI_OK )
 			return (retval);
 	}
+	#if defined(USE_COMPILER_TLS)
+	my_tls_state = state;
+	#endif
 	*hlstate = state;
 	return PAPI_OK;
 }
 
+int my_internal_attach_state( HighLevelInfo * state )
+{
+	int retval;
+	int cid;
+	PAPI_option_t opt;
+
+	//	the attach and inherit options require the component be assigned first
+	cid = PAPI_get_component_index("perf_event");
+	if ( cid < 0 ) cid = 0;
+	if ( ( retval = PAPI_assign_eventset_component( state->EventSet, cid ) ) != PAPI_OK ) {
+		fprintf(stderr,"*** error. <my_internal_attach_state> :: <PAPI_assign_eventset_component>\n");
+		return retval;
+	}
+	memset(&opt, 0, sizeof(opt));
+	opt.inherit.eventset = state->EventSet;
+	opt.inherit.inherit = PAPI_INHERIT_ALL;
+	if ( ( retval = PAPI_set_opt( PAPI_INHERIT, &opt ) ) != PAPI_OK ) {
+		fprintf(stderr,"*** error. <my_internal_attach_state> :: <PAPI_set_opt> PAPI_INHERIT\n");
+		return retval;
+	}
+	if ( ( retval = PAPI_attach( state->EventSet, (unsigned long) state->attach_pid ) ) != PAPI_OK ) {
+		fprintf(stderr,"*** error. <my_internal_attach_state> :: <PAPI_attach> pid=%d\n", state->attach_pid);
+		return retval;
+	}
+	return PAPI_OK;
+}
+
 void my_internal_cleanup_hl_info( HighLevelInfo * state )
 {
 	state->num_evts = 0;
@@ -259,6 +446,10 @@ void my_papi_internal_free()
 	my_internal_cleanup_hl_info( state );
 	PAPI_cleanup_eventset( state->EventSet );
 	free( state );
+	(void) PAPI_set_thr_specific(PAPI_USR1_TLS, NULL);
+	#if defined(USE_COMPILER_TLS)
+	my_tls_state = NULL;
+	#endif
 
 	return;
 }
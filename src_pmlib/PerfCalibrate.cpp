@@ -0,0 +1,190 @@
+/*
+###################################################################################
+#
+# PMlib - Performance Monitor Library
+#
+# Copyright (c) 2010-2011 VCAD System Research Program, RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2012-2020 Advanced Institute for Computational Science(AICS), RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2016-2020 Research Institute for Information Technology(RIIT), Kyushu University.
+# All rights reserved.
+#
+###################################################################################
+ */
+
+//! @file   PerfCalibrate.cpp
+//! @brief  PMLIB_OVERHEAD calibration of the cost of PMlib start/stop itself
+
+#include "PerfMonitor.h"
+#include <algorithm>
+
+
+namespace pm_lib {
+
+  extern struct pmlib_timer_chooser pm_timer;
+
+//
+//	PMLIB_OVERHEAD self calibration
+//
+//	PMLIB_OVERHEAD=OFF		: no calibration
+//	PMLIB_OVERHEAD=REPORT	: (default) the cost is measured and reported in the header
+//	PMLIB_OVERHEAD=SUBTRACT	: the cost is measured, reported, and the part of it
+//							  that falls inside the measured interval is subtracted
+//							  from every stop() of every section
+//
+//	Empty start/stop pairs are run on a scratch PerfWatch instance with the active
+//	HWPC_CHOOSER, POWER_CHOOSER and sampling configuration, in serial region and in
+//	parallel region. Two values are taken as the median of the batches.
+//	  pair : the wall clock time of one pair including the label lookup
+//	  bias : the time accumulated by the pair into m_time, i.e. the part of the
+//	         cost between the two getTime() calls, which inflates each section
+//	The scratch instance does not write OTF events and is not shown in the report.
+//
+
+  const int Pm_calib_batches = 11;		///< number of the batches. odd for the median
+  const int Pm_calib_pairs = 100;		///< number of start/stop pairs in a batch
+
+
+  /// 測定値の中央値. 配列は並べ替えられる
+  ///
+  static double calib_median(double* v, int n)
+  {
+	std::sort(v, v+n);
+	return v[n/2];
+  }
+
+
+  /// PMlib自身のstart/stopのコストを測定する
+  ///
+  ///   @note initialize() の最後に呼ばれる。
+  ///		Root区間は計測中なので、較正に要した時間はRoot区間に含まれる。
+  ///
+  void PerfMonitor::calibrateOverhead(void)
+  {
+	// If initialize() is called inside of parallel region, the master thread
+	// calibrates and the result is shared by all the threads.
+	#ifdef _OPENMP
+	bool in_parallel = omp_in_parallel();
+	if (in_parallel && (omp_get_thread_num() != 0)) return;
+	#endif
+
+	pm_timer.pair_serial = 0.0;
+	pm_timer.pair_parallel = 0.0;
+	pm_timer.bias_serial = 0.0;
+	pm_timer.bias_parallel = 0.0;
+	pm_timer.is_subtracted = false;
+
+// Parse the Environment Variable PMLIB_OVERHEAD
+	std::string s_chooser;
+	std::string s_default = "REPORT";
+	char* cp_env = std::getenv("PMLIB_OVERHEAD");
+	if (cp_env == NULL) {
+		s_chooser = s_default;
+	} else {
+		s_chooser = cp_env;
+		std::transform(s_chooser.begin(), s_chooser.end(), s_chooser.begin(), toupper);
+		if (s_chooser == "OFF" ||
+			s_chooser == "REPORT" ||
+			s_chooser == "SUBTRACT" ) {
+			;
+		} else {
+			printDiag("initialize()",  "unknown PMLIB_OVERHEAD value [%s]. the default value [%s] is set.\n", cp_env, s_default.c_str());
+			s_chooser = s_default;
+		}
+	}
+	if (s_chooser == "OFF") {
+		pm_timer.calibrate = 0;
+		return;
+	}
+	pm_timer.calibrate = (s_chooser == "SUBTRACT") ? 2 : 1;
+
+	const std::string label = m_watchArray[0].m_label;
+	double v_pair[Pm_calib_batches];
+	double v_bias[Pm_calib_batches];
+
+// serial region, or the master thread if initialize() is called in parallel region
+	{
+	PerfWatch w;
+	w.setProperties("PMlib overhead", -1, CALC, num_process, my_rank, num_threads, true);
+	w.level_OTF = 0;
+
+	for (int k=0; k<Pm_calib_batches; k++) {
+		double m0 = w.m_time;
+		double t0 = w.getTime();
+		for (int i=0; i<Pm_calib_pairs; i++) {
+			(void) find_section_object(label);
+			w.start();
+			#ifdef USE_POWER
+			if ((level_POWER != 0) && (power_interval == 0.0))
+			w.power_start( pm_pacntxt, pm_extcntxt, pm_obj_array, pm_obj_ext);
+			#endif
+			(void) find_section_object(label);
+			w.stop(0.0, 1);
+			#ifdef USE_POWER
+			if ((level_POWER != 0) && (power_interval == 0.0))
+			w.power_stop( pm_pacntxt, pm_extcntxt, pm_obj_array, pm_obj_ext);
+			#endif
+		}
+		v_pair[k] = (w.getTime() - t0) / (double)Pm_calib_pairs;
+		v_bias[k] = (w.m_time - m0) / (double)Pm_calib_pairs;
+	}
+	pm_timer.pair_serial = calib_median(v_pair, Pm_calib_batches);
+	pm_timer.bias_serial = calib_median(v_bias, Pm_calib_batches);
+	w.releaseThreadArrays();
+	}
+
+// parallel region. The slowest thread is taken.
+	pm_timer.pair_parallel = pm_timer.pair_serial;
+	pm_timer.bias_parallel = pm_timer.bias_serial;
+	#ifdef _OPENMP
+	if (!in_parallel) {
+	pm_timer.pair_parallel = 0.0;
+	pm_timer.bias_parallel = 0.0;
+	#pragma omp parallel
+	{
+	PerfWatch w;
+	w.setProperties("PMlib overhead", -1, CALC, num_process, my_rank, num_threads, true);
+	w.level_OTF = 0;
+
+	double t_pair[Pm_calib_batches];
+	double t_bias[Pm_calib_batches];
+	for (int k=0; k<Pm_calib_batches; k++) {
+		double m0 = w.m_time;
+		double t0 = w.getTime();
+		for (int i=0; i<Pm_calib_pairs; i++) {
+			(void) find_section_object(label);
+			w.start();
+			(void) find_section_object(label);
+			w.stop(0.0, 1);
+		}
+		t_pair[k] = (w.getTime() - t0) / (double)Pm_calib_pairs;
+		t_bias[k] = (w.m_time - m0) / (double)Pm_calib_pairs;
+	}
+	double pair = calib_median(t_pair, Pm_calib_batches);
+	double bias = calib_median(t_bias, Pm_calib_batches);
+	w.releaseThreadArrays();
+	#pragma omp critical
+	{
+	pm_timer.pair_parallel = std::max(pm_timer.pair_parallel, pair);
+	pm_timer.bias_parallel = std::max(pm_timer.bias_parallel, bias);
+	}
+	}
+	}
+	#endif
+
+	// the subtraction starts after the calibration
+	pm_timer.is_subtracted = (pm_timer.calibrate == 2);
+
+	#ifdef DEBUG_PRINT_MONITOR
+	if (my_rank == 0) {
+		fprintf(stderr, "<calibrateOverhead> PMLIB_OVERHEAD=%s, pair serial=%e parallel=%e, bias serial=%e parallel=%e \n",
+			s_chooser.c_str(), pm_timer.pair_serial, pm_timer.pair_parallel, pm_timer.bias_serial, pm_timer.bias_parallel);
+	}
+	#endif
+  }
+
+} /* namespace pm_lib */
+
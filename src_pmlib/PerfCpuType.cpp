@@ -24,6 +24,7 @@
 #include <string>
 #include <cstdlib>
 #include <cstdio>
+#include <climits>
 
 #ifdef DISABLE_MPI
 #include "mpi_stubs.h"
@@ -31,6 +32,7 @@
 #include <mpi.h>
 #endif
 #include <cmath>
+#include <algorithm>
 #include "PerfWatch.h"
 
 namespace pm_lib {
@@ -83,6 +85,12 @@ void PerfWatch::initializeHWPC ()
 		hwpc_group.index[i] = -999999;
 		}
 
+	hwpc_group.n_rotate = 0;
+	hwpc_group.i_rotate = 0;
+	hwpc_group.i_report = 0;
+	hwpc_group.read_index = 0;
+	hwpc_group.read_number = 0;
+
 	papi.num_events = 0;
 	for (int i=0; i<Max_chooser_events; i++){
 		papi.events[i] = 0;
@@ -90,13 +98,6 @@ void PerfWatch::initializeHWPC ()
 		papi.accumu[i] = 0;
 		papi.v_sorted[i] = 0;
 		}
-	for (int j=0; j<Max_nthreads; j++){
-	for (int i=0; i<Max_chooser_events; i++){
-			papi.th_values[j][i] = 0;
-			papi.th_accumu[j][i] = 0;
-			papi.th_v_sorted[j][i] = 0;
-		}
-		}
 	}
 
 // Parse the Environment Variable HWPC_CHOOSER
@@ -113,6 +114,8 @@ void PerfWatch::initializeHWPC ()
 			s_chooser == "CACHE" ||
 			s_chooser == "CYCLE" ||
 			s_chooser == "LOADSTORE" ||
+			s_chooser == "ROTATE" ||
+			s_chooser == "ROOFLINE" ||
 			s_chooser == "USER" ) {
 			;
 		} else {
@@ -121,9 +124,90 @@ void PerfWatch::initializeHWPC ()
 	}
 	hwpc_group.env_str_hwpc = s_chooser;
 
-	read_cpu_clock_freq(); /// API for reading processor clock frequency.
+// Parse the Environment Variable PMLIB_ROTATE
+//	HWPC_CHOOSER=ROTATE and ROOFLINE switch the counted group at the stop() calls in serial region,
+//	either every <N> calls, or after <T> seconds if the value is given as <T>s or <T>ms.
+	hwpc_group.rotate_calls = 0;
+	hwpc_group.rotate_slice = 0.1;
+	hwpc_group.rotate_count = 0;
+	cp_env = std::getenv("PMLIB_ROTATE");
+	if ((cp_env != NULL) && (hwpc_group.env_str_hwpc == "ROTATE" || hwpc_group.env_str_hwpc == "ROOFLINE")) {
+		char* cp_end;
+		double d_rotate = strtod(cp_env, &cp_end);
+		std::string s_unit = cp_end;
+		if ((cp_end == cp_env) || (d_rotate <= 0.0)) {
+			s_unit = "?";
+		}
+		if (s_unit.empty() && (d_rotate == floor(d_rotate)) && (d_rotate <= (double)INT_MAX)) {
+			hwpc_group.rotate_calls = (int)d_rotate;
+		} else if (s_unit == "s") {
+			hwpc_group.rotate_slice = d_rotate;
+		} else if (s_unit == "ms") {
+			hwpc_group.rotate_slice = d_rotate * 1.0e-3;
+		} else {
+			printError("initializeHWPC",  "PMLIB_ROTATE=%s is not valid. the default value [100ms] is set.\n", cp_env);
+		}
+	}
 
-	if (hwpc_group.env_str_hwpc == "USER" ) return;	// Is this a correct return? Yes!
+// Parse the Environment Variable PMLIB_SAMPLE
+//	HWPC is read at every PMLIB_SAMPLE-th call of start/stop pairs, and the
+//	counts of the skipped calls are extrapolated. The default 1 reads every call.
+	hwpc_group.sample_interval = 1;
+	cp_env = std::getenv("PMLIB_SAMPLE");
+	if (cp_env != NULL) {
+		char* cp_end;
+		long i_sample = strtol(cp_env, &cp_end, 10);
+		if ((cp_end != cp_env) && (*cp_end == '\0') && (1 <= i_sample) && (i_sample <= INT_MAX)) {
+			hwpc_group.sample_interval = (int)i_sample;
+		} else {
+			printError("initializeHWPC",  "PMLIB_SAMPLE=%s is not a positive integer. the default value [1] is set.\n", cp_env);
+		}
+	}
+
+// Parse the Environment Variable PMLIB_SERIAL_HWPC
+//	TEAM   : start/stop in serial region read HWPC of all the threads in a new parallel region.
+//	MASTER : start/stop in serial region read HWPC of the master thread only, without
+//		forking the thread team. suited to the serial sections not containing parallel region.
+	hwpc_group.serial_master_only = false;
+	cp_env = std::getenv("PMLIB_SERIAL_HWPC");
+	if (cp_env != NULL) {
+		std::string s_serial = cp_env;
+		if (s_serial == "MASTER") {
+			hwpc_group.serial_master_only = true;
+		} else if (s_serial != "TEAM") {
+			printError("initializeHWPC",  "PMLIB_SERIAL_HWPC=%s is not available. the default value [TEAM] is set.\n", cp_env);
+		}
+	}
+
+// Parse the Environment Variable PMLIB_HWPC_PID
+//	<pid> : the master thread counts HWPC of the process <pid> and of its children
+//		forked afterwards, instead of the calling thread. shellpm_daemon sets the job
+//		shell pid, so that the sections count the shell workload between start_pm/stop_pm.
+//		The serial sections read the master thread HWPC only, once the attach succeeds.
+	hwpc_group.attach_pid = 0;
+	cp_env = std::getenv("PMLIB_HWPC_PID");
+	if (cp_env != NULL) {
+		char* cp_end;
+		long i_pid = strtol(cp_env, &cp_end, 10);
+		if ((cp_end != cp_env) && (*cp_end == '\0') && (1 <= i_pid) && (i_pid <= INT_MAX)) {
+			hwpc_group.attach_pid = (int)i_pid;
+		} else {
+			printError("initializeHWPC",  "PMLIB_HWPC_PID=%s is not a process id. the calling process is counted.\n", cp_env);
+		}
+	}
+
+	initializeTimer(); /// select and calibrate the timer source
+	hwpc_group.rotate_time = getTime();
+
+	int max_threads = 1;
+	#ifdef _OPENMP
+	max_threads = omp_get_max_threads();
+	#endif
+
+	if (hwpc_group.env_str_hwpc == "USER" ) {
+		if (root_thread == 0) allocateThreadArrays (papi, max_threads);
+		return;	// Is this a correct return? Yes!
+	}
 
 #ifdef USE_PAPI
 	int i_papi;
@@ -145,6 +229,7 @@ void PerfWatch::initializeHWPC ()
 		}
 
 	createPapiCounterList ();
+	allocateThreadArrays (papi, max_threads);
 
 	#ifdef DEBUG_PRINT_PAPI
 	if (my_rank == 0 && root_thread == 0) {
@@ -161,14 +246,15 @@ void PerfWatch::initializeHWPC ()
 
 	if (root_in_parallel) {
 	int t_papi;
-	t_papi = my_papi_add_events (papi.events, papi.num_events);
+	if (root_thread == 0) attachHWPC();
+	t_papi = my_papi_add_events (papi.events + hwpc_group.read_index, hwpc_group.read_number);
 	if ( t_papi != PAPI_OK ) {
 		fprintf(stderr, "*** error. <initializeHWPC> <my_papi_add_events> code: %d\n"
 			"\n\t most likely un-supported HWPC PAPI combination.\n", t_papi);
 		papi.num_events = 0;
 		PM_Exit(0);
 		}
-	t_papi = my_papi_bind_start (papi.values, papi.num_events);
+	t_papi = my_papi_bind_start (papi.values, hwpc_group.read_number);
 	if ( t_papi != PAPI_OK ) {
 		fprintf(stderr, "*** error. <initializeHWPC> <my_papi_bind_start> code: %d\n", t_papi);
 		PM_Exit(0);
@@ -178,14 +264,15 @@ void PerfWatch::initializeHWPC ()
 	#pragma omp parallel
 	{
 	int t_papi;
-	t_papi = my_papi_add_events (papi.events, papi.num_events);
+	if (omp_get_thread_num() == 0) attachHWPC();
+	t_papi = my_papi_add_events (papi.events + hwpc_group.read_index, hwpc_group.read_number);
 	if ( t_papi != PAPI_OK ) {
 		fprintf(stderr, "*** error. <initializeHWPC> <my_papi_add_events> code: %d\n"
 			"\n\t most likely un-supported HWPC PAPI combination.\n", t_papi);
 		papi.num_events = 0;
 		PM_Exit(0);
 		}
-	t_papi = my_papi_bind_start (papi.values, papi.num_events);
+	t_papi = my_papi_bind_start (papi.values, hwpc_group.read_number);
 	if ( t_papi != PAPI_OK ) {
 		fprintf(stderr, "*** error. <initializeHWPC> <my_papi_bind_start> code: %d\n", t_papi);
 		PM_Exit(0);
@@ -197,6 +284,204 @@ void PerfWatch::initializeHWPC ()
 }
 
 
+  /// PMLIB_HWPC_PID で指定されたプロセスにマスタースレッドのHWPCを接続する
+  ///
+  ///   @note initializeHWPC() から、イベントの登録前にマスタースレッドが呼ぶ。
+  ///		接続できた場合のみ、逐次区間はマスタースレッドのHWPCを読み取る。
+  ///		接続できない場合は呼び出したスレッド自身を計測し、PMLIB_SERIAL_HWPC の指定に従う。
+  ///
+void PerfWatch::attachHWPC ()
+{
+#ifdef USE_PAPI
+	if (hwpc_group.attach_pid <= 0) return;
+	int t_papi = my_papi_attach_inherit (hwpc_group.attach_pid);
+	if ( t_papi != PAPI_OK ) {
+		printError("initializeHWPC",  "can not count the process %d, code: %d. the calling process is counted.\n"
+			"\t the process must be owned by the same user, and perf_event_paranoid must allow it.\n",
+			hwpc_group.attach_pid, t_papi);
+		hwpc_group.attach_pid = 0;
+		return;
+	}
+	//	the other threads do not follow the attached process tree
+	hwpc_group.serial_master_only = true;
+#endif
+}
+
+
+  /// allocate the thread arrays th_values, th_accumu, th_v_sorted of the chooser
+  ///
+  ///   @param[in,out] p    the chooser. p.num_events must have been set.
+  ///   @param[in] nthreads the number of thread rows
+  ///
+  /// @note
+  ///	The three arrays share one cache line aligned block of [3][nthreads][stride],
+  ///	where stride is max(num_events, 3) rounded up to the cache line size.
+  ///	The arrays are cleared. A new block is always allocated, since the
+  ///	chooser may have been copied from another one sharing the old block.
+  ///
+void PerfWatch::allocateThreadArrays (struct pmlib_papi_chooser& p, int nthreads)
+{
+	const int n_line = 64 / sizeof(long long);
+	int stride = std::max(p.num_events, 3);
+	stride = ((stride + n_line - 1) / n_line) * n_line;
+	if (nthreads < 1) nthreads = 1;
+
+	void* block = NULL;
+	size_t n_bytes = (size_t)3 * nthreads * stride * sizeof(long long);
+	if (posix_memalign(&block, 64, n_bytes) != 0) {
+		printError("allocateThreadArrays",  "memory allocation failed. %d threads %d events\n",
+			nthreads, p.num_events);
+		PM_Exit(0);
+	}
+	p.th_values.data = static_cast<long long*>(block);
+	p.th_accumu.data = p.th_values.data + (size_t)nthreads * stride;
+	p.th_v_sorted.data = reinterpret_cast<double*>(p.th_accumu.data + (size_t)nthreads * stride);
+	p.th_nthreads = nthreads;
+	p.th_values.stride = p.th_accumu.stride = p.th_v_sorted.stride = stride;
+
+	for (int j=0; j<p.th_nthreads; j++){
+	for (int i=0; i<p.th_values.stride; i++){
+		p.th_values[j][i] = 0;
+		p.th_accumu[j][i] = 0;
+		p.th_v_sorted[j][i] = 0.0;
+	}
+	}
+}
+
+
+  /// release the thread arrays allocated by setProperties()
+  ///
+  /// @note
+  ///	The block of allocateThreadArrays() and th_sampled of allocateSampledArray()
+  ///	are owned by this instance. The chooser template is not allocated with th_sampled.
+  ///	For the scratch instances that are not kept in m_watchArray.
+  ///
+void PerfWatch::releaseThreadArrays (void)
+{
+	if (!m_is_set) return;
+	free(my_papi.th_values.data);
+	free(my_papi.th_sampled.data);
+	my_papi.th_values.data = NULL;
+	my_papi.th_accumu.data = NULL;
+	my_papi.th_v_sorted.data = NULL;
+	my_papi.th_sampled.data = NULL;
+	my_papi.th_nthreads = 0;
+	m_rotated = false;
+	m_is_set = false;
+}
+
+
+  /// number of the HWPC groups counted in turn by HWPC_CHOOSER=ROTATE
+  ///
+  ///   @return 0 unless HWPC_CHOOSER=ROTATE
+  ///
+int PerfWatch::rotateGroups (void)
+{
+	return hwpc_group.n_rotate;
+}
+
+
+  /// select the HWPC group which is reported, sorted and gathered
+  ///
+  ///   @param[in] k   the rotated group number, 0 <= k < rotateGroups()
+  ///
+  /// @note hwpc_group.number[] and index[] are set for the selected group only,
+  ///	so that statsSwitch() and sortPapiCounterList() handle it as if the group
+  ///	were chosen by HWPC_CHOOSER.
+  ///
+void PerfWatch::selectReportGroup (int k)
+{
+	if ((k < 0) || (k >= hwpc_group.n_rotate)) return;
+	for (int i=0; i<Max_hwpc_output_group; i++) {
+		hwpc_group.number[i] = 0;
+		hwpc_group.index[i] = -999999;
+	}
+	int i_group = hwpc_group.rotate_group[k];
+	hwpc_group.number[i_group] = hwpc_group.rotate_number[k];
+	hwpc_group.index[i_group] = hwpc_group.rotate_index[k];
+	hwpc_group.i_report = k;
+}
+
+
+  /// check if the counted HWPC group should be rotated
+  ///
+  /// @note called by PerfMonitor::stop() in serial region.
+  ///	The stop time of this section is compared with the time slice.
+  ///
+bool PerfWatch::rotateDue (void)
+{
+	if (hwpc_group.n_rotate < 2) return false;
+	hwpc_group.rotate_count++;
+	if (hwpc_group.rotate_calls > 0) {
+		return (hwpc_group.rotate_count >= hwpc_group.rotate_calls);
+	}
+	return (m_stopTime - hwpc_group.rotate_time >= hwpc_group.rotate_slice);
+}
+
+
+  /// account the measured section with the counted group before rotateHWPC()
+  ///
+  /// @note the serial sections which are started and sampled are processed.
+  ///
+void PerfWatch::suspendRotatedHWPC (void)
+{
+	if (!m_rotated || !m_started || !m_sample_now || m_in_parallel) return;
+	stopSectionSerial(0.0, 0);
+	rotateAccount(getTime());
+}
+
+
+  /// restart measuring the section with the new group after rotateHWPC()
+  ///
+void PerfWatch::resumeRotatedHWPC (void)
+{
+	if (!m_rotated || !m_started || !m_sample_now || m_in_parallel) return;
+	startSectionSerial();
+	m_rot_mark = getTime();
+}
+
+
+  /// relative error [%] of the extrapolated HWPC values of the rotated group k
+  ///
+double PerfWatch::rotateError (int k)
+{
+	if ((k < 0) || (k >= hwpc_group.n_rotate)) return 0.0;
+	return m_rot_error[k];
+}
+
+
+  /// switch the counted HWPC group to the next one for all the threads
+  ///
+  /// @note must be called from serial region. The sections being measured
+  ///	must be suspended beforehand and resumed afterwards.
+  ///	See PerfMonitor::rotate_hwpc_group()
+  ///
+void PerfWatch::rotateHWPC (void)
+{
+#ifdef USE_PAPI
+	if (hwpc_group.n_rotate < 2) return;
+	int k = (hwpc_group.i_rotate + 1) % hwpc_group.n_rotate;
+	hwpc_group.i_rotate = k;
+	hwpc_group.read_index = hwpc_group.rotate_index[k];
+	hwpc_group.read_number = hwpc_group.rotate_number[k];
+
+	#pragma omp parallel
+	{
+	int t_papi;
+	t_papi = my_papi_switch_events (papi.events + hwpc_group.read_index, hwpc_group.read_number);
+	if ( t_papi != PAPI_OK ) {
+		fprintf(stderr, "*** error. <rotateHWPC> <my_papi_switch_events> code: %d, group %s\n",
+			t_papi, hwpc_group.rotate_name[k].c_str());
+		PM_Exit(0);
+		}
+	} // end of #pragma omp parallel
+
+	hwpc_group.rotate_count = 0;
+	hwpc_group.rotate_time = getTime();
+#endif
+}
+
+
   /// cleanup and free HWPC memory space for papi HighLevelInfo struct
   /// @note  this routine is called by PerfMonitor::stopRoot()
   ///
@@ -245,6 +530,7 @@ void PerfWatch::createPapiCounterList ()
 	int i_papi;
 
 // 1. Identify the CPU architecture
+	hwpc_group.coreBW = 0.0;
 
 	// Verified on the following platform
 	//	corot:	: Intel(R) Core(TM) i5-3470S CPU @ 2.90GHz	# Ivybridge	2012 model
@@ -336,16 +622,21 @@ void PerfWatch::createPapiCounterList ()
 			hwpc_group.coreGHz = 1.000;
 		}
 
+		//	coreBW is the nominal socket memory bandwidth divided by the number of cores
 		if (hwpc_group.i_platform == 1) {
 			hwpc_group.corePERF = hwpc_group.coreGHz * 1.0e9 * 1;
 		} else if (hwpc_group.i_platform == 2) {
 			hwpc_group.corePERF = hwpc_group.coreGHz * 1.0e9 * 8;
+			hwpc_group.coreBW = 51.2e9 / 8.0;	// 4ch DDR3-1600, 8 cores
 		} else if (hwpc_group.i_platform == 3) {
 			hwpc_group.corePERF = hwpc_group.coreGHz * 1.0e9 * 8;
+			hwpc_group.coreBW = 68.0e9 / 12.0;	// 4ch DDR4-2133, 12 cores
 		} else if (hwpc_group.i_platform == 4) {
 			hwpc_group.corePERF = hwpc_group.coreGHz * (2.7/3.0) * 1.0e9 * 16;
+			hwpc_group.coreBW = 76.8e9 / 18.0;	// 4ch DDR4-2400, 18 cores
 		} else if (hwpc_group.i_platform == 5) {
 			hwpc_group.corePERF = hwpc_group.coreGHz * (2.7/3.0) * 1.0e9 * 32;
+			hwpc_group.coreBW = 128.0e9 / 18.0;	// 6ch DDR4-2666, 18 cores
 		}
 	}
 
@@ -356,16 +647,19 @@ void PerfWatch::createPapiCounterList ()
 			hwpc_group.i_platform = 8;	// K computer
 			hwpc_group.coreGHz = 2.0;
 			hwpc_group.corePERF = hwpc_group.coreGHz * 1.0e9 * 8;
+			hwpc_group.coreBW = 64.0e9 / 8.0;
 		}
     	else if ( s_model_string.find( "IXfx" ) != string::npos ) {
 			hwpc_group.i_platform = 9;	// Fujitsu FX10
 			hwpc_group.coreGHz = 1.848;
 			hwpc_group.corePERF = hwpc_group.coreGHz * 1.0e9 * 8;
+			hwpc_group.coreBW = 85.0e9 / 16.0;
 		}
     	else if ( s_model_string.find( "XIfx" ) != string::npos ) {
 			hwpc_group.i_platform = 11;	// Fujitsu FX100
 			hwpc_group.coreGHz = 1.975;
 			hwpc_group.corePERF = hwpc_group.coreGHz * 1.0e9 * 16;
+			hwpc_group.coreBW = 480.0e9 / 32.0;
 		}
 	}
 
@@ -375,6 +669,7 @@ void PerfWatch::createPapiCounterList ()
 			hwpc_group.platform = "A64FX" ;
 			hwpc_group.coreGHz = 2.0;
 			hwpc_group.corePERF = hwpc_group.coreGHz * 1.0e9 * 32;
+			hwpc_group.coreBW = 1024.0e9 / 48.0;	// HBM2 4 stacks, 48 cores
 	}
 
 	// other ARM based processors
@@ -387,7 +682,11 @@ void PerfWatch::createPapiCounterList ()
 
     	if ( hwpc_group.i_platform == 21 ) {
 			// should have matched s_model_string.find( "A64FX" )
-			;
+			hwpc_group.platform = "A64FX" ;
+			hwpc_group.coreGHz = 2.0;
+			hwpc_group.corePERF = hwpc_group.coreGHz * 1.0e9 * 32;
+			hwpc_group.coreBW = 1024.0e9 / 48.0;
+			s_model_string = hwpc_group.platform ;
 		} else {
 			hwpc_group.i_platform = 98;
 			hwpc_group.platform = "unsupported_hardware";
@@ -408,7 +707,17 @@ void PerfWatch::createPapiCounterList ()
 
 
 // 3. Select the corresponding PAPI hardware counter events
+//	HWPC_CHOOSER=ROTATE selects all the groups, and concatenates their events.
+//	HWPC_CHOOSER=ROOFLINE selects FLOPS and BANDWIDTH groups in the same way.
 	int ip=0;
+	const char* s_rotate[] = { "FLOPS", "BANDWIDTH", "VECTOR", "CACHE", "CYCLE", "LOADSTORE" };
+	const char* s_group_name[Max_hwpc_output_group] = { "", "FLOPS", "VECTOR", "BANDWIDTH", "CACHE", "CYCLE", "LOADSTORE" };
+	const std::string s_multi = hwpc_group.env_str_hwpc;
+	int n_pass = 1;
+	if (s_multi == "ROTATE") n_pass = 6;
+	if (s_multi == "ROOFLINE") n_pass = 2;
+	for (int k_pass=0; k_pass<n_pass; k_pass++) {
+	if (n_pass > 1) hwpc_group.env_str_hwpc = s_rotate[k_pass];
 
 
 // if (FLOPS)
@@ -827,8 +1136,34 @@ void PerfWatch::createPapiCounterList ()
 	}
 
 
+	}	// end of for (k_pass) loop
+
 // total number of traced events by PMlib
 	papi.num_events = ip;
+	hwpc_group.read_index = 0;
+	hwpc_group.read_number = ip;
+
+	if (n_pass > 1) {
+		hwpc_group.env_str_hwpc = s_multi;
+		//	the groups are listed in the order of hwpc_output_group
+		for (int i=0; i<Max_hwpc_output_group; i++) {
+			if (hwpc_group.number[i] <= 0) continue;
+			int k = hwpc_group.n_rotate++;
+			hwpc_group.rotate_group[k] = i;
+			hwpc_group.rotate_index[k] = hwpc_group.index[i];
+			hwpc_group.rotate_number[k] = hwpc_group.number[i];
+			hwpc_group.rotate_name[k] = s_group_name[i];
+		}
+		if (hwpc_group.n_rotate == 0) {
+			printError("createPapiCounterList",  "HWPC_CHOOSER=%s found no HWPC group on this platform.\n", s_multi.c_str());
+		} else {
+			//	the first group is counted first, and is reported in the section table
+			hwpc_group.read_index = hwpc_group.rotate_index[0];
+			hwpc_group.read_number = hwpc_group.rotate_number[0];
+			selectReportGroup(0);
+		}
+		if (s_multi == "ROOFLINE") initializeRoofline();
+	}
 
 // end of hwpc_group selection
 
@@ -1588,17 +1923,42 @@ void PerfWatch::outputPapiCounterLegend (FILE* fp)
 	fprintf(fp, "\t\t In addition to detail report, produce the thread report which contains the HWPC event counts\n");
 	fprintf(fp, "\t\t and the performance for each of the OpenMP threads for all the processes.\n");
 	fprintf(fp, "\t\t The maximum number of threads is limited to the physical number of compute cores per CPU.\n");
+	fprintf(fp, "\t PMLIB_REPORT=IMBALANCE:\n");
+	fprintf(fp, "\t\t In addition to basic report, produce the load imbalance report of each section: the max/avg ratio,\n");
+	fprintf(fp, "\t\t the slowest process and thread, the time lost to the imbalance and the speedup if balanced.\n");
+	fprintf(fp, "\t\t PMLIB_IMBALANCE_TIMESTEP=<label> also shows the critical path process of each call of the section.\n");
 	fprintf(fp, "\n");
 	fprintf(fp, "\t The Section table shows the averaged value from all the processes.\n");
 	fprintf(fp, "\t The total time in the aggregate active sections row is taken from active PMlib elapse time.\n");
 	fprintf(fp, "\t Following annotation symbols are attached to the section lable if judged as so by PMlib.\n");
 	fprintf(fp, "\t (*) : The section is inclusive, i.e. the stats includes other sections inside of it.\n");
 	fprintf(fp, "\t       The section without (*) simbol is exclusive, which does not include other section.\n");
+	fprintf(fp, "\t (self) : The row following the (*) section shows its exclusive time, i.e. the inclusive time\n");
+	fprintf(fp, "\t       subtracted by the time of the sections nested directly inside of it.\n");
+#ifdef USE_PAPI
+	if (!hwpc_group.serial_master_only) {
+	fprintf(fp, "\t       The HWPC (self) row is not shown for a serial section which has (+) sections nested\n");
+	fprintf(fp, "\t       inside of it, since only the master thread counts of them are subtracted.\n");
+	}
+#endif
 	fprintf(fp, "\t (+) : The section is executed inside of OpenMP parallel region, which can overlap with\n");
 	fprintf(fp, "\t       other sections including itself.\n");
 	fprintf(fp, "\t       For this type of parallel construct, the execution time must be interpreted carefully\n");
 	fprintf(fp, "\t       based on the inclusive section stats for that parallel region, and on the thread report.\n");
 	fprintf(fp, "\t       The section without (+) is defined in serial region. It can start parallel region inside.\n");
+#ifdef USE_PAPI
+	if (hwpc_group.sample_interval > 1) {
+	fprintf(fp, "\t (s) : The HWPC values of the section are read once per PMLIB_SAMPLE=%d calls, and are\n",
+		hwpc_group.sample_interval);
+	fprintf(fp, "\t       extrapolated to all the calls by the ratio of the call counts.\n");
+	}
+	if (hwpc_group.n_rotate > 0) {
+	fprintf(fp, "\t err[%%] : HWPC_CHOOSER=%s counts the groups in turn. The HWPC values of each group are\n",
+		hwpc_group.env_str_hwpc.c_str());
+	fprintf(fp, "\t       extrapolated by the ratio of the section time to the time counted with the group.\n");
+	fprintf(fp, "\t       err[%%] is the estimated relative error of the extrapolation, the maximum of all the processes.\n");
+	}
+#endif
 	fprintf(fp, "\t The sections without any annotation symbols, i.e. exclusive and in serial region,\n");
 	fprintf(fp, "\t are suited to simply nested loop kernels often seen in HPC applications.\n");
 	fprintf(fp, "\n");
@@ -1619,6 +1979,8 @@ void PerfWatch::outputPapiCounterLegend (FILE* fp)
 	s_model_string = hwinfo->model_string;
 
 	fprintf(fp, "\t Detected CPU architecture: %s \n", s_model_string.c_str());
+	fprintf(fp, "\t HWPC counters are read %s.\n",
+		my_papi_fast_read() ? "with user space rdpmc instruction" : "through system call");
 	fprintf(fp, "\t The available HWPC_CHOOSER values and their HWPC events for this CPU are shown below.\n");
 	fprintf(fp, "\n");
 
@@ -1823,6 +2185,14 @@ void PerfWatch::outputPapiCounterLegend (FILE* fp)
 	}
 	fprintf(fp, "\t\t [Ins/cyc]: performed instructions per machine clock cycle\n");
 
+// ROOFLINE
+	fprintf(fp, "\t HWPC_CHOOSER=ROOFLINE:\n");
+	fprintf(fp, "\t\t FLOPS and BANDWIDTH groups are counted in turn, and the roofline report is added.\n");
+	fprintf(fp, "\t\t [AI[F/B]]:  arithmetic intensity. Total_FP over the memory traffic in bytes\n");
+	fprintf(fp, "\t\t [attainable]: min(peak, AI * bandwidth) with the ceilings of the process\n");
+	fprintf(fp, "\t\t [%%attain]:  performance over the attainable performance\n");
+	fprintf(fp, "\t\t bound:      memory if AI is below the ridge point peak/bandwidth, compute otherwise\n");
+
 // USER
 	fprintf(fp, "\t HWPC_CHOOSER=USER:\n");
 	fprintf(fp, "\t\t User provided argument values (Arithmetic Workload) are accumulated and reported.\n");
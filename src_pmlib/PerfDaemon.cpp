@@ -0,0 +1,234 @@
+#include "PerfMonitor.h"
+#include <unistd.h> // for getppid()
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <signal.h>
+#include <cerrno>
+#include <cstring>
+
+
+namespace pm_lib {
+
+//
+//	ShellPM daemon mode
+//
+//	A long-lived agent process keeps one initialized PerfMonitor object,
+//	while start_pm/stop_pm become thin clients sending a one line message
+//	through the Unix domain socket named by pm_daemon_socket_name().
+//
+//	message			: action taken by the agent
+//	"begin <label>"	: PM.start(label)
+//	"end <label>"	: PM.stop(label)
+//	"report"		: PM.report() written back to the client, then the agent exits.
+//					  the sections still active are stopped before the report.
+//	"quit"			: the agent exits without report
+//	"ping"			: no action. used to check if the agent is running
+//
+
+  static volatile sig_atomic_t pm_daemon_terminated = 0;
+
+  static void pm_daemon_signal_handler(int signum)
+  {
+	pm_daemon_terminated = 1;
+  }
+
+  void PerfMonitor::pm_daemon_socket_name(std::string& pm_socket_name)
+  {
+	std::string dir_name;
+	std::string file_name;
+	PerfMonitor::pm_storage_dir_name(dir_name);
+	PerfMonitor::pm_storage_file_name(file_name);
+
+	pm_socket_name = dir_name + "/" + file_name + ".sock";
+
+	#ifdef DEBUG_PRINT_MONITOR
+	fprintf(stderr, "<pm_daemon_socket_name> returns: %s\n", pm_socket_name.c_str());
+	#endif
+  }
+
+
+  /// send one message to the ShellPM agent
+  ///
+  ///   @param[in] message   the message line. see the table above.
+  ///   @param[in] fp_reply  the reply from the agent is copied to fp_reply, if not NULL
+  ///
+  ///   @return 0 : the message has been handled by the agent
+  ///   @return 1 : no agent is running. caller should behave as standalone command
+  ///   @return -1: the agent rejected the message or the connection failed
+  ///
+  ///   @note this routine does not require the PerfMonitor object to be initialized.
+  ///
+  int PerfMonitor::pm_daemon_send(const std::string& message, FILE* fp_reply)
+  {
+	std::string socket_name;
+	PerfMonitor::pm_daemon_socket_name(socket_name);
+
+	struct sockaddr_un addr;
+	if (socket_name.size() >= sizeof(addr.sun_path)) return 1;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, socket_name.c_str(), sizeof(addr.sun_path)-1);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) return 1;
+	if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+		// ENOENT or ECONNREFUSED : there is no agent listening
+		close(fd);
+		return 1;
+	}
+
+	std::string s_line = message + "\n";
+	if (write(fd, s_line.c_str(), s_line.size()) != (ssize_t)s_line.size()) {
+		fprintf(stderr, "*** ShellPM Error. <pm_daemon_send> write to %s failed errno=%d\n",
+			socket_name.c_str(), errno);
+		close(fd);
+		return -1;
+	}
+	shutdown(fd, SHUT_WR);
+
+	//	The reply is "ok\n", "error ...\n" or the report text
+	char buf[4096];
+	ssize_t n_read;
+	int iret = 0;
+	bool first_chunk = true;
+	while ((n_read = read(fd, buf, sizeof(buf))) != 0) {
+		if (n_read < 0) {
+			if (errno == EINTR) continue;
+			iret = -1;
+			break;
+		}
+		if (first_chunk && (n_read >= 5) && (strncmp(buf, "error", 5) == 0)) {
+			fprintf(stderr, "*** ShellPM Error. <pm_daemon_send> %.*s", (int)n_read, buf);
+			iret = -1;
+		} else if (fp_reply != NULL) {
+			fwrite(buf, 1, n_read, fp_reply);
+		}
+		first_chunk = false;
+	}
+	close(fd);
+	return iret;
+  }
+
+
+  /// run the ShellPM agent loop
+  ///
+  ///   @note PerfMonitor::initialize() must have been called. The loop returns
+  ///		when "report", "quit" or SIGTERM/SIGINT is received.
+  ///		The report is written to stdout in the case of SIGTERM/SIGINT.
+  ///
+  void PerfMonitor::pm_daemon_serve(void)
+  {
+    if (!is_PMlib_enabled) return;
+
+	std::string dir_name;
+	std::string socket_name;
+	PerfMonitor::pm_storage_dir_name(dir_name);
+	PerfMonitor::pm_daemon_socket_name(socket_name);
+	(void) mkdir(dir_name.c_str(), 0700);
+
+	struct sockaddr_un addr;
+	if (socket_name.size() >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "*** ShellPM Error. <pm_daemon_serve> socket path is too long: %s\n", socket_name.c_str());
+		exit(99);
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, socket_name.c_str(), sizeof(addr.sun_path)-1);
+
+	int fd_listen = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd_listen < 0) {
+		fprintf(stderr, "*** ShellPM Error. <pm_daemon_serve> socket() failed errno=%d\n", errno);
+		exit(99);
+	}
+	(void) unlink(socket_name.c_str());	// remove the stale socket left by a killed agent
+	if ((bind(fd_listen, (struct sockaddr*)&addr, sizeof(addr)) != 0) || (listen(fd_listen, 16) != 0)) {
+		fprintf(stderr, "*** ShellPM Error. <pm_daemon_serve> can not listen on %s errno=%d\n",
+			socket_name.c_str(), errno);
+		exit(99);
+	}
+
+	//	sa_flags=0, i.e. no SA_RESTART, so that accept() returns with EINTR
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = pm_daemon_signal_handler;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGTERM, &sa, NULL);
+	sigaction(SIGINT, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	#ifdef DEBUG_PRINT_MONITOR
+	fprintf(stderr, "<pm_daemon_serve> listening on %s\n", socket_name.c_str());
+	#endif
+
+	bool is_report = true;
+	FILE* fp_report = stdout;
+
+	while (!pm_daemon_terminated) {
+		int fd = accept(fd_listen, NULL, NULL);
+		if (fd < 0) {
+			if (errno == EINTR) continue;
+			fprintf(stderr, "*** ShellPM Error. <pm_daemon_serve> accept() failed errno=%d\n", errno);
+			break;
+		}
+
+		char buf[Pm_record_label_size + 16];
+		size_t n_done = 0;
+		ssize_t n_read;
+		while (n_done < sizeof(buf)-1) {
+			n_read = read(fd, buf + n_done, sizeof(buf)-1 - n_done);
+			if (n_read < 0 && errno == EINTR) continue;
+			if (n_read <= 0) break;
+			n_done += n_read;
+			if (memchr(buf, '\n', n_done) != NULL) break;
+		}
+		buf[n_done] = '\0';
+		char* p_nl = strchr(buf, '\n');
+		if (p_nl != NULL) *p_nl = '\0';
+
+		std::string s_line = buf;
+		std::string s_command = s_line.substr(0, s_line.find(' '));
+		std::string s_label;
+		if (s_line.find(' ') != std::string::npos) s_label = s_line.substr(s_line.find(' ')+1);
+
+		#ifdef DEBUG_PRINT_MONITOR
+		fprintf(stderr, "<pm_daemon_serve> received [%s]\n", s_line.c_str());
+		#endif
+
+		const char reply_ok[] = "ok\n";
+		if ((s_command == "begin") && !s_label.empty()) {
+			PerfMonitor::start(s_label);
+			(void) write(fd, reply_ok, sizeof(reply_ok)-1);
+		} else if ((s_command == "end") && !s_label.empty()) {
+			PerfMonitor::stop(s_label);
+			(void) write(fd, reply_ok, sizeof(reply_ok)-1);
+		} else if (s_command == "ping") {
+			(void) write(fd, reply_ok, sizeof(reply_ok)-1);
+		} else if (s_command == "report") {
+			fp_report = fdopen(fd, "w");
+			break;
+		} else if (s_command == "quit") {
+			(void) write(fd, reply_ok, sizeof(reply_ok)-1);
+			is_report = false;
+			close(fd);
+			break;
+		} else {
+			const char reply_error[] = "error unknown message\n";
+			(void) write(fd, reply_error, sizeof(reply_error)-1);
+		}
+		close(fd);
+	}
+
+	close(fd_listen);
+	(void) unlink(socket_name.c_str());
+
+	if (is_report) {
+		if (fp_report == NULL) fp_report = stdout;
+		PerfMonitor::stop_active_sections();
+		PerfMonitor::report(fp_report);
+		if (fp_report != stdout) fclose(fp_report);
+	}
+  }
+
+} /* namespace pm_lib */
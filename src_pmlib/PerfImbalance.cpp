@@ -0,0 +1,280 @@
+/*
+###################################################################################
+#
+# PMlib - Performance Monitor Library
+#
+# Copyright (c) 2010-2011 VCAD System Research Program, RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2012-2020 Advanced Institute for Computational Science(AICS), RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2016-2020 Research Institute for Information Technology(RIIT), Kyushu University.
+# All rights reserved.
+#
+###################################################################################
+ */
+
+//! @file   PerfImbalance.cpp
+//! @brief  PMLIB_REPORT=IMBALANCE load imbalance and critical path report
+
+#include "PerfMonitor.h"
+#include "pmlib_pmpi.h"
+#include <algorithm>
+#include <vector>
+
+namespace pm_lib {
+
+//
+//	PMLIB_REPORT=IMBALANCE
+//
+//	After the BASIC report, the section times of all the processes gathered
+//	in m_timeArray[] and the thread times th_v_sorted[thread][1] of the
+//	sections in parallel region are compared against their average:
+//		max/avg  : the slowest process (thread) against the average
+//		lost[%]  : (max - avg) / max, the time the others wait for the slowest
+//		speedup  : max / avg, the estimated speedup if the load is balanced
+//
+//	PMLIB_IMBALANCE_TIMESTEP=<label> also records the time of each call of
+//	the section, and the report shows which process was on the critical path
+//	of each iteration, i.e. the slowest process of the call.
+//
+
+  const int Pm_imbalance_top_ranks = 8;	///< processes listed by the critical path histogram
+  const int Pm_imbalance_max_runs = 40;	///< runs of the same critical process listed
+
+
+  /// PMLIB_IMBALANCE_TIMESTEP の区間の各呼び出しの時間
+  ///
+  struct pm_imbalance_steps
+  {
+	std::vector<double> time;
+  };
+
+
+  /// PMLIB_IMBALANCE_TIMESTEP を解析する
+  ///
+  ///   @note initialize() で PMLIB_REPORT の後に呼ばれる。
+  ///
+  void PerfMonitor::initializeImbalance(void)
+  {
+	imbalance_section = -1;
+	imbalance_steps = NULL;
+	imbalance_label = "";
+
+	char* cp_env = std::getenv("PMLIB_IMBALANCE_TIMESTEP");
+	if (cp_env == NULL) return;
+	if (env_str_report != "IMBALANCE") {
+		printDiag("initialize()",  "PMLIB_IMBALANCE_TIMESTEP=%s is ignored unless PMLIB_REPORT=IMBALANCE.\n", cp_env);
+		return;
+	}
+	imbalance_label = cp_env;
+	imbalance_steps = new pm_imbalance_steps;
+	imbalance_section = find_section_object(imbalance_label);
+  }
+
+
+  /// PMLIB_IMBALANCE_TIMESTEP の区間の今回の呼び出し時間を記録する
+  ///
+  ///   @param[in] id  区間番号
+  ///
+  ///   @note stop() から呼ばれる。並列領域ではマスタースレッドのみが記録する。
+  ///
+  void PerfMonitor::imbalance_step(int id)
+  {
+	#ifdef _OPENMP
+	if (omp_in_parallel() && (omp_get_thread_num() != 0)) return;
+	#endif
+	double t_start, t_stop;
+	m_watchArray[id].lastInterval(t_start, t_stop);
+	imbalance_steps->time.push_back(t_stop - t_start);
+  }
+
+
+  /// プロセス間の時間の最大値と平均値
+  ///
+  ///   @param[out] t_max  最も遅いプロセスの時間
+  ///   @param[out] t_avg  全プロセスの平均時間
+  ///   @param[out] r_max  最も遅いプロセスのランク番号
+  ///
+  void PerfWatch::imbalanceProcess(double& t_max, double& t_avg, int& r_max)
+  {
+	double t_sum = 0.0;
+	t_max = 0.0;
+	r_max = 0;
+	for (int r=0; r<num_process; r++) {
+		t_sum += m_timeArray[r];
+		if (m_timeArray[r] > t_max) { t_max = m_timeArray[r]; r_max = r; }
+	}
+	t_avg = t_sum / (double)num_process;
+  }
+
+
+  /// 負荷不均衡とクリティカルパスのレポートを出力する
+  ///
+  ///   @param[in] fp  出力ファイルポインタ
+  ///
+  ///   @note selectReport() から全プロセスが呼び出す。ランク0が出力する。
+  ///
+  void PerfMonitor::printImbalance(FILE* fp)
+  {
+	if (!is_PMlib_enabled) return;
+	if (m_nWatch == 0) return;
+	if (!is_rank_gathered) gather();
+
+	//	the thread times of the sections in parallel region
+	int n_th = std::max(1, num_threads);
+	int n_pack = m_nWatch * n_th;
+	std::vector<double> th_send(n_pack, 0.0);
+	for (int i=0; i<m_nWatch; i++) {
+		PerfWatch& w = m_watchArray[i];
+		if (!w.m_in_parallel) continue;
+		int n = std::min(n_th, w.my_papi.th_nthreads);
+		for (int j=0; j<n; j++) th_send[(size_t)i*n_th + j] = w.my_papi.th_v_sorted[j][1];
+	}
+	std::vector<double> th_recv;
+	if (my_rank == 0) th_recv.resize((size_t)n_pack * num_process);
+	if (num_process > 1) {
+		if (MPI_Gather(&th_send[0], n_pack, MPI_DOUBLE, (my_rank == 0) ? &th_recv[0] : NULL,
+			n_pack, MPI_DOUBLE, 0, MPI_COMM_WORLD) != MPI_SUCCESS) PM_Exit(0);
+	} else {
+		th_recv = th_send;
+	}
+
+	//	the calls of the timestep section. the processes may differ in the number of calls
+	long n_steps = 0;
+	std::vector<double> st_recv;
+	if (imbalance_steps != NULL) {
+		long n_local = (long)imbalance_steps->time.size();
+		n_steps = n_local;
+		if (num_process > 1) {
+			if (MPI_Allreduce(&n_local, &n_steps, 1, MPI_LONG, MPI_MIN, MPI_COMM_WORLD) != MPI_SUCCESS) PM_Exit(0);
+		}
+		if (n_steps > 0) {
+			if (my_rank == 0) st_recv.resize((size_t)n_steps * num_process);
+			if (num_process > 1) {
+				if (MPI_Gather(&imbalance_steps->time[0], (int)n_steps, MPI_DOUBLE, (my_rank == 0) ? &st_recv[0] : NULL,
+					(int)n_steps, MPI_DOUBLE, 0, MPI_COMM_WORLD) != MPI_SUCCESS) PM_Exit(0);
+			} else {
+				st_recv.assign(imbalance_steps->time.begin(), imbalance_steps->time.begin() + n_steps);
+			}
+		}
+	}
+
+	if (my_rank != 0) return;
+
+	int maxLabelLen = 7;
+	for (int i=1; i<m_nWatch; i++) {
+		PerfWatch& w = m_watchArray[i];
+		int labelLen = w.m_label.size() + (w.m_in_parallel ? 4 : 0);
+		maxLabelLen = std::max(maxLabelLen, labelLen);
+	}
+	maxLabelLen++;
+
+	fprintf(fp, "\n## PMlib Load Imbalance Report -------------------------------------------------\n\n");
+	fprintf(fp, "\tmax/avg : the slowest against the average of the processes, or of the threads which ran the section (+).\n");
+	fprintf(fp, "\t          it is also the estimated speedup of the section if the load is balanced.\n");
+	fprintf(fp, "\tlost[%%] : (max-avg)/max, the time the other processes wait for the slowest one.\n\n");
+
+	fprintf(fp, "%-*s|                   processes                     | threads (+)\n", maxLabelLen, "Section");
+	fprintf(fp, "%-*s|  max[sec]   avg[sec]  max/avg  slowest  lost[%%] | max/avg  slowest\n", maxLabelLen, "Label");
+	for (int i=0; i< maxLabelLen; i++) { fputc('-', fp); }
+	fprintf(fp, "+-------------------------------------------------+------------------\n");
+
+	for (int k=0; k<m_nWatch; k++) {
+		int i = m_order[k];
+		if (i == 0) continue;
+		PerfWatch& w = m_watchArray[i];
+		if (!(w.m_count_sum > 0)) continue;
+
+		double t_max, t_avg;
+		int r_max;
+		w.imbalanceProcess(t_max, t_avg, r_max);
+		std::string p_label = w.m_label;
+		if (w.m_in_parallel) p_label = p_label + " (+)";
+		fprintf(fp, "%-*s: %9.3e  %9.3e  %6.3f   %6d   %6.2f  ",
+			maxLabelLen, p_label.c_str(), t_max, t_avg,
+			(t_avg > 0.0) ? t_max / t_avg : 1.0, r_max,
+			(t_max > 0.0) ? 100.0 * (t_max - t_avg) / t_max : 0.0);
+
+		if (w.m_in_parallel) {
+			//	the threads which did not run the section, e.g. num_threads(2) of 8, are not averaged
+			double h_max = 0.0, h_sum = 0.0;
+			int r_h = 0, j_h = 0, n_ran = 0;
+			for (int r=0; r<num_process; r++) {
+			for (int j=0; j<n_th; j++) {
+				double t = th_recv[(size_t)r*n_pack + (size_t)i*n_th + j];
+				if (t <= 0.0) continue;
+				h_sum += t;
+				n_ran++;
+				if (t > h_max) { h_max = t; r_h = r; j_h = j; }
+			}
+			}
+			double h_avg = (n_ran > 0) ? h_sum / (double)n_ran : 0.0;
+			fprintf(fp, "| %6.3f  %d:%d\n", (h_avg > 0.0) ? h_max / h_avg : 1.0, r_h, j_h);
+		} else {
+			fprintf(fp, "|    -\n");
+		}
+	}
+	for (int i=0; i< maxLabelLen; i++) { fputc('-', fp); }
+	fprintf(fp, "+-------------------------------------------------+------------------\n");
+	fprintf(fp, "\tslowest shows the process rank, or rank:thread of the slowest thread.\n");
+
+	if (imbalance_steps == NULL) return;
+	fprintf(fp, "\n\tCritical path of the timestep section [%s] given by PMLIB_IMBALANCE_TIMESTEP\n", imbalance_label.c_str());
+	if (n_steps == 0) {
+		fprintf(fp, "\tThe section was not called by all the processes.\n");
+		return;
+	}
+
+	//	the slowest process of each iteration
+	std::vector<int> critical(n_steps);
+	std::vector<long> n_critical(num_process, 0);
+	double sum_max = 0.0, sum_avg = 0.0;
+	for (long s=0; s<n_steps; s++) {
+		double t_max = -1.0, t_sum = 0.0;
+		int r_max = 0;
+		for (int r=0; r<num_process; r++) {
+			double t = st_recv[(size_t)r*n_steps + s];
+			t_sum += t;
+			if (t > t_max) { t_max = t; r_max = r; }
+		}
+		critical[s] = r_max;
+		n_critical[r_max]++;
+		sum_max += t_max;
+		sum_avg += t_sum / (double)num_process;
+	}
+	fprintf(fp, "\t%ld iterations of %d processes. the iterations beyond the fewest calls of a process are not counted.\n",
+		n_steps, num_process);
+	fprintf(fp, "\tsum of the slowest process of each iteration : %9.3e [sec]\n", sum_max);
+	fprintf(fp, "\tsum of the average of each iteration         : %9.3e [sec]\n", sum_avg);
+	fprintf(fp, "\ttime lost to the imbalance                   : %6.2f [%%], estimated speedup if balanced : %6.3f\n\n",
+		(sum_max > 0.0) ? 100.0 * (sum_max - sum_avg) / sum_max : 0.0,
+		(sum_avg > 0.0) ? sum_max / sum_avg : 1.0);
+
+	std::vector<int> rank_order(num_process);
+	for (int r=0; r<num_process; r++) rank_order[r] = r;
+	std::stable_sort(rank_order.begin(), rank_order.end(), [&n_critical](int a, int b) { return n_critical[a] > n_critical[b]; });
+	fprintf(fp, "\t  rank  critical iterations    [%%]\n");
+	for (int k=0; k<std::min(num_process, Pm_imbalance_top_ranks); k++) {
+		int r = rank_order[k];
+		if (n_critical[r] == 0) break;
+		fprintf(fp, "\t%6d  %12ld       %6.2f\n", r, n_critical[r], 100.0 * (double)n_critical[r] / (double)n_steps);
+	}
+
+	fprintf(fp, "\n\t  iterations         critical rank\n");
+	int n_runs = 0;
+	long s_begin = 0;
+	for (long s=1; s<=n_steps; s++) {
+		if ((s < n_steps) && (critical[s] == critical[s_begin])) continue;
+		if (n_runs == Pm_imbalance_max_runs) {
+			fprintf(fp, "\t  ... the critical rank changes after iteration %ld are not listed.\n", s_begin);
+			break;
+		}
+		fprintf(fp, "\t  %8ld-%-8ld  %6d\n", s_begin, s-1, critical[s_begin]);
+		n_runs++;
+		s_begin = s;
+	}
+  }
+
+} /* namespace pm_lib */
@@ -21,15 +21,19 @@
 //	either <mpi.h> or "mpi_stubs.h" is included in PerfWatch.cpp
 
 #include "PerfMonitor.h"
+#include "pmlib_pmpi.h"
 #include <time.h>
 #include <unistd.h> // for gethostname() of FX10/K
 #include <cmath>
+#include <algorithm>
+#include <new>
+#include <stdint.h>
 #include "power_obj_menu.h"
+#include "pmlib_registry.h"
 
 namespace pm_lib {
 
-    /// shared map of section name and ID
-    std::map<std::string, int > shared_map_sections;
+    extern struct pmlib_timer_chooser pm_timer;
 
 
 
@@ -106,7 +110,20 @@ namespace pm_lib {
 	is_POWER_enabled = false;
 	#endif
 
-    #ifdef USE_OTF
+	is_rank_gathered = false;
+	is_node_comm_set = false;
+	m_nest_depth = 0;
+	is_nest_warned = false;
+	for (int i=0; i<Pm_label_cache_size; i++) {
+		m_label_cache[i].label = NULL;
+		m_label_cache[i].len = 0;
+		m_label_cache[i].id = -1;
+	}
+	is_hwpc_rotated = false;
+	is_async_active = false;
+	is_async_thread = false;
+
+    #if defined(USE_OTF) || defined(USE_OTF2)
     is_OTF_enabled = true;
     #else
     is_OTF_enabled = false;
@@ -128,7 +145,7 @@ namespace pm_lib {
     }
 
 // Parse the Environment Variable HWPC_CHOOSER
-	// If given, the value should be one of {FLOPS| BANDWIDTH| VECTOR| CACHE| CYCLE| LOADSTORE| USER}
+	// If given, the value should be one of {FLOPS| BANDWIDTH| VECTOR| CACHE| CYCLE| LOADSTORE| ROTATE| ROOFLINE| USER}
 	std::string s_chooser;
 	std::string s_default = "FLOPS";
 
@@ -144,6 +161,8 @@ namespace pm_lib {
 			s_chooser == "CACHE" ||
 			s_chooser == "CYCLE" ||
 			s_chooser == "LOADSTORE" ||
+			s_chooser == "ROTATE" ||
+			s_chooser == "ROOFLINE" ||
 			s_chooser == "USER" ) {
 			;
 		} else {
@@ -163,11 +182,16 @@ namespace pm_lib {
     std::string label;
     label="Root Section";
 
-	// objects created by "new" operator can be accessed using pointer, not name.
-    m_watchArray = new PerfWatch[init_nWatch];
+	// PerfWatch instances are placed in the cache line aligned slabs.
+    if (!m_watchArray.reserve(init_nWatch)) {
+        printDiag("initialize()", "memory allocation failed for %d sections.\n", init_nWatch);
+        is_PMlib_enabled = false;
+        return;
+    }
     m_nWatch = 0 ;
     m_order = NULL;
-	reserved_nWatch = init_nWatch;
+    m_order_size = 0;
+	reserved_nWatch = m_watchArray.capacity();
 
     m_watchArray[0].my_rank = my_rank;
     m_watchArray[0].num_process = num_process;
@@ -176,6 +200,7 @@ namespace pm_lib {
 
 // initialize HWPC interface structure
     m_watchArray[0].initializeHWPC();
+    is_hwpc_rotated = (m_watchArray[0].rotateGroups() > 1);
 
 // initialize Power API binding contexts
 	num_power = PerfMonitor::initializePOWER() ;
@@ -205,15 +230,31 @@ namespace pm_lib {
 // initialize OTF manager
     m_watchArray[0].initializeOTF();
 
+// start the power sampler thread, if PMLIB_POWER_SAMPLE is set
+    initializePowerSampler();
+
+// read the baseline power knobs, if PMLIB_POWER_TUNE is set
+    initializePowerTune();
+
+// accumulate the intercepted MPI calls, if libPMmpi_auto.a is linked
+    initializeMpiAuto();
+
 // start root section
     m_watchArray[0].start();
     is_Root_active = true;			// "Root Section" is now active
 
 // start power measurement
 	#ifdef USE_POWER
+	if (power_interval > 0.0) {
+    power_mark(0, true);
+	} else {
     m_watchArray[0].power_start( pm_pacntxt, pm_extcntxt, pm_obj_array, pm_obj_ext);
+	}
 	#endif
 
+// start the time series of the section accumulators, if PMLIB_SERIES is set
+    initializeSeries();
+
 
 // Parse the Environment Variable PMLIB_REPORT
 	//	std::string s_chooser;
@@ -227,7 +268,8 @@ namespace pm_lib {
 		s_chooser = cp_env;
 		if (s_chooser == "BASIC" ||
 			s_chooser == "DETAIL" ||
-			s_chooser == "FULL" ) {
+			s_chooser == "FULL" ||
+			s_chooser == "IMBALANCE" ) {
 			;
 		} else {
 			printDiag("initialize()",  "unknown PMLIB_REPORT value [%s]. the default value [%s] is set.\n", cp_env, s_default.c_str());
@@ -235,6 +277,26 @@ namespace pm_lib {
 		}
 	}
 	env_str_report = s_chooser;
+
+// the timestep section of PMLIB_REPORT=IMBALANCE, if PMLIB_IMBALANCE_TIMESTEP is set
+    initializeImbalance();
+
+// Parse the Environment Variable PMLIB_REPORT_FORMAT
+    env_str_format = "";
+	cp_env = std::getenv("PMLIB_REPORT_FORMAT");
+	if (cp_env != NULL) {
+		s_chooser = cp_env;
+		if (s_chooser == "JSON" || s_chooser == "json") {
+			env_str_format = "JSON";
+		} else if (s_chooser == "CSV" || s_chooser == "csv") {
+			env_str_format = "CSV";
+		} else {
+			printDiag("initialize()",  "unknown PMLIB_REPORT_FORMAT value [%s]. the structured report is not produced.\n", cp_env);
+		}
+	}
+
+// measure the cost of start/stop itself, if PMLIB_OVERHEAD is not OFF
+    calibrateOverhead();
   }
 
 
@@ -246,14 +308,14 @@ namespace pm_lib {
   ///   @param[in] exclusive 排他測定フラグ。bool型(省略時true)、
   ///                        Fortran仕様は整数型(0:false, 1:true)
   ///
-  void PerfMonitor::setProperties(const std::string& label, Type type, bool exclusive)
+  int PerfMonitor::setProperties(const std::string& label, Type type, bool exclusive)
   {
 
-    if (!is_PMlib_enabled) return;
+    if (!is_PMlib_enabled) return(-1);
 
     if (label.empty()) {
       printDiag("setProperties()",  "label is blank. Ignoring this call.\n");
-      return;
+      return(-1);
     }
 
 	#ifdef _OPENMP
@@ -278,40 +340,43 @@ namespace pm_lib {
     	#ifdef DEBUG_PRINT_MONITOR
 		fprintf(stderr, "<PerfMonitor::setProperties> [%s] section id=%d exists. my_rank=%d, my_thread=%d \n", label.c_str(), id, my_rank, my_thread);
 		#endif
+		//	Only update the properties. The section must not be counted twice.
+    	m_watchArray[id].setProperties(label, id, type, num_process, my_rank, num_threads, exclusive);
+		return id;
 	}
 
 //
-// If short of memory, allocate new space
-//	and move the existing PerfWatch class storage into the new address
+// If short of memory, allocate more slabs.
+//	The existing PerfWatch class storage is not moved.
+//	The sampler threads of PMLIB_SERIES and PMLIB_POWER_SAMPLE must not see
+//	the slab table being replaced.
 //
+    if (is_series_thread) pthread_mutex_lock(&series_lock);
+    if (is_power_thread) pthread_mutex_lock(&power_lock);
     if ((m_nWatch+1) >= reserved_nWatch) {
 
-      reserved_nWatch = m_nWatch + init_nWatch;
-      PerfWatch* watch_more = new PerfWatch[reserved_nWatch];
-      if (watch_more == NULL) {
+      if (!m_watchArray.reserve(m_nWatch + init_nWatch)) {
         printDiag("setProperties()", "memory allocation failed. [%s] is not added.\n", label.c_str());
-        reserved_nWatch = m_nWatch;
-        return;
+        if (is_power_thread) pthread_mutex_unlock(&power_lock);
+        if (is_series_thread) pthread_mutex_unlock(&series_lock);
+        return(-1);
       }
-
-      for (int i = 0; i < m_nWatch; i++) {
-          watch_more[i] = m_watchArray[i];
-      }
-
-      delete [] m_watchArray;
-      m_watchArray = NULL;
-      m_watchArray = watch_more;
-      watch_more = NULL;
+      reserved_nWatch = m_watchArray.capacity();
       #ifdef DEBUG_PRINT_MONITOR
 		fprintf(stderr, "\t<PerfMonitor::setProperties> allocated new memory. reserved_nWatch is now %d.  my_rank=%d, my_thread=%d \n",
 			reserved_nWatch, my_rank, my_thread);
       #endif
     }
 
-    is_exclusive_construct = exclusive;
     m_nWatch++;
     m_watchArray[id].setProperties(label, id, type, num_process, my_rank, num_threads, exclusive);
+    if (is_power_thread) pthread_mutex_unlock(&power_lock);
+    if (is_series_thread) pthread_mutex_unlock(&series_lock);
 
+    if ((series_mode == Series_calls) && (label == series_label)) series_section = id;
+    if (power_tuner != NULL) power_tune_register(id, label);
+    if (label == imbalance_label) imbalance_section = id;
+    return id;
   }
 
 
@@ -418,9 +483,8 @@ namespace pm_lib {
     id = find_section_object(label);
     if (id < 0) {
       // Create and set the property for this section
-      PerfMonitor::setProperties(label);
-
-      id = find_section_object(label);
+      id = PerfMonitor::setProperties(label);
+      if (id < 0) return;
       #ifdef DEBUG_PRINT_MONITOR
 		fprintf(stderr, "\tdebug <start> [%s] id is created and property is set. id=%d my_thread=%d \n", label.c_str(), id, my_thread);
       #endif
@@ -430,12 +494,36 @@ namespace pm_lib {
       #endif
 	}
 
-    is_exclusive_construct = true;
+    PerfMonitor::start(id);
+  }
+
+
+  /// 測定区間スタート, overload version using the section ID
+  ///
+  ///   @param[in] id 区間番号。setProperties()の返り値
+  ///
+  void PerfMonitor::start (int id)
+  {
+    if (!is_PMlib_enabled) return;
+
+    if ((id <= 0) || (id >= m_nWatch)) {
+      printDiag("start()",  "section ID %d is out of range. Ignored the call.\n", id);
+      return;
+    }
 
+	#ifdef USE_POWER
+	if (power_tuner != NULL) power_tune_start(id);
+	#endif
     m_watchArray[id].start();
+    push_nest_frame(id);
 	#ifdef USE_POWER
-	if (level_POWER != 0)
+	if (level_POWER != 0) {
+	if (power_interval > 0.0) {
+    power_mark(id, true);
+	} else {
     m_watchArray[id].power_start( pm_pacntxt, pm_extcntxt, pm_obj_array, pm_obj_ext);
+	}
+	}
 	#endif
 
   }
@@ -468,17 +556,135 @@ namespace pm_lib {
 				label.c_str());
       return;
     }
+    PerfMonitor::stop(id, flopPerTask, iterationCount);
+  }
+
+
+  /// 測定区間ストップ, overload version using the section ID
+  ///
+  ///   @param[in] id 区間番号。setProperties()の返り値
+  ///   @param[in] flopPerTask 測定区間の計算量(演算量Flopまたは通信量Byte):省略値0
+  ///   @param[in] iterationCount  計算量の乗数（反復回数）:省略値1
+  ///
+  void PerfMonitor::stop(int id, double flopPerTask, unsigned iterationCount)
+  {
+    if (!is_PMlib_enabled) return;
+
+    if ((id <= 0) || (id >= m_nWatch)) {
+      printDiag("stop()",  "section ID %d is out of range. Ignored the call.\n", id);
+      return;
+    }
     m_watchArray[id].stop(flopPerTask, iterationCount);
 	#ifdef USE_POWER
-	if (level_POWER != 0)
+	if (level_POWER != 0) {
+	if (power_interval > 0.0) {
+    power_mark(id, false);
+	} else {
     m_watchArray[id].power_stop( pm_pacntxt, pm_extcntxt, pm_obj_array, pm_obj_ext);
+	}
+	}
+	if (power_tuner != NULL) power_tune_stop(id);
 	#endif
 
-    if (!is_exclusive_construct) {
-      m_watchArray[id].m_exclusive = false;
+    pop_nest_frame(id);
+
+    //	HWPC_CHOOSER=ROTATE switches the group at the section boundary in serial region
+    if (is_hwpc_rotated && !m_watchArray[id].m_in_parallel && m_watchArray[id].rotateDue()) {
+      rotate_hwpc_group();
     }
-    is_exclusive_construct = false;
 
+    //	PMLIB_SERIES=<N> takes a snapshot at every N-th call of PMLIB_SERIES_SECTION
+    if ((id == series_section) && (++series_calls >= series_interval)) {
+      series_calls = 0;
+      series_snapshot();
+    }
+
+    //	PMLIB_IMBALANCE_TIMESTEP records each call of the timestep section
+    if (id == imbalance_section) imbalance_step(id);
+  }
+
+
+  /// HWPC_CHOOSER=ROTATE で計測するHWPCグループを次のグループに切り替える
+  ///
+  void PerfMonitor::rotate_hwpc_group(void)
+  {
+	#ifdef _OPENMP
+	if (omp_in_parallel()) return;
+	#endif
+    for (int i=0; i<m_nWatch; i++) {
+      m_watchArray[i].suspendRotatedHWPC();
+    }
+    m_watchArray[0].rotateHWPC();
+    for (int i=0; i<m_nWatch; i++) {
+      m_watchArray[i].resumeRotatedHWPC();
+    }
+  }
+
+
+  /// 区間スタックを積む
+  ///
+  ///   @param[in] id 開始した区間番号
+  ///
+  void PerfMonitor::push_nest_frame(int id)
+  {
+    if (m_nest_depth < Pm_max_nest_depth) {
+      pm_nest_frame& f = m_nest_stack[m_nest_depth];
+      f.id = id;
+      f.has_child = false;
+      f.time_child = 0.0;
+      for (int i=0; i<m_watchArray[0].num_child_events(); i++) f.hwpc_child[i] = 0;
+    }
+    m_nest_depth++;
+  }
+
+
+  /// 区間スタックを降ろし、区間の測定値を親区間の子区間分として加算する
+  ///
+  ///   @param[in] id 終了した区間番号
+  ///
+  ///   @note 区間が他の区間を含む場合、その区間は非排他(inclusive)となる。
+  ///		スタックの先頭以外の区間がstopされた場合(交差した区間)は、
+  ///		その区間をスタックから取り除き、内側の区間は外側の区間の子として扱う。
+  ///
+  void PerfMonitor::pop_nest_frame(int id)
+  {
+    if (m_nest_depth <= 0) return;		// stop() without start()
+    if (m_nest_depth > Pm_max_nest_depth) {
+      m_nest_depth--;					// not recorded
+      return;
+    }
+
+    int k = m_nest_depth - 1;
+    while ((k >= 0) && (m_nest_stack[k].id != id)) k--;
+    if (k < 0) return;					// the section was not started by this thread
+    if ((k != m_nest_depth - 1) && !is_nest_warned) {
+      printDiag("stop()",  "[%s] is stopped while [%s] is active. The sections are not nested.\n",
+        m_watchArray[id].m_label.c_str(), m_watchArray[m_nest_stack[m_nest_depth-1].id].m_label.c_str());
+      is_nest_warned = true;
+    }
+
+    PerfWatch& w = m_watchArray[id];
+    pm_nest_frame& f = m_nest_stack[k];
+    if (f.has_child) {
+      w.m_exclusive = false;
+      w.addChildDelta(f.time_child, f.hwpc_child);
+    }
+
+    double t;
+    long long hwpc[Max_group_events];
+    if (k > 0) {
+      pm_nest_frame& parent = m_nest_stack[k-1];
+      w.lastDelta(t, hwpc);
+      if (w.m_in_parallel) m_watchArray[parent.id].m_child_in_parallel = true;
+      parent.has_child = true;
+      parent.time_child += t;
+      for (int i=0; i<w.num_child_events(); i++) parent.hwpc_child[i] += hwpc[i];
+    }
+
+    for (int j=k; j<m_nest_depth-1; j++) {
+      m_nest_stack[j] = m_nest_stack[j+1];
+    }
+    m_nest_depth--;
   }
 
 
@@ -512,6 +718,30 @@ namespace pm_lib {
   }
 
 
+  /// 測定区間のHWPCサンプリング間隔を設定する
+  ///
+  ///   @param[in] label ラベル文字列
+  ///   @param[in] interval  HWPCを読み取る呼び出し間隔
+  ///
+  void PerfMonitor::setSampleInterval (const std::string& label, int interval)
+  {
+    if (!is_PMlib_enabled) return;
+
+    int id;
+    if (label.empty()) {
+      printDiag("setSampleInterval()",  "label is blank. Ignored the call.\n");
+      return;
+    }
+    id = find_section_object(label);
+    if (id < 0) {
+      printDiag("setSampleInterval()",  "label [%s] is undefined. Ignored the call.\n",
+				label.c_str());
+      return;
+    }
+    m_watchArray[id].setSampleInterval(interval);
+  }
+
+
   /// 全測定区間リセット
   /// ただしroot区間はresetされない
   ///
@@ -563,7 +793,13 @@ namespace pm_lib {
     if (is_Root_active) {
     	m_watchArray[0].stop(0.0, 1);
 
-    	m_watchArray[0].power_stop( pm_pacntxt, pm_extcntxt, pm_obj_array, pm_obj_ext );
+    	if (power_interval > 0.0) {
+    		power_mark(0, false);
+    	} else {
+    		m_watchArray[0].power_stop( pm_pacntxt, pm_extcntxt, pm_obj_array, pm_obj_ext );
+    	}
+    	finalizePowerSampler();
+    	finalizePowerTune();
     	(void) finalizePOWER();
 
     	m_watchArray[0].cleanupHWPC();
@@ -584,7 +820,7 @@ namespace pm_lib {
 	std::string p_label;
 	int id;
 
-	n_shared_sections = shared_map_sections.size();	// this is the shared value for all threads
+	n_shared_sections = shared_section_count();	// this is the shared value for all threads
 
 	#ifdef DEBUG_PRINT_MONITOR
     //	if (my_rank == 0) {
@@ -597,9 +833,10 @@ namespace pm_lib {
 	if (n_shared_sections == m_nWatch) return; // The master thread contains all the shared sections
 
 	// Add the missing section object instances in the master thread
-	std::map<std::string, int>::const_iterator it;
-	for(it = shared_map_sections.begin(); it != shared_map_sections.end(); ++it) {
-		p_label = it->first;
+	for (int i=0; i<n_shared_sections; i++) {
+		const std::string* p_shared = shared_section_label(i);
+		if (p_shared == NULL) continue;
+		p_label = *p_shared;
 		if ( find_section_object(p_label) >= 0)  continue;
 		PerfMonitor::setProperties(p_label);
 		id = find_section_object(p_label);
@@ -637,7 +874,7 @@ namespace pm_lib {
 
     if (!is_PMlib_enabled) return;
 
-	int n_shared_sections = shared_map_sections.size();
+	int n_shared_sections = shared_section_count();
 
     if ((id<0) || (n_shared_sections<=id)) {
 		fprintf(stderr, "*** PMlib internal Error <SerialParallelRegion> section id=%d is out of range\n", id);
@@ -648,13 +885,10 @@ namespace pm_lib {
 	std::string s;
 
 	mid=-1;
-	for (auto it=shared_map_sections.begin(); it != shared_map_sections.end(); ++it)
-	{
-    	if (it->second == id) {
-			s = it->first;
-			mid = find_section_object(s);
-			break;
-		}
+	const std::string* p_shared = shared_section_label(id);
+	if (p_shared != NULL) {
+		s = *p_shared;
+		mid = find_section_object(s);
 	}
 	if ( (mid<0) || (mid>=n_shared_sections) ) {
 		// Well, this class instance does not contain the section labeled "s".
@@ -700,15 +934,12 @@ namespace pm_lib {
 	std::string s;
 
 	// identify the section label for id
-	for (auto it=shared_map_sections.begin(); it != shared_map_sections.end(); ++it)
-	{
-    	if (it->second == id) {
-			s = it->first;
-			// search for section id in local thread
-			// if found, mid returns the local section id. if not, mid=-1.
-			mid = find_section_object(s);
-			break;
-		}
+	const std::string* p_shared = shared_section_label(id);
+	if (p_shared != NULL) {
+		s = *p_shared;
+		// search for section id in local thread
+		// if found, mid returns the local section id. if not, mid=-1.
+		mid = find_section_object(s);
 	}
 
 	#ifdef DEBUG_PRINT_MONITOR
@@ -777,28 +1008,228 @@ namespace pm_lib {
 
     if (m_nWatch == 0) return; // There is no section defined yet. This is basically an error case.
 
+    mpi_auto_fold();
+
     // For each of the sections,
-	// allgather the HWPC event values of all processes in MPI_COMM_WORLD.
-	// Calibrate some numbers to represent the process value as the sum of thread values
+	// calibrate some numbers to represent the process value as the sum of thread values
 
     for (int i=0; i<m_nWatch; i++) {
       m_watchArray[i].gatherHWPC();
     }
 
-	//   Allgather the process level basic statistics of m_time, m_flop, m_count
+	//	Pack m_time, m_flop, m_count and the HWPC values of all the sections into one buffer
+	//	and gather them to rank 0 with a single collective.
+	int* p_offset = new int[m_nWatch+1];
+	p_offset[0] = 0;
     for (int i = 0; i < m_nWatch; i++) {
-        m_watchArray[i].gather();
+      p_offset[i+1] = p_offset[i] + m_watchArray[i].gatherPackSize();
     }
+	int n_pack = p_offset[m_nWatch];
 
-    //	summary stats including the average, standard deviation, etc.
+	double* p_send = new double[n_pack];
     for (int i = 0; i < m_nWatch; i++) {
-      m_watchArray[i].statsAverage();
+      m_watchArray[i].gatherPack(p_send + p_offset[i]);
     }
 
+	double* p_recv = p_send;
+	if (num_process > 1) {
+		if (my_rank == 0) p_recv = new double[(size_t)n_pack * num_process];
+		if (MPI_Gather(p_send, n_pack, MPI_DOUBLE, p_recv, n_pack, MPI_DOUBLE, 0, MPI_COMM_WORLD) != MPI_SUCCESS) PM_Exit(0);
+	}
+
+    //	summary stats including the average, standard deviation, etc. are computed by rank 0,
+    //	and are broadcasted to all ranks with a single collective.
+	if (my_rank == 0) {
+    	for (int i = 0; i < m_nWatch; i++) {
+			m_watchArray[i].gatherUnpack(p_recv, n_pack, p_offset[i]);
+			m_watchArray[i].statsAverage();
+		}
+	}
+	reduce_self_stats();
+	bcast_stats();
+	is_rank_gathered = true;
+
+	if (p_recv != p_send) delete [] p_recv;
+	delete [] p_send;
+	delete [] p_offset;
+
+	//  summary stats of the estimated power consumption. Only the Root section does this.
+	if (level_POWER != 0)
+    m_watchArray[0].gatherPOWER();
+
+  }
+
+
+  /// ランク0が計算した統計量を全プロセスに配布する
+  ///
+  void PerfMonitor::bcast_stats(void)
+  {
+	if (num_process <= 1) return;
+
+	double* p_stats = new double[(size_t)m_nWatch * Pm_stats_pack_size];
+	if (my_rank == 0) {
+    	for (int i = 0; i < m_nWatch; i++) {
+			m_watchArray[i].statsPack(p_stats + (size_t)i*Pm_stats_pack_size);
+		}
+	}
+	if (MPI_Bcast(p_stats, m_nWatch * Pm_stats_pack_size, MPI_DOUBLE, 0, MPI_COMM_WORLD) != MPI_SUCCESS) PM_Exit(0);
+	if (my_rank != 0) {
+    	for (int i = 0; i < m_nWatch; i++) {
+			m_watchArray[i].statsUnpack(p_stats + (size_t)i*Pm_stats_pack_size);
+		}
+	}
+	delete [] p_stats;
+  }
+
+
+  /// 入れ子区間を除いた排他時間・HWPC値のプロセス平均をランク0に集約する
+  ///
+  ///   @note  gatherHWPC() の後に呼び出す。平均値はランク0のみが保持する。
+  ///
+  void PerfMonitor::reduce_self_stats(void)
+  {
+	int n_hwpc = 0;
+    for (int i = 0; i < m_nWatch; i++) {
+		n_hwpc = std::max(n_hwpc, m_watchArray[i].gatherPackSize() - 3);
+	}
+	int n_rec = 1 + n_hwpc;
+
+	double* p_self = new double[(size_t)m_nWatch * n_rec];
+    for (int i = 0; i < m_nWatch; i++) {
+		m_watchArray[i].selfPack(p_self + (size_t)i*n_rec, n_hwpc);
+	}
+	double* p_sum = p_self;
+	if (num_process > 1) {
+		if (my_rank == 0) p_sum = new double[(size_t)m_nWatch * n_rec];
+		if (MPI_Reduce(p_self, p_sum, m_nWatch * n_rec, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD) != MPI_SUCCESS) PM_Exit(0);
+	}
+	if (my_rank == 0) {
+    	for (int i = 0; i < m_nWatch; i++) {
+			m_watchArray[i].selfUnpack(p_sum + (size_t)i*n_rec, n_hwpc);
+		}
+	}
+	if (p_sum != p_self) delete [] p_sum;
+	delete [] p_self;
+  }
+
+
+#ifndef DISABLE_MPI
+  //	record length of the Welford reduction, set before MPI_Reduce is called
+  static int pm_reduce_record_size = Pm_reduce_base_size;
+
+  ///	MPI user operation combining the records of PerfWatch::reducePack()
+  ///	The mean and M2 are merged by the parallel variant of Welford's algorithm.
+  ///
+  static void pm_reduce_welford(void* p_in, void* p_inout, int* len, MPI_Datatype* datatype)
+  {
+	const double* a = static_cast<const double*>(p_in);
+	double* b = static_cast<double*>(p_inout);
+	int n_rec = pm_reduce_record_size;
+
+	for (int k = 0; k < *len; k++, a += n_rec, b += n_rec) {
+		double na = a[0];
+		double nb = b[0];
+		double n = na + nb;
+		if (na == 0.0) continue;
+		double d_time = a[1] - b[1];
+		double d_flop = a[5] - b[5];
+		b[0] = n;
+		b[1] += d_time * na / n;
+		b[2] += a[2] + d_time * d_time * na * nb / n;
+		b[3] = std::max(a[3], b[3]);
+		b[4] = std::min(a[4], b[4]);
+		b[5] += d_flop * na / n;
+		b[6] += a[6] + d_flop * d_flop * na * nb / n;
+		for (int i = 7; i < n_rec; i++) {
+			b[i] += a[i];		// count sum and HWPC sums
+		}
+	}
+  }
+#endif
+
+
+  /// 全プロセスの測定結果の統計量のみを集約する
+  ///
+  ///   @note  The records of all the sections are reduced within each node over
+  ///	MPI_COMM_TYPE_SHARED communicator first, then across the node leaders.
+  ///	Only rank 0 holds the result, and bcast_stats() shares it with all ranks.
+  ///	No per process array of O(num_process) is allocated.
+  ///
+  void PerfMonitor::gather_and_reduce(void)
+  {
+    if (!is_PMlib_enabled) return;
+    if (m_nWatch == 0) return;
+
+    mpi_auto_fold();
+
+    for (int i=0; i<m_nWatch; i++) {
+      m_watchArray[i].gatherHWPC();
+    }
+
+	//	All the sections share the same record length
+	int n_hwpc = 0;
+    for (int i = 0; i < m_nWatch; i++) {
+		n_hwpc = std::max(n_hwpc, m_watchArray[i].gatherPackSize() - 3);
+	}
+	int n_rec = Pm_reduce_base_size + n_hwpc;
+
+	double* p_rec = new double[(size_t)m_nWatch * n_rec];
+    for (int i = 0; i < m_nWatch; i++) {
+		m_watchArray[i].reducePack(p_rec + (size_t)i*n_rec, n_hwpc);
+	}
+
+#ifndef DISABLE_MPI
+	if (num_process > 1) {
+		if (!is_node_comm_set) {
+			int node_rank;
+			MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, my_rank, MPI_INFO_NULL, &m_node_comm);
+			MPI_Comm_rank(m_node_comm, &node_rank);
+			MPI_Comm_split(MPI_COMM_WORLD, (node_rank == 0) ? 0 : MPI_UNDEFINED, my_rank, &m_leader_comm);
+			is_node_comm_set = true;
+		}
+
+		MPI_Datatype rec_type;
+		MPI_Op rec_op;
+		MPI_Type_contiguous(n_rec, MPI_DOUBLE, &rec_type);
+		MPI_Type_commit(&rec_type);
+		MPI_Op_create(pm_reduce_welford, 1, &rec_op);
+		pm_reduce_record_size = n_rec;
+
+		double* p_node = new double[(size_t)m_nWatch * n_rec];
+		if (MPI_Reduce(p_rec, p_node, m_nWatch, rec_type, rec_op, 0, m_node_comm) != MPI_SUCCESS) PM_Exit(0);
+
+		//	The world rank 0 is the rank 0 of both node and leader communicators
+		if (m_leader_comm != MPI_COMM_NULL) {
+			if (MPI_Reduce(p_node, p_rec, m_nWatch, rec_type, rec_op, 0, m_leader_comm) != MPI_SUCCESS) PM_Exit(0);
+		}
+		delete [] p_node;
+		MPI_Op_free(&rec_op);
+		MPI_Type_free(&rec_type);
+	}
+#endif
+
+	if (my_rank == 0) {
+    	for (int i = 0; i < m_nWatch; i++) {
+			m_watchArray[i].reduceUnpack(p_rec + (size_t)i*n_rec, n_hwpc);
+		}
+	}
+	reduce_self_stats();
+	bcast_stats();
+	is_rank_gathered = false;
+
+	delete [] p_rec;
+
 	//  summary stats of the estimated power consumption. Only the Root section does this.
 	if (level_POWER != 0)
     m_watchArray[0].gatherPOWER();
+  }
+
 
+  /// sort_m_order() の降順の比較. 経過時間の長い区間を先にする
+  ///
+  static bool sort_m_order_greater(const std::pair<double, unsigned>& a, const std::pair<double, unsigned>& b)
+  {
+    return (a.first > b.first);
   }
 
 
@@ -817,41 +1248,25 @@ namespace pm_lib {
 	#endif
 
     // 経過時間でソートした測定区間のリストm_order[m_nWatch] を作成する
-    // This delete/new may look redundant, but is needed if m_nWatch has
-    // increased since last call...
-    if ( m_order != NULL) { delete[] m_order; m_order = NULL; }
-    if ( !(m_order = new unsigned[m_nWatch]) ) PM_Exit(0);
-
-    for (int i=0; i<m_nWatch; i++) {
-      m_order[i] = i;
+    // m_order is reallocated only if m_nWatch has increased beyond its length.
+    if (m_nWatch > m_order_size) {
+      int n_order = std::max(m_nWatch, 2*m_order_size);
+      if ( m_order != NULL) { delete[] m_order; m_order = NULL; }
+      if ( !(m_order = new (std::nothrow) unsigned[n_order]) ) PM_Exit(0);
+      m_order_size = n_order;
     }
 
-    double *m_tcost = NULL;
-    if ( !(m_tcost = new double[m_nWatch]) ) PM_Exit(0);
+    std::vector< std::pair<double, unsigned> > v_tcost(m_nWatch);
     for (int i = 0; i < m_nWatch; i++) {
       PerfWatch& w = m_watchArray[i];
-      if ( w.m_count_sum > 0 ) {
-        m_tcost[i] = w.m_time_av;
-      } else {
-        m_tcost[i] = 0.0;
-      }
+      v_tcost[i].first = ( w.m_count_sum > 0 ) ? w.m_time_av : 0.0;
+      v_tcost[i].second = i;
     }
-    // 降順ソート O(n^2) Brute force　
-    double tmp_d;
-    unsigned tmp_u;
-    for (int i=0; i<m_nWatch-1; i++) {
-      PerfWatch& w = m_watchArray[i];
-      if (w.m_label.empty()) continue;  //
-      for (int j=i+1; j<m_nWatch; j++) {
-        PerfWatch& q = m_watchArray[j];
-        if (q.m_label.empty()) continue;  //
-        if ( m_tcost[i] < m_tcost[j] ) {
-          tmp_d=m_tcost[i]; m_tcost[i]=m_tcost[j]; m_tcost[j]=tmp_d;
-          tmp_u=m_order[i]; m_order[i]=m_order[j]; m_order[j]=tmp_u;
-        }
-      }
+    // 降順ソート O(n log n). 同じ時間の区間は登録順
+    std::stable_sort(v_tcost.begin(), v_tcost.end(), sort_m_order_greater);
+    for (int i=0; i<m_nWatch; i++) {
+      m_order[i] = v_tcost[i].second;
     }
-    delete[] m_tcost; m_tcost = NULL;
 
 	#ifdef DEBUG_PRINT_MONITOR
 	(void) MPI_Barrier(MPI_COMM_WORLD);
@@ -886,6 +1301,21 @@ namespace pm_lib {
     if (my_rank==0) fprintf(stderr, "\n<PerfMonitor::report> start \n");
 	#endif
 
+	prepareReport ();
+
+//	now start reporting the PMlib stats
+	selectReport (fp);
+	return;
+  }
+
+
+  /// report() と report_async() の前処理. Root区間を停止し、スレッドの測定値を集約する
+  ///
+  /// - [1] stop the Root section
+  /// - [2] merge thread serial/parallel sections
+  ///
+  void PerfMonitor::prepareReport(void)
+  {
 	int id, mid, inside;
 	int nSections;
 
@@ -909,6 +1339,9 @@ namespace pm_lib {
 		;
 	}
 
+//	the last snapshot of the time series includes the Root section
+	finalizeSeries ();
+
 //	count the number of SHARED sections
 
 	countSections (nSections);
@@ -933,10 +1366,6 @@ namespace pm_lib {
 		;
 	}
 	}	// end of for loop
-
-//	now start reporting the PMlib stats
-	selectReport (fp);
-	return;
   }
 
 
@@ -954,6 +1383,10 @@ namespace pm_lib {
   ///   PMLIB_REPORT=DETAIL: MPIランク別に経過時間、頻度、HWPC統計情報の詳細レポートを出力する。
   ///   PMLIB_REPORT=FULL： BASICとDETAILのレポートに加えて、
   ///		各MPIランクが生成した各並列スレッド毎にHWPC統計情報の詳細レポートを出力する。
+  ///   PMLIB_REPORT=IMBALANCE: BASICのレポートに加えて、各区間のプロセス間・スレッド間の
+  ///		負荷不均衡と PMLIB_IMBALANCE_TIMESTEP 区間のクリティカルパスを出力する。
+  ///   PMLIB_REPORT_FORMAT=json|csv が指定された場合は、全区間・全ランク・全スレッドの
+  ///		測定値をJSONまたはCSVのファイルにも出力する。
   ///
   void PerfMonitor::selectReport(FILE* fp)
   {
@@ -963,10 +1396,18 @@ namespace pm_lib {
     	fprintf(stderr, "<PerfMonitor::selectReport> starts. num_process=%d \n", num_process);
 	#endif
 
+	// PMLIB_DUMP defers the report to pm_merge. No collective is called.
+	if (PerfMonitor::dump_pm_records(fp)) return;
+
 	// BASIC report is always generated.
 	PerfMonitor::print(fp, "", "", 0);
 
-	// env_str_report should be one of {"BASIC" || "DETAIL" || "FULL"}
+	// env_str_report should be one of {"BASIC" || "DETAIL" || "FULL" || "IMBALANCE"}
+	// IMBALANCE report of the processes and the threads
+	if (env_str_report == "IMBALANCE") {
+		PerfMonitor::printImbalance(fp);
+	}
+
 	// DETAIL report per MPI ranks
 	#ifdef DEBUG_PRINT_MONITOR
     	fprintf(stderr, "<PerfMonitor::selectReport> calls printDetail. \n" );
@@ -975,6 +1416,9 @@ namespace pm_lib {
 		PerfMonitor::printDetail(fp, 0, 0);
 	}
 
+	// JSON/CSV file of PMLIB_REPORT_FORMAT, before printThreads() overwrites the process HWPC values
+	PerfMonitor::printFormatted();
+
 	// FULL report per each parallel thread
 	#ifdef DEBUG_PRINT_MONITOR
     	fprintf(stderr, "<PerfMonitor::selectReport> calls printThreads. \n" );
@@ -1030,11 +1474,52 @@ namespace pm_lib {
       }
       return;
     }
-    gather();
 
-    if (my_rank != 0) return;
+    //	BASIC report needs the statistics only. The per process values are
+    //	gathered later by printDetail() or printGroup() if they are requested.
+    if (env_str_report == "BASIC") {
+      gather_and_reduce();
+      sort_m_order();
+    } else {
+      gather();
+    }
 
+    if (my_rank != 0) {
+      //	the other groups of HWPC_CHOOSER=ROTATE are gathered collectively
+      if (is_hwpc_rotated) PerfMonitor::printRotatedHWPC (fp, 0, op_sort);
+      return;
+    }
 
+    int maxLabelLen = PerfMonitor::printBasicTable (fp, hostname, comments, op_sort);
+
+    if (is_hwpc_rotated) {
+      PerfMonitor::printRotatedHWPC (fp, maxLabelLen, op_sort);
+    } else {
+      PerfMonitor::printBasicHWPC (fp, maxLabelLen, op_sort);
+    }
+
+    PerfMonitor::printBasicPower (fp, maxLabelLen, op_sort);
+
+	#ifdef DEBUG_PRINT_MONITOR
+    fprintf(stderr, "<PerfMonitor::print> ends. \n");
+	#endif
+
+  }
+
+
+  /// 集約済みの統計量から基本統計レポートのヘッダ、各測定区間、テイラ部分を出力
+  ///
+  ///   @param[in] fp       出力ファイルポインタ
+  ///   @param[in] hostname ホスト名(省略時はrank 0 実行ホスト名)
+  ///   @param[in] comments 任意のコメント
+  ///   @param[in] op_sort  測定区間の表示順 (0:経過時間順、1:登録順で表示)
+  ///
+  ///   @return ラベル文字長 maxLabelLen
+  ///
+  ///   @note ランク0のみが呼び出す。集団通信は行わない。
+  ///
+  int PerfMonitor::printBasicTable(FILE* fp, std::string hostname, const std::string comments, int op_sort)
+  {
     // 測定時間の分母
     // initialize()からgather()までの区間（==Root区間）の測定時間を分母とする
     double tot = m_watchArray[0].m_time_av;
@@ -1073,14 +1558,10 @@ namespace pm_lib {
     PerfMonitor::printBasicTailer (fp, maxLabelLen, tot, sum_flop, sum_comm, sum_other,
                                   sum_time_flop, sum_time_comm, sum_time_other, unit);
 
-    PerfMonitor::printBasicHWPC (fp, maxLabelLen, op_sort);
-
-    PerfMonitor::printBasicPower (fp, maxLabelLen, op_sort);
-
-	#ifdef DEBUG_PRINT_MONITOR
-    fprintf(stderr, "<PerfMonitor::print> ends. \n");
-	#endif
+    /// PMmpi_auto が計測した区間毎のMPI通信の内訳を出力。
+    PerfMonitor::printMpiAuto (fp, maxLabelLen);
 
+    return maxLabelLen;
   }
 
 
@@ -1112,8 +1593,78 @@ void PerfMonitor::printBasicHWPC (FILE* fp, int maxLabelLen, int op_sort)
         m_watchArray[i].printBasicHWPCsums(fp, maxLabelLen);
     }
 
+	int n_column = m_watchArray[0].my_papi.num_sorted;
+	if (is_hwpc_rotated) n_column++;	// err[%]
 	for (int i=0; i< maxLabelLen; i++) { fputc('-', fp); }  fputc('+', fp);
-	for (int i=0; i<(m_watchArray[0].my_papi.num_sorted*11); i++) { fputc('-', fp); } fprintf(fp, "\n");
+	for (int i=0; i<(n_column*11); i++) { fputc('-', fp); } fprintf(fp, "\n");
+#endif
+}
+
+
+/// Report the BASIC HWPC statistics of all the groups counted by HWPC_CHOOSER=ROTATE
+///
+///   @param[in] fp       	report file pointer
+///   @param[in] maxLabelLen    maximum label string field length
+///   @param[in] op_sort 	sorting option (0:sorted by seconds, 1:listed order)
+///
+///	  @note   The first group has been gathered by print(). The statistics of
+///		the other groups are gathered in turn, and the first group is gathered
+///		again at the end so that the following reports find it selected.
+///
+void PerfMonitor::printRotatedHWPC (FILE* fp, int maxLabelLen, int op_sort)
+{
+#ifdef USE_PAPI
+	int n_rotate = m_watchArray[0].rotateGroups();
+
+	for (int k=0; k<n_rotate; k++) {
+		if (k > 0) {
+			m_watchArray[0].selectReportGroup(k);
+			if (env_str_report == "BASIC") {
+				gather_and_reduce();
+			} else {
+				gather_and_stats();
+			}
+		}
+
+		//	the error of the extrapolation is reported as the maximum of all the processes
+		double* p_err = new double[m_nWatch];
+		double* p_max = new double[m_nWatch];
+		for (int i=0; i<m_nWatch; i++) {
+			p_err[i] = m_watchArray[i].rotateError(k);
+		}
+		if (num_process > 1) {
+			if (MPI_Reduce(p_err, p_max, m_nWatch, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD) != MPI_SUCCESS) PM_Exit(0);
+		} else {
+			for (int i=0; i<m_nWatch; i++) p_max[i] = p_err[i];
+		}
+		if (my_rank == 0) {
+			for (int i=0; i<m_nWatch; i++) {
+				m_watchArray[i].m_rot_error_max = p_max[i];
+			}
+			PerfMonitor::printBasicHWPC (fp, maxLabelLen, op_sort);
+			if (env_str_hwpc == "ROOFLINE") {
+				for (int i=0; i<m_nWatch; i++) {
+					m_watchArray[i].rooflineCollect();
+				}
+			}
+		}
+		delete [] p_err;
+		delete [] p_max;
+	}
+
+	if (n_rotate > 1) {
+		m_watchArray[0].selectReportGroup(0);
+		if (env_str_report == "BASIC") {
+			gather_and_reduce();
+		} else {
+			gather_and_stats();
+		}
+	}
+
+	//	HWPC_CHOOSER=ROOFLINE combines FLOPS and BANDWIDTH groups
+	if ((my_rank == 0) && (env_str_hwpc == "ROOFLINE")) {
+		PerfMonitor::printRoofline (fp, maxLabelLen, op_sort);
+	}
 #endif
 }
 
@@ -1207,7 +1758,12 @@ void PerfMonitor::printBasicPower(FILE* fp, int maxLabelLen, int op_sort)
 	fprintf(fp, "\n");
 	fprintf(fp, "# PMlib Power Consumption report per node basis ---------------------------------- #\n");
 	fprintf(fp, "\n");
-    fprintf(fp, "\tReport is generated for POWER_CHOOSER=%s option.\n\n", p_label.c_str());
+    fprintf(fp, "\tReport is generated for POWER_CHOOSER=%s option.\n", p_label.c_str());
+	if (power_interval > 0.0) {
+    fprintf(fp, "\tThe energy is attributed to the sections from the samples taken every %.3g [ms] (PMLIB_POWER_SAMPLE).\n",
+		power_interval*1.0e3);
+	}
+    fprintf(fp, "\n");
 
 	double t_joule;
 	int nnodes;
@@ -1243,10 +1799,10 @@ void PerfMonitor::printBasicPower(FILE* fp, int maxLabelLen, int op_sort)
 
 	fprintf(fp, "Section"); for (int i=7; i< maxLabelLen; i++) { fputc(' ', fp); }		fputc('|', fp);
 	for (int i=0; i<n_parts-1; i++) { fprintf(fp, "%8s", sorted_obj_name[i].c_str()); }
-	fprintf(fp, " %8s| Energy[Wh] \n", sorted_obj_name[n_parts-1].c_str());
+	fprintf(fp, " %8s| Energy[Wh] Energy[J]   max[W]\n", sorted_obj_name[n_parts-1].c_str());
 
     for (int i=0; i< maxLabelLen; i++) { fputc('-', fp); }	; fprintf(fp, "+--------+");
-    for (int i=0; i<(n_parts-1)*8; i++) { fputc('-', fp); }	 ; fprintf(fp, "+----------\n");
+    for (int i=0; i<(n_parts-1)*8; i++) { fputc('-', fp); }	 ; fprintf(fp, "+-----------------------------\n");
 
 	// actual records
     for (int j=0; j<m_nWatch; j++)
@@ -1310,12 +1866,15 @@ void PerfMonitor::printBasicPower(FILE* fp, int maxLabelLen, int op_sort)
 			fprintf(fp, "%7.1f ",  sorted_joule[i]/w.m_time_av);	// Watt value
 		}
 		fprintf(fp, "  %8.2e",  sorted_joule[0]/3600.0);			// Watt-Hour energy value
+		fprintf(fp, "  %8.2e",  sorted_joule[0]);					// Joule energy value
+		fprintf(fp, " %8.1f",  w.my_power.watt_max[0]);			// max Watt of a start/stop pair
 		fprintf(fp, "\n");
 	}
 
     for (int i=0; i< maxLabelLen; i++) { fputc('-', fp); }	; fprintf(fp, "+--------+");
-    for (int i=0; i<(n_parts-1)*8; i++) { fputc('-', fp); }	 ; fprintf(fp, "+----------\n");
+    for (int i=0; i<(n_parts-1)*8; i++) { fputc('-', fp); }	 ; fprintf(fp, "+-----------------------------\n");
 
+	printPowerTune(fp, maxLabelLen);
 #endif
 }
 
@@ -1349,6 +1908,24 @@ void PerfMonitor::printBasicPower(FILE* fp, int maxLabelLen, int op_sort)
 
     if (my_rank != 0) return;
 
+    PerfMonitor::printDetailTable(fp, op_sort);
+
+	#ifdef DEBUG_PRINT_MONITOR
+    fprintf(stderr, "<PerfMonitor::printDetail> ends. \n");
+	#endif
+
+  }
+
+
+  /// 集約済みのプロセス別測定値からMPIランク別詳細レポート、HWPC詳細レポートを出力
+  ///
+  ///   @param[in] fp           出力ファイルポインタ
+  ///   @param[in] op_sort      測定区間の表示順 (0:経過時間順、1:登録順で表示)
+  ///
+  ///   @note ランク0のみが呼び出す。集団通信は行わない。
+  ///
+  void PerfMonitor::printDetailTable(FILE* fp, int op_sort)
+  {
     // 	I. MPIランク別詳細レポート: MPIランク別測定結果を出力
       if (is_MPI_enabled) {
         fprintf(fp, "\n## PMlib Process Report --- Elapsed time for individual MPI ranks ------\n\n");
@@ -1398,11 +1975,6 @@ void PerfMonitor::printBasicPower(FILE* fp, int maxLabelLen, int op_sort)
     }
 
 #endif
-
-	#ifdef DEBUG_PRINT_MONITOR
-    fprintf(stderr, "<PerfMonitor::printDetail> ends. \n");
-	#endif
-
   }
 
 
@@ -1499,7 +2071,9 @@ void PerfMonitor::printBasicPower(FILE* fp, int maxLabelLen, int op_sort)
 
     if (!is_PMlib_enabled) return;
 
-    //	gather(); is always called by print()
+    //	gather(); is always called by print().
+    //	The per process values are missing if print() has reduced the stats only.
+    if (!is_rank_gathered) gather_and_stats();
 
     // check the size of the group
     int new_size, new_id;
@@ -1649,7 +2223,7 @@ void PerfMonitor::printBasicPower(FILE* fp, int maxLabelLen, int op_sort)
 
   /// ポスト処理用traceファイルの出力と終了処理
   ///
-  /// @note current version supports OTF(Open Trace Format) v1.5
+  /// @note current version supports OTF(Open Trace Format) v1.5 and OTF2
   /// @note This API terminates producing post trace immediately, and may
   ///       produce non-pairwise start()/stop() records.
   ///
@@ -1668,7 +2242,7 @@ void PerfMonitor::printBasicPower(FILE* fp, int maxLabelLen, int op_sort)
 
     gather_and_stats();
 
-#ifdef USE_OTF
+#if defined(USE_OTF) || defined(USE_OTF2)
     // OTFファイルの出力と終了処理
     if (is_OTF_enabled) {
       std::string label;
@@ -1741,7 +2315,11 @@ void PerfMonitor::printBasicPower(FILE* fp, int maxLabelLen, int op_sort)
 #else
     fprintf(fp, ", no-PowerAPI");
 #endif
-#ifdef USE_OTF
+#if defined(USE_OTF) && defined(USE_OTF2)
+    fprintf(fp, ", OTF, OTF2");
+#elif defined(USE_OTF2)
+    fprintf(fp, ", OTF2");
+#elif defined(USE_OTF)
     fprintf(fp, ", OTF");
 #else
     fprintf(fp, ", no-OTF");
@@ -1778,6 +2356,12 @@ void PerfMonitor::printBasicPower(FILE* fp, int maxLabelLen, int op_sort)
 
     m_watchArray[0].printEnvVars(fp);
 
+    fprintf(fp, "\tTimer source: %s, overhead per call = %9.3e [sec]\n", pm_timer.name.c_str(), pm_timer.overhead);
+    if (pm_timer.calibrate != 0) {
+      fprintf(fp, "\tPMlib start/stop overhead per pair = %9.3e [sec] serial, %9.3e [sec] parallel. Inside the section = %9.3e, %9.3e [sec] %s\n",
+        pm_timer.pair_serial, pm_timer.pair_parallel, pm_timer.bias_serial, pm_timer.bias_parallel,
+        pm_timer.is_subtracted ? "(subtracted)" : "(not subtracted)");
+    }
     fprintf(fp, "\tActive PMlib elapsed time (from initialize to report/print) = %9.3e [sec]\n", tot);
     fprintf(fp, "\tBasic process stats as the average of all the processes are reported below.\n");
     fprintf(fp, "\tSee Legend page if the section name is annotated with special symbols such as (*),(+).\n");
@@ -1956,6 +2540,15 @@ void PerfMonitor::printBasicPower(FILE* fp, int maxLabelLen, int op_sort)
             uF,                   // 測定区間の計算速度(全プロセスの平均値)
             p_label.c_str());		// 計算速度の単位
 
+      // 入れ子区間を除いた排他時間
+      if (w.has_nested() && !w.m_in_parallel) {
+        fprintf(fp, "%-*s: %8s   %9.3e %6.2f  %9.3e\n",
+              maxLabelLen, "  (self)", "",
+              w.m_time_self_av,
+              100*w.m_time_self_av/tot,
+              (w.m_count_av != 0) ? w.m_time_self_av/(double)w.m_count_av : 0.0);
+      }
+
       if (w.m_exclusive) {
         if ( is_unit == 0 ) {
           sum_time_comm += w.m_time_av;
@@ -1976,6 +2569,21 @@ void PerfMonitor::printBasicPower(FILE* fp, int maxLabelLen, int op_sort)
           sum_other += w.m_flop_av * uF;
         }
 
+      } else
+      if (w.has_nested() && !w.m_in_parallel) {
+        // the exclusive part of the inclusive section, printed in the (self) row
+        double flop_self, pct_self;
+        bool is_self = w.selfFlop(flop_self, pct_self);
+        if ( is_unit == 0 ) {
+          sum_time_comm += w.m_time_self_av;
+          sum_comm += flop_self;
+        } else {
+          sum_time_flop += w.m_time_self_av;
+          if (is_self) sum_flop += flop_self;
+        }
+        if ( is_self && ((is_unit == 4) || (is_unit == 5) || (is_unit == 7)) ) {
+          sum_other += flop_self * w.unitFlop(pct_self, unit, is_unit);
+        }
       }
 
     }	// for
@@ -2422,7 +3030,9 @@ int PerfMonitor::add_section_object(std::string arg_st)
 {
 	int mid;
 	mid = m_nWatch;
-   	m_map_sections.insert( make_pair(arg_st, mid) );
+   	std::map<std::string, int>::iterator it = m_map_sections.insert( make_pair(arg_st, mid) ).first;
+	if ((int)m_section_labels.size() <= mid) m_section_labels.resize(mid+1, NULL);
+	m_section_labels[mid] = &(it->first);
 
     #ifdef DEBUG_PRINT_LABEL
 	//	if (my_rank==0) {
@@ -2442,13 +3052,14 @@ int PerfMonitor::add_section_object(std::string arg_st)
   ///	The return value shows the location within the thread local section map
   ///	If arg_st does not exist in the section map, the value (-1) is returned.
   ///
-int PerfMonitor::find_section_object(std::string arg_st)
+int PerfMonitor::find_section_object(const std::string& arg_st)
 {
    	int mid;
-   	if (m_map_sections.find(arg_st) == m_map_sections.end()) {
+   	std::map<std::string, int>::const_iterator it = m_map_sections.find(arg_st);
+   	if (it == m_map_sections.end()) {
    		mid = -1;
    	} else {
-   		mid = m_map_sections[arg_st] ;
+   		mid = it->second;
    	}
 	#ifdef DEBUG_PRINT_LABEL
 	//	if (my_rank==0) {
@@ -2458,6 +3069,34 @@ int PerfMonitor::find_section_object(std::string arg_st)
    	return mid;
 }
 
+  /// C/Fortranのラベル文字列から登録済みの区間番号を取得する
+  ///
+  ///   @param[in] label  ラベル文字列. NUL終端でなくてよい
+  ///   @param[in] len    ラベルの文字数
+  ///
+  ///   @return 区間番号. 未登録の場合やPMlibが無効な場合は(-1)
+  ///
+int PerfMonitor::find_section_label(const char* label, int len)
+{
+	if (!is_PMlib_enabled || (label == NULL) || (len <= 0)) return -1;
+
+	uintptr_t key = (uintptr_t)label;
+	pm_label_cache_entry& e = m_label_cache[((key >> 3) ^ (key >> 9) ^ (uintptr_t)len) & (Pm_label_cache_size-1)];
+	int id = e.id;
+	if ((e.label == label) && (e.len == len) && (id > 0) && (id < m_nWatch)) {
+		const std::string& s = m_watchArray[id].m_label;
+		if (((int)s.size() == len) && (memcmp(s.data(), label, len) == 0)) return id;
+	}
+
+	id = find_section_object(std::string(label, len));
+	if (id > 0) {
+		e.label = label;
+		e.len = len;
+		e.id = id;
+	}
+	return id;
+}
+
   /// 測定区間の区間番号に対応するラベルを取得
   /// Search the section ID in the map and return the label string
   ///
@@ -2466,19 +3105,15 @@ int PerfMonitor::find_section_object(std::string arg_st)
   ///
 void PerfMonitor::loop_section_object(const int mid, std::string& p_label)
 {
-	std::map<std::string, int>::const_iterator it;
-	int p_id;
-
-	for(it = m_map_sections.begin(); it != m_map_sections.end(); ++it) {
-		if (it->second == mid) {
-			p_label = it->first;
-			#ifdef DEBUG_PRINT_LABEL
-			//	if (my_rank==0) {
-			fprintf(stderr, "<loop_section_object> [mid=%d] in my_rank=%d my_thread=%d matched to [%s] \n", mid, my_rank, my_thread, p_label.c_str() );
-			//	}
-			#endif
-			return;
-		}
+	// m_section_labels is indexed by the section ID, so the lookup is O(1)
+	if ((mid >= 0) && (mid < (int)m_section_labels.size()) && (m_section_labels[mid] != NULL)) {
+		p_label = *m_section_labels[mid];
+		#ifdef DEBUG_PRINT_LABEL
+		//	if (my_rank==0) {
+		fprintf(stderr, "<loop_section_object> [mid=%d] in my_rank=%d my_thread=%d matched to [%s] \n", mid, my_rank, my_thread, p_label.c_str() );
+		//	}
+		#endif
+		return;
 	}
 	// should not reach here
 	fprintf(stderr, "*** PMlib Error. <loop_section_object> section ID %d was not found. my_rank=%d, my_thread=%d \n", mid, my_rank, my_thread);
@@ -2514,26 +3149,19 @@ void PerfMonitor::check_all_section_object(void)
   ///	including the one just created.
   ///
   ///	@note
-  ///	The shared map is accessible from all threads inside or outside of parallel region
+  ///	The shared registry is accessible from all threads inside or outside of parallel region.
+  ///	The registry is lock-free. See pmlib_registry.h
   ///	@note
-  ///	The entry is not added if arg_st already exists in the map
+  ///	The entry is not added if arg_st already exists in the registry
   ///
 int PerfMonitor::add_shared_section(std::string arg_st)
 {
    	int n_shared_sections;
-	#ifdef _OPENMP
-	#pragma omp critical
-	#endif
-	{
-		int n = shared_map_sections.size();
-   		shared_map_sections.insert( make_pair(arg_st, n) );
-   		n_shared_sections = shared_map_sections[arg_st] ;
+	n_shared_sections = shared_section_insert(arg_st);
 
-    	#ifdef DEBUG_PRINT_LABEL
-		fprintf(stderr, "\t<add_shared_section> [%s] updated n_shared_sections=%d  my_rank=%d, my_thread=%d \n", arg_st.c_str(), n_shared_sections, my_rank, my_thread);
-    	#endif
-	}
-	// remark. end critical does not exist for C++. its only for fortran !$omp.
+   	#ifdef DEBUG_PRINT_LABEL
+	fprintf(stderr, "\t<add_shared_section> [%s] updated n_shared_sections=%d  my_rank=%d, my_thread=%d \n", arg_st.c_str(), n_shared_sections, my_rank, my_thread);
+   	#endif
 	return n_shared_sections;
 }
 
@@ -2541,20 +3169,51 @@ int PerfMonitor::add_shared_section(std::string arg_st)
   ///
 void PerfMonitor::check_all_shared_sections(void)
 {
-	std::map<std::string, int>::const_iterator it;
-	std::string p_label;
-	int p_id;
-	int n_shared_sections = shared_map_sections.size();
-	fprintf(stderr, "\t<check_all_shared_sections> shared map size=%d \n", n_shared_sections);
+	int n_shared_sections = shared_section_count();
+	fprintf(stderr, "\t<check_all_shared_sections> shared registry size=%d \n", n_shared_sections);
 	if (n_shared_sections==0) return;
 
-	fprintf(stderr, "\t[map pair] : label, value, &(it->first), &(it->second)\n");
-	for(it = shared_map_sections.begin(); it != shared_map_sections.end(); ++it) {
-		p_label = it->first;
-		p_id = it->second;
-		fprintf(stderr, "\t [%s] : %d, %p, %p\n", p_label.c_str(), p_id, &(it->first), &(it->second));
+	fprintf(stderr, "\t[registry] : label, id, &label\n");
+	for (int i=0; i<n_shared_sections; i++) {
+		const std::string* p_label = shared_section_label(i);
+		if (p_label == NULL) continue;
+		fprintf(stderr, "\t [%s] : %d, %p\n", p_label->c_str(), i, p_label);
+	}
+}
+
 
+  /// 少なくとも n 区間分のPerfWatchをslabに確保する
+  ///
+  ///   @note 既存のslabとPerfWatchインスタンスは移動しない。
+  ///		slabのポインタ表が不足する場合のみ、倍の長さに拡張する。
+  ///
+bool PerfWatchSlabs::reserve(int n)
+{
+	int n_slabs = (n + Pm_watch_slab_size - 1) / Pm_watch_slab_size;
+	if (n_slabs <= m_nslabs) return true;
+
+	if (n_slabs > m_ntable) {
+		int n_table = std::max(n_slabs, 2*m_ntable);
+		PerfWatch** slabs_more = new (std::nothrow) PerfWatch*[n_table];
+		if (slabs_more == NULL) return false;
+		for (int i=0; i<m_nslabs; i++) slabs_more[i] = m_slabs[i];
+		if (m_slabs != NULL) delete [] m_slabs;
+		m_slabs = slabs_more;
+		m_ntable = n_table;
+	}
+
+	for (int i=m_nslabs; i<n_slabs; i++) {
+		void* p = NULL;
+		if (posix_memalign(&p, 64, sizeof(PerfWatch) * Pm_watch_slab_size) != 0) {
+			for (int k=m_nslabs; k<i; k++) free(m_slabs[k]);
+			return false;
+		}
+		PerfWatch* slab = static_cast<PerfWatch*>(p);
+		for (int j=0; j<Pm_watch_slab_size; j++) new (&slab[j]) PerfWatch();
+		m_slabs[i] = slab;
 	}
+	m_nslabs = n_slabs;
+	return true;
 }
 
 } /* namespace pm_lib */
@@ -0,0 +1,270 @@
+/*
+###################################################################################
+#
+# PMlib - Performance Monitor Library
+#
+# Copyright (c) 2010-2011 VCAD System Research Program, RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2012-2020 Advanced Institute for Computational Science(AICS), RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2016-2020 Research Institute for Information Technology(RIIT), Kyushu University.
+# All rights reserved.
+#
+###################################################################################
+ */
+
+//! @file   PerfMpiAuto.cpp
+//! @brief  accumulate the MPI calls intercepted by libPMmpi_auto.a into the sections
+
+#ifdef DISABLE_MPI
+#include "mpi_stubs.h"
+#else
+#include <mpi.h>
+#endif
+
+#include "PerfMonitor.h"
+#include "pmlib_pmpi.h"
+#include "pmlib_mpi_auto.h"
+#include <algorithm>
+#include <vector>
+
+namespace pm_lib {
+
+//
+//	Automatic MPI communication sections
+//
+//	The application is linked with -lPMmpi_auto -lPMmpi. The wrappers in
+//	PerfMpiWrap.cpp time each PMPI call and call mpi_auto_add(), which adds
+//	the call count, time and bytes to the [enclosing section][call type] table
+//	of this process, and the time to the child time of the enclosing section,
+//	so that the exclusive time of the section excludes the communication.
+//	Calls outside of any user section are attributed to the Root section.
+//
+//	mpi_auto_fold() runs at the beginning of the report collectives. The call
+//	types used by any process become COMM sections named "MPI_XXX", registered
+//	in the same order on all processes, and are set to the totals of the calls.
+//	The fold runs after the threads are merged, which rebuilds the count, time
+//	and flop of every section from the thread values, so the totals are set
+//	rather than added. printMpiAuto() prints the per section breakdown.
+//
+
+  const char* pm_mpi_auto_label[Max_mpi_auto_calls] = {
+	"MPI_Send", "MPI_Recv", "MPI_Isend", "MPI_Irecv", "MPI_Sendrecv",
+	"MPI_Wait", "MPI_Waitall", "MPI_Waitany", "MPI_Barrier", "MPI_Bcast",
+	"MPI_Reduce", "MPI_Allreduce", "MPI_Gather", "MPI_Allgather",
+	"MPI_Alltoall", "MPI_Alltoallv"
+  };
+
+  PerfMonitor* pm_mpi_auto_monitor = NULL;
+  pthread_t pm_mpi_auto_owner;
+  bool pm_mpi_auto_linked = false;
+
+
+  /// 区間と呼び出し種別毎の積算値
+  ///
+  struct pm_mpi_auto_stat
+  {
+	double count;
+	double time;
+	double bytes;
+  };
+
+
+  /// PMmpi_auto の積算表. See PerfMonitor::mpi_auto
+  ///
+  struct pm_mpi_auto
+  {
+	std::vector<pm_mpi_auto_stat> local;	///< [section][call] of this process
+	int id_call[Max_mpi_auto_calls];		///< the MPI_XXX section of each call, or (-1)
+	std::vector<pm_mpi_auto_stat> sum;		///< [section][call] sum of all the processes. rank 0 only
+  };
+
+
+  /// PMmpi_auto の積算表を用意し、MPI呼び出しを積算するPerfMonitorとして登録する
+  ///
+  ///   @note initialize() から呼ばれる。libPMmpi_auto.a がリンクされていない場合は何もしない。
+  ///		threadprivateのPerfMonitorではマスタースレッドのインスタンスを登録する。
+  ///
+  void PerfMonitor::initializeMpiAuto(void)
+  {
+	mpi_auto = NULL;
+	if (!pm_mpi_auto_linked || (pm_mpi_auto_monitor != NULL)) return;
+	#ifdef _OPENMP
+	if (omp_get_thread_num() != 0) return;
+	#endif
+
+	pm_mpi_auto* a = new pm_mpi_auto;
+	pm_mpi_auto_stat zero = { 0.0, 0.0, 0.0 };
+	for (int c=0; c<Max_mpi_auto_calls; c++) {
+		a->id_call[c] = -1;
+	}
+	a->local.assign((size_t)init_nWatch * Max_mpi_auto_calls, zero);
+	mpi_auto = a;
+	pm_mpi_auto_owner = pthread_self();
+	pm_mpi_auto_monitor = this;
+  }
+
+
+  /// 区間と同じタイマーの時刻
+  ///
+  double PerfMonitor::mpi_auto_time(void)
+  {
+	return m_watchArray[0].getTime();
+  }
+
+
+  /// MPI呼び出し1回の時間と通信量を実行中の区間に積算する
+  ///
+  ///   @param[in] call   呼び出し種別 pm_mpi_auto_call
+  ///   @param[in] t0     呼び出し前の時刻
+  ///   @param[in] t1     呼び出し後の時刻
+  ///   @param[in] bytes  通信量(バイト)
+  ///
+  ///   @note libPMmpi_auto.a のラッパーから登録したスレッドでのみ呼ばれる。
+  ///
+  void PerfMonitor::mpi_auto_add(int call, double t0, double t1, double bytes)
+  {
+	double dt = t1 - t0;
+	int id = 0;
+	if (m_nest_depth > 0) {
+		pm_nest_frame& f = m_nest_stack[std::min(m_nest_depth, Pm_max_nest_depth) - 1];
+		id = f.id;
+		if (m_nest_depth <= Pm_max_nest_depth) {
+			f.has_child = true;
+			f.time_child += dt;
+		}
+	}
+
+	std::vector<pm_mpi_auto_stat>& v = mpi_auto->local;
+	size_t k = (size_t)id * Max_mpi_auto_calls + call;
+	if (k >= v.size()) {
+		pm_mpi_auto_stat zero = { 0.0, 0.0, 0.0 };
+		v.resize(std::max(2 * v.size(), (size_t)(id + 1) * Max_mpi_auto_calls), zero);
+	}
+	pm_mpi_auto_stat& s = v[k];
+	s.count += 1.0;
+	s.time += dt;
+	s.bytes += bytes;
+  }
+
+
+  /// 積算したMPI呼び出しの合計を MPI_XXX 区間に設定し、区間毎の内訳をランク0に集める
+  ///
+  ///   @note gather_and_stats() と gather_and_reduce() の最初に全プロセスから呼ばれる。
+  ///
+  void PerfMonitor::mpi_auto_fold(void)
+  {
+	if (!pm_mpi_auto_linked || (this != pm_mpi_auto_monitor)) return;
+	pm_mpi_auto* a = mpi_auto;
+
+	pm_mpi_auto_stat total[Max_mpi_auto_calls];
+	for (int c=0; c<Max_mpi_auto_calls; c++) {
+		total[c].count = total[c].time = total[c].bytes = 0.0;
+	}
+	for (size_t k=0; k<a->local.size(); k++) {
+		pm_mpi_auto_stat& t = total[k % Max_mpi_auto_calls];
+		t.count += a->local[k].count;
+		t.time += a->local[k].time;
+		t.bytes += a->local[k].bytes;
+	}
+
+	//	the call types used by any process. the MPI_XXX sections must be the same on all processes
+	int used[Max_mpi_auto_calls];
+	int used_any[Max_mpi_auto_calls];
+	for (int c=0; c<Max_mpi_auto_calls; c++) {
+		used[c] = (total[c].count > 0.0) ? 1 : 0;
+		used_any[c] = used[c];
+	}
+	if (num_process > 1) {
+		if (MPI_Allreduce(used, used_any, Max_mpi_auto_calls, MPI_INT, MPI_MAX, MPI_COMM_WORLD) != MPI_SUCCESS) PM_Exit(0);
+	}
+	for (int c=0; c<Max_mpi_auto_calls; c++) {
+		if (used_any[c] && (a->id_call[c] < 0)) {
+			a->id_call[c] = setProperties(pm_mpi_auto_label[c], COMM, true);
+		}
+	}
+
+	for (int c=0; c<Max_mpi_auto_calls; c++) {
+		if (a->id_call[c] < 0) continue;
+		PerfWatch& w = m_watchArray[a->id_call[c]];
+		w.m_count = (long)total[c].count;
+		w.m_time = total[c].time;
+		w.m_flop = total[c].bytes;
+	}
+
+	//	the breakdown of the sections is the sum of all the processes
+	int n_rows = m_nWatch;
+	pm_mpi_auto_stat zero = { 0.0, 0.0, 0.0 };
+	a->local.resize(std::max(a->local.size(), (size_t)n_rows * Max_mpi_auto_calls), zero);
+	int n_sum = n_rows * Max_mpi_auto_calls * 3;
+	if (num_process > 1) {
+		if (my_rank == 0) a->sum.resize((size_t)n_rows * Max_mpi_auto_calls);
+		if (MPI_Reduce(&a->local[0], (my_rank == 0) ? &a->sum[0] : NULL, n_sum,
+			MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD) != MPI_SUCCESS) PM_Exit(0);
+	} else {
+		a->sum.assign(a->local.begin(), a->local.begin() + (size_t)n_rows * Max_mpi_auto_calls);
+	}
+  }
+
+
+  /// 区間毎のMPI呼び出しの内訳を出力する
+  ///
+  ///   @param[in] fp       出力ファイルポインタ
+  ///   @param[in] maxLabelLen    ラベル文字長
+  ///
+  ///   @note printBasicTable() から呼ばれる。ランク0のみが呼び出す。集団通信は行わない。
+  ///
+  void PerfMonitor::printMpiAuto(FILE* fp, int maxLabelLen)
+  {
+	if (!pm_mpi_auto_linked || (this != pm_mpi_auto_monitor)) return;
+	pm_mpi_auto* a = mpi_auto;
+	int n_rows = (int)(a->sum.size() / Max_mpi_auto_calls);
+	if (n_rows == 0) return;
+
+	fprintf(fp, "\n\tMPI communication of the sections intercepted by PMmpi_auto. The values are the average of the processes.\n\n");
+	fprintf(fp, "Section"); for (int i=7; i< maxLabelLen; i++) { fputc(' ', fp); }
+	fprintf(fp, "|   calls  | MPI time[sec]  [%%] |   Bytes    | dominant calls\n");
+	for (int i=0; i< maxLabelLen; i++) { fputc('-', fp); }
+	fprintf(fp, "+----------+--------------------+------------+-------------------------------------\n");
+
+	double r_np = 1.0 / (double)num_process;
+	for (int j=0; j<m_nWatch; j++) {
+		int i = m_order[j];
+		if (i >= n_rows) continue;
+		const pm_mpi_auto_stat* s = &a->sum[(size_t)i * Max_mpi_auto_calls];
+		double count = 0.0, time = 0.0, bytes = 0.0;
+		int c1 = -1, c2 = -1;
+		for (int c=0; c<Max_mpi_auto_calls; c++) {
+			count += s[c].count;
+			time += s[c].time;
+			bytes += s[c].bytes;
+			if (s[c].count <= 0.0) continue;
+			if ((c1 < 0) || (s[c].time > s[c1].time)) {
+				c2 = c1; c1 = c;
+			} else if ((c2 < 0) || (s[c].time > s[c2].time)) {
+				c2 = c;
+			}
+		}
+		if (count <= 0.0) continue;
+
+		PerfWatch& w = m_watchArray[i];
+		double t_sec = (w.m_time_av > 0.0) ? w.m_time_av : m_watchArray[0].m_time_av;
+		fprintf(fp, "%-*s: %8ld   %9.3e %6.2f   %9.3e  ",
+			maxLabelLen, w.m_label.c_str(), (long)(count * r_np), time * r_np,
+			(t_sec > 0.0) ? 100.0 * time * r_np / t_sec : 0.0, bytes * r_np);
+		int top[2] = { c1, c2 };
+		for (int n=0; n<2; n++) {
+			int c = top[n];
+			if (c < 0) continue;
+			fprintf(fp, " %s %.1f%%", pm_mpi_auto_label[c], (time > 0.0) ? 100.0 * s[c].time / time : 0.0);
+		}
+		fprintf(fp, "\n");
+	}
+	for (int i=0; i< maxLabelLen; i++) { fputc('-', fp); }
+	fprintf(fp, "+----------+--------------------+------------+-------------------------------------\n");
+	fprintf(fp, "\t[%%] is the MPI time against the time of the section. the sections are inclusive (*) of the MPI_XXX sections.\n");
+  }
+
+} /* namespace pm_lib */
@@ -0,0 +1,219 @@
+/*
+###################################################################################
+#
+# PMlib - Performance Monitor Library
+#
+# Copyright (c) 2010-2011 VCAD System Research Program, RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2012-2020 Advanced Institute for Computational Science(AICS), RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2016-2020 Research Institute for Information Technology(RIIT), Kyushu University.
+# All rights reserved.
+#
+###################################################################################
+ */
+
+//! @file   PerfMpiWrap.cpp
+//! @brief  PMPI wrappers of libPMmpi_auto.a
+
+//	The application is linked with "-lPMmpi_auto -lPMmpi" so that its MPI calls
+//	resolve to the functions below. Each wrapper calls PMPI_XXX() and, if the
+//	calling thread is the one which initialized the PerfMonitor, passes the two
+//	time stamps and the bytes given to the call to PerfMonitor::mpi_auto_add().
+//	The bytes are count * type size of the send buffer, of the receive buffer
+//	for MPI_Recv/MPI_Irecv, and zero for MPI_Wait* and MPI_Barrier.
+//	This file must not include pmlib_pmpi.h.
+
+#include <mpi.h>
+#include "PerfMonitor.h"
+#include "pmlib_mpi_auto.h"
+
+using namespace pm_lib;
+
+#if MPI_VERSION >= 3
+#define PM_MPI_CONST const
+#else
+#define PM_MPI_CONST
+#endif
+
+#define PM_MPI_AUTO_BEGIN \
+	PerfMonitor* pm = pm_mpi_auto_current(); \
+	double t0 = (pm != NULL) ? pm->mpi_auto_time() : 0.0;
+
+#define PM_MPI_AUTO_END(call, bytes) \
+	if (pm != NULL) pm->mpi_auto_add(call, t0, pm->mpi_auto_time(), (bytes));
+
+namespace {
+
+  /// libPMmpi_auto.a がリンクされたことをPerfMonitorに知らせる
+  struct pm_mpi_auto_link {
+	pm_mpi_auto_link() { pm_mpi_auto_linked = true; }
+  };
+  pm_mpi_auto_link pm_mpi_auto_link_now;
+
+  inline double type_bytes(int count, MPI_Datatype type)
+  {
+	int size = 0;
+	PMPI_Type_size(type, &size);
+	return (double)count * (double)size;
+  }
+
+  inline int comm_size(MPI_Comm comm)
+  {
+	int np = 1;
+	PMPI_Comm_size(comm, &np);
+	return np;
+  }
+
+}
+
+
+extern "C" {
+
+int MPI_Send(PM_MPI_CONST void* buf, int count, MPI_Datatype type, int dest, int tag, MPI_Comm comm)
+{
+	PM_MPI_AUTO_BEGIN
+	int iret = PMPI_Send(buf, count, type, dest, tag, comm);
+	PM_MPI_AUTO_END(Pm_mpi_send, type_bytes(count, type))
+	return iret;
+}
+
+int MPI_Recv(void* buf, int count, MPI_Datatype type, int source, int tag, MPI_Comm comm, MPI_Status* status)
+{
+	PM_MPI_AUTO_BEGIN
+	int iret = PMPI_Recv(buf, count, type, source, tag, comm, status);
+	PM_MPI_AUTO_END(Pm_mpi_recv, type_bytes(count, type))
+	return iret;
+}
+
+int MPI_Isend(PM_MPI_CONST void* buf, int count, MPI_Datatype type, int dest, int tag, MPI_Comm comm, MPI_Request* request)
+{
+	PM_MPI_AUTO_BEGIN
+	int iret = PMPI_Isend(buf, count, type, dest, tag, comm, request);
+	PM_MPI_AUTO_END(Pm_mpi_isend, type_bytes(count, type))
+	return iret;
+}
+
+int MPI_Irecv(void* buf, int count, MPI_Datatype type, int source, int tag, MPI_Comm comm, MPI_Request* request)
+{
+	PM_MPI_AUTO_BEGIN
+	int iret = PMPI_Irecv(buf, count, type, source, tag, comm, request);
+	PM_MPI_AUTO_END(Pm_mpi_irecv, type_bytes(count, type))
+	return iret;
+}
+
+int MPI_Sendrecv(PM_MPI_CONST void* sendbuf, int sendcount, MPI_Datatype sendtype, int dest, int sendtag,
+	void* recvbuf, int recvcount, MPI_Datatype recvtype, int source, int recvtag, MPI_Comm comm, MPI_Status* status)
+{
+	PM_MPI_AUTO_BEGIN
+	int iret = PMPI_Sendrecv(sendbuf, sendcount, sendtype, dest, sendtag,
+		recvbuf, recvcount, recvtype, source, recvtag, comm, status);
+	PM_MPI_AUTO_END(Pm_mpi_sendrecv, type_bytes(sendcount, sendtype))
+	return iret;
+}
+
+int MPI_Wait(MPI_Request* request, MPI_Status* status)
+{
+	PM_MPI_AUTO_BEGIN
+	int iret = PMPI_Wait(request, status);
+	PM_MPI_AUTO_END(Pm_mpi_wait, 0.0)
+	return iret;
+}
+
+int MPI_Waitall(int count, MPI_Request requests[], MPI_Status statuses[])
+{
+	PM_MPI_AUTO_BEGIN
+	int iret = PMPI_Waitall(count, requests, statuses);
+	PM_MPI_AUTO_END(Pm_mpi_waitall, 0.0)
+	return iret;
+}
+
+int MPI_Waitany(int count, MPI_Request requests[], int* index, MPI_Status* status)
+{
+	PM_MPI_AUTO_BEGIN
+	int iret = PMPI_Waitany(count, requests, index, status);
+	PM_MPI_AUTO_END(Pm_mpi_waitany, 0.0)
+	return iret;
+}
+
+int MPI_Barrier(MPI_Comm comm)
+{
+	PM_MPI_AUTO_BEGIN
+	int iret = PMPI_Barrier(comm);
+	PM_MPI_AUTO_END(Pm_mpi_barrier, 0.0)
+	return iret;
+}
+
+int MPI_Bcast(void* buf, int count, MPI_Datatype type, int root, MPI_Comm comm)
+{
+	PM_MPI_AUTO_BEGIN
+	int iret = PMPI_Bcast(buf, count, type, root, comm);
+	PM_MPI_AUTO_END(Pm_mpi_bcast, type_bytes(count, type))
+	return iret;
+}
+
+int MPI_Reduce(PM_MPI_CONST void* sendbuf, void* recvbuf, int count, MPI_Datatype type, MPI_Op op, int root, MPI_Comm comm)
+{
+	PM_MPI_AUTO_BEGIN
+	int iret = PMPI_Reduce(sendbuf, recvbuf, count, type, op, root, comm);
+	PM_MPI_AUTO_END(Pm_mpi_reduce, type_bytes(count, type))
+	return iret;
+}
+
+int MPI_Allreduce(PM_MPI_CONST void* sendbuf, void* recvbuf, int count, MPI_Datatype type, MPI_Op op, MPI_Comm comm)
+{
+	PM_MPI_AUTO_BEGIN
+	int iret = PMPI_Allreduce(sendbuf, recvbuf, count, type, op, comm);
+	PM_MPI_AUTO_END(Pm_mpi_allreduce, type_bytes(count, type))
+	return iret;
+}
+
+int MPI_Gather(PM_MPI_CONST void* sendbuf, int sendcount, MPI_Datatype sendtype,
+	void* recvbuf, int recvcount, MPI_Datatype recvtype, int root, MPI_Comm comm)
+{
+	PM_MPI_AUTO_BEGIN
+	int iret = PMPI_Gather(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, root, comm);
+	PM_MPI_AUTO_END(Pm_mpi_gather, (sendbuf == MPI_IN_PLACE) ? type_bytes(recvcount, recvtype)
+		: type_bytes(sendcount, sendtype))
+	return iret;
+}
+
+int MPI_Allgather(PM_MPI_CONST void* sendbuf, int sendcount, MPI_Datatype sendtype,
+	void* recvbuf, int recvcount, MPI_Datatype recvtype, MPI_Comm comm)
+{
+	PM_MPI_AUTO_BEGIN
+	int iret = PMPI_Allgather(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, comm);
+	PM_MPI_AUTO_END(Pm_mpi_allgather, (sendbuf == MPI_IN_PLACE) ? type_bytes(recvcount, recvtype)
+		: type_bytes(sendcount, sendtype))
+	return iret;
+}
+
+int MPI_Alltoall(PM_MPI_CONST void* sendbuf, int sendcount, MPI_Datatype sendtype,
+	void* recvbuf, int recvcount, MPI_Datatype recvtype, MPI_Comm comm)
+{
+	PM_MPI_AUTO_BEGIN
+	int iret = PMPI_Alltoall(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, comm);
+	PM_MPI_AUTO_END(Pm_mpi_alltoall, comm_size(comm) * ((sendbuf == MPI_IN_PLACE)
+		? type_bytes(recvcount, recvtype) : type_bytes(sendcount, sendtype)))
+	return iret;
+}
+
+int MPI_Alltoallv(PM_MPI_CONST void* sendbuf, PM_MPI_CONST int sendcounts[], PM_MPI_CONST int sdispls[], MPI_Datatype sendtype,
+	void* recvbuf, PM_MPI_CONST int recvcounts[], PM_MPI_CONST int rdispls[], MPI_Datatype recvtype, MPI_Comm comm)
+{
+	PM_MPI_AUTO_BEGIN
+	int iret = PMPI_Alltoallv(sendbuf, sendcounts, sdispls, sendtype, recvbuf, recvcounts, rdispls, recvtype, comm);
+	if (pm != NULL) {
+		bool in_place = (sendbuf == MPI_IN_PLACE);
+		long n = 0;
+		for (int i=0, np=comm_size(comm); i<np; i++) {
+			n += in_place ? recvcounts[i] : sendcounts[i];
+		}
+		PM_MPI_AUTO_END(Pm_mpi_alltoallv, type_bytes(1, in_place ? recvtype : sendtype) * (double)n)
+	}
+	return iret;
+}
+
+} // extern "C"
@@ -0,0 +1,373 @@
+/*
+###################################################################################
+#
+# PMlib - Performance Monitor Library
+#
+# Copyright (c) 2010-2011 VCAD System Research Program, RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2012-2020 Advanced Institute for Computational Science(AICS), RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2016-2020 Research Institute for Information Technology(RIIT), Kyushu University.
+# All rights reserved.
+#
+###################################################################################
+ */
+
+//! @file   PerfPowerSampler.cpp
+//! @brief  PMLIB_POWER_SAMPLE periodic sampling of the Power API objects
+
+#include "PerfMonitor.h"
+#include <time.h>
+#include <cmath>
+#include <cerrno>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include <new>
+
+
+namespace pm_lib {
+
+//
+//	PMLIB_POWER_SAMPLE periodic power sampling
+//
+//	PMLIB_POWER_SAMPLE=<T>s or <T>ms	: a sampler thread reads the Power API objects
+//								  every T seconds. Valid only with POWER_CHOOSER
+//								  other than OFF. If it is not set, the sections read
+//								  the objects at every start() and stop() as before.
+//
+//	With the sampler, start() and stop() of the master thread only push the section
+//	ID and the time stamps into a lock free queue. The sampler thread keeps the
+//	time stamped cumulative energy of all the parts in a ring, and once a sample
+//	newer than a queued boundary is taken, the cumulative energy at the boundary is
+//	interpolated linearly between the two neighbouring samples and the difference
+//	between stop and start is added to my_power.w_accumu[] of the section.
+//	The accuracy is then limited to the power variation within one sampling period.
+//	The sections of the other threads are not accounted, same as the report.
+//
+
+  const int Pm_power_ring_size = 256;	///< number of the samples in the ring
+  const int Pm_power_queue_size = 65536;	///< number of the queued section boundaries
+
+
+  /// 電力量の標本. 全ての測定対象の積算電力量(J)とその時刻
+  ///
+  struct pm_power_sample
+  {
+	double time;						///< getTime() at the middle of the read
+	double joule[Max_power_stats];		///< accumulated energy (J) of each part
+  };
+
+
+  /// 区間境界の記録. start()とstop()が積む
+  ///
+  struct pm_power_mark
+  {
+	int id;								///< section ID
+	int is_start;						///< 1: start(), 0: stop()
+	double t_start;						///< start time of the section
+	double t_stop;						///< stop time of the section, if is_start==0
+  };
+
+
+  /// サンプラの標本リングと区間境界のキュー
+  ///
+  ///   @note キューは1つの書き手(マスタースレッド)と1つの読み手(サンプラスレッド)
+  ///		の間のlock freeキュー。標本リングはサンプラスレッドだけが読み書きする。
+  ///
+  struct pm_power_sampler
+  {
+	pm_power_sample ring[Pm_power_ring_size];
+	long n_samples;						///< number of the samples taken so far
+	long n_clamped;						///< boundaries older than the ring
+
+	pm_power_mark queue[Pm_power_queue_size];
+	std::atomic<long> n_put;			///< number of the marks pushed by the master thread
+	std::atomic<long> n_got;			///< number of the marks attributed by the sampler
+
+	// the following members are used by the master thread only
+	pthread_t owner;					///< the thread which pushes the marks
+	std::vector<char> is_open;			///< the start mark of the section is queued
+	long n_open;						///< number of the sections with the start mark queued
+	long n_dropped;						///< start/stop pairs not recorded by the full queue
+  };
+
+
+  /// 時刻 t の積算電力量を標本リングから線形補間する
+  ///
+  ///   @param[in] s       sampler state
+  ///   @param[in] t       time stamp of the section boundary
+  ///   @param[in] n       number of the parts
+  ///   @param[out] joule  interpolated energy (J) of each part
+  ///
+  static void power_interpolate(pm_power_sampler* s, double t, int n, double joule[])
+  {
+	long k_end = s->n_samples;
+	long k_begin = std::max(0L, k_end - Pm_power_ring_size);
+	long k = k_end - 1;
+	while ((k > k_begin) && (s->ring[k % Pm_power_ring_size].time > t)) k--;
+
+	const pm_power_sample& a = s->ring[k % Pm_power_ring_size];
+	if ((t <= a.time) || (k == k_end - 1)) {
+		if ((t < a.time) && (k == k_begin)) s->n_clamped++;
+		for (int i=0; i<n; i++) joule[i] = a.joule[i];
+		return;
+	}
+	const pm_power_sample& b = s->ring[(k+1) % Pm_power_ring_size];
+	double f = (b.time > a.time) ? (t - a.time) / (b.time - a.time) : 1.0;
+	for (int i=0; i<n; i++) {
+		joule[i] = a.joule[i] + f * (b.joule[i] - a.joule[i]);
+	}
+  }
+
+
+  /// PMLIB_POWER_SAMPLE を解析し、電力サンプラスレッドを開始する
+  ///
+  ///   @note initialize() から Root区間の開始前に呼ばれる。
+  ///
+  void PerfMonitor::initializePowerSampler(void)
+  {
+	power_interval = 0.0;
+	power_state = NULL;
+	is_power_thread = false;
+	power_quit = false;
+
+	if (level_POWER == 0) return;
+	char* cp_env = std::getenv("PMLIB_POWER_SAMPLE");
+	if (cp_env == NULL) return;
+
+	char* cp_end = NULL;
+	double value = strtod(cp_env, &cp_end);
+	std::string s_unit = (cp_end != NULL) ? cp_end : "";
+	if ((cp_end == cp_env) || (value <= 0.0)) {
+		s_unit = "invalid";
+	}
+	if (s_unit == "s") {
+		power_interval = value;
+	} else if (s_unit == "ms") {
+		power_interval = value * 1.0e-3;
+	} else {
+		printDiag("initializePowerSampler()",  "invalid PMLIB_POWER_SAMPLE value [%s]. Use <T>s or <T>ms. The power is read at every start/stop.\n",
+			cp_env);
+		return;
+	}
+
+	// The other threads of threadprivate PerfMonitor skip the power measurement.
+	#ifdef _OPENMP
+	if (omp_in_parallel() && (omp_get_thread_num() != 0)) return;
+	#endif
+
+	pm_power_sampler* s = new (std::nothrow) pm_power_sampler;
+	if (s == NULL) {
+		printDiag("initializePowerSampler()",  "memory allocation failed. The power is read at every start/stop.\n");
+		power_interval = 0.0;
+		return;
+	}
+	s->n_samples = 0;
+	s->n_clamped = 0;
+	s->n_put = 0;
+	s->n_got = 0;
+	s->owner = pthread_self();
+	s->n_open = 0;
+	s->n_dropped = 0;
+	power_state = s;
+
+	// the first sample precedes the start mark of the Root section
+	power_take_sample();
+
+	pthread_mutex_init(&power_lock, NULL);
+	pthread_cond_init(&power_cond, NULL);
+	if (pthread_create(&power_thread, NULL, PerfMonitor::power_sampler, this) != 0) {
+		printDiag("initializePowerSampler()",  "the sampler thread could not be created. The power is read at every start/stop.\n");
+		pthread_cond_destroy(&power_cond);
+		pthread_mutex_destroy(&power_lock);
+		delete power_state;
+		power_state = NULL;
+		power_interval = 0.0;
+		return;
+	}
+	is_power_thread = true;
+
+	#ifdef DEBUG_PRINT_POWER_EXT
+	fprintf(stderr, "<initializePowerSampler> PMLIB_POWER_SAMPLE=%s, interval=%e\n",
+		cp_env, power_interval);
+	#endif
+  }
+
+
+  /// 電力サンプラスレッドの本体. power_interval 秒毎に標本を取り、区間に配分する
+  ///
+  ///   @param[in] arg   the PerfMonitor instance of the master thread
+  ///
+  void* PerfMonitor::power_sampler(void* arg)
+  {
+	PerfMonitor* pm = static_cast<PerfMonitor*>(arg);
+
+	double t_sec = floor(pm->power_interval);
+	long t_nsec = (long)((pm->power_interval - t_sec) * 1.0e9);
+	struct timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+
+	pthread_mutex_lock(&pm->power_lock);
+	while (!pm->power_quit) {
+		deadline.tv_sec += (time_t)t_sec;
+		deadline.tv_nsec += t_nsec;
+		if (deadline.tv_nsec >= 1000000000L) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+		int iret = 0;
+		while (!pm->power_quit && (iret != ETIMEDOUT)) {
+			iret = pthread_cond_timedwait(&pm->power_cond, &pm->power_lock, &deadline);
+		}
+		if (pm->power_quit) break;
+		pm->power_take_sample();
+		pm->power_drain(false);
+	}
+	pthread_mutex_unlock(&pm->power_lock);
+	return NULL;
+  }
+
+
+  /// 全ての測定対象の積算電力量を読み、標本リングに追加する
+  ///
+  void PerfMonitor::power_take_sample(void)
+  {
+	pm_power_sampler* s = power_state;
+	pm_power_sample& e = s->ring[s->n_samples % Pm_power_ring_size];
+	PerfWatch& w = m_watchArray[0];
+
+	double t0 = w.getTime();
+	w.power_sample(pm_pacntxt, pm_extcntxt, pm_obj_array, pm_obj_ext, e.joule);
+	e.time = 0.5 * (t0 + w.getTime());
+	s->n_samples++;
+  }
+
+
+  /// 区間境界の時刻をキューに積む
+  ///
+  ///   @param[in] id        区間番号
+  ///   @param[in] is_start  true: start()の直後, false: stop()の直後
+  ///
+  ///   @note マスタースレッドだけが積む。キューの残りが少ない場合は、既に開始を
+  ///		積んだ区間の停止の分を残してstart/stopの組を記録しない。
+  ///
+  void PerfMonitor::power_mark(int id, bool is_start)
+  {
+	pm_power_sampler* s = power_state;
+	if (s == NULL) return;
+	if (!pthread_equal(pthread_self(), s->owner)) return;
+
+	if ((int)s->is_open.size() <= id) s->is_open.resize(id+1, 0);
+	long n_put = s->n_put.load(std::memory_order_relaxed);
+	long n_got = s->n_got.load(std::memory_order_acquire);
+	if (is_start) {
+		if (s->is_open[id]) return;
+		if ((n_put - n_got) + s->n_open + 2 > Pm_power_queue_size) {
+			s->n_dropped++;
+			return;
+		}
+		s->is_open[id] = 1;
+		s->n_open++;
+	} else {
+		if (!s->is_open[id]) return;
+		s->is_open[id] = 0;
+		s->n_open--;
+	}
+
+	pm_power_mark& v = s->queue[n_put % Pm_power_queue_size];
+	v.id = id;
+	v.is_start = is_start ? 1 : 0;
+	m_watchArray[id].lastInterval(v.t_start, v.t_stop);
+	s->n_put.store(n_put + 1, std::memory_order_release);
+  }
+
+
+  /// キューの区間境界のうち、最新の標本より前のものの電力量を区間に配分する
+  ///
+  ///   @param[in] is_final  true: 全ての区間境界を配分する
+  ///
+  void PerfMonitor::power_drain(bool is_final)
+  {
+	pm_power_sampler* s = power_state;
+	double t_last = s->ring[(s->n_samples - 1) % Pm_power_ring_size].time;
+	long n_got = s->n_got.load(std::memory_order_relaxed);
+	long n_put = s->n_put.load(std::memory_order_acquire);
+	double joule[Max_power_stats];
+
+	for (; n_got < n_put; n_got++) {
+		const pm_power_mark& v = s->queue[n_got % Pm_power_queue_size];
+		double t = v.is_start ? v.t_start : v.t_stop;
+		if ((t > t_last) && !is_final) break;
+
+		PerfWatch& w = m_watchArray[v.id];
+		int n_parts = w.my_power.num_power_stats;
+		power_interpolate(s, t, n_parts, joule);
+		if (v.is_start) {
+			for (int i=0; i<n_parts; i++) {
+				w.my_power.u_joule[i] = joule[i];
+			}
+		} else {
+			// output in Joule : 1 Joule == 1 Newton x meter == 1 Watt x second
+			double dt = v.t_stop - v.t_start;
+			for (int i=0; i<n_parts; i++) {
+				double uvJ = joule[i] - w.my_power.u_joule[i];
+				w.my_power.v_joule[i] = joule[i];
+				w.my_power.w_accumu[i] += uvJ;
+				if (dt > 0.0) {
+					w.my_power.watt_max[i] = std::max (w.my_power.watt_max[i], uvJ / dt);
+				}
+			}
+		}
+	}
+	s->n_got.store(n_got, std::memory_order_release);
+  }
+
+
+  /// 電力サンプラスレッドを停止し、残りの区間境界を配分する。各区間の平均電力を求める
+  ///
+  ///   @note stopRoot() から Root区間の停止後、finalizePOWER() の前に呼ばれる。
+  ///		サンプラを使わない場合も平均電力 my_power.watt_ave[] はここで求める。
+  ///
+  void PerfMonitor::finalizePowerSampler(void)
+  {
+	if (power_state != NULL) {
+		if (is_power_thread) {
+			pthread_mutex_lock(&power_lock);
+			power_quit = true;
+			pthread_cond_signal(&power_cond);
+			pthread_mutex_unlock(&power_lock);
+			pthread_join(power_thread, NULL);
+			pthread_cond_destroy(&power_cond);
+			pthread_mutex_destroy(&power_lock);
+			is_power_thread = false;
+		}
+
+		power_take_sample();
+		power_drain(true);
+
+		if (power_state->n_dropped > 0) {
+			printDiag("finalizePowerSampler()",  "%ld start/stop pairs were not accounted because the power sampler queue was full. Use a shorter PMLIB_POWER_SAMPLE.\n",
+				power_state->n_dropped);
+		}
+		#ifdef DEBUG_PRINT_POWER_EXT
+		fprintf(stderr, "<finalizePowerSampler> samples=%ld, marks=%ld, clamped=%ld, dropped=%ld\n",
+			power_state->n_samples, power_state->n_put.load(), power_state->n_clamped, power_state->n_dropped);
+		#endif
+		delete power_state;
+		power_state = NULL;
+	}
+
+	if (level_POWER == 0) return;
+	for (int j=0; j<m_nWatch; j++) {
+		PerfWatch& w = m_watchArray[j];
+		for (int i=0; i<w.my_power.num_power_stats; i++) {
+			w.my_power.watt_ave[i] = (w.m_time > 0.0) ? w.my_power.w_accumu[i] / w.m_time : 0.0;
+		}
+	}
+  }
+
+} /* namespace pm_lib */
+
@@ -0,0 +1,460 @@
+/*
+###################################################################################
+#
+# PMlib - Performance Monitor Library
+#
+# Copyright (c) 2010-2011 VCAD System Research Program, RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2012-2020 Advanced Institute for Computational Science(AICS), RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2016-2020 Research Institute for Information Technology(RIIT), Kyushu University.
+# All rights reserved.
+#
+###################################################################################
+ */
+
+//! @file   PerfPowerTune.cpp
+//! @brief  PMLIB_POWER_TUNE energy aware selection of the power knobs per section
+
+#include "PerfMonitor.h"
+#include "power_obj_menu.h"
+#include <algorithm>
+#include <vector>
+#include <new>
+
+
+namespace pm_lib {
+
+//
+//	PMLIB_POWER_TUNE power knob tuning
+//
+//	PMLIB_POWER_TUNE=<label>[,<label>...]	: the sections to be tuned. Valid only
+//								  with POWER_CHOOSER other than OFF.
+//	PMLIB_POWER_TUNE_GOAL=ENERGY|EDP	: minimize the energy (default) or the
+//								  energy delay product of the section
+//	PMLIB_POWER_TUNE_SLOWDOWN=<percent>	: the allowed slowdown against the
+//								  knob setting at initialize(). default 5
+//	PMLIB_POWER_TUNE_CALLS=<N>	: measured calls per knob setting. default 2
+//
+//	The knob setting at initialize() is the baseline. The candidates are the
+//	combinations of CPU frequency {2200, 2000} [MHz] and ECO state {0, 1, 2}
+//	with the other knobs kept at the baseline. Each candidate is applied before
+//	start() of the section and the baseline is restored after stop(). The first
+//	call of a candidate is a warm up and is not used, the next N calls measure the
+//	time and the energy of the node. After all the candidates, the one with the
+//	least energy (or EDP) among those within the slowdown bound is locked in and
+//	is applied at every later call. The knobs are switched outside of the measured
+//	interval, so that the cost of the switch is attributed to the enclosing section.
+//	Only the calls by the master thread in serial region are tuned. Each process
+//	decides by its own measurements, and the knobs are shared by the processes of
+//	a node, so that one process per node, or the same section call sequence in all
+//	the processes of a node, is assumed.
+//
+
+  const int Pm_tune_freq[2] = { 2200, 2000 };	///< candidate CPU frequencies [MHz]
+  const int Pm_tune_eco[3] = { 0, 1, 2 };		///< candidate ECO states
+
+
+  /// 電力ノブの設定値の組
+  ///
+  struct pm_power_setting
+  {
+	int value[Max_power_knob];
+
+	bool operator== (const pm_power_setting& b) const
+	{
+		for (int k=0; k<Max_power_knob; k++) {
+			if (value[k] != b.value[k]) return false;
+		}
+		return true;
+	}
+  };
+
+
+  /// 電力ノブの設定値の候補とその測定値
+  ///
+  struct pm_power_trial
+  {
+	pm_power_setting knob;
+	int n_calls;			///< measured calls
+	double time;			///< accumulated time [sec]
+	double joule;			///< accumulated energy of the node [J]
+	bool is_failed;			///< the knobs could not be set
+  };
+
+
+  /// 調整する区間の状態
+  ///
+  struct pm_power_tune_section
+  {
+	std::string label;
+	int id;								///< section ID. (-1) until setProperties()
+	std::vector<pm_power_trial> trial;	///< trial[0] is the baseline
+	int i_trial;						///< current candidate. trial.size() after locked
+	int i_choice;						///< the chosen candidate
+	bool is_warm;						///< the warm up call of the candidate is done
+	bool is_active;						///< start() is tuned and stop() is to be measured
+	double e_start;						///< energy at start() [J]
+	long n_locked;						///< calls with the chosen candidate
+  };
+
+
+  /// PMLIB_POWER_TUNE の全体の状態
+  ///
+  struct pm_power_tuner
+  {
+	int goal;							///< 0: ENERGY, 1: EDP
+	double slowdown;					///< allowed slowdown ratio
+	int n_calls;						///< measured calls per candidate
+	bool is_finished;					///< stopRoot() restored the baseline
+	pm_power_setting baseline;			///< the knobs at initialize()
+	pm_power_setting current;			///< the knobs being applied
+	std::vector<pm_power_tune_section> section;
+	std::vector<int> index;				///< section ID -> element of section, or (-1)
+  };
+
+
+  static const char* tune_knob_name[Max_power_knob] = { "CPU", "MEMORY", "ISSUE", "PIPE", "ECO" };
+
+
+  /// PMLIB_POWER_TUNE を解析し、ベースラインの電力ノブを読む
+  ///
+  ///   @note initialize() から呼ばれる。
+  ///
+  void PerfMonitor::initializePowerTune(void)
+  {
+	power_tuner = NULL;
+	if (level_POWER == 0) return;
+	char* cp_env = std::getenv("PMLIB_POWER_TUNE");
+	if (cp_env == NULL) return;
+	#ifdef _OPENMP
+	if (omp_in_parallel() && (omp_get_thread_num() != 0)) return;
+	#endif
+
+	pm_power_tuner* t = new (std::nothrow) pm_power_tuner;
+	if (t == NULL) {
+		printDiag("initializePowerTune()",  "memory allocation failed. PMLIB_POWER_TUNE is ignored.\n");
+		return;
+	}
+
+	std::string s_list = cp_env;
+	size_t i_begin = 0;
+	while (i_begin <= s_list.size()) {
+		size_t i_end = s_list.find(',', i_begin);
+		if (i_end == std::string::npos) i_end = s_list.size();
+		if (i_end > i_begin) {
+			pm_power_tune_section s;
+			s.label = s_list.substr(i_begin, i_end - i_begin);
+			s.id = -1;
+			s.i_trial = 0;
+			s.i_choice = 0;
+			s.is_warm = false;
+			s.is_active = false;
+			s.e_start = 0.0;
+			s.n_locked = 0;
+			t->section.push_back(s);
+		}
+		i_begin = i_end + 1;
+	}
+	if (t->section.empty()) {
+		printDiag("initializePowerTune()",  "PMLIB_POWER_TUNE has no section label. PMLIB_POWER_TUNE is ignored.\n");
+		delete t;
+		return;
+	}
+
+	std::string s_goal = "ENERGY";
+	cp_env = std::getenv("PMLIB_POWER_TUNE_GOAL");
+	if (cp_env != NULL) {
+		std::string s_value = cp_env;
+		std::transform(s_value.begin(), s_value.end(), s_value.begin(), toupper);
+		if (s_value == "ENERGY" || s_value == "EDP") {
+			s_goal = s_value;
+		} else {
+			printDiag("initializePowerTune()",  "unknown PMLIB_POWER_TUNE_GOAL value [%s]. the default value [%s] is set.\n", cp_env, s_goal.c_str());
+		}
+	}
+	t->goal = (s_goal == "EDP") ? 1 : 0;
+
+	t->slowdown = 0.05;
+	cp_env = std::getenv("PMLIB_POWER_TUNE_SLOWDOWN");
+	if (cp_env != NULL) {
+		char* cp_end = NULL;
+		double value = strtod(cp_env, &cp_end);
+		if ((cp_end == cp_env) || (*cp_end != '\0') || (value < 0.0)) {
+			printDiag("initializePowerTune()",  "invalid PMLIB_POWER_TUNE_SLOWDOWN value [%s]. the default value [5] is set.\n", cp_env);
+		} else {
+			t->slowdown = value * 0.01;
+		}
+	}
+
+	t->n_calls = 2;
+	cp_env = std::getenv("PMLIB_POWER_TUNE_CALLS");
+	if (cp_env != NULL) {
+		int value = atoi(cp_env);
+		if (value < 1) {
+			printDiag("initializePowerTune()",  "invalid PMLIB_POWER_TUNE_CALLS value [%s]. the default value [2] is set.\n", cp_env);
+		} else {
+			t->n_calls = value;
+		}
+	}
+
+	for (int k=0; k<Max_power_knob; k++) {
+		t->baseline.value[k] = 0;
+		if (operatePowerKnob (k, 0, t->baseline.value[k]) != 0) {
+			printDiag("initializePowerTune()",  "the power knob %s can not be read. PMLIB_POWER_TUNE is ignored.\n", tune_knob_name[k]);
+			delete t;
+			return;
+		}
+	}
+	t->current = t->baseline;
+	t->is_finished = false;
+
+	//	the candidates, which are common to all the sections
+	std::vector<pm_power_setting> v_knob;
+	v_knob.push_back(t->baseline);
+	for (int i=0; i<2; i++) {
+	for (int j=0; j<3; j++) {
+		pm_power_setting c = t->baseline;
+		c.value[I_knob_CPU] = Pm_tune_freq[i];
+		c.value[I_knob_ECO] = Pm_tune_eco[j];
+		if (std::find(v_knob.begin(), v_knob.end(), c) == v_knob.end()) v_knob.push_back(c);
+	}
+	}
+	power_tuner = t;
+	for (size_t n=0; n<t->section.size(); n++) {
+		pm_power_tune_section& s = t->section[n];
+		for (size_t i=0; i<v_knob.size(); i++) {
+			pm_power_trial r;
+			r.knob = v_knob[i];
+			r.n_calls = 0;
+			r.time = 0.0;
+			r.joule = 0.0;
+			r.is_failed = false;
+			s.trial.push_back(r);
+		}
+		//	the sections defined before initialize() completes, if any
+		int id = find_section_object(s.label);
+		if (id > 0) power_tune_register(id, s.label);
+	}
+
+	#ifdef DEBUG_PRINT_POWER_EXT
+	fprintf(stderr, "<initializePowerTune> %d sections, %d candidates, goal=%s, slowdown=%e, calls=%d\n",
+		(int)t->section.size(), (int)v_knob.size(), s_goal.c_str(), t->slowdown, t->n_calls);
+	#endif
+  }
+
+
+  /// 区間番号を調整対象の区間に対応付ける
+  ///
+  ///   @param[in] id     区間番号
+  ///   @param[in] label  ラベル
+  ///
+  ///   @note setProperties() で区間が作成された時に呼ばれる。
+  ///
+  void PerfMonitor::power_tune_register(int id, const std::string& label)
+  {
+	pm_power_tuner* t = power_tuner;
+	if (t == NULL) return;
+	for (size_t n=0; n<t->section.size(); n++) {
+		if (t->section[n].label == label) {
+			if ((int)t->index.size() <= id) t->index.resize(id+1, -1);
+			t->index[id] = (int)n;
+			t->section[n].id = id;
+			return;
+		}
+	}
+  }
+
+
+  /// 電力ノブを設定する. 現在値と同じノブは設定しない
+  ///
+  ///   @return true: 成功, false: 失敗
+  ///
+  bool PerfMonitor::power_tune_apply(const pm_power_setting& knob)
+  {
+	pm_power_tuner* t = power_tuner;
+	bool is_ok = true;
+	for (int k=0; k<Max_power_knob; k++) {
+		if (t->current.value[k] == knob.value[k]) continue;
+		int value = knob.value[k];
+		if (operatePowerKnob (k, 1, value) == 0) {
+			t->current.value[k] = value;
+		} else {
+			is_ok = false;
+		}
+	}
+	return is_ok;
+  }
+
+
+  /// 調整対象の区間の開始前に電力ノブを設定し、電力量を読む
+  ///
+  ///   @param[in] id     区間番号
+  ///
+  void PerfMonitor::power_tune_start(int id)
+  {
+	pm_power_tuner* t = power_tuner;
+	if (t->is_finished || (id >= (int)t->index.size()) || (t->index[id] < 0)) return;
+	#ifdef _OPENMP
+	if (omp_in_parallel()) return;
+	#endif
+	pm_power_tune_section& s = t->section[t->index[id]];
+
+	int n_trials = (int)s.trial.size();
+	while ((s.i_trial < n_trials) && s.trial[s.i_trial].is_failed) s.i_trial++;
+	if (s.i_trial < n_trials) {
+		if (!power_tune_apply(s.trial[s.i_trial].knob)) {
+			s.trial[s.i_trial].is_failed = true;
+			(void) power_tune_apply(t->baseline);
+			return;
+		}
+	} else {
+		(void) power_tune_apply(s.trial[s.i_choice].knob);
+		s.n_locked++;
+		return;
+	}
+
+	double joule[Max_power_stats];
+	PerfWatch& w = m_watchArray[id];
+	w.power_sample(pm_pacntxt, pm_extcntxt, pm_obj_array, pm_obj_ext, joule);
+	s.e_start = joule[0];
+	s.is_active = true;
+  }
+
+
+  /// 調整対象の区間の停止後に電力量を読み、ベースラインの電力ノブに戻す
+  ///
+  ///   @param[in] id     区間番号
+  ///
+  void PerfMonitor::power_tune_stop(int id)
+  {
+	pm_power_tuner* t = power_tuner;
+	if (t->is_finished || (id >= (int)t->index.size()) || (t->index[id] < 0)) return;
+	#ifdef _OPENMP
+	if (omp_in_parallel()) return;
+	#endif
+	pm_power_tune_section& s = t->section[t->index[id]];
+
+	if (s.is_active) {
+		s.is_active = false;
+		double joule[Max_power_stats];
+		double t_start, t_stop;
+		PerfWatch& w = m_watchArray[id];
+		w.power_sample(pm_pacntxt, pm_extcntxt, pm_obj_array, pm_obj_ext, joule);
+		w.lastInterval(t_start, t_stop);
+
+		pm_power_trial& r = s.trial[s.i_trial];
+		if (!s.is_warm) {
+			s.is_warm = true;
+		} else {
+			r.n_calls++;
+			r.time += (t_stop - t_start);
+			r.joule += (joule[0] - s.e_start);
+		}
+		if (r.n_calls >= t->n_calls) {
+			s.i_trial++;
+			s.is_warm = false;
+			if (s.i_trial >= (int)s.trial.size()) power_tune_choose(s);
+		}
+	}
+	(void) power_tune_apply(t->baseline);
+  }
+
+
+  /// 全ての候補の測定値から、許容する遅延の範囲で電力量またはEDPが最小の候補を選ぶ
+  ///
+  void PerfMonitor::power_tune_choose(pm_power_tune_section& s)
+  {
+	pm_power_tuner* t = power_tuner;
+	s.i_choice = 0;
+	const pm_power_trial& b = s.trial[0];
+	if (b.is_failed || (b.n_calls == 0)) return;
+	double t_base = b.time / b.n_calls;
+	double best = 0.0;
+	for (size_t i=0; i<s.trial.size(); i++) {
+		const pm_power_trial& r = s.trial[i];
+		if (r.is_failed || (r.n_calls == 0)) continue;
+		double t_call = r.time / r.n_calls;
+		double e_call = r.joule / r.n_calls;
+		if (t_call > t_base * (1.0 + t->slowdown)) continue;
+		double cost = (t->goal == 1) ? e_call * t_call : e_call;
+		if ((i == 0) || (cost < best)) {
+			best = cost;
+			s.i_choice = (int)i;
+		}
+	}
+  }
+
+
+  /// ベースラインの電力ノブに戻し、以後の調整を止める
+  ///
+  ///   @note stopRoot() から finalizePOWER() の前に呼ばれる。測定値はレポートのために残す。
+  ///
+  void PerfMonitor::finalizePowerTune(void)
+  {
+	if (power_tuner == NULL) return;
+	(void) power_tune_apply(power_tuner->baseline);
+	power_tuner->is_finished = true;
+  }
+
+
+  /// PMLIB_POWER_TUNE の各区間の選択結果を出力する
+  ///
+  ///   @param[in] fp       出力ファイルポインタ
+  ///   @param[in] maxLabelLen    ラベル文字長
+  ///
+  ///   @note printBasicPower() から呼ばれる。ランク0の測定値を表示する。
+  ///
+  void PerfMonitor::printPowerTune(FILE* fp, int maxLabelLen)
+  {
+	pm_power_tuner* t = power_tuner;
+	if (t == NULL) return;
+
+	fprintf(fp, "\n\tPower knob tuning by PMLIB_POWER_TUNE : goal=%s, allowed slowdown=%.1f%%, %d calls per setting\n",
+		(t->goal == 1) ? "EDP" : "ENERGY", t->slowdown * 100.0, t->n_calls);
+	fprintf(fp, "\tThe baseline is CPU=%d[MHz] MEMORY=%d ISSUE=%d PIPE=%d ECO=%d at initialize().\n\n",
+		t->baseline.value[I_knob_CPU], t->baseline.value[I_knob_MEMORY], t->baseline.value[I_knob_ISSUE],
+		t->baseline.value[I_knob_PIPE], t->baseline.value[I_knob_ECO]);
+
+	fprintf(fp, "Section"); for (int i=7; i< maxLabelLen; i++) { fputc(' ', fp); }
+	fprintf(fp, "| CPU[MHz]  ECO | time/call[s] energy/call[J] | time[%%]  energy[%%] | locked calls\n");
+	for (int i=0; i< maxLabelLen; i++) { fputc('-', fp); }
+	fprintf(fp, "+---------------+----------------------------+--------------------+-------------\n");
+
+	for (size_t n=0; n<t->section.size(); n++) {
+		const pm_power_tune_section& s = t->section[n];
+		fprintf(fp, "%-*s:", maxLabelLen, s.label.c_str());
+		int n_done = std::min(s.i_trial, (int)s.trial.size());
+		if (s.id < 0) {
+			fprintf(fp, " the section is not called.\n");
+			continue;
+		}
+		if (n_done < (int)s.trial.size()) {
+			fprintf(fp, " tuning is not finished. %d of %d settings are measured.\n", n_done, (int)s.trial.size());
+			continue;
+		}
+		const pm_power_trial& b = s.trial[0];
+		const pm_power_trial& r = s.trial[s.i_choice];
+		if (b.is_failed || (b.n_calls == 0) || (r.n_calls == 0)) {
+			fprintf(fp, " the power knobs could not be set.\n");
+			continue;
+		}
+		double t_base = b.time / b.n_calls;
+		double e_base = b.joule / b.n_calls;
+		double t_call = r.time / r.n_calls;
+		double e_call = r.joule / r.n_calls;
+		fprintf(fp, "  %6d  %5d |  %10.3e   %10.3e    | %+7.1f  %+8.1f  | %ld\n",
+			r.knob.value[I_knob_CPU], r.knob.value[I_knob_ECO], t_call, e_call,
+			(t_base > 0.0) ? (t_call / t_base - 1.0) * 100.0 : 0.0,
+			(e_base > 0.0) ? (e_call / e_base - 1.0) * 100.0 : 0.0,
+			s.n_locked);
+	}
+	for (int i=0; i< maxLabelLen; i++) { fputc('-', fp); }
+	fprintf(fp, "+---------------+----------------------------+--------------------+-------------\n");
+	fprintf(fp, "\ttime[%%] and energy[%%] are the change of the chosen setting against the baseline.\n");
+  }
+
+} /* namespace pm_lib */
+
@@ -25,6 +25,7 @@
 #endif
 #include <stdio.h>
 #include <string>
+#include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include "PerfMonitor.h"
@@ -159,6 +160,11 @@ void C_pm_initialize (int init_nWatch)
 ///
 void C_pm_start (char* fc)
 {
+	int id = (fc == NULL) ? -1 : PM.find_section_label(fc, strlen(fc));
+	if (id > 0) {
+		PM.start(id);
+		return;
+	}
 	std::string s;
 	s = fc;
 
@@ -182,6 +188,11 @@ void C_pm_start (char* fc)
 ///
 void C_pm_stop (char* fc)
 {
+	int id = (fc == NULL) ? -1 : PM.find_section_label(fc, strlen(fc));
+	if (id > 0) {
+		PM.stop(id);
+		return;
+	}
 	std::string s;
 	s = fc;
 
@@ -208,6 +219,11 @@ void C_pm_stop (char* fc)
 ///
 void C_pm_stop_usermode (char* fc, double fpt, unsigned tic)
 {
+	int id = (fc == NULL) ? -1 : PM.find_section_label(fc, strlen(fc));
+	if (id > 0) {
+		PM.stop(id, fpt, tic);
+		return;
+	}
 	std::string s;
 	s = fc;
 
@@ -222,6 +238,74 @@ void C_pm_stop_usermode (char* fc, double fpt, unsigned tic)
 }
 
 
+/// PMlib C interface
+/// return the section ID of the label
+///
+///   @param[in] label        the character label, i.e. name, of the measuring section
+///
+///   @return the section ID to be given to C_pm_start_id()/C_pm_stop_id().
+///   		(-1) if the section has not been created yet.
+///
+///   @note  the section is not created. Call it once after the section is created
+///          by C_pm_setproperties() or C_pm_start(), and use the ID in the loop.
+///
+int C_pm_sectionid (char* fc)
+{
+	if (fc == NULL) return(-1);
+	return PM.find_section_label(fc, strlen(fc));
+}
+
+
+/// PMlib C interface
+/// start the measurement section, using the section ID
+///
+///   @param[in] id        the section ID returned by C_pm_setproperties()
+///
+///   @note  the label lookup is skipped, so this is the cheapest way to start
+///          a section called very frequently.
+///
+void C_pm_start_id (int id)
+{
+#ifdef DEBUG_PRINT_MONITOR
+	fprintf(stderr, "<C_pm_start_id> id=%d \n", id);
+#endif
+	PM.start(id);
+	return;
+}
+
+
+/// PMlib C interface
+/// stop the measurement section, using the section ID
+///
+///   @param[in] id        the section ID returned by C_pm_setproperties()
+///
+void C_pm_stop_id (int id)
+{
+#ifdef DEBUG_PRINT_MONITOR
+	fprintf(stderr, "<C_pm_stop_id> id=%d \n", id);
+#endif
+	PM.stop(id);
+	return;
+}
+
+
+/// PMlib C interface
+/// stop the measurement section using the section ID, version for USER mode measurement.
+///
+///   @param[in] id           the section ID returned by C_pm_setproperties()
+///   @param[in] fpt          computing volume (FLOP) or moved data(Byte) in "USER" mode measurement
+///   @param[in] tic          the number of cycles in "USER" mode measurement
+///
+void C_pm_stop_usermode_id (int id, double fpt, unsigned tic)
+{
+#ifdef DEBUG_PRINT_MONITOR
+	fprintf(stderr, "<C_pm_stop_usermode_id> id=%d, fpt=%8.0lf, tic=%d \n", id, fpt, tic);
+#endif
+	PM.stop(id, fpt, tic);
+	return;
+}
+
+
 /// PMlib C interface
 /// @attention
 ///	Users should not call this routine directly.
@@ -264,6 +348,48 @@ void C_pm_select_report (char *fc)
 }
 
 
+//	the output file of C_pm_report_async, closed by C_pm_report_wait
+static FILE* fp_report_async = NULL;
+
+/// PMlib C interface
+/// start the non-blocking report generation
+///
+///   @param[in] char* fc         output file name(character array). if "" , stdout is chosen.
+///
+///   @note C_pm_report_wait() must be called before MPI_Finalize().
+///		The sections defined inside of parallel regions must have been
+///		merged by C_pm_mergethreads() as in C_pm_report().
+///
+void C_pm_report_async (char *fc)
+{
+	std::string s;
+	s=fc;
+
+	fp_report_async=stdout;
+	if (s != "") {
+		FILE *fp=fopen(fc,"a");
+		if (fp != NULL) fp_report_async=fp;
+	}
+	PM.report_async (fp_report_async);
+	return;
+}
+
+
+/// PMlib C interface
+/// complete the report started by C_pm_report_async()
+///
+void C_pm_report_wait (void)
+{
+	PM.report_wait ();
+
+	if (fp_report_async != NULL && fp_report_async != stdout) {
+		fclose(fp_report_async);
+	}
+	fp_report_async = NULL;
+	return;
+}
+
+
 /// PMlib C interface
 /// output BASIC report of the measured statistics
 ///
@@ -573,10 +699,13 @@ void C_pm_resetall (void)
 ///   @param[in] int f_type  測定対象タイプ(0:COMM:データ移動, 1:CALC:計算)
 ///   @param[in] int f_exclusive 排他測定フラグ(0:false, 1:true)
 ///
+///   @return 区間番号 the section ID to be given to C_pm_start_id()/C_pm_stop_id().
+///   		(-1) if the call is ignored.
+///
 ///   @note ラベルは測定区間を識別するために用いる。
 ///   		各ラベル毎に対応した区間番号は内部で自動生成する
 ///
-void C_pm_setproperties (char* fc, int f_type, int f_exclusive)
+int C_pm_setproperties (char* fc, int f_type, int f_exclusive)
 {
 
 	std::string s;
@@ -589,7 +718,7 @@ void C_pm_setproperties (char* fc, int f_type, int f_exclusive)
 #endif
 	if (s == "" ) {
 		fprintf(stderr, "<C_pm_setpropertie> label argument fc is (null). The call is ignored.\n");
-		return;
+		return(-1);
 	}
 	if (f_exclusive == 1) {
 		exclusive=true;
@@ -597,7 +726,7 @@ void C_pm_setproperties (char* fc, int f_type, int f_exclusive)
 		exclusive=false;
 	} else {
 		fprintf(stderr, "<C_pm_setpropertie> argument f_exclusive is invalid: %u . The call is ignored.\n", f_exclusive);
-		return;
+		return(-1);
 	}
 	//	PM.setProperties(s, f_type, exclusive);
 	if (f_type == 0) {
@@ -606,10 +735,9 @@ void C_pm_setproperties (char* fc, int f_type, int f_exclusive)
 		arg_type = PM.CALC;
 	} else {
 		fprintf(stderr, "<C_pm_setproperties> argument f_type is invalid: %u . The call is ignored. \n", f_type);
-		return;
+		return(-1);
 	}
-	PM.setProperties(s, arg_type, exclusive);
-	return;
+	return PM.setProperties(s, arg_type, exclusive);
 }
 
 
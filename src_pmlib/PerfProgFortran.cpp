@@ -28,6 +28,7 @@
 #include "stdlib.h"
 #include <unistd.h>
 #include <PerfMonitor.h>
+#include <algorithm>
 
 #ifndef _OPENMP
 using namespace pm_lib;
@@ -146,6 +147,11 @@ void f_pm_initialize_ (int& init_nWatch)
 ///
 void f_pm_start_ (char* fc, int fc_size)
 {
+	int id = PM.find_section_label(fc, fc_size);
+	if (id > 0) {
+		PM.start(id);
+		return;
+	}
 	std::string s=std::string(fc,fc_size);
 
 	#ifdef DEBUG_PRINT_MONITOR
@@ -176,6 +182,11 @@ void f_pm_start_ (char* fc, int fc_size)
 ///
 void f_pm_stop_ (char* fc, int fc_size)
 {
+	int id = PM.find_section_label(fc, fc_size);
+	if (id > 0) {
+		PM.stop(id);
+		return;
+	}
 	std::string s=std::string(fc,fc_size);
 
 	#ifdef DEBUG_PRINT_MONITOR
@@ -205,6 +216,11 @@ void f_pm_stop_ (char* fc, int fc_size)
 ///
 void f_pm_stop_usermode_ (char* fc, double& fpt, unsigned& tic, int fc_size)
 {
+	int id = PM.find_section_label(fc, fc_size);
+	if (id > 0) {
+		PM.stop(id, fpt, tic);
+		return;
+	}
 	std::string s=std::string(fc,fc_size);
 
 	if (s == "") {
@@ -215,6 +231,66 @@ void f_pm_stop_usermode_ (char* fc, double& fpt, unsigned& tic, int fc_size)
 }
 
 
+/// PMlib Fortran interface
+/// return the section ID of the label
+///
+///   @param[in]  label        the character label, i.e. name, of the measuring section
+///   @param[out] id           the section ID to be given to f_pm_start_id()/f_pm_stop_id().
+///   			(-1) if the section has not been created yet.
+///   @param[in]  int fc_size  the length of the character label.
+///
+///   @note  the section is not created. Call it once after the section is created
+///          by f_pm_setproperties() or f_pm_start(), and use the ID in the loop.
+///          for example, call f_pm_sectionid ("myname", id)
+///
+void f_pm_sectionid_ (char* fc, int& id, int fc_size)
+{
+	id = PM.find_section_label(fc, fc_size);
+	return;
+}
+
+
+/// PMlib Fortran interface
+/// start the measurement section, using the section ID
+///
+///   @param[in] id        the section ID returned by f_pm_setproperties_id()
+///
+///   @note  the label lookup is skipped, so this is the cheapest way to start
+///          a section called very frequently.
+///
+void f_pm_start_id_ (int& id)
+{
+	PM.start(id);
+	return;
+}
+
+
+/// PMlib Fortran interface
+/// stop the measurement section, using the section ID
+///
+///   @param[in] id        the section ID returned by f_pm_setproperties_id()
+///
+void f_pm_stop_id_ (int& id)
+{
+	PM.stop(id);
+	return;
+}
+
+
+/// PMlib Fortran interface
+/// stop the measurement section using the section ID, version for USER mode measurement.
+///
+///   @param[in] id           the section ID returned by f_pm_setproperties_id()
+///   @param[in] fpt          computing volume (FLOP) or moved data(Byte) in "USER" mode measurement
+///   @param[in] tic          the number of cycles in "USER" mode measurement
+///
+void f_pm_stop_usermode_id_ (int& id, double& fpt, unsigned& tic)
+{
+	PM.stop(id, fpt, tic);
+	return;
+}
+
+
 //> PMlib Fortran interface
 /// @attention
 /// Users should not call this routine directly.
@@ -262,6 +338,53 @@ void f_pm_select_report_ (char* fc, int fc_size)
 }
 
 
+//	the output file of f_pm_report_async, closed by f_pm_report_wait
+static FILE* fp_report_async = NULL;
+
+//> PMlib Fortran interface
+/// start the non-blocking report generation
+///
+///   @param[in] char* fc         output file name(character array). if "" , stdout is chosen.
+///   @param[in] int fc_size      the number of characters in fc
+///
+///   @note f_pm_report_wait() must be called before MPI_Finalize().
+///
+void f_pm_report_async_ (char* fc, int fc_size)
+{
+	std::string s;
+	char fn[512];
+
+	// argument fc may contain some garbage characters in tail. so cut them off.
+	int n_size = std::min(fc_size, (int)sizeof(fn)-1);
+	strncpy (fn, fc, n_size);
+	fn[n_size] = '\0';
+	s=fn;
+
+	fp_report_async=stdout;
+	if (s != "" && fc_size != 0) {
+		FILE *fp=fopen(fn,"a");
+		if (fp != NULL) fp_report_async=fp;
+	}
+	PM.report_async(fp_report_async);
+	return;
+}
+
+
+//> PMlib Fortran interface
+/// complete the report started by f_pm_report_async()
+///
+void f_pm_report_wait_ (void)
+{
+	PM.report_wait();
+
+	if (fp_report_async != NULL && fp_report_async != stdout) {
+		fclose(fp_report_async);
+	}
+	fp_report_async = NULL;
+	return;
+}
+
+
 //> PMlib Fortran interface
 /// output BASIC report of the measured statistics
 ///
@@ -588,6 +711,8 @@ void f_pm_resetall_ (void)
 ///   @param[in] char* fc ラベルとなる character文字列
 ///   @param[in] int f_type  測定対象タイプ(0:COMM:データ移動, 1:CALC:計算)
 ///   @param[in] int f_exclusive 排他測定フラグ(0:false, 1:true)
+///   @param[out] int id  区間番号 the section ID to be given to f_pm_start_id()/f_pm_stop_id()
+///   			(-1) if the call is ignored.
 ///   @param[in] int fc_size  character文字列ラベルの長さ（文字数）
 ///
 ///   @note ラベルは測定区間を識別するために用いる。
@@ -595,7 +720,7 @@ void f_pm_resetall_ (void)
 ///   @note fc_sizeはFortranコンパイラが自動的に追加してしまう引数。
 ///			ユーザがFortranプログラムから呼び出す場合に指定する必要はない。
 ///
-void f_pm_setproperties_ (char* fc, int& f_type, int& f_exclusive, int fc_size)
+void f_pm_setproperties_id_ (char* fc, int& f_type, int& f_exclusive, int& id, int fc_size)
 {
 	//	Note on fortran character 2 C++ string
 	//	Although the auto appended fc_size argument value is correct,
@@ -605,6 +730,7 @@ void f_pm_setproperties_ (char* fc, int& f_type, int& f_exclusive, int fc_size)
 	//	So, we do explicit string conversion here...
 	std::string s=std::string(fc,fc_size);
 	bool exclusive;
+	id = -1;
     PerfMonitor::Type arg_type; /// 測定対象タイプ from PerfMonitor.h
 
 	#ifdef DEBUG_PRINT_MONITOR
@@ -631,7 +757,28 @@ void f_pm_setproperties_ (char* fc, int& f_type, int& f_exclusive, int fc_size)
 		fprintf(stderr, "<f_pm_setproperties> argument f_type is invalid: %u . The call is ignored. \n", f_type);
 		return;
 	}
-	PM.setProperties(s, arg_type, exclusive);
+	id = PM.setProperties(s, arg_type, exclusive);
+	return;
+}
+
+
+/// PMlib Fortran インタフェイス
+/// 測定区間にプロパティを設定.
+///
+///   @param[in] char* fc ラベルとなる character文字列
+///   @param[in] int f_type  測定対象タイプ(0:COMM:データ移動, 1:CALC:計算)
+///   @param[in] int f_exclusive 排他測定フラグ(0:false, 1:true)
+///   @param[in] int fc_size  character文字列ラベルの長さ（文字数）
+///
+///   @note ラベルは測定区間を識別するために用いる。
+///   		各ラベル毎に対応した区間番号は内部で自動生成する
+///   @note fc_sizeはFortranコンパイラが自動的に追加してしまう引数。
+///			ユーザがFortranプログラムから呼び出す場合に指定する必要はない。
+///
+void f_pm_setproperties_ (char* fc, int& f_type, int& f_exclusive, int fc_size)
+{
+	int id;
+	f_pm_setproperties_id_ (fc, f_type, f_exclusive, id, fc_size);
 	return;
 }
 
@@ -6,10 +6,40 @@
 #include "power_obj_menu.h"
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 #include <cerrno>
+#include <cstring>
 
 
 namespace pm_lib {
+
+  extern struct pmlib_timer_chooser pm_timer;
+
+  /// write the whole record into the file
+  ///
+  ///   @return false if the file can not be written. errno tells the reason.
+  ///
+  static bool write_pm_file(const std::string& file_name, const char* p_buf, size_t total_size)
+  {
+	int fd = open(file_name.c_str(), O_WRONLY|O_CREAT|O_TRUNC, 0600);
+	if (fd < 0) return false;
+	size_t n_done = 0;
+	while (n_done < total_size) {
+		ssize_t n_write = write(fd, p_buf + n_done, total_size - n_done);
+		if (n_write < 0) {
+			if (errno == EINTR) continue;
+			int save_errno = errno;
+			close(fd);
+			errno = save_errno;
+			return false;
+		}
+		n_done += n_write;
+	}
+	return (close(fd) == 0);
+  }
+
+
 //
 //	PerfMonitor class
 //
@@ -55,28 +85,129 @@ namespace pm_lib {
 	fprintf(stderr, "<save_pm_records> writing to %s\n", file_name.c_str());
 	#endif
 
-	FILE *fp;
-	fp=fopen(file_name.c_str(),"w+");
-	if (fp == NULL) {
-		fprintf(stderr, "*** ShellPM Error. <save_pm_records> can not open %s ***\n", file_name.c_str());
+	size_t total_size;
+	char* p_buf = PerfMonitor::pack_pm_records(total_size);
+	if (!write_pm_file(file_name, p_buf, total_size)) {
+		fprintf(stderr, "*** ShellPM Error. <save_pm_records> can not write %s errno=%d ***\n", file_name.c_str(), errno);
 		exit(99);
 	}
+	delete [] p_buf;
+
+	#ifdef DEBUG_PRINT_MONITOR
+	fprintf(stderr, "<save_pm_records> wrote %zu Bytes: %d sections, %d threads\n",
+		total_size, m_nWatch, num_threads);
+	#endif
+  }
+
+  /// compose the record of all the sections in memory
+  ///
+  ///   @param[out] total_size   size of the record in Byte
+  ///
+  ///   @return the record buffer. the caller deletes it.
+  ///
+  ///   @note See include/pmlib_record.h for the layout.
+  ///
+  char* PerfMonitor::pack_pm_records(size_t& total_size)
+  {
+	int nthreads = num_threads;
+	int nevents = m_watchArray[0].my_papi.num_events;
+	size_t n_counter = (size_t)nthreads * (size_t)nevents;
+	size_t n_thread = (size_t)nthreads * Pm_record_thread_size;
+	total_size = sizeof(pm_record_header)
+					+ (size_t)m_nWatch * sizeof(pm_record_section)
+					+ (size_t)m_nWatch * 2 * n_counter * sizeof(long long)
+					+ (size_t)m_nWatch * n_thread * sizeof(double);
+
+	char* p_buf = new char[total_size];
+	memset(p_buf, 0, total_size);
+
+	pm_record_header* p_head = (pm_record_header*)p_buf;
+	pm_record_section* p_table = (pm_record_section*)(p_buf + sizeof(pm_record_header));
+	long long* p_block = (long long*)(p_table + m_nWatch);
+	double* p_threads = (double*)(p_block + (size_t)m_nWatch * 2 * n_counter);
+
+	memcpy(p_head->magic, Pm_record_magic, sizeof(p_head->magic));
+	p_head->version = Pm_record_version;
+	p_head->header_size = sizeof(pm_record_header);
+	p_head->section_size = sizeof(pm_record_section);
+	p_head->num_sections = m_nWatch;
+	p_head->num_threads = nthreads;
+	p_head->num_events = nevents;
+	strncpy(p_head->hwpc_chooser, env_str_hwpc.c_str(), Pm_record_chooser_size-1);
+	p_head->nest_depth = std::min(m_nest_depth, Pm_max_nest_depth);
+	p_head->timer_source = pm_timer.source;
+	p_head->total_size = total_size;
+	p_head->rank = my_rank;
+	p_head->num_process = num_process;
+	for (int i=0; i<nevents; i++) {
+		strncpy(p_head->event_name[i], m_watchArray[0].my_papi.s_name[i].c_str(), Pm_record_event_size-1);
+	}
 
-	fprintf(fp,"ShellPM HWPC_CHOOSER=%s\n", env_str_hwpc.c_str());
 	for (int i=0; i<m_nWatch; i++) {
-		m_watchArray[i].save_pm_records(fp);
+		m_watchArray[i].save_pm_records(&p_table[i], p_block + (size_t)i*2*n_counter,
+			p_threads + (size_t)i*n_thread, nthreads, nevents);
+		p_table[i].nest_level = -1;
 		#ifdef USE_POWER
 		if (level_POWER != 0)
 		//	m_watchArray[id].save_power_records( pm_pacntxt, pm_extcntxt, pm_obj_array, pm_obj_ext);
+		;
 		#endif
 	}
 
-	fclose(fp);
+	//	The open frames of the section stack
+	for (int k=0; k<p_head->nest_depth; k++) {
+		const pm_nest_frame& f = m_nest_stack[k];
+		p_table[f.id].nest_level = k;
+		p_table[f.id].nest_has_child = f.has_child ? 1 : 0;
+		p_table[f.id].time_child_open = f.time_child;
+		for (int j=0; j<Max_group_events; j++) p_table[f.id].hwpc_child_open[j] = f.hwpc_child[j];
+	}
+	return p_buf;
   }
 
-  void PerfMonitor::load_pm_records(void)
+
+  /// PMLIB_DUMP=<prefix> : write the record of this process to <prefix>_<rank>.pmrec
+  ///
+  ///   @return true if PMLIB_DUMP is set. The collective report is not produced then,
+  ///		even if the file could not be written, so that all the processes agree.
+  ///
+  ///   @note called by selectReport() after the threads are merged.
+  ///		pm_merge command produces the report from the files.
+  ///
+  bool PerfMonitor::dump_pm_records(FILE* fp)
   {
-    if (!is_PMlib_enabled) return;
+	char* cp_env = std::getenv("PMLIB_DUMP");
+	if (cp_env == NULL) return false;
+
+	char file_name[1024];
+	snprintf(file_name, sizeof(file_name), "%s_%d.pmrec", cp_env, my_rank);
+
+	size_t total_size;
+	char* p_buf = PerfMonitor::pack_pm_records(total_size);
+	if (!write_pm_file(file_name, p_buf, total_size)) {
+		printDiag("dump_pm_records()",  "can not write the record file %s : %s\n", file_name, strerror(errno));
+	}
+	delete [] p_buf;
+
+	if (my_rank == 0) {
+		fprintf(fp, "\n# PMlib report is not produced. PMLIB_DUMP=%s : each process wrote %s_<rank>.pmrec\n", cp_env, cp_env);
+		fprintf(fp, "#\tRun pm_merge %s_*.pmrec to produce the report.\n", cp_env);
+	}
+	return true;
+  }
+
+
+  /// load the record saved by the previous start_pm/stop_pm
+  ///
+  ///   @return true if the record has been restored.
+  ///		false if there is no record or the record can not be trusted.
+  ///
+  ///   @note the sections in the record which are not defined yet are created
+  ///		in the saved order. the record file itself is kept.
+  ///
+  bool PerfMonitor::load_pm_records(void)
+  {
+    if (!is_PMlib_enabled) return false;
 
 	std::string file_name;
 	std::string dir_name;
@@ -85,26 +216,133 @@ namespace pm_lib {
 
 	file_name = dir_name + "/" + file_name;
 
-	FILE *fp;
-	fp=fopen(file_name.c_str(),"r");
-	if (fp == NULL) {
-		fprintf(stderr, "*** ShellPM Error. <load_pm_records> can not open %s\n", file_name.c_str());
-		exit(99);
+	int fd = open(file_name.c_str(), O_RDONLY);
+	if (fd < 0) {
+		if (errno != ENOENT) {
+			fprintf(stderr, "*** ShellPM Error. <load_pm_records> can not open %s\n", file_name.c_str());
+		}
+		return false;
 	}
 
 	#ifdef DEBUG_PRINT_MONITOR
 	fprintf(stderr, "<load_pm_records> reading %s\n", file_name.c_str());
 	#endif
 
-	fprintf(fp,"ShellPM HWPC_CHOOSER=%s\n", env_str_hwpc.c_str());
-	for (int i=0; i<m_nWatch; i++) {
-		m_watchArray[i].load_pm_records(fp);
+	struct stat st;
+	if ((fstat(fd, &st) != 0) || ((size_t)st.st_size < sizeof(pm_record_header))) {
+		fprintf(stderr, "*** ShellPM Error. <load_pm_records> %s is not a ShellPM record\n", file_name.c_str());
+		close(fd);
+		return false;
+	}
+	size_t total_size = st.st_size;
+	void* p_map = mmap(NULL, total_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (p_map == MAP_FAILED) {
+		fprintf(stderr, "*** ShellPM Error. <load_pm_records> mmap failed %s errno=%d\n", file_name.c_str(), errno);
+		return false;
+	}
+
+	//	Validate the header before trusting any of the values
+	const char* p_buf = (const char*)p_map;
+	const pm_record_header* p_head = (const pm_record_header*)p_buf;
+	int nthreads = num_threads;
+	int nevents = m_watchArray[0].my_papi.num_events;
+
+	if ( (memcmp(p_head->magic, Pm_record_magic, sizeof(p_head->magic)) != 0)
+		|| (p_head->version != Pm_record_version)
+		|| (p_head->header_size != (int)sizeof(pm_record_header))
+		|| (p_head->section_size != (int)sizeof(pm_record_section)) ) {
+		fprintf(stderr, "*** ShellPM Error. <load_pm_records> %s has an incompatible record format\n", file_name.c_str());
+		munmap(p_map, total_size);
+		return false;
+	}
+	size_t n_counter = (size_t)p_head->num_threads * (size_t)p_head->num_events;
+	size_t expected_size = sizeof(pm_record_header)
+					+ (size_t)p_head->num_sections * sizeof(pm_record_section)
+					+ (size_t)p_head->num_sections * 2 * n_counter * sizeof(long long)
+					+ (size_t)p_head->num_sections * p_head->num_threads * Pm_record_thread_size * sizeof(double);
+	if ( (p_head->num_sections < 0) || (p_head->num_threads < 0) || (p_head->num_events < 0)
+		|| ((size_t)p_head->total_size != total_size) || (expected_size != total_size) ) {
+		fprintf(stderr, "*** ShellPM Error. <load_pm_records> %s is truncated or corrupted\n", file_name.c_str());
+		munmap(p_map, total_size);
+		return false;
+	}
+	if ( (p_head->num_threads != nthreads) || (p_head->num_events != nevents)
+		|| (strncmp(p_head->hwpc_chooser, env_str_hwpc.c_str(), Pm_record_chooser_size) != 0) ) {
+		fprintf(stderr, "*** ShellPM Error. <load_pm_records> the record does not match the current run.\n");
+		fprintf(stderr, "\t record : HWPC_CHOOSER=%.*s, num_threads=%d, num_events=%d\n",
+			Pm_record_chooser_size, p_head->hwpc_chooser, p_head->num_threads, p_head->num_events);
+		fprintf(stderr, "\t current: HWPC_CHOOSER=%s, num_threads=%d, num_events=%d\n",
+			env_str_hwpc.c_str(), nthreads, nevents);
+		munmap(p_map, total_size);
+		return false;
+	}
+
+	if (p_head->timer_source != pm_timer.source) {
+		fprintf(stderr, "*** ShellPM Error. <load_pm_records> the record was measured with another PMLIB_TIMER source.\n");
+		fprintf(stderr, "\t Set the same PMLIB_TIMER value for all ShellPM commands. current: %s\n", pm_timer.name.c_str());
+		munmap(p_map, total_size);
+		return false;
+	}
+
+	const pm_record_section* p_table = (const pm_record_section*)(p_buf + sizeof(pm_record_header));
+	const long long* p_block = (const long long*)(p_table + p_head->num_sections);
+
+	int nest_depth = std::min(std::max(p_head->nest_depth, 0), Pm_max_nest_depth);
+	m_nest_depth = 0;
+	for (int i=0; i<p_head->num_sections; i++) {
+		std::string s_label(p_table[i].label, strnlen(p_table[i].label, Pm_record_label_size));
+		if (s_label.empty()) continue;
+		int id = find_section_object(s_label);
+		if (id < 0) {
+			PerfMonitor::setProperties(s_label, (p_table[i].type_calc == 0) ? COMM : CALC,
+				(p_table[i].exclusive != 0));
+			id = find_section_object(s_label);
+			#ifdef DEBUG_PRINT_MONITOR
+			fprintf(stderr, "<load_pm_records> section [%s] is created. id=%d\n", s_label.c_str(), id);
+			#endif
+		}
+		m_watchArray[id].load_pm_records(&p_table[i], p_block + (size_t)i*2*n_counter, nthreads, nevents);
+
+		//	Rebuild the open frame of the section stack
+		int k = p_table[i].nest_level;
+		if ((k >= 0) && (k < nest_depth)) {
+			pm_nest_frame& f = m_nest_stack[k];
+			f.id = id;
+			f.has_child = (p_table[i].nest_has_child != 0);
+			f.time_child = p_table[i].time_child_open;
+			for (int j=0; j<Max_group_events; j++) f.hwpc_child[j] = p_table[i].hwpc_child_open[j];
+			m_nest_depth++;
+		}
 		#ifdef USE_POWER
 		if (level_POWER != 0)
 		//	m_watchArray[id].load_power_records( pm_pacntxt, pm_extcntxt, pm_obj_array, pm_obj_ext);
+		;
 		#endif
 	}
-	fclose(fp);
+
+	if (m_nest_depth != nest_depth) {
+		printDiag("load_pm_records",  "the section stack could not be restored. %d of %d open sections\n",
+			m_nest_depth, nest_depth);
+		m_nest_depth = 0;
+	}
+	munmap(p_map, total_size);
+	return true;
+  }
+
+
+  /// delete the record file after the final report
+  ///
+  void PerfMonitor::remove_pm_records(void)
+  {
+    if (!is_PMlib_enabled) return;
+
+	std::string file_name;
+	std::string dir_name;
+	PerfMonitor::pm_storage_file_name(file_name);
+	PerfMonitor::pm_storage_dir_name(dir_name);
+
+	file_name = dir_name + "/" + file_name;
 
 	// delete the data record
 	int iret = remove(file_name.c_str());
@@ -127,6 +365,27 @@ namespace pm_lib {
 
   }
 
+  /// stop the sections which are still active, before the final report
+  ///
+  ///   @note the sections on the section stack are stopped from the inner most one.
+  ///		the rest are stopped in the reverse order of creation. Root section is not stopped here.
+  ///
+  void PerfMonitor::stop_active_sections(void)
+  {
+    if (!is_PMlib_enabled) return;
+
+	while ((m_nest_depth > 0) && (m_nest_depth <= Pm_max_nest_depth)) {
+		int depth = m_nest_depth;
+		PerfMonitor::stop(m_watchArray[m_nest_stack[depth-1].id].m_label);
+		if (m_nest_depth == depth) break;
+	}
+	for (int i=m_nWatch-1; i>0; i--) {
+		if (m_watchArray[i].is_started()) {
+			PerfMonitor::stop(m_watchArray[i].m_label);
+		}
+	}
+  }
+
   void PerfMonitor::pm_storage_file_name(std::string& pm_file_name)
   {
 	char* cp_env;
@@ -184,7 +443,7 @@ namespace pm_lib {
 //	PerfWatch class
 //
 
-  void PerfWatch::save_pm_records(FILE* fp)
+  void PerfWatch::save_pm_records(pm_record_section* p_sec, long long* p_values, double* p_threads, int nthreads, int nevents)
   {
 	#ifdef DEBUG_PRINT_MONITOR
 	fprintf(stderr, "<PerfWatch::save_pm_records> section [%s]\n", m_label.c_str());
@@ -193,19 +452,45 @@ namespace pm_lib {
 	//
 	// Saving the values in external storage device
 	//
+	if (m_label.size() >= (size_t)Pm_record_label_size) {
+		printError("save_pm_records",  "label [%s] is truncated to %d characters\n",
+			m_label.c_str(), Pm_record_label_size-1);
+	}
+	strncpy(p_sec->label, m_label.c_str(), Pm_record_label_size-1);
+	p_sec->id = m_id;
+	p_sec->started = m_started ? 1 : 0;
+	p_sec->exclusive = m_exclusive ? 1 : 0;
+	p_sec->type_calc = m_typeCalc;
+	p_sec->in_parallel = m_in_parallel ? 1 : 0;
+	p_sec->child_in_parallel = m_child_in_parallel ? 1 : 0;
+	p_sec->start_time = m_startTime;
+	p_sec->count = m_count;
+	p_sec->time = m_time;
+	p_sec->flop = m_flop;
+	p_sec->count_sampled = m_count_sampled;
+	p_sec->time_child = m_time_child;
+	for (int i=0; i<Max_group_events; i++) p_sec->hwpc_child[i] = m_hwpc_child[i];
+	p_sec->rot_mark = m_rot_mark;
+	for (int k=0; k<Max_hwpc_output_group; k++) {
+		p_sec->rot_time[k] = m_rot_time[k];
+		p_sec->rot_calls[k] = m_rot_calls[k];
+		p_sec->rot_mean[k] = m_rot_mean[k];
+		p_sec->rot_m2[k] = m_rot_m2[k];
+	}
 
-//    m_started;	// = should be true;
-//    m_threads_merged;	// = should be false;
-//    m_startTime;	// = getTime();
-	fprintf(fp, "section %s m_startTime= %20.15e\n", m_label.c_str(), m_startTime);
-	fprintf(fp, "num_threads= %d, my_papi.num_events= %d\n", num_threads, my_papi.num_events);
-	fprintf(fp, "my_papi.th_values[num_threads][my_papi.num_events]:\n" );
-
-	for (int j=0; j<num_threads; j++) {
-        for (int i=0; i<my_papi.num_events; i++) {
-			fprintf(fp, "%lld\n", my_papi.th_values[j][i]);
+	long long* p_accumu = p_values + nthreads*nevents;
+	for (int j=0; j<nthreads; j++) {
+        for (int i=0; i<nevents; i++) {
+			p_values[j*nevents+i] = my_papi.th_values[j][i];
+			p_accumu[j*nevents+i] = is_scaled() ? my_papi.th_sampled[j][i] : my_papi.th_accumu[j][i];
         }
 	}
+	//	th_v_sorted[j][0:2] keep m_count, m_time, m_flop of each thread. See PerfWatch::stop()
+	for (int j=0; j<nthreads && j<my_papi.th_nthreads; j++) {
+		for (int i=0; i<Pm_record_thread_size; i++) {
+			p_threads[j*Pm_record_thread_size+i] = my_papi.th_v_sorted[j][i];
+		}
+	}
 	#ifdef USE_POWER
 	if (level_POWER != 0)
 ;
@@ -213,9 +498,67 @@ namespace pm_lib {
   }
 
 
-  void PerfWatch::load_pm_records(FILE* fp)
+  bool PerfWatch::load_pm_records(const pm_record_section* p_sec, const long long* p_values, int nthreads, int nevents)
   {
+	#ifdef DEBUG_PRINT_MONITOR
+	fprintf(stderr, "<PerfWatch::load_pm_records> section [%s] started=%d\n", m_label.c_str(), p_sec->started);
+	#endif
+
+	if ( (nthreads != num_threads) || (nevents != my_papi.num_events)
+		|| (nthreads > my_papi.th_nthreads) || (nevents > Max_chooser_events) ) {
+		printError("load_pm_records",  "[%s] record has %d threads %d events, expected %d threads %d events\n",
+			m_label.c_str(), nthreads, nevents, num_threads, my_papi.num_events);
+		return false;
+	}
+
+	//	The accumulated values of the previous invocations
+	m_exclusive = (p_sec->exclusive != 0);
+	m_count = p_sec->count;
+	m_time = p_sec->time;
+	m_flop = p_sec->flop;
+	m_time_child = p_sec->time_child;
+	m_child_in_parallel = (p_sec->child_in_parallel != 0);
+	for (int i=0; i<Max_group_events; i++) m_hwpc_child[i] = p_sec->hwpc_child[i];
+	m_rot_mark = p_sec->rot_mark;
+	for (int k=0; k<Max_hwpc_output_group; k++) {
+		m_rot_time[k] = p_sec->rot_time[k];
+		m_rot_calls[k] = p_sec->rot_calls[k];
+		m_rot_mean[k] = p_sec->rot_mean[k];
+		m_rot_m2[k] = p_sec->rot_m2[k];
+	}
+	m_threads_merged = false;
+
+	const long long* p_accumu = p_values + nthreads*nevents;
+	for (int j=0; j<nthreads; j++) {
+        for (int i=0; i<nevents; i++) {
+			my_papi.th_values[j][i] = p_values[j*nevents+i];
+			my_papi.th_accumu[j][i] = p_accumu[j*nevents+i];
+        }
+	}
+	my_papi.th_v_sorted[my_thread][0] = (double)m_count;
+	my_papi.th_v_sorted[my_thread][1] = m_time;
+	my_papi.th_v_sorted[my_thread][2] = m_flop;
+	//	The sampled and the rotated sections keep the accumulated HWPC in th_sampled[][]
+	m_count_sampled = p_sec->count_sampled;
+	if (is_scaled() && (my_papi.th_sampled.data != NULL)) {
+		for (int j=0; j<nthreads; j++) {
+			for (int i=0; i<nevents; i++) {
+				my_papi.th_sampled[j][i] = my_papi.th_accumu[j][i];
+			}
+		}
+	}
+
+	//	The active section is resumed as if it had been started in the previous invocation
+    m_started = (p_sec->started != 0);
+	if (m_started) {
+		m_startTime = p_sec->start_time;
+		m_sample_now = (m_sample_interval <= 1) || (m_count % m_sample_interval == 0) || (statsSwitch() < 2);
+	}
+	#ifdef USE_POWER
+	if (level_POWER != 0)
 ;
+	#endif
+	return true;
   }
 
 } /* namespace pm_lib */
@@ -0,0 +1,192 @@
+/*
+###################################################################################
+#
+# PMlib - Performance Monitor Library
+#
+# Copyright (c) 2010-2011 VCAD System Research Program, RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2012-2020 Advanced Institute for Computational Science(AICS), RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2016-2020 Research Institute for Information Technology(RIIT), Kyushu University.
+# All rights reserved.
+#
+###################################################################################
+ */
+
+//! @file   PerfRegistry.cpp
+//! @brief  lock-free append-only registry of the shared section labels
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <cstdio>
+
+#include "pmlib_registry.h"
+
+namespace pm_lib {
+
+  //	The registry consists of
+  //	(1) a chain of open addressing hash tables holding the interned labels.
+  //		a new table of double size is chained when the probe sequence of a
+  //		label is full. tables and entries are never moved nor freed.
+  //	(2) the ID indexed segments pointing to the same entries.
+  //		segment k has (Registry_seg_base << k) entries.
+
+  const int Registry_table_base = 1024;	// slots in the first hash table
+  const int Registry_seg_base = 256;	// entries in the first ID segment
+  const int Registry_max_segs = 24;
+
+  struct registry_entry {
+	std::string label;
+	size_t hash;
+	std::atomic<int> id;	// (-1) until the ID is published
+  };
+
+  struct registry_table {
+	int capacity;			// power of 2
+	int max_probe;
+	std::atomic<registry_entry*>* slots;
+	std::atomic<registry_table*> next;
+  };
+
+  static registry_table* new_registry_table(int capacity)
+  {
+	registry_table* t = new registry_table;
+	t->capacity = capacity;
+	t->max_probe = capacity/4;
+	t->slots = new std::atomic<registry_entry*>[capacity];
+	for (int i=0; i<capacity; i++) t->slots[i].store(NULL, std::memory_order_relaxed);
+	t->next.store(NULL, std::memory_order_relaxed);
+	return t;
+  }
+
+  static registry_table* registry_head = new_registry_table(Registry_table_base);
+  static std::atomic<int> registry_count(0);
+  static std::atomic<std::atomic<registry_entry*>*> registry_segs[Registry_max_segs];
+
+
+  /// locate the segment and offset of the shared section ID
+  ///
+  static inline void id_to_segment(int id, int& k, int& offset)
+  {
+	int x = id / Registry_seg_base + 1;
+	k = 0;
+	while (x > 1) { x >>= 1; k++; }
+	offset = id - Registry_seg_base * ((1<<k) - 1);
+  }
+
+  static void publish_id(registry_entry* e, int id)
+  {
+	int k, offset;
+	id_to_segment(id, k, offset);
+	if (k >= Registry_max_segs) {
+		fprintf(stderr, "*** PMlib Error. <shared_section_insert> too many sections: %d\n", id);
+		e->id.store(id, std::memory_order_release);
+		return;
+	}
+	std::atomic<registry_entry*>* seg = registry_segs[k].load(std::memory_order_acquire);
+	if (seg == NULL) {
+		int n = Registry_seg_base << k;
+		std::atomic<registry_entry*>* seg_new = new std::atomic<registry_entry*>[n];
+		for (int i=0; i<n; i++) seg_new[i].store(NULL, std::memory_order_relaxed);
+		if (registry_segs[k].compare_exchange_strong(seg, seg_new, std::memory_order_acq_rel)) {
+			seg = seg_new;
+		} else {
+			delete [] seg_new;	// another thread has installed the segment. seg is updated.
+		}
+	}
+	seg[offset].store(e, std::memory_order_release);
+	e->id.store(id, std::memory_order_release);
+  }
+
+  static int wait_id(registry_entry* e)
+  {
+	int id;
+	while ((id = e->id.load(std::memory_order_acquire)) < 0) { ; }
+	return id;
+  }
+
+
+  int shared_section_insert (const std::string& label)
+  {
+	size_t h = std::hash<std::string>()(label);
+	registry_entry* e_new = NULL;
+	registry_table* t = registry_head;
+
+	while (true) {
+		int mask = t->capacity - 1;
+		for (int p=0; p<t->max_probe; p++) {
+			std::atomic<registry_entry*>& slot = t->slots[(h + p) & mask];
+			registry_entry* e = slot.load(std::memory_order_acquire);
+			if (e == NULL) {
+				if (e_new == NULL) {
+					e_new = new registry_entry;
+					e_new->label = label;
+					e_new->hash = h;
+					e_new->id.store(-1, std::memory_order_relaxed);
+				}
+				if (slot.compare_exchange_strong(e, e_new, std::memory_order_acq_rel)) {
+					int id = registry_count.fetch_add(1, std::memory_order_acq_rel);
+					publish_id(e_new, id);
+					return id;
+				}
+				// lost the race. e now holds the entry inserted by another thread
+			}
+			if ((e->hash == h) && (e->label == label)) {
+				if (e_new != NULL) delete e_new;
+				return wait_id(e);
+			}
+		}
+		// the probe sequence is full. move on to the next table
+		registry_table* t_next = t->next.load(std::memory_order_acquire);
+		if (t_next == NULL) {
+			registry_table* t_new = new_registry_table(t->capacity * 2);
+			if (t->next.compare_exchange_strong(t_next, t_new, std::memory_order_acq_rel)) {
+				t_next = t_new;
+			} else {
+				delete [] t_new->slots;
+				delete t_new;
+			}
+		}
+		t = t_next;
+	}
+  }
+
+
+  int shared_section_find (const std::string& label)
+  {
+	size_t h = std::hash<std::string>()(label);
+	for (registry_table* t = registry_head; t != NULL; t = t->next.load(std::memory_order_acquire)) {
+		int mask = t->capacity - 1;
+		for (int p=0; p<t->max_probe; p++) {
+			registry_entry* e = t->slots[(h + p) & mask].load(std::memory_order_acquire);
+			if (e == NULL) return -1;
+			if ((e->hash == h) && (e->label == label)) return wait_id(e);
+		}
+	}
+	return -1;
+  }
+
+
+  int shared_section_count (void)
+  {
+	return registry_count.load(std::memory_order_acquire);
+  }
+
+
+  const std::string* shared_section_label (int id)
+  {
+	if ((id < 0) || (id >= shared_section_count())) return NULL;
+	int k, offset;
+	id_to_segment(id, k, offset);
+	if (k >= Registry_max_segs) return NULL;
+	std::atomic<registry_entry*>* seg = registry_segs[k].load(std::memory_order_acquire);
+	if (seg == NULL) return NULL;
+	registry_entry* e = seg[offset].load(std::memory_order_acquire);
+	if (e == NULL) return NULL;		// the ID is being published by another thread
+	return &(e->label);
+  }
+
+} /* namespace pm_lib */
@@ -0,0 +1,238 @@
+/*
+###################################################################################
+#
+# PMlib - Performance Monitor Library
+#
+# Copyright (c) 2010-2011 VCAD System Research Program, RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2012-2020 Advanced Institute for Computational Science(AICS), RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2016-2020 Research Institute for Information Technology(RIIT), Kyushu University.
+# All rights reserved.
+#
+###################################################################################
+ */
+
+//! @file   PerfReportAsync.cpp
+//! @brief  report_async() non-blocking report generation
+
+#include "PerfMonitor.h"
+#include "pmlib_pmpi.h"
+#include <algorithm>
+
+
+namespace pm_lib {
+
+//
+//	report_async() / report_wait()
+//
+//	report_async() packs the same records as gather_and_stats() and reduce_self_stats(),
+//	and starts MPI_Igather and MPI_Ireduce to rank 0. No rank waits for the others there.
+//	If the MPI library provides MPI_THREAD_MULTIPLE, rank 0 starts a helper thread which
+//	waits for the collectives and formats the BASIC and DETAIL reports, while the main
+//	thread returns to the application. Otherwise rank 0 formats them in report_wait().
+//	The other ranks only complete their requests in report_wait().
+//
+//	The statistics are not broadcasted back, so that only rank 0 holds them after
+//	report_wait(). The power consumption of the Root section is summed up in the same
+//	MPI_Ireduce as the exclusive time records.
+//	The PMLIB_REPORT_FORMAT file is written without the thread values.
+//
+
+  /// report() の非同期版. 集約を開始して直ちに戻る
+  ///
+  ///   @param[in] fp       出力ファイルポインタ
+  ///
+  void PerfMonitor::report_async(FILE* fp)
+  {
+    if (!is_PMlib_enabled) return;
+
+	if (is_async_active) {
+		if (my_rank == 0) printDiag("report_async()",  "the previous report_async() is not completed yet. report_wait() is called first.\n");
+		report_wait();
+	}
+
+	#ifdef DEBUG_PRINT_MONITOR
+    if (my_rank==0) fprintf(stderr, "\n<PerfMonitor::report_async> start \n");
+	#endif
+
+	prepareReport ();
+
+	if (PerfMonitor::dump_pm_records(fp)) return;
+
+    if (m_nWatch == 0) {
+      if (my_rank == 0) {
+        fprintf(fp, "\n\t#<PerfMonitor::report_async> No section has been defined.\n");
+      }
+      return;
+    }
+
+	if ((env_str_report == "FULL") && (my_rank == 0)) {
+		printDiag("report_async()",  "the thread report of PMLIB_REPORT=FULL is not produced by report_async(). The DETAIL report is produced.\n");
+	}
+
+    mpi_auto_fold();
+
+    for (int i=0; i<m_nWatch; i++) {
+      m_watchArray[i].gatherHWPC();
+    }
+
+	//	the per process records of printDetail(), the same layout as gather_and_stats()
+	async_offset = new int[m_nWatch+1];
+	async_offset[0] = 0;
+    for (int i = 0; i < m_nWatch; i++) {
+      async_offset[i+1] = async_offset[i] + m_watchArray[i].gatherPackSize();
+    }
+	async_n_pack = async_offset[m_nWatch];
+
+	async_send = new double[async_n_pack];
+    for (int i = 0; i < m_nWatch; i++) {
+      m_watchArray[i].gatherPack(async_send + async_offset[i]);
+    }
+
+	//	the exclusive time records of reduce_self_stats(), followed by the Root power
+	async_n_hwpc = 0;
+    for (int i = 0; i < m_nWatch; i++) {
+		async_n_hwpc = std::max(async_n_hwpc, m_watchArray[i].gatherPackSize() - 3);
+	}
+	int n_rec = 1 + async_n_hwpc;
+	int n_self = m_nWatch * n_rec + 1;
+
+	async_self = new double[n_self];
+    for (int i = 0; i < m_nWatch; i++) {
+		m_watchArray[i].selfPack(async_self + (size_t)i*n_rec, async_n_hwpc);
+	}
+	async_self[n_self-1] = 0.0;
+	#ifdef USE_POWER
+	if (level_POWER != 0) async_self[n_self-1] = m_watchArray[0].my_power.w_accumu[0];
+	#endif
+
+	async_recv = async_send;
+	async_sum = async_self;
+	async_req[0] = MPI_REQUEST_NULL;
+	async_req[1] = MPI_REQUEST_NULL;
+	if (num_process > 1) {
+		if (my_rank == 0) {
+			async_recv = new double[(size_t)async_n_pack * num_process];
+			async_sum = new double[n_self];
+		}
+		if (MPI_Igather(async_send, async_n_pack, MPI_DOUBLE, async_recv, async_n_pack, MPI_DOUBLE,
+				0, MPI_COMM_WORLD, &async_req[0]) != MPI_SUCCESS) PM_Exit(0);
+		if (MPI_Ireduce(async_self, async_sum, n_self, MPI_DOUBLE, MPI_SUM,
+				0, MPI_COMM_WORLD, &async_req[1]) != MPI_SUCCESS) PM_Exit(0);
+	}
+	async_fp = fp;
+	is_async_active = true;
+	is_async_thread = false;
+
+	if (my_rank != 0) return;
+
+	//	the helper thread calls MPI_Waitall concurrently with the application
+	int level = MPI_THREAD_MULTIPLE;
+	if (num_process > 1) {
+		if (MPI_Query_thread(&level) != MPI_SUCCESS) level = MPI_THREAD_SINGLE;
+	}
+	if (level == MPI_THREAD_MULTIPLE) {
+		if (pthread_create(&async_thread, NULL, PerfMonitor::async_formatter, this) == 0) {
+			is_async_thread = true;
+		}
+	}
+
+	#ifdef DEBUG_PRINT_MONITOR
+	fprintf(stderr, "<PerfMonitor::report_async> n_pack=%d, n_self=%d, helper thread=%s \n",
+		async_n_pack, n_self, is_async_thread?"yes":"no");
+	#endif
+  }
+
+
+  /// report_async() の完了を待つ
+  ///
+  void PerfMonitor::report_wait(void)
+  {
+    if (!is_PMlib_enabled) return;
+	if (!is_async_active) return;
+
+	if (is_async_thread) {
+		pthread_join(async_thread, NULL);
+		is_async_thread = false;
+	} else {
+		async_format();
+	}
+
+	if (async_recv != async_send) delete [] async_recv;
+	if (async_sum != async_self) delete [] async_sum;
+	delete [] async_send;
+	delete [] async_self;
+	delete [] async_offset;
+	async_fp = NULL;
+	is_async_active = false;
+  }
+
+
+  /// ランク0のレポート作成スレッドの本体
+  ///
+  ///   @param[in] arg   the PerfMonitor instance which called report_async()
+  ///
+  void* PerfMonitor::async_formatter(void* arg)
+  {
+	PerfMonitor* pm = static_cast<PerfMonitor*>(arg);
+	pm->async_format();
+	return NULL;
+  }
+
+
+  /// 集約の完了を待ち、ランク0はレポートを出力する
+  ///
+  ///   @note ランク0ではレポート作成スレッドまたは report_wait() から呼ばれる。
+  ///
+  void PerfMonitor::async_format(void)
+  {
+	if (num_process > 1) {
+		if (MPI_Waitall(2, async_req, MPI_STATUSES_IGNORE) != MPI_SUCCESS) PM_Exit(0);
+	}
+	if (my_rank != 0) return;
+
+	int n_rec = 1 + async_n_hwpc;
+    for (int i = 0; i < m_nWatch; i++) {
+		m_watchArray[i].gatherUnpack(async_recv, async_n_pack, async_offset[i]);
+		m_watchArray[i].statsAverage();
+		m_watchArray[i].selfUnpack(async_sum + (size_t)i*n_rec, async_n_hwpc);
+	}
+	#ifdef USE_POWER
+	if (level_POWER != 0) m_watchArray[0].m_power_av = async_sum[(size_t)m_nWatch*n_rec] / num_process;
+	#endif
+	is_rank_gathered = true;
+
+	sort_m_order();
+
+	//	the error of the first group is reported as the value of rank 0
+	if (is_hwpc_rotated) {
+		for (int i=0; i<m_nWatch; i++) {
+			m_watchArray[i].m_rot_error_max = m_watchArray[i].rotateError(0);
+		}
+	}
+
+	FILE* fp = async_fp;
+	int maxLabelLen = PerfMonitor::printBasicTable (fp, "", "", 0);
+	PerfMonitor::printBasicHWPC (fp, maxLabelLen, 0);
+	PerfMonitor::printBasicPower (fp, maxLabelLen, 0);
+
+	if (env_str_report == "DETAIL" || env_str_report == "FULL") {
+		PerfMonitor::printDetailTable (fp, 0);
+	}
+	if (env_str_hwpc != "USER" ) {
+		PerfMonitor::printLegend (fp);
+	}
+	fflush(fp);
+
+	//	the thread values are not gathered without a collective
+	PerfMonitor::writeFormatted (NULL, 0);
+
+	#ifdef DEBUG_PRINT_MONITOR
+    fprintf(stderr, "<PerfMonitor::async_format> ends. \n");
+	#endif
+  }
+
+} /* namespace pm_lib */
@@ -0,0 +1,486 @@
+/*
+###################################################################################
+#
+# PMlib - Performance Monitor Library
+#
+# Copyright (c) 2010-2011 VCAD System Research Program, RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2012-2020 Advanced Institute for Computational Science(AICS), RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2016-2020 Research Institute for Information Technology(RIIT), Kyushu University.
+# All rights reserved.
+#
+###################################################################################
+ */
+
+//! @file   PerfReportFormat.cpp
+//! @brief  PMLIB_REPORT_FORMAT machine readable report in JSON or CSV
+
+#include "PerfMonitor.h"
+#include "pmlib_pmpi.h"
+#include <cmath>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+
+
+namespace pm_lib {
+
+  extern struct hwpc_group_chooser hwpc_group;
+
+//
+//	PMLIB_REPORT_FORMAT
+//
+//	PMLIB_REPORT_FORMAT=json|csv	  : report() writes the statistics to a file in addition
+//									    to the text report. Rank 0 writes the file.
+//	PMLIB_REPORT_FORMAT_FILE=<prefix> : the file is <prefix>.json or <prefix>.csv
+//									    default prefix is "pmlib_report"
+//
+//	All the sections are written in the registered order, including the Root section (id 0).
+//	Each section has its statistics over the processes, the values of each rank, and the
+//	values of each thread of each rank. The numbers are written with 17 significant digits.
+//	The HWPC values of the sections and ranks are the sorted values of the text report.
+//	The HWPC values of the threads are the raw event counts, since the sorted values of
+//	the threads are not kept. The serial sections report the calls, time and operations
+//	of thread 0 for all the threads, as printThreads() does.
+//
+//	CSV file is a single table. The column "scope" is one of section, rank or thread.
+//	The columns which do not apply to the scope are left empty.
+//
+
+  static const int Pm_format_thread_base = 3;	// calls, time, operations of each thread
+
+
+  /// JSON string with the escaped characters
+  ///
+  static void json_string(FILE* fp, const std::string& s)
+  {
+	fputc('"', fp);
+	for (size_t i=0; i<s.size(); i++) {
+		unsigned char c = s[i];
+		if (c == '"' || c == '\\') {
+			fputc('\\', fp); fputc(c, fp);
+		} else if (c < 0x20) {
+			fprintf(fp, "\\u%04x", c);
+		} else {
+			fputc(c, fp);
+		}
+	}
+	fputc('"', fp);
+  }
+
+  /// JSON number. NaN and Inf are written as null
+  ///
+  static void json_number(FILE* fp, double v)
+  {
+	if (std::isfinite(v)) {
+		fprintf(fp, "%.17g", v);
+	} else {
+		fprintf(fp, "null");
+	}
+  }
+
+  /// CSV field. The field is quoted if it contains a comma, a quote or a new line
+  ///
+  static void csv_string(FILE* fp, const std::string& s)
+  {
+	if (s.find_first_of(",\"\n\r") == std::string::npos) {
+		fputs(s.c_str(), fp);
+		return;
+	}
+	fputc('"', fp);
+	for (size_t i=0; i<s.size(); i++) {
+		if (s[i] == '"') fputc('"', fp);
+		fputc(s[i], fp);
+	}
+	fputc('"', fp);
+  }
+
+  static void csv_number(FILE* fp, double v)
+  {
+	fputc(',', fp);
+	if (std::isfinite(v)) fprintf(fp, "%.17g", v);
+  }
+
+  static void csv_empty(FILE* fp, int n)
+  {
+	for (int i=0; i<n; i++) fputc(',', fp);
+  }
+
+  /// CSV columns shared by all the scopes : id,label,exclusive,in_parallel,unit
+  ///
+  static void csv_section(FILE* fp, int id, const std::string& label, bool exclusive, bool in_parallel,
+	const std::string& unit)
+  {
+	fprintf(fp, ",%d,", id);
+	csv_string(fp, label);
+	fprintf(fp, ",%d,%d,", exclusive ? 1 : 0, in_parallel ? 1 : 0);
+	csv_string(fp, unit);
+  }
+
+
+  /// PMLIB_REPORT_FORMAT の機械可読レポートを出力する
+  ///
+  ///   @note 全プロセスが呼び出す集団操作。report() の selectReport() から呼ばれる。
+  ///		スレッド別の測定値をランク0に集約した後、ランク0がファイルに出力する。
+  ///
+  void PerfMonitor::printFormatted(void)
+  {
+	if (env_str_format.empty()) return;
+	if (m_nWatch == 0) return;
+
+	//	the per process values are needed. BASIC report does not gather them.
+	if (!is_rank_gathered) gather();
+
+	//	thread records of all the sections : calls, time, operations, raw events
+	int n_raw = 0;
+	for (int i=0; i<m_nWatch; i++) {
+		n_raw = std::max(n_raw, m_watchArray[i].my_papi.num_events);
+	}
+	int n_rec = Pm_format_thread_base + n_raw;
+	size_t n_local = (size_t)m_nWatch * num_threads * n_rec;
+
+	double* p_send = new double[n_local];
+	for (int i=0; i<m_nWatch; i++) {
+		m_watchArray[i].formatThreadPack(p_send + (size_t)i*num_threads*n_rec, n_raw);
+	}
+	double* p_recv = p_send;
+	if (num_process > 1) {
+		if (my_rank == 0) p_recv = new double[n_local * num_process];
+		if (MPI_Gather(p_send, n_local, MPI_DOUBLE, p_recv, n_local, MPI_DOUBLE, 0, MPI_COMM_WORLD) != MPI_SUCCESS) PM_Exit(0);
+	}
+
+	if (my_rank == 0) PerfMonitor::writeFormatted(p_recv, n_raw);
+
+	if (p_recv != p_send) delete [] p_recv;
+	delete [] p_send;
+  }
+
+
+  /// 機械可読レポートのファイルを作成する. ランク0のみが呼び出す
+  ///
+  ///   @param[in] p_threads  全プロセスのスレッド別測定値 [num_process][m_nWatch][num_threads][3+n_raw]
+  ///                         NULLの場合はスレッド別の値を出力しない
+  ///   @param[in] n_raw      スレッド別のHWPCイベント数
+  ///
+  void PerfMonitor::writeFormatted(const double* p_threads, int n_raw)
+  {
+	if (env_str_format.empty()) return;
+
+	std::string s_prefix = "pmlib_report";
+	char* cp_env = std::getenv("PMLIB_REPORT_FORMAT_FILE");
+	if (cp_env != NULL) s_prefix = cp_env;
+	bool is_json = (env_str_format == "JSON");
+	std::string file_name = s_prefix + (is_json ? ".json" : ".csv");
+
+	FILE* fp = fopen(file_name.c_str(), "w");
+	if (fp == NULL) {
+		printDiag("writeFormatted()",  "can not open %s : %s. PMLIB_REPORT_FORMAT file is not produced.\n",
+			file_name.c_str(), strerror(errno));
+		return;
+	}
+
+	//	the sorted HWPC symbols of the text report, and the raw event names
+	PerfWatch& w0 = m_watchArray[0];
+	int n_hwpc = 0;
+	int i_hwpc = 0;
+	for (int i=0; i<m_nWatch; i++) {
+		int n = m_watchArray[i].gatherPackSize() - 3;
+		if (n > n_hwpc) { n_hwpc = n; i_hwpc = i; }
+	}
+	const pmlib_papi_chooser& papi = m_watchArray[i_hwpc].my_papi;
+	size_t n_stride = (size_t)num_threads * (Pm_format_thread_base + n_raw);
+	size_t n_process_stride = (size_t)m_nWatch * n_stride;
+
+	if (is_json) {
+		fprintf(fp, "{\n");
+		fprintf(fp, "\"pmlib_version\": "); json_string(fp, PM_VERSION); fprintf(fp, ",\n");
+		fprintf(fp, "\"parallel_mode\": "); json_string(fp, parallel_mode); fprintf(fp, ",\n");
+		fprintf(fp, "\"num_process\": %d,\n", num_process);
+		fprintf(fp, "\"num_threads\": %d,\n", num_threads);
+		fprintf(fp, "\"hwpc_chooser\": "); json_string(fp, env_str_hwpc); fprintf(fp, ",\n");
+		fprintf(fp, "\"report\": "); json_string(fp, env_str_report); fprintf(fp, ",\n");
+		fprintf(fp, "\"total_time\": "); json_number(fp, w0.m_time_av); fprintf(fp, ",\n");
+		#ifdef USE_POWER
+		if (level_POWER != 0) {
+			fprintf(fp, "\"power_joule_av\": "); json_number(fp, w0.m_power_av); fprintf(fp, ",\n");
+		}
+		#endif
+		fprintf(fp, "\"hwpc_names\": [");
+		for (int n=0; n<n_hwpc; n++) { if (n) fputc(',', fp); json_string(fp, papi.s_sorted[n]); }
+		fprintf(fp, "],\n");
+		fprintf(fp, "\"event_names\": [");
+		for (int n=0; n<n_raw; n++) { if (n) fputc(',', fp); json_string(fp, w0.my_papi.s_name[n]); }
+		fprintf(fp, "],\n");
+		fprintf(fp, "\"sections\": [\n");
+	} else {
+		fprintf(fp, "scope,rank,thread,id,label,exclusive,in_parallel,unit,calls,calls_sum,"
+			"time,time_sd,time_min,time_max,time_self,flop,flop_sd,rate,power_joule");
+		for (int n=0; n<n_hwpc; n++) { fputc(',', fp); csv_string(fp, papi.s_sorted[n]); }
+		for (int n=0; n<n_raw; n++) { fputc(',', fp); csv_string(fp, "event:" + w0.my_papi.s_name[n]); }
+		fprintf(fp, "\n");
+	}
+
+	bool is_first = true;
+	for (int i=0; i<m_nWatch; i++) {
+		PerfWatch& w = m_watchArray[i];
+		if (w.m_label.empty()) continue;
+		const double* p_sec = (p_threads == NULL) ? NULL : p_threads + (size_t)i*n_stride;
+		if (is_json) {
+			if (!is_first) fprintf(fp, ",\n");
+			w.printFormattedJSON(fp, p_sec, n_process_stride, n_raw);
+		} else {
+			w.printFormattedCSV(fp, p_sec, n_process_stride, n_hwpc, n_raw);
+		}
+		is_first = false;
+	}
+
+	if (is_json) fprintf(fp, "\n]\n}\n");
+	if (fclose(fp) != 0) {
+		printDiag("writeFormatted()",  "writing %s failed : %s\n", file_name.c_str(), strerror(errno));
+	}
+  }
+
+
+  /// スレッド別の呼び出し回数、時間、演算量、HWPCイベント数を詰める
+  ///
+  ///   @param[out] p      [num_threads][3+n_raw]
+  ///   @param[in]  n_raw  HWPCイベント数
+  ///
+  ///   @note 直列区間の呼び出し回数、時間、演算量はスレッド0の値を全スレッドに出力する
+  ///
+  void PerfWatch::formatThreadPack(double* p, int n_raw)
+  {
+	int n_rec = Pm_format_thread_base + n_raw;
+	for (int j=0; j<num_threads; j++, p += n_rec) {
+		for (int n=0; n<n_rec; n++) p[n] = 0.0;
+		if (j >= my_papi.th_nthreads) continue;
+		int k = m_in_parallel ? j : 0;
+		p[0] = my_papi.th_v_sorted[k][0];
+		p[1] = my_papi.th_v_sorted[k][1];
+		p[2] = my_papi.th_v_sorted[k][2];
+		for (int n=0; n<n_raw && n<my_papi.num_events; n++) {
+			p[Pm_format_thread_base+n] = (double)my_papi.th_accumu[j][n];
+		}
+	}
+  }
+
+
+  /// 計算量の単位. 0:B/sec, 1:Flops, HWPCの場合はHWPC_CHOOSERの値
+  ///
+  static std::string format_unit(int is_unit, const std::string& s_chooser)
+  {
+	if (is_unit == 0) return "B/sec";
+	if (is_unit == 1) return "Flops";
+	return s_chooser;
+  }
+
+
+  /// 区間のJSONオブジェクトを出力. ランク0のみが呼び出す
+  ///
+  ///   @param[in] fp         出力ファイルポインタ
+  ///   @param[in] p_threads  この区間のランク0のスレッド別測定値. NULLの場合は出力しない
+  ///   @param[in] n_process  p_threads のプロセス間の間隔
+  ///   @param[in] n_raw      スレッド別のHWPCイベント数
+  ///
+  void PerfWatch::printFormattedJSON(FILE* fp, const double* p_threads, size_t n_process, int n_raw)
+  {
+	int is_unit = statsSwitch();
+	int n_sorted = gatherPackSize() - 3;
+	double rate_av = (m_time_av > 0.0) ? m_flop_av / m_time_av : 0.0;
+
+	fprintf(fp, "{\"id\": %d, \"label\": ", m_id); json_string(fp, m_label);
+	fprintf(fp, ", \"exclusive\": %s, \"in_parallel\": %s, \"unit\": ",
+		m_exclusive ? "true" : "false", m_in_parallel ? "true" : "false");
+	json_string(fp, format_unit(is_unit, hwpc_group.env_str_hwpc));
+	fprintf(fp, ",\n  \"calls_av\": %ld, \"calls_sum\": %ld", m_count_av, m_count_sum);
+	fprintf(fp, ", \"time_av\": "); json_number(fp, m_time_av);
+	fprintf(fp, ", \"time_sd\": "); json_number(fp, m_time_sd);
+	if (m_gathered) {
+		double t_min = m_timeArray[0], t_max = m_timeArray[0];
+		for (int r=1; r<num_process; r++) {
+			t_min = std::min(t_min, m_timeArray[r]);
+			t_max = std::max(t_max, m_timeArray[r]);
+		}
+		fprintf(fp, ", \"time_min\": "); json_number(fp, t_min);
+		fprintf(fp, ", \"time_max\": "); json_number(fp, t_max);
+	}
+	if (has_nested()) {
+		fprintf(fp, ", \"time_self_av\": "); json_number(fp, m_time_self_av);
+	}
+	fprintf(fp, ",\n  \"flop_av\": "); json_number(fp, m_flop_av);
+	fprintf(fp, ", \"flop_sd\": "); json_number(fp, m_flop_sd);
+	fprintf(fp, ", \"rate_av\": "); json_number(fp, rate_av);
+
+	if (n_sorted > 0) {
+		fprintf(fp, ",\n  \"hwpc_av\": [");
+		for (int n=0; n<n_sorted; n++) {
+			double v = m_sortedAverageHWPC[n];
+			if (m_gathered) {
+				v = 0.0;
+				for (int r=0; r<num_process; r++) v += fabs(m_sortedArrayHWPC[r*n_sorted+n]);
+				v /= num_process;
+			}
+			if (n) fputc(',', fp);
+			json_number(fp, v);
+		}
+		fprintf(fp, "]");
+	}
+	#ifdef USE_POWER
+	if (level_POWER != 0) {
+		fprintf(fp, ",\n  \"power_joule_rank0\": [");
+		for (int n=0; n<my_power.num_power_stats; n++) {
+			if (n) fputc(',', fp);
+			json_number(fp, my_power.w_accumu[n]);
+		}
+		fprintf(fp, "]");
+	}
+	#endif
+
+	if (m_gathered) {
+		fprintf(fp, ",\n  \"ranks\": [");
+		for (int r=0; r<num_process; r++) {
+			double rate = (m_timeArray[r] > 0.0) ? m_flopArray[r] / m_timeArray[r] : 0.0;
+			fprintf(fp, "%s\n    {\"rank\": %d, \"calls\": %ld, \"time\": ", r ? "," : "", r, m_countArray[r]);
+			json_number(fp, m_timeArray[r]);
+			fprintf(fp, ", \"flop\": "); json_number(fp, m_flopArray[r]);
+			fprintf(fp, ", \"rate\": "); json_number(fp, rate);
+			if (n_sorted > 0) {
+				fprintf(fp, ", \"hwpc\": [");
+				for (int n=0; n<n_sorted; n++) {
+					if (n) fputc(',', fp);
+					json_number(fp, m_sortedArrayHWPC[r*n_sorted+n]);
+				}
+				fprintf(fp, "]");
+			}
+			fprintf(fp, "}");
+		}
+		fprintf(fp, "]");
+	}
+
+	if (p_threads != NULL) {
+		int n_rec = Pm_format_thread_base + n_raw;
+		fprintf(fp, ",\n  \"threads\": [");
+		for (int r=0; r<num_process; r++) {
+			const double* p = p_threads + (size_t)r*n_process;
+			for (int j=0; j<num_threads; j++, p += n_rec) {
+				fprintf(fp, "%s\n    {\"rank\": %d, \"thread\": %d, \"calls\": %lld, \"time\": ",
+					(r || j) ? "," : "", r, j, llround(p[0]));
+				json_number(fp, p[1]);
+				fprintf(fp, ", \"flop\": "); json_number(fp, p[2]);
+				if (n_raw > 0) {
+					fprintf(fp, ", \"events\": [");
+					for (int n=0; n<n_raw; n++) {
+						if (n) fputc(',', fp);
+						json_number(fp, p[Pm_format_thread_base+n]);
+					}
+					fprintf(fp, "]");
+				}
+				fprintf(fp, "}");
+			}
+		}
+		fprintf(fp, "]");
+	}
+	fprintf(fp, "}");
+  }
+
+
+  /// 区間のCSV行を出力. ランク0のみが呼び出す
+  ///
+  ///   @param[in] fp         出力ファイルポインタ
+  ///   @param[in] p_threads  この区間のランク0のスレッド別測定値. NULLの場合は出力しない
+  ///   @param[in] n_process  p_threads のプロセス間の間隔
+  ///   @param[in] n_hwpc     HWPC列の個数
+  ///   @param[in] n_raw      HWPCイベント列の個数
+  ///
+  void PerfWatch::printFormattedCSV(FILE* fp, const double* p_threads, size_t n_process, int n_hwpc, int n_raw)
+  {
+	int is_unit = statsSwitch();
+	int n_sorted = gatherPackSize() - 3;
+	std::string s_unit = format_unit(is_unit, hwpc_group.env_str_hwpc);
+	double power = 0.0;
+	#ifdef USE_POWER
+	if (level_POWER != 0) power = my_power.w_accumu[0];
+	#endif
+
+	//	section statistics
+	fprintf(fp, "section,,");
+	csv_section(fp, m_id, m_label, m_exclusive, m_in_parallel, s_unit);
+	fprintf(fp, ",%ld,%ld", m_count_av, m_count_sum);
+	csv_number(fp, m_time_av);
+	csv_number(fp, m_time_sd);
+	if (m_gathered) {
+		double t_min = m_timeArray[0], t_max = m_timeArray[0];
+		for (int r=1; r<num_process; r++) {
+			t_min = std::min(t_min, m_timeArray[r]);
+			t_max = std::max(t_max, m_timeArray[r]);
+		}
+		csv_number(fp, t_min);
+		csv_number(fp, t_max);
+	} else {
+		csv_empty(fp, 2);
+	}
+	if (has_nested()) csv_number(fp, m_time_self_av); else csv_empty(fp, 1);
+	csv_number(fp, m_flop_av);
+	csv_number(fp, m_flop_sd);
+	csv_number(fp, (m_time_av > 0.0) ? m_flop_av / m_time_av : 0.0);
+	if (level_POWER != 0) csv_number(fp, power); else csv_empty(fp, 1);
+	for (int n=0; n<n_hwpc; n++) {
+		if (n >= n_sorted) { csv_empty(fp, 1); continue; }
+		double v = m_sortedAverageHWPC[n];
+		if (m_gathered) {
+			v = 0.0;
+			for (int r=0; r<num_process; r++) v += fabs(m_sortedArrayHWPC[r*n_sorted+n]);
+			v /= num_process;
+		}
+		csv_number(fp, v);
+	}
+	csv_empty(fp, n_raw);
+	fprintf(fp, "\n");
+
+	//	values of each rank
+	if (m_gathered) {
+		for (int r=0; r<num_process; r++) {
+			fprintf(fp, "rank,%d,", r);
+			csv_section(fp, m_id, m_label, m_exclusive, m_in_parallel, s_unit);
+			fprintf(fp, ",%ld,", m_countArray[r]);
+			csv_number(fp, m_timeArray[r]);
+			csv_empty(fp, 4);
+			csv_number(fp, m_flopArray[r]);
+			csv_empty(fp, 1);
+			csv_number(fp, (m_timeArray[r] > 0.0) ? m_flopArray[r] / m_timeArray[r] : 0.0);
+			csv_empty(fp, 1);
+			for (int n=0; n<n_hwpc; n++) {
+				if (n < n_sorted) csv_number(fp, m_sortedArrayHWPC[r*n_sorted+n]); else csv_empty(fp, 1);
+			}
+			csv_empty(fp, n_raw);
+			fprintf(fp, "\n");
+		}
+	}
+
+	//	values of each thread
+	if (p_threads != NULL) {
+		int n_rec = Pm_format_thread_base + n_raw;
+		for (int r=0; r<num_process; r++) {
+			const double* p = p_threads + (size_t)r*n_process;
+			for (int j=0; j<num_threads; j++, p += n_rec) {
+				fprintf(fp, "thread,%d,%d", r, j);
+				csv_section(fp, m_id, m_label, m_exclusive, m_in_parallel, s_unit);
+				fprintf(fp, ",%lld,", llround(p[0]));
+				csv_number(fp, p[1]);
+				csv_empty(fp, 4);
+				csv_number(fp, p[2]);
+				csv_empty(fp, 1);
+				csv_number(fp, (p[1] > 0.0) ? p[2] / p[1] : 0.0);
+				csv_empty(fp, 1);
+				csv_empty(fp, n_hwpc);
+				for (int n=0; n<n_raw; n++) csv_number(fp, p[Pm_format_thread_base+n]);
+				fprintf(fp, "\n");
+			}
+		}
+	}
+  }
+
+} /* namespace pm_lib */
@@ -0,0 +1,199 @@
+/*
+###################################################################################
+#
+# PMlib - Performance Monitor Library
+#
+# Copyright (c) 2010-2011 VCAD System Research Program, RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2012-2020 Advanced Institute for Computational Science(AICS), RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2016-2020 Research Institute for Information Technology(RIIT), Kyushu University.
+# All rights reserved.
+#
+###################################################################################
+ */
+
+//! @file   PerfRoofline.cpp
+//! @brief  HWPC_CHOOSER=ROOFLINE arithmetic intensity and roofline report
+
+#include "PerfMonitor.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+
+namespace pm_lib {
+
+  extern struct hwpc_group_chooser hwpc_group;
+
+//
+//	HWPC_CHOOSER=ROOFLINE
+//
+//	FLOPS and BANDWIDTH groups are counted in turn as HWPC_CHOOSER=ROTATE does,
+//	so that each section has both the floating point operations and the memory
+//	traffic. The arithmetic intensity AI = Flop / Byte places the section against
+//	the ceilings of the process:
+//		attainable = min (peak performance, AI * peak memory bandwidth)
+//	The section is memory bound if AI is below the ridge point peak / bandwidth,
+//	and compute bound otherwise.
+//
+//	The ceilings are the nominal per core values of the platform detected by
+//	createPapiCounterList() multiplied by the number of threads of the process.
+//	PMLIB_ROOFLINE_PEAK=<GFlops>,<GB/s> gives the measured or the configured
+//	values of the process instead.
+//	The sections in parallel region (+) are placed against the ceilings of the
+//	process. The serial sections run on one core, and are placed against the
+//	ceilings divided by the number of threads.
+//
+
+
+  /// HWPC_CHOOSER=ROOFLINE のプロセスの上限性能を設定する
+  ///
+  ///   @note createPapiCounterList() でプラットフォームを判定した後に呼ばれる。
+  ///
+void PerfWatch::initializeRoofline (void)
+{
+#ifdef USE_PAPI
+	int max_threads = 1;
+	#ifdef _OPENMP
+	max_threads = omp_get_max_threads();
+	#endif
+	hwpc_group.roof_PERF = hwpc_group.corePERF * max_threads;
+	hwpc_group.roof_BW = hwpc_group.coreBW * max_threads;
+
+	char* cp_env = std::getenv("PMLIB_ROOFLINE_PEAK");
+	if (cp_env == NULL) return;
+	double d_perf, d_bw;
+	char c_tail;
+	if ((sscanf(cp_env, "%lf,%lf%c", &d_perf, &d_bw, &c_tail) == 2) && (d_perf > 0.0) && (d_bw > 0.0)) {
+		hwpc_group.roof_PERF = d_perf * 1.0e9;
+		hwpc_group.roof_BW = d_bw * 1.0e9;
+	} else {
+		printError("initializeRoofline",  "PMLIB_ROOFLINE_PEAK=%s is not <GFlops>,<GB/s>. the nominal values of the platform are used.\n", cp_env);
+	}
+#endif
+}
+
+
+  /// HWPC_CHOOSER=ROOFLINE 集計したグループの演算数またはメモリ転送量を写す
+  ///
+  /// @note FLOPS group gives Total_FP. BANDWIDTH group gives the memory bandwidth
+  ///	"Mem [B/s]", which is converted to the bytes by the time of each process.
+  ///
+void PerfWatch::rooflineCollect (void)
+{
+#ifdef USE_PAPI
+	if ( m_count_sum == 0 ) return;
+
+	bool is_flops = (hwpc_group.number[I_flops] > 0);
+	bool is_bandwidth = (hwpc_group.number[I_bandwidth] > 0);
+	if (!is_flops && !is_bandwidth) return;
+	const char* s_event = is_flops ? "Total_FP" : "Mem [B/s]";
+
+	int n_sorted = my_papi.num_sorted;
+	for (int n=0; n<n_sorted; n++) {
+		if (my_papi.s_sorted[n] != s_event) continue;
+		double dx = 0.0;
+		if (m_gathered) {
+			for (int i=0; i<num_process; i++) {
+				double v = fabs(m_sortedArrayHWPC[i*n_sorted + n]);
+				dx += is_flops ? v : v * m_timeArray[i];
+			}
+			dx = dx / num_process;
+		} else {
+			dx = m_sortedAverageHWPC[n];	// reduced by gather_and_reduce()
+			if (!is_flops) dx = dx * m_time_av;
+		}
+		if (is_flops) {
+			m_roof_flop = dx;
+		} else {
+			m_roof_bytes = dx;
+		}
+		return;
+	}
+#endif
+}
+
+
+  /// HWPC_CHOOSER=ROOFLINE 区間毎の演算密度とルーフラインに対する位置を出力する
+  ///
+  ///   @param[in] fp       	出力ファイルポインタ
+  ///   @param[in] maxLabelLen    ラベル文字長
+  ///   @param[in] op_sort 	測定区間の表示順 (0:経過時間順、1:登録順で表示)
+  ///
+  ///   @note printRotatedHWPC() から呼ばれる。ランク0のみが呼び出す。集団通信は行わない。
+  ///
+void PerfMonitor::printRoofline (FILE* fp, int maxLabelLen, int op_sort)
+{
+#ifdef USE_PAPI
+	double d_perf = hwpc_group.roof_PERF;
+	double d_bw = hwpc_group.roof_BW;
+	bool is_ceiling = (d_perf > 0.0) && (d_bw > 0.0);
+
+	fprintf(fp, "\n");
+	fprintf(fp, "\n# PMlib roofline report of the averaged process ---------------------------------- #\n");
+	fprintf(fp, "\n");
+	if (is_ceiling) {
+		fprintf(fp, "\tCeilings of the process: peak %9.3e [Flops], memory bandwidth %9.3e [B/s], ridge point %.3f [Flop/B]\n",
+			d_perf, d_bw, d_perf / d_bw);
+		if (std::getenv("PMLIB_ROOFLINE_PEAK") != NULL) {
+			fprintf(fp, "\tThe ceilings are given by PMLIB_ROOFLINE_PEAK.\n\n");
+		} else {
+			fprintf(fp, "\tThe ceilings are the nominal values of %s for %d threads. PMLIB_ROOFLINE_PEAK=<GFlops>,<GB/s> can replace them.\n\n",
+				hwpc_group.platform.c_str(), num_threads);
+		}
+	} else {
+		fprintf(fp, "\tThe ceilings of this platform are not known. Set PMLIB_ROOFLINE_PEAK=<GFlops>,<GB/s> of the process.\n\n");
+	}
+
+	fprintf(fp, "Section"); for (int i=7; i< maxLabelLen; i++) { fputc(' ', fp); }
+	fprintf(fp, "|  AI[F/B]     [Flops]   attainable  [%%attain]  bound\n");
+	for (int i=0; i< maxLabelLen; i++) { fputc('-', fp); }
+	fprintf(fp, "+-----------------------------------------------------------\n");
+
+	for (int j = 0; j < m_nWatch; j++) {
+		int i = (op_sort == 0) ? m_order[j] : j;
+		if (i == 0) continue;
+		PerfWatch& w = m_watchArray[i];
+		if (w.m_count_sum == 0) continue;
+
+		std::string s = w.m_label;
+		if (!w.m_exclusive)  { s = s + " (*)"; }
+		if (w.m_in_parallel) { s = s + " (+)"; }
+		fprintf(fp, "%-*s:", maxLabelLen, s.c_str() );
+
+		if ((w.m_roof_flop < 0.0) || (w.m_roof_bytes < 0.0)) {
+			fprintf(fp, "  the FLOPS or BANDWIDTH group is not counted on this platform\n");
+			continue;
+		}
+		double d_flops = (w.m_time_av > 0.0) ? w.m_roof_flop / w.m_time_av : 0.0;
+		if (w.m_roof_bytes <= 0.0) {
+			fprintf(fp, "  %9s  %9.3e  %s\n", "-", d_flops, "no memory traffic is counted");
+			continue;
+		}
+		double d_ai = w.m_roof_flop / w.m_roof_bytes;
+		fprintf(fp, "  %9.3e  %9.3e", d_ai, d_flops);
+		if (is_ceiling) {
+			//	the serial sections are placed against the ceilings of one core
+			double r_core = w.m_in_parallel ? 1.0 : 1.0 / (double)std::max(num_threads, 1);
+			double d_attain = std::min(d_perf * r_core, d_ai * d_bw * r_core);
+			fprintf(fp, "  %9.3e   %7.2f    %s\n", d_attain,
+				(d_attain > 0.0) ? 100.0 * d_flops / d_attain : 0.0,
+				(d_ai < d_perf / d_bw) ? "memory" : "compute");
+		} else {
+			fprintf(fp, "  %9s   %7s    %s\n", "-", "-", "-");
+		}
+	}
+	for (int i=0; i< maxLabelLen; i++) { fputc('-', fp); }
+	fprintf(fp, "+-----------------------------------------------------------\n");
+	fprintf(fp, "\tAI is Total_FP of FLOPS group over the memory traffic Mem [B/s] * time of BANDWIDTH group.\n");
+	fprintf(fp, "\tattainable = min(peak, AI * bandwidth). [%%attain] is [Flops] against it.\n");
+	fprintf(fp, "\tthe sections in parallel region (+) use the ceilings of the process, the serial sections the ceilings of one core,\n");
+	fprintf(fp, "\ti.e. the ceilings divided by %d threads.\n", num_threads);
+	fprintf(fp, "\tmemory bound sections gain by reducing the memory traffic, compute bound sections by the vectorization and the parallelization.\n");
+#endif
+}
+
+} /* namespace pm_lib */
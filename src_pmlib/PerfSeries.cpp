@@ -0,0 +1,328 @@
+/*
+###################################################################################
+#
+# PMlib - Performance Monitor Library
+#
+# Copyright (c) 2010-2011 VCAD System Research Program, RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2012-2020 Advanced Institute for Computational Science(AICS), RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2016-2020 Research Institute for Information Technology(RIIT), Kyushu University.
+# All rights reserved.
+#
+###################################################################################
+ */
+
+//! @file   PerfSeries.cpp
+//! @brief  PMLIB_SERIES periodic snapshots of the section accumulators
+
+#include "PerfMonitor.h"
+#include <time.h>
+#include <cmath>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <new>
+
+
+namespace pm_lib {
+
+//
+//	PMLIB_SERIES time series
+//
+//	PMLIB_SERIES=<T>s or <T>ms	: the sampler thread takes a snapshot every T seconds
+//	PMLIB_SERIES=<N>			: a snapshot is taken at every N-th stop() of the
+//								  section PMLIB_SERIES_SECTION=<label>
+//	PMLIB_SERIES_FILE=<prefix>	: the snapshots are written to <prefix>_<rank>.pmts
+//								  default prefix is "pmlib_series"
+//
+//	The snapshot copies m_count, m_time, m_flop and the HWPC accumulators of all
+//	the sections of the master thread. Nothing is reset, and the application
+//	thread does no extra work in the time mode. The sampler reads the values
+//	without locks, so that a snapshot may see a section in the middle of stop().
+//	The sampler and setProperties() exclude each other while a section is added.
+//
+
+  /// PMLIB_SERIES を解析し、スナップショットの出力を開始する
+  ///
+  ///   @note initialize() から直列領域で呼ばれる。
+  ///
+  void PerfMonitor::initializeSeries(void)
+  {
+	series_mode = -1;
+	series_section = -1;
+	series_calls = 0;
+	series_nlabeled = 0;
+	series_fp = NULL;
+	series_buffer = NULL;
+	series_used = 0;
+	is_series_thread = false;
+	series_quit = false;
+
+	char* cp_env = std::getenv("PMLIB_SERIES");
+	if (cp_env == NULL) return;
+	#ifdef _OPENMP
+	if (omp_in_parallel() && (omp_get_thread_num() != 0)) return;
+	#endif
+
+	std::string s_value = cp_env;
+	char* cp_end = NULL;
+	double value = strtod(cp_env, &cp_end);
+	std::string s_unit = (cp_end != NULL) ? cp_end : "";
+	if ((cp_end == cp_env) || (value <= 0.0)) {
+		s_unit = "invalid";
+	}
+	if (s_unit == "s") {
+		series_mode = Series_time;
+		series_interval = value;
+	} else if (s_unit == "ms") {
+		series_mode = Series_time;
+		series_interval = value * 1.0e-3;
+	} else if (s_unit.empty() && (value == floor(value))) {
+		series_mode = Series_calls;
+		series_interval = value;
+		cp_env = std::getenv("PMLIB_SERIES_SECTION");
+		if (cp_env == NULL) {
+			printDiag("initializeSeries()",  "PMLIB_SERIES=%s requires PMLIB_SERIES_SECTION=<label>. The time series is disabled.\n",
+				s_value.c_str());
+			series_mode = -1;
+			return;
+		}
+		series_label = cp_env;
+		series_section = find_section_object(series_label);
+	} else {
+		printDiag("initializeSeries()",  "invalid PMLIB_SERIES value [%s]. Use <T>s, <T>ms or <N>. The time series is disabled.\n",
+			s_value.c_str());
+		return;
+	}
+
+	std::string s_prefix = "pmlib_series";
+	cp_env = std::getenv("PMLIB_SERIES_FILE");
+	if (cp_env != NULL) s_prefix = cp_env;
+	char file_name[1024];
+	snprintf(file_name, sizeof(file_name), "%s_%d.pmts", s_prefix.c_str(), my_rank);
+
+	series_fp = fopen(file_name, "wb");
+	series_buffer = new (std::nothrow) char[Pm_series_buffer_size];
+	if ((series_fp == NULL) || (series_buffer == NULL)) {
+		printDiag("initializeSeries()",  "can not open the time series file %s : %s. The time series is disabled.\n",
+			file_name, strerror(errno));
+		if (series_fp != NULL) fclose(series_fp);
+		if (series_buffer != NULL) delete [] series_buffer;
+		series_fp = NULL;
+		series_buffer = NULL;
+		series_mode = -1;
+		series_section = -1;
+		return;
+	}
+
+	PerfWatch& w = m_watchArray[0];
+	series_origin = w.getTime();
+
+	pm_series_header head;
+	memset(&head, 0, sizeof(head));
+	memcpy(head.magic, Pm_series_magic, sizeof(head.magic));
+	head.version = Pm_series_version;
+	head.rank = my_rank;
+	head.num_process = num_process;
+	head.num_threads = num_threads;
+	head.num_events = w.my_papi.num_events;
+	head.mode = series_mode;
+	head.interval = series_interval;
+	head.time_origin = series_origin;
+	strncpy(head.hwpc_chooser, env_str_hwpc.c_str(), sizeof(head.hwpc_chooser)-1);
+	series_append(&head, sizeof(head));
+	for (int i=0; i<w.my_papi.num_events; i++) {
+		char name[Pm_series_name_size];
+		memset(name, 0, sizeof(name));
+		strncpy(name, w.my_papi.s_name[i].c_str(), sizeof(name)-1);
+		series_append(name, sizeof(name));
+	}
+
+	if (series_mode == Series_time) {
+		pthread_mutex_init(&series_lock, NULL);
+		pthread_cond_init(&series_cond, NULL);
+		if (pthread_create(&series_thread, NULL, PerfMonitor::series_sampler, this) != 0) {
+			printDiag("initializeSeries()",  "the sampler thread could not be created. The time series is disabled.\n");
+			pthread_cond_destroy(&series_cond);
+			pthread_mutex_destroy(&series_lock);
+			fclose(series_fp);
+			delete [] series_buffer;
+			series_fp = NULL;
+			series_buffer = NULL;
+			series_mode = -1;
+			return;
+		}
+		is_series_thread = true;
+	}
+
+	#ifdef DEBUG_PRINT_MONITOR
+	fprintf(stderr, "<initializeSeries> PMLIB_SERIES=%s, mode=%d, interval=%e, file=%s\n",
+		s_value.c_str(), series_mode, series_interval, file_name);
+	#endif
+  }
+
+
+  /// サンプラスレッドの本体. series_interval 秒毎にスナップショットを取る
+  ///
+  ///   @param[in] arg   the PerfMonitor instance of the master thread
+  ///
+  void* PerfMonitor::series_sampler(void* arg)
+  {
+	PerfMonitor* pm = static_cast<PerfMonitor*>(arg);
+
+	double t_sec = floor(pm->series_interval);
+	long t_nsec = (long)((pm->series_interval - t_sec) * 1.0e9);
+	struct timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+
+	pthread_mutex_lock(&pm->series_lock);
+	while (!pm->series_quit) {
+		deadline.tv_sec += (time_t)t_sec;
+		deadline.tv_nsec += t_nsec;
+		if (deadline.tv_nsec >= 1000000000L) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+		int iret = 0;
+		while (!pm->series_quit && (iret != ETIMEDOUT)) {
+			iret = pthread_cond_timedwait(&pm->series_cond, &pm->series_lock, &deadline);
+		}
+		if (pm->series_quit) break;
+		pm->series_snapshot();
+	}
+	pthread_mutex_unlock(&pm->series_lock);
+	return NULL;
+  }
+
+
+  /// 全区間の積算値のスナップショットをバッファに追加する
+  ///
+  ///   @note 新しく追加された区間は、スナップショットの前にラベルを出力する。
+  ///
+  void PerfMonitor::series_snapshot(void)
+  {
+	if (series_fp == NULL) return;
+
+	int n_sections = m_nWatch;
+	int n_events = m_watchArray[0].my_papi.num_events;
+	pm_series_tag tag;
+
+	for (int i=series_nlabeled; i<n_sections; i++) {
+		const std::string& s = m_watchArray[i].m_label;
+		int32_t id = i;
+		tag.type = Pm_series_label;
+		tag.size = sizeof(id) + s.size();
+		series_append(&tag, sizeof(tag));
+		series_append(&id, sizeof(id));
+		series_append(s.data(), s.size());
+	}
+	series_nlabeled = n_sections;
+
+	pm_series_snapshot_head head;
+	head.time = m_watchArray[0].getTime() - series_origin;
+	head.n_sections = n_sections;
+	head.reserved = 0;
+	tag.type = Pm_series_snapshot;
+	tag.size = sizeof(head) + (size_t)n_sections * (sizeof(pm_series_entry) + n_events*sizeof(int64_t));
+	series_append(&tag, sizeof(tag));
+	series_append(&head, sizeof(head));
+
+	pm_series_entry e;
+	int64_t hwpc[Max_chooser_events];
+	for (int i=0; i<n_sections; i++) {
+		m_watchArray[i].seriesPack(&e, hwpc);
+		series_append(&e, sizeof(e));
+		series_append(hwpc, n_events*sizeof(int64_t));
+	}
+  }
+
+
+  /// バッファに追加する. 一杯になった場合はファイルに書き出す
+  ///
+  void PerfMonitor::series_append(const void* p, size_t n)
+  {
+	if (series_used + n > (size_t)Pm_series_buffer_size) series_flush();
+	if (n > (size_t)Pm_series_buffer_size) {
+		if (fwrite(p, 1, n, series_fp) != n) {
+			printDiag("series_append()",  "write error of the time series file : %s\n", strerror(errno));
+		}
+		return;
+	}
+	memcpy(series_buffer + series_used, p, n);
+	series_used += n;
+  }
+
+
+  /// バッファをファイルに書き出す
+  ///
+  void PerfMonitor::series_flush(void)
+  {
+	if ((series_fp == NULL) || (series_used == 0)) return;
+	if (fwrite(series_buffer, 1, series_used, series_fp) != series_used) {
+		printDiag("series_flush()",  "write error of the time series file : %s\n", strerror(errno));
+	}
+	fflush(series_fp);
+	series_used = 0;
+  }
+
+
+  /// サンプラスレッドを停止し、最後のスナップショットを書き出してファイルを閉じる
+  ///
+  ///   @note report() から Root区間の停止後に呼ばれる。
+  ///
+  void PerfMonitor::finalizeSeries(void)
+  {
+	if (series_fp == NULL) return;
+
+	if (is_series_thread) {
+		pthread_mutex_lock(&series_lock);
+		series_quit = true;
+		pthread_cond_signal(&series_cond);
+		pthread_mutex_unlock(&series_lock);
+		pthread_join(series_thread, NULL);
+		pthread_cond_destroy(&series_cond);
+		pthread_mutex_destroy(&series_lock);
+		is_series_thread = false;
+	}
+
+	series_snapshot();
+	series_flush();
+	fclose(series_fp);
+	delete [] series_buffer;
+	series_fp = NULL;
+	series_buffer = NULL;
+	series_mode = -1;
+	series_section = -1;
+  }
+
+
+  /// PMLIB_SERIES スナップショットの区間の積算値
+  ///
+  void PerfWatch::seriesPack(pm_series_entry* e, int64_t* hwpc)
+  {
+	e->count = m_count;
+	e->count_sampled = m_count_sampled;
+	e->time = m_time;
+	e->flop = m_flop;
+
+	for (int i=0; i<my_papi.num_events; i++) {
+		hwpc[i] = 0;
+	}
+	if (my_papi.num_events == 0) return;
+
+	//	the sampled and the rotated sections accumulate in th_sampled[][]
+	pmlib_thread_array<long long>& th_acc
+		= (is_scaled() && (my_papi.th_sampled.data != NULL)) ? my_papi.th_sampled : my_papi.th_accumu;
+	int j_begin = m_in_parallel ? my_thread : 0;
+	int j_end = m_in_parallel ? my_thread+1 : std::min(num_threads, my_papi.th_nthreads);
+	for (int j=j_begin; j<j_end; j++) {
+	for (int i=0; i<my_papi.num_events; i++) {
+		hwpc[i] += th_acc[j][i];
+	}
+	}
+  }
+
+} /* namespace pm_lib */
@@ -0,0 +1,305 @@
+/*
+###################################################################################
+#
+# PMlib - Performance Monitor Library
+#
+# Copyright (c) 2010-2011 VCAD System Research Program, RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2012-2020 Advanced Institute for Computational Science(AICS), RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2016-2020 Research Institute for Information Technology(RIIT), Kyushu University.
+# All rights reserved.
+#
+###################################################################################
+ */
+
+//! @file   PerfTimer.cpp
+//! @brief  PerfWatch class timer source selection and calibration
+
+#include <string>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <time.h>
+
+#ifdef DISABLE_MPI
+#include "mpi_stubs.h"
+#else
+#include <mpi.h>
+#endif
+
+#include "PerfWatch.h"
+
+#if defined (USE_PRECISE_TIMER) // Platform specific precise timer
+	#if defined (__APPLE__)				// Mac Clang and/or GCC
+		#include <unistd.h>
+		#include <mach/mach.h>
+		#include <mach/mach_time.h>
+	#elif defined (__FUJITSU)			// Fugaku A64FX, FX100, K computer
+		#include <fjcex.h>
+	#endif
+	#if defined (__x86_64__)
+		#include <cpuid.h>
+	#endif
+#endif
+
+
+namespace pm_lib {
+
+  extern struct pmlib_timer_chooser pm_timer;
+
+  static inline double read_clock(clockid_t clk)
+  {
+	struct timespec ts;
+	clock_gettime(clk, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1.0e-9;
+  }
+
+#if defined (USE_PRECISE_TIMER)
+	#if defined (__x86_64__)
+  static inline unsigned long long read_tsc(void)
+  {
+	unsigned int lo, hi;
+	__asm__ __volatile__ ( "rdtsc" : "=a"(lo), "=d"(hi) );
+	return ( (unsigned long long)lo)|( ((unsigned long long)hi)<<32 );
+  }
+  static inline unsigned long long read_tsc_lfence(void)
+  {
+	unsigned int lo, hi;
+	__asm__ __volatile__ ( "lfence\n\trdtsc" : "=a"(lo), "=d"(hi) :: "memory" );
+	return ( (unsigned long long)lo)|( ((unsigned long long)hi)<<32 );
+  }
+  static inline unsigned long long read_tscp(void)
+  {
+	unsigned int lo, hi;
+	__asm__ __volatile__ ( "rdtscp" : "=a"(lo), "=d"(hi) :: "rcx" );
+	return ( (unsigned long long)lo)|( ((unsigned long long)hi)<<32 );
+  }
+	#elif defined (__aarch64__)
+  static inline unsigned long long read_cntvct(void)
+  {
+	unsigned long long v;
+	__asm__ __volatile__ ( "isb\n\tmrs %0, cntvct_el0" : "=r"(v) :: "memory" );
+	return v;
+  }
+	#endif
+#endif
+
+  static unsigned long long read_tick(int source)
+  {
+	switch (source) {
+#if defined (USE_PRECISE_TIMER)
+	#if defined (__x86_64__)
+	case Timer_tsc:			return read_tsc();
+	case Timer_tsc_lfence:	return read_tsc_lfence();
+	case Timer_tscp:		return read_tscp();
+	#elif defined (__aarch64__)
+	case Timer_cntvct:		return read_cntvct();
+	#endif
+#endif
+	default:				return 0;
+	}
+  }
+
+
+  /// 時刻を取得
+  ///
+  ///   @return 時刻値(秒)
+  ///
+  double PerfWatch::getTime()
+  {
+	switch (pm_timer.source) {
+	case Timer_monotonic:
+		return read_clock(CLOCK_MONOTONIC);
+
+	case Timer_monotonic_raw:
+		return read_clock(CLOCK_MONOTONIC_RAW);
+
+#if defined (USE_PRECISE_TIMER)
+	#if defined (__x86_64__)
+	case Timer_tsc:
+		return (double)(read_tsc() - pm_timer.tick_base) * pm_timer.second_per_tick + pm_timer.time_base;
+	case Timer_tsc_lfence:
+		return (double)(read_tsc_lfence() - pm_timer.tick_base) * pm_timer.second_per_tick + pm_timer.time_base;
+	case Timer_tscp:
+		return (double)(read_tscp() - pm_timer.tick_base) * pm_timer.second_per_tick + pm_timer.time_base;
+	#elif defined (__aarch64__)
+	case Timer_cntvct:
+		return (double)(read_cntvct() - pm_timer.tick_base) * pm_timer.second_per_tick + pm_timer.time_base;
+	#endif
+	#if defined (__APPLE__)
+	case Timer_mach:
+		return (double)(mach_absolute_time() - pm_timer.tick_base) * pm_timer.second_per_tick + pm_timer.time_base;
+	#endif
+	#if defined (__FUJITSU)
+	case Timer_gettod:
+		return (__gettod()*1.0e-6);
+	#endif
+#endif
+
+	default:	// Portable timer gettimeofday() on Linux, Unix, Macos
+		struct timeval tv;
+		gettimeofday(&tv, 0);
+		return (double)tv.tv_sec + (double)tv.tv_usec * 1.0e-6;
+	}
+  }
+
+
+  /// calibrate the tick based timer against CLOCK_MONOTONIC_RAW
+  ///
+  ///   @param[in] source    pmlib_timer_source
+  ///   @param[in] interval  calibration interval [sec]
+  ///
+  ///   @return seconds per tick
+  ///
+  static double calibrate_tick(int source, double interval)
+  {
+	double t0, t1;
+	unsigned long long c0, c1;
+
+	t0 = read_clock(CLOCK_MONOTONIC_RAW);
+	c0 = read_tick(source);
+	do {
+		t1 = read_clock(CLOCK_MONOTONIC_RAW);
+	} while (t1 - t0 < interval);
+	c1 = read_tick(source);
+
+	if (c1 <= c0) return 0.0;
+	return (t1 - t0) / (double)(c1 - c0);
+  }
+
+
+  /// check if the processor has an invariant TSC
+  ///
+  static bool has_invariant_tsc(int source)
+  {
+#if defined (USE_PRECISE_TIMER) && defined (__x86_64__)
+	unsigned int eax, ebx, ecx, edx;
+	if (__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) == 0) return false;
+	if ((edx & (1u << 8)) == 0) return false;
+	if (source == Timer_tscp) {
+		if (__get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx) == 0) return false;
+		if ((edx & (1u << 27)) == 0) return false;
+	}
+	return true;
+#else
+	return false;
+#endif
+  }
+
+
+  void PerfWatch::initializeTimer()
+  {
+	#ifdef _OPENMP
+	#pragma omp critical
+	#endif
+	{
+	if (!pm_timer.is_set) {
+
+	// Parse the Environment Variable PMLIB_TIMER
+	std::string s_chooser;
+	std::string s_default = "MONOTONIC";
+	char* cp_env = std::getenv("PMLIB_TIMER");
+	if (cp_env == NULL) {
+		s_chooser = s_default;
+	} else {
+		s_chooser = cp_env;
+	}
+
+	int source = -1;
+	if (s_chooser == "MONOTONIC")			source = Timer_monotonic;
+	else if (s_chooser == "MONOTONIC_RAW")	source = Timer_monotonic_raw;
+	else if (s_chooser == "GETTIMEOFDAY")	source = Timer_gettimeofday;
+#if defined (USE_PRECISE_TIMER)
+	#if defined (__x86_64__)
+	else if (s_chooser == "TSC")			source = Timer_tsc;
+	else if (s_chooser == "TSC_LFENCE")		source = Timer_tsc_lfence;
+	else if (s_chooser == "TSCP")			source = Timer_tscp;
+	#elif defined (__aarch64__)
+	else if (s_chooser == "CNTVCT")			source = Timer_cntvct;
+	#endif
+	#if defined (__APPLE__)
+	else if (s_chooser == "MACH")			source = Timer_mach;
+	#endif
+	#if defined (__FUJITSU)
+	else if (s_chooser == "GETTOD")			source = Timer_gettod;
+	#endif
+#endif
+	if (source < 0) {
+		printError("initializeTimer",  "PMLIB_TIMER=%s is not available. the default value [%s] is set.\n",
+			s_chooser.c_str(), s_default.c_str());
+		s_chooser = s_default;
+		source = Timer_monotonic;
+	}
+
+	if ((source == Timer_tsc) || (source == Timer_tsc_lfence) || (source == Timer_tscp)) {
+		if (!has_invariant_tsc(source)) {
+			printError("initializeTimer",  "%s is not invariant on this processor. the default value [%s] is set.\n",
+				s_chooser.c_str(), s_default.c_str());
+			s_chooser = s_default;
+			source = Timer_monotonic;
+		}
+	}
+
+	pm_timer.second_per_tick = 1.0;
+	pm_timer.tick_base = 0;
+	pm_timer.time_base = 0.0;
+
+	if ((source == Timer_tsc) || (source == Timer_tsc_lfence) ||
+		(source == Timer_tscp) || (source == Timer_cntvct)) {
+		//	Calibrate twice and check that the rate is stable
+		double spt_1 = calibrate_tick(source, 1.0e-2);
+		double spt_2 = calibrate_tick(source, 5.0e-3);
+#if defined (USE_PRECISE_TIMER) && defined (__aarch64__)
+		if (source == Timer_cntvct) {
+			unsigned long long freq;
+			__asm__ __volatile__ ( "mrs %0, cntfrq_el0" : "=r"(freq) );
+			if (freq > 0) spt_2 = 1.0/(double)freq;
+		}
+#endif
+		if ((spt_1 <= 0.0) || (spt_2 <= 0.0) || (fabs(spt_2/spt_1 - 1.0) > 1.0e-3)) {
+			printError("initializeTimer",  "%s calibration is not stable (%e, %e [sec/tick]). the default value [%s] is set.\n",
+				s_chooser.c_str(), spt_1, spt_2, s_default.c_str());
+			s_chooser = s_default;
+			source = Timer_monotonic;
+		} else {
+			pm_timer.second_per_tick = spt_1;
+			pm_timer.time_base = read_clock(CLOCK_MONOTONIC);
+			pm_timer.tick_base = read_tick(source);
+		}
+	}
+#if defined (USE_PRECISE_TIMER) && defined (__APPLE__)
+	if (source == Timer_mach) {
+		mach_timebase_info_data_t tb;
+		mach_timebase_info(&tb);
+		pm_timer.second_per_tick = (double)tb.numer / (double)tb.denom * 1.0e-9;
+		pm_timer.time_base = read_clock(CLOCK_MONOTONIC);
+		pm_timer.tick_base = mach_absolute_time();
+	}
+#endif
+
+	pm_timer.source = source;
+	pm_timer.name = s_chooser;
+
+	//	Measure the cost of one getTime() call
+	const int n_calls = 1000;
+	double t0 = PerfWatch::getTime();
+	for (int i=0; i<n_calls; i++) {
+		(void) PerfWatch::getTime();
+	}
+	pm_timer.overhead = (PerfWatch::getTime() - t0) / (double)(n_calls+1);
+	pm_timer.is_set = true;
+
+	#ifdef DEBUG_PRINT_WATCH
+	if (my_rank == 0) {
+		fprintf(stderr, "<initializeTimer> PMLIB_TIMER=%s, second_per_tick=%16.12e, overhead=%e \n",
+			pm_timer.name.c_str(), pm_timer.second_per_tick, pm_timer.overhead);
+	}
+	#endif
+	}
+	}	// end of omp critical
+  }
+
+} /* namespace pm_lib */
@@ -0,0 +1,531 @@
+/*
+###################################################################################
+#
+# PMlib - Performance Monitor Library
+#
+# Copyright (c) 2010-2011 VCAD System Research Program, RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2012-2020 Advanced Institute for Computational Science(AICS), RIKEN.
+# All rights reserved.
+#
+# Copyright (c) 2016-2020 Research Institute for Information Technology(RIIT), Kyushu University.
+# All rights reserved.
+#
+###################################################################################
+ */
+
+//! @file   PerfTrace.cpp
+//! @brief  OTF2 trace writer with per thread event buffers and a writer thread
+
+#ifdef DISABLE_MPI
+#include "mpi_stubs.h"
+#else
+#include <mpi.h>
+#endif
+
+#include "PerfWatch.h"
+
+#ifdef USE_OTF2
+#include <otf2/otf2.h>
+#ifndef DISABLE_MPI
+#include <otf2/OTF2_MPI_Collectives.h>
+#endif
+#include "pmlib_pmpi.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <algorithm>
+#include <deque>
+#include <vector>
+#include <new>
+
+
+namespace pm_lib {
+
+//
+//	OTF2 trace writer
+//
+//	OTF_TRACING=on|full and OTF_FILENAME=<dir> select the trace as for OTF.
+//	The archive <dir>/pmlib.otf2 has one location per thread of each process,
+//	so that the sections in parallel region are traced by the calling thread.
+//
+//	PerfWatch::start()/stop() append a compact 24 Byte record to the current
+//	chunk of the calling thread. No lock and no library call is made until the
+//	chunk is full. A full chunk is queued to the writer thread, which converts
+//	the records into OTF2 events, and the thread continues with a free chunk of
+//	its own pool. When the pool is exhausted the thread waits for the writer, so
+//	that no event is lost. The time stamps are nanoseconds since initialize()
+//	taken from PerfWatch::getTime(). Nested parallel regions are not traced.
+//
+
+  const int Pm_trace_chunk_events = 4096;	///< records per chunk
+  const int Pm_trace_thread_chunks = 4;	///< chunks per thread
+
+
+  /// トレースの1イベントの記録
+  ///
+  struct pm_trace_record
+  {
+	uint64_t time;			///< nanoseconds since initialize()
+	uint32_t region;		///< section ID
+	uint32_t type;			///< pm_trace_event_type
+	double value;			///< counter value of Pm_trace_leave_metric
+  };
+
+
+  /// スレッド毎の書き込み中のchunk. cache lineを共有しない
+  ///
+  struct pm_trace_thread
+  {
+	pm_trace_record* rec;	///< records of the current chunk
+	int n;					///< number of the records in the current chunk
+	int i_chunk;			///< index of the current chunk
+	uint64_t n_events;		///< number of the events written by the thread
+	uint64_t t_last;		///< time stamp of the last event
+	char pad[64];
+  };
+
+
+  /// OTF2 トレースの全体の状態
+  ///
+  struct pm_trace_state
+  {
+	bool is_open;
+	int num_process;
+	int my_rank;
+	int num_threads;
+	double base_time;
+
+	std::vector<pm_trace_thread> thread;
+	std::vector<pm_trace_record*> chunk;	///< the records of each chunk
+	std::vector<int> chunk_n;				///< number of the records of each queued chunk
+	std::vector<int> chunk_owner;			///< the thread which owns the chunk
+	std::vector< std::vector<int> > free_chunk;	///< free chunks of each thread
+	std::deque<int> full_chunk;				///< chunks waiting for the writer thread
+	long n_stalls;							///< waits for a free chunk
+
+	pthread_t writer;
+	pthread_mutex_t lock;
+	pthread_cond_t cond_full;				///< a chunk is queued, or quit
+	pthread_cond_t cond_free;				///< a chunk is returned to its owner
+	bool is_writer;
+	bool quit;
+
+	OTF2_Archive* archive;
+	std::vector<OTF2_EvtWriter*> evt_writer;	///< event writer of each thread
+	std::vector<std::string> label;			///< section labels
+  };
+
+  static pm_trace_state pm_trace;
+  static pthread_mutex_t pm_trace_open_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+  static OTF2_FlushType pm_trace_pre_flush(void* userData, OTF2_FileType fileType,
+		OTF2_LocationRef location, void* callerData, bool final)
+  {
+	return OTF2_FLUSH;
+  }
+
+  static OTF2_TimeStamp pm_trace_post_flush(void* userData, OTF2_FileType fileType,
+		OTF2_LocationRef location)
+  {
+	return 0;
+  }
+
+  static OTF2_FlushCallbacks pm_trace_flush_callbacks =
+  {
+	pm_trace_pre_flush,
+	pm_trace_post_flush
+  };
+
+
+  /// OTF2のlocation番号. ランク毎に num_threads 個の連番
+  ///
+  static inline OTF2_LocationRef trace_location(int rank, int th)
+  {
+	return (OTF2_LocationRef)rank * (OTF2_LocationRef)pm_trace.num_threads + (OTF2_LocationRef)th;
+  }
+
+
+  /// chunkの記録をOTF2のイベントに変換する. 書き込みスレッドから呼ばれる
+  ///
+  static void trace_write_chunk(int k)
+  {
+	int th = pm_trace.chunk_owner[k];
+	OTF2_EvtWriter*& w = pm_trace.evt_writer[th];
+	if (w == NULL) {
+		w = OTF2_Archive_GetEvtWriter(pm_trace.archive, trace_location(pm_trace.my_rank, th));
+		if (w == NULL) {
+			fprintf(stderr, "\t*** internal error. <trace_write_chunk> OTF2_Archive_GetEvtWriter() failed. \n");
+			return;
+		}
+	}
+	const pm_trace_record* r = pm_trace.chunk[k];
+	for (int i=0; i<pm_trace.chunk_n[k]; i++) {
+		if (r[i].type == Pm_trace_enter) {
+			OTF2_EvtWriter_Enter(w, NULL, r[i].time, r[i].region);
+		} else {
+			if (r[i].type == Pm_trace_leave_metric) {
+				OTF2_Type type = OTF2_TYPE_DOUBLE;
+				OTF2_MetricValue v;
+				v.floating_point = r[i].value;
+				OTF2_EvtWriter_Metric(w, NULL, r[i].time, 0, 1, &type, &v);
+			}
+			OTF2_EvtWriter_Leave(w, NULL, r[i].time, r[i].region);
+		}
+	}
+  }
+
+
+  /// 書き込みスレッドの本体. キューに積まれたchunkを順に書き出し、所有スレッドに返す
+  ///
+  static void* trace_writer(void* arg)
+  {
+	pthread_mutex_lock(&pm_trace.lock);
+	while (true) {
+		while (pm_trace.full_chunk.empty() && !pm_trace.quit) {
+			pthread_cond_wait(&pm_trace.cond_full, &pm_trace.lock);
+		}
+		if (pm_trace.full_chunk.empty()) break;
+		int k = pm_trace.full_chunk.front();
+		pm_trace.full_chunk.pop_front();
+		pthread_mutex_unlock(&pm_trace.lock);
+
+		trace_write_chunk(k);
+
+		pthread_mutex_lock(&pm_trace.lock);
+		pm_trace.free_chunk[pm_trace.chunk_owner[k]].push_back(k);
+		pthread_cond_broadcast(&pm_trace.cond_free);
+	}
+	pthread_mutex_unlock(&pm_trace.lock);
+	return NULL;
+  }
+
+
+  /// 書き込み中のchunkをキューに積み、空きchunkに切り替える
+  ///
+  static void trace_next_chunk(int th)
+  {
+	pm_trace_thread& b = pm_trace.thread[th];
+	pthread_mutex_lock(&pm_trace.lock);
+	pm_trace.chunk_n[b.i_chunk] = b.n;
+	pm_trace.full_chunk.push_back(b.i_chunk);
+	pthread_cond_signal(&pm_trace.cond_full);
+	while (pm_trace.free_chunk[th].empty()) {
+		pm_trace.n_stalls++;
+		pthread_cond_wait(&pm_trace.cond_free, &pm_trace.lock);
+	}
+	b.i_chunk = pm_trace.free_chunk[th].back();
+	pm_trace.free_chunk[th].pop_back();
+	pthread_mutex_unlock(&pm_trace.lock);
+	b.rec = pm_trace.chunk[b.i_chunk];
+	b.n = 0;
+  }
+
+
+  /// chunkを開放する
+  ///
+  static void trace_free_chunks(void)
+  {
+	for (size_t k=0; k<pm_trace.chunk.size(); k++) {
+		delete [] pm_trace.chunk[k];
+	}
+	pm_trace.chunk.clear();
+  }
+
+
+  /// OTF2 アーカイブとバッファを用意する. pm_trace_open_lock の中で呼ばれる
+  ///
+  ///   @note アーカイブを開いた後にバッファや書き込みスレッドを用意できない場合は
+  ///		イベントを記録しないが、アーカイブは開いたままにする。アーカイブを閉じる
+  ///		処理は全プロセスの集団操作なので、pm_trace_finalize() で他のプロセスと共に閉じる。
+  ///
+  static void trace_open(int num_process, int my_rank, int num_threads, const char* otf_filename, double baseT)
+  {
+	pm_trace.is_open = false;
+	pm_trace.num_process = num_process;
+	pm_trace.my_rank = my_rank;
+	pm_trace.num_threads = std::max(1, num_threads);
+	pm_trace.base_time = baseT;
+	pm_trace.n_stalls = 0;
+	pm_trace.is_writer = false;
+	pm_trace.quit = false;
+
+	pm_trace.archive = OTF2_Archive_Open(otf_filename, "pmlib", OTF2_FILEMODE_WRITE,
+		1024*1024, 4*1024*1024, OTF2_SUBSTRATE_POSIX, OTF2_COMPRESSION_NONE);
+	if (pm_trace.archive == NULL) {
+		fprintf(stderr, "\t*** internal error. <pm_trace_initialize> OTF2_Archive_Open() failed. \n");
+		return;
+	}
+	OTF2_Archive_SetFlushCallbacks(pm_trace.archive, &pm_trace_flush_callbacks, NULL);
+	#ifndef DISABLE_MPI
+	OTF2_MPI_Archive_SetCollectiveCallbacks(pm_trace.archive, MPI_COMM_WORLD, MPI_COMM_NULL);
+	#else
+	OTF2_Archive_SetSerialCollectiveCallbacks(pm_trace.archive);
+	#endif
+	OTF2_Archive_OpenEvtFiles(pm_trace.archive);
+
+	pthread_mutex_init(&pm_trace.lock, NULL);
+	pthread_cond_init(&pm_trace.cond_full, NULL);
+	pthread_cond_init(&pm_trace.cond_free, NULL);
+
+	int nth = pm_trace.num_threads;
+	int n_chunks = nth * Pm_trace_thread_chunks;
+	pm_trace_thread zero_thread = {};
+	pm_trace.thread.assign(nth, zero_thread);
+	pm_trace.chunk.assign(n_chunks, (pm_trace_record*)NULL);
+	pm_trace.chunk_n.assign(n_chunks, 0);
+	pm_trace.chunk_owner.assign(n_chunks, 0);
+	pm_trace.free_chunk.assign(nth, std::vector<int>());
+	pm_trace.evt_writer.assign(nth, (OTF2_EvtWriter*)NULL);
+	for (int k=0; k<n_chunks; k++) {
+		pm_trace.chunk[k] = new (std::nothrow) pm_trace_record[Pm_trace_chunk_events];
+		if (pm_trace.chunk[k] == NULL) {
+			fprintf(stderr, "\t*** internal error. <pm_trace_initialize> trace buffer allocation failed. \n");
+			trace_free_chunks();
+			return;
+		}
+		pm_trace.chunk_owner[k] = k / Pm_trace_thread_chunks;
+	}
+	for (int th=0; th<nth; th++) {
+		pm_trace_thread& b = pm_trace.thread[th];
+		b.i_chunk = th * Pm_trace_thread_chunks;
+		b.rec = pm_trace.chunk[b.i_chunk];
+		b.n = 0;
+		b.n_events = 0;
+		b.t_last = 0;
+		for (int i=Pm_trace_thread_chunks-1; i>0; i--) {
+			pm_trace.free_chunk[th].push_back(b.i_chunk + i);
+		}
+	}
+
+	if (pthread_create(&pm_trace.writer, NULL, trace_writer, NULL) != 0) {
+		fprintf(stderr, "\t*** internal error. <pm_trace_initialize> the writer thread could not be created. \n");
+		trace_free_chunks();
+		return;
+	}
+	pm_trace.is_writer = true;
+	pm_trace.is_open = true;
+
+	#ifdef DEBUG_PRINT_OTF
+	if (my_rank == 0) {
+	fprintf(stderr, "\t<pm_trace_initialize> num_process=%d, my_rank=%d, num_threads=%d, archive=%s/pmlib.otf2, baseT=%f \n",
+		num_process, my_rank, nth, otf_filename, baseT);
+	}
+	#endif
+  }
+
+
+  /// OTF2 アーカイブを開き、スレッド毎のバッファと書き込みスレッドを用意する
+  ///
+  ///   @param[in] num_process  並列プロセス数
+  ///   @param[in] my_rank      自ランク番号
+  ///   @param[in] num_threads  並列スレッド数
+  ///   @param[in] otf_filename アーカイブのディレクトリ
+  ///   @param[in] baseT        時刻の原点
+  ///
+  ///   @note threadprivateのPerfMonitorでは各スレッドから呼ばれ、最初の呼び出しが
+  ///         アーカイブを開く。他のスレッドはそれが終わるまで待つ。
+  ///
+  void pm_trace_initialize(int num_process, int my_rank, int num_threads, const char* otf_filename, double baseT)
+  {
+	pthread_mutex_lock(&pm_trace_open_lock);
+	if (pm_trace.archive == NULL) trace_open(num_process, my_rank, num_threads, otf_filename, baseT);
+	pthread_mutex_unlock(&pm_trace_open_lock);
+  }
+
+
+  /// イベントを呼び出したスレッドのバッファに追加する
+  ///
+  ///   @param[in] type   pm_trace_event_type
+  ///   @param[in] time   PerfWatch::getTime() の時刻
+  ///   @param[in] id     区間番号
+  ///   @param[in] value  Pm_trace_leave_metric のカウンター値
+  ///
+  void pm_trace_event(int type, double time, int id, double value)
+  {
+	if (!pm_trace.is_open) return;
+	int th = 0;
+	#ifdef _OPENMP
+	if (omp_get_level() > 1) return;
+	th = omp_get_thread_num();
+	if (th >= pm_trace.num_threads) return;
+	#endif
+
+	pm_trace_thread& b = pm_trace.thread[th];
+	if (b.n == Pm_trace_chunk_events) trace_next_chunk(th);
+
+	double dt = time - pm_trace.base_time;
+	pm_trace_record& r = b.rec[b.n++];
+	r.time = (dt > 0.0) ? (uint64_t)(dt * 1.0e9) : 0;
+	r.region = (uint32_t)id;
+	r.type = (uint32_t)type;
+	r.value = value;
+	b.n_events += (type == Pm_trace_leave_metric) ? 2 : 1;
+	b.t_last = r.time;
+  }
+
+
+  /// 区間のラベルを保存する. 定義の出力はランク0の pm_trace_finalize() が行う
+  ///
+  ///   @param[in] id       区間番号
+  ///   @param[in] c_label  ラベル
+  ///
+  ///   @note 全プロセスから呼ばれ、区間数を数える。
+  ///
+  void pm_trace_label(int id, const char* c_label)
+  {
+	if (!pm_trace.is_open) return;
+	if ((int)pm_trace.label.size() <= id) pm_trace.label.resize(id+1);
+	pm_trace.label[id] = c_label;
+  }
+
+
+  /// 全スレッドのバッファを書き出し、定義を出力してアーカイブを閉じる
+  ///
+  ///   @param[in] c_counter   カウンターの名前
+  ///   @param[in] c_unit      カウンターの単位
+  ///
+  ///   @note 全プロセスのマスタースレッドから、他スレッドの計測が終わった後に呼ばれる。
+  ///		バッファを用意できずにイベントを記録しなかったプロセスも、
+  ///		イベント数0としてアーカイブを閉じる集団操作に加わる。
+  ///
+  void pm_trace_finalize(const char* c_counter, const char* c_unit)
+  {
+	#ifdef _OPENMP
+	if (omp_get_thread_num() != 0) return;
+	#endif
+	if (pm_trace.archive == NULL) return;
+	int nth = pm_trace.num_threads;
+
+	if (pm_trace.is_open) {
+		pthread_mutex_lock(&pm_trace.lock);
+		for (int th=0; th<nth; th++) {
+			pm_trace_thread& b = pm_trace.thread[th];
+			if (b.n == 0) continue;
+			pm_trace.chunk_n[b.i_chunk] = b.n;
+			pm_trace.full_chunk.push_back(b.i_chunk);
+			b.n = 0;
+		}
+		pm_trace.quit = true;
+		pthread_cond_signal(&pm_trace.cond_full);
+		pthread_mutex_unlock(&pm_trace.lock);
+	}
+	if (pm_trace.is_writer) pthread_join(pm_trace.writer, NULL);
+	pthread_cond_destroy(&pm_trace.cond_free);
+	pthread_cond_destroy(&pm_trace.cond_full);
+	pthread_mutex_destroy(&pm_trace.lock);
+	pm_trace.is_writer = false;
+	pm_trace.is_open = false;
+
+	for (int th=0; th<nth; th++) {
+		if (pm_trace.evt_writer[th] != NULL) {
+			OTF2_Archive_CloseEvtWriter(pm_trace.archive, pm_trace.evt_writer[th]);
+		}
+	}
+	OTF2_Archive_CloseEvtFiles(pm_trace.archive);
+
+	OTF2_Archive_OpenDefFiles(pm_trace.archive);
+	for (int th=0; th<nth; th++) {
+		OTF2_DefWriter* d = OTF2_Archive_GetDefWriter(pm_trace.archive, trace_location(pm_trace.my_rank, th));
+		OTF2_Archive_CloseDefWriter(pm_trace.archive, d);
+	}
+	OTF2_Archive_CloseDefFiles(pm_trace.archive);
+
+	//	the event counts of all the locations, and the number of the regions
+	std::vector<uint64_t> n_events(nth);
+	uint64_t t_length = 0;
+	for (int th=0; th<nth; th++) {
+		n_events[th] = pm_trace.thread[th].n_events;
+		t_length = std::max(t_length, pm_trace.thread[th].t_last);
+	}
+	std::vector<uint64_t> n_all((size_t)nth * pm_trace.num_process);
+	uint64_t t_all = t_length;
+	int n_sections = (int)pm_trace.label.size();
+	int n_regions = n_sections;
+	#ifndef DISABLE_MPI
+	if (pm_trace.num_process > 1) {
+		MPI_Gather(&n_events[0], nth, MPI_UINT64_T, &n_all[0], nth, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+		MPI_Reduce(&t_length, &t_all, 1, MPI_UINT64_T, MPI_MAX, 0, MPI_COMM_WORLD);
+		MPI_Reduce(&n_sections, &n_regions, 1, MPI_INT, MPI_MAX, 0, MPI_COMM_WORLD);
+	} else
+	#endif
+	{
+		n_all = n_events;
+	}
+
+	if (pm_trace.my_rank == 0) {
+		OTF2_GlobalDefWriter* d = OTF2_Archive_GetGlobalDefWriter(pm_trace.archive);
+		OTF2_StringRef n_str = 0;
+		OTF2_StringRef s_empty = n_str++;
+		OTF2_GlobalDefWriter_WriteString(d, s_empty, "");
+
+		#if OTF2_VERSION_MAJOR >= 3
+		OTF2_GlobalDefWriter_WriteClockProperties(d, 1000000000, 0, t_all + 1, OTF2_UNDEFINED_TIMESTAMP);
+		#else
+		OTF2_GlobalDefWriter_WriteClockProperties(d, 1000000000, 0, t_all + 1);
+		#endif
+
+		OTF2_StringRef s_node = n_str++;
+		OTF2_GlobalDefWriter_WriteString(d, s_node, "PMlib job");
+		OTF2_StringRef s_class = n_str++;
+		OTF2_GlobalDefWriter_WriteString(d, s_class, "job");
+		OTF2_GlobalDefWriter_WriteSystemTreeNode(d, 0, s_node, s_class, OTF2_UNDEFINED_SYSTEM_TREE_NODE);
+
+		char c_name[64];
+		for (int r=0; r<pm_trace.num_process; r++) {
+			OTF2_StringRef s_process = n_str++;
+			snprintf(c_name, sizeof(c_name), "Process %d", r);
+			OTF2_GlobalDefWriter_WriteString(d, s_process, c_name);
+			#if OTF2_VERSION_MAJOR >= 3
+			OTF2_GlobalDefWriter_WriteLocationGroup(d, r, s_process, OTF2_LOCATION_GROUP_TYPE_PROCESS, 0, OTF2_UNDEFINED_LOCATION_GROUP);
+			#else
+			OTF2_GlobalDefWriter_WriteLocationGroup(d, r, s_process, OTF2_LOCATION_GROUP_TYPE_PROCESS, 0);
+			#endif
+			for (int th=0; th<nth; th++) {
+				OTF2_StringRef s_thread = n_str++;
+				snprintf(c_name, sizeof(c_name), "Thread %d", th);
+				OTF2_GlobalDefWriter_WriteString(d, s_thread, c_name);
+				OTF2_GlobalDefWriter_WriteLocation(d, trace_location(r, th), s_thread,
+					OTF2_LOCATION_TYPE_CPU_THREAD, n_all[(size_t)r*nth + th], r);
+			}
+		}
+
+		//	the sections of the other processes beyond rank 0 are named by the ID
+		for (int id=0; id<n_regions; id++) {
+			OTF2_StringRef s_region = n_str++;
+			if ((id < (int)pm_trace.label.size()) && !pm_trace.label[id].empty()) {
+				OTF2_GlobalDefWriter_WriteString(d, s_region, pm_trace.label[id].c_str());
+			} else {
+				snprintf(c_name, sizeof(c_name), "Section %d", id);
+				OTF2_GlobalDefWriter_WriteString(d, s_region, c_name);
+			}
+			OTF2_GlobalDefWriter_WriteRegion(d, id, s_region, s_region, s_empty,
+				OTF2_REGION_ROLE_FUNCTION, OTF2_PARADIGM_USER, OTF2_REGION_FLAG_NONE, s_empty, 0, 0);
+		}
+
+		OTF2_StringRef s_counter = n_str++;
+		OTF2_GlobalDefWriter_WriteString(d, s_counter, c_counter);
+		OTF2_StringRef s_unit = n_str++;
+		OTF2_GlobalDefWriter_WriteString(d, s_unit, c_unit);
+		OTF2_GlobalDefWriter_WriteMetricMember(d, 0, s_counter, s_counter,
+			OTF2_METRIC_TYPE_USER, OTF2_METRIC_ABSOLUTE_LAST, OTF2_TYPE_DOUBLE, OTF2_BASE_DECIMAL, 0, s_unit);
+		OTF2_MetricMemberRef member = 0;
+		OTF2_GlobalDefWriter_WriteMetricClass(d, 0, 1, &member, OTF2_METRIC_ASYNCHRONOUS, OTF2_RECORDER_KIND_ABSTRACT);
+
+		OTF2_Archive_CloseGlobalDefWriter(pm_trace.archive, d);
+	}
+	OTF2_Archive_Close(pm_trace.archive);
+	pm_trace.archive = NULL;
+
+	trace_free_chunks();
+
+	#ifdef DEBUG_PRINT_OTF
+	fprintf(stderr, "\t<pm_trace_finalize> my_rank=%d, events of thread 0=%lu, stalls=%ld \n",
+		pm_trace.my_rank, (unsigned long)n_events[0], pm_trace.n_stalls);
+	#endif
+  }
+
+} /* namespace pm_lib */
+
+#endif // USE_OTF2
@@ -33,6 +33,7 @@
 #endif
 
 #include "PerfWatch.h"
+#include "pmlib_pmpi.h"
 
 extern void sortPapiCounterList ();
 extern void outputPapiCounterHeader (FILE*, std::string);
@@ -44,10 +45,22 @@ namespace pm_lib {
 
   struct pmlib_papi_chooser papi;
   struct hwpc_group_chooser hwpc_group;
-  double cpu_clock_freq;        /// processor clock frequency, i.e. Hz
-  double second_per_cycle;  /// real time to take each cycle
+  struct pmlib_timer_chooser pm_timer;	/// timer source of getTime()
   struct pmlib_power_chooser power;
 
+
+  /// PMLIB_OVERHEAD=SUBTRACT の場合、start/stopの組の区間内に入るコストを差し引く
+  ///
+  ///   @param[in] dt          stop() - start() の時間
+  ///   @param[in] in_parallel 並列領域内の区間かどうか
+  ///
+  static inline double overhead_corrected(double dt, bool in_parallel)
+  {
+	if (!pm_timer.is_subtracted) return dt;
+	dt -= in_parallel ? pm_timer.bias_parallel : pm_timer.bias_serial;
+	return (dt > 0.0) ? dt : 0.0;
+  }
+
   ///
   /// 単位変換.
   ///
@@ -150,7 +163,7 @@ namespace pm_lib {
   ///
   void PerfWatch::statsAverage()
   {
-	//	if (my_rank != 0) return;	// This was a bad idea. All ranks should compute the stats.
+	//	Called by rank 0 in gather_and_stats(). The results are broadcasted to all ranks.
 
 	// 平均値
 	m_time_av = 0.0;
@@ -248,8 +261,8 @@ namespace pm_lib {
 
 
 
-  /// Allgather the process level HWPC event values for all processes in MPI_COMM_WORLD
   /// Calibrate some numbers to represent the process value as the sum of thread values
+  /// The values of all processes are gathered by PerfMonitor::gather_and_stats()
   ///
   ///
   void PerfWatch::gatherHWPC()
@@ -265,6 +278,9 @@ namespace pm_lib {
 	fprintf(stderr, "debug <gatherHWPC> [%s] starts. my_rank=%d \n", m_label.c_str(), my_rank );
 	#endif
 
+	// the rotated groups are counted in different intervals. the self HWPC is not defined.
+	if (has_nested() && !m_rotated) sortSelfHWPC ();
+
 	sortPapiCounterList ();
 
 	double perf_rate=0.0;
@@ -316,47 +332,8 @@ namespace pm_lib {
 		m_percentage = my_papi.v_sorted[my_papi.num_sorted-1] ;	// [Vector %]
 	}
 
-	// The space is reserved only once as a fixed size array
-	if ( m_sortedArrayHWPC == NULL) {
-		m_sortedArrayHWPC = new double[num_process*my_papi.num_sorted];
-		if (!(m_sortedArrayHWPC)) {
-			printError("gatherHWPC", "new memory failed. %d x %d x 8\n", num_process, my_papi.num_sorted);
-			PM_Exit(0);
-		}
-		#ifdef DEBUG_PRINT_WATCH
-		fprintf(stderr, "debug <gatherHWPC> allocated [%s] array at %p,  size=%d Bytes for my_rank=%d \n",
-			m_label.c_str(), m_sortedArrayHWPC, 8*num_process*my_papi.num_sorted, my_rank );
-		#endif
-	} else {
-		#ifdef DEBUG_PRINT_WATCH
-		fprintf(stderr, "debug <gatherHWPC> [%s] already exists. my_rank=%d \n",
-			m_label.c_str(), my_rank );
-		#endif
-	}
-
-	#ifdef DEBUG_PRINT_WATCH
-	if ( num_process > 1 ) {
-		fprintf(stderr, "debug <gatherHWPC> [%s] calling barrier \n", m_label.c_str() );
-		int iret = MPI_Barrier(MPI_COMM_WORLD);
-		if ( iret != 0 ) { printError("gatherHWPC", " MPI_Barrier failed. iret=%d\n", iret); }
-	}
-	fprintf(stderr, "debug <gatherHWPC> [%s] calling MPI_Allgather \n", m_label.c_str() );
-	#endif
-
-	if ( num_process > 1 ) {
-		int iret =
-		MPI_Allgather (my_papi.v_sorted, my_papi.num_sorted, MPI_DOUBLE,
-					m_sortedArrayHWPC, my_papi.num_sorted, MPI_DOUBLE, MPI_COMM_WORLD);
-		if ( iret != 0 ) {
-			printError("gatherHWPC", " MPI_Allather failed.\n");
-			PM_Exit(0);
-		}
-	} else {
-
-        for (int i = 0; i < my_papi.num_sorted; i++) {
-			m_sortedArrayHWPC[i] = my_papi.v_sorted[i];
-		}
-	}
+	//	The process values my_papi.v_sorted[] are gathered to rank 0 together with
+	//	all the other sections by PerfMonitor::gather_and_stats()
 	#ifdef DEBUG_PRINT_WATCH
 	fprintf(stderr, "debug <gatherHWPC> [%s] ends. my_rank=%d \n",
 			m_label.c_str(), my_rank );
@@ -462,6 +439,249 @@ namespace pm_lib {
 
 
 
+  ///	HWPC sorted values of the section excluding the nested sections
+  ///
+  ///	@note the process level HWPC counts and time of the direct children are
+  ///		subtracted, and sortPapiCounterList() is applied to the remainder.
+  ///		The results are saved in m_sortedSelfHWPC[]. The section values are restored.
+  ///
+  void PerfWatch::sortSelfHWPC()
+  {
+#ifdef USE_PAPI
+	int is_unit = statsSwitch();
+	if ( (is_unit < 2) || (my_papi.num_events == 0) ) return;
+
+	long long save_accumu[Max_group_events];
+	double save_time = m_time;
+	for (int i=0; i<my_papi.num_events; i++) {
+		save_accumu[i] = my_papi.accumu[i];
+		my_papi.accumu[i] = std::max(my_papi.accumu[i] - m_hwpc_child[i], 0LL);
+	}
+	m_time = std::max(m_time - m_time_child, 0.0);
+
+	sortPapiCounterList ();
+	for (int n=0; n<my_papi.num_sorted; n++) {
+		m_sortedSelfHWPC[n] = my_papi.v_sorted[n];
+	}
+	// the same process level calibration as gatherHWPC() does
+	if ( (is_unit == 3) && (m_time > 0.0) ) {
+		m_sortedSelfHWPC[my_papi.num_sorted-1] = m_sortedSelfHWPC[my_papi.num_sorted-3] / m_time
+			/ (hwpc_group.corePERF*num_threads) * 100.0;
+	} else if ( is_unit == 6 ) {
+		m_sortedSelfHWPC[0] = m_sortedSelfHWPC[0] / num_threads;
+	}
+
+	for (int i=0; i<my_papi.num_events; i++) {
+		my_papi.accumu[i] = save_accumu[i];
+	}
+	m_time = save_time;
+#endif
+  }
+
+
+  ///	pack the process level exclusive time and HWPC values for PerfMonitor::reduce_self_stats()
+  ///
+  void PerfWatch::selfPack(double* p, int n_hwpc)
+  {
+	p[0] = std::max(m_time - m_time_child, 0.0);
+	int n_sorted = gatherPackSize() - 3;
+	for (int n = 0; n < n_hwpc; n++) {
+		double v = 0.0;
+		if (n < n_sorted) v = has_nested() ? m_sortedSelfHWPC[n] : my_papi.v_sorted[n];
+		p[1+n] = fabs(v);
+	}
+  }
+
+
+  ///	unpack the sum of all processes and set the averages. This routine is called by rank 0 only.
+  ///
+  void PerfWatch::selfUnpack(const double* p, int n_hwpc)
+  {
+	m_time_self_av = p[0] / (double)num_process;
+	for (int n = 0; n < n_hwpc && n < Max_group_events; n++) {
+		m_sortedSelfHWPC[n] = p[1+n] / (double)num_process;
+	}
+  }
+
+
+  ///	the HWPC values excluding the nested sections are defined
+  ///
+  ///	@note a serial section counts all the threads, but the parallel nested sections
+  ///		report the master thread only, unless the serial sections count the master thread.
+  ///		the rotated groups are counted in different intervals.
+  ///
+  bool PerfWatch::has_self_HWPC() const
+  {
+	return has_nested() && !m_in_parallel && !m_rotated
+		&& !(m_child_in_parallel && !hwpc_group.serial_master_only);
+  }
+
+
+  ///	the process average of the flop (or byte) count and the percentage excluding the nested sections
+  ///
+  ///	@note the counts are picked from m_sortedSelfHWPC[] as gatherHWPC() picks them from v_sorted[].
+  ///		The count given by the user to stop() is the work of the section itself, and is kept.
+  ///
+  bool PerfWatch::selfFlop(double& flop, double& percentage)
+  {
+	int is_unit = statsSwitch();
+	flop = 0.0;
+	percentage = 0.0;
+	if ( (is_unit == 0) || (is_unit == 1) ) {
+		flop = m_flop_av;
+		return true;
+	}
+#ifdef USE_PAPI
+	if (!has_self_HWPC()) return false;
+	const double* v = m_sortedSelfHWPC;
+	int n = my_papi.num_sorted;
+	if ( is_unit == 2 ) {
+		flop = v[n-1];				// BYTES
+	} else
+	if ( (is_unit == 3) || (is_unit == 4) ) {
+		flop = v[n-3];				// Total_FP
+	} else
+	if ( (is_unit == 5) || (is_unit == 7) ) {
+		flop = v[0] + v[1];			// load+store
+		if (hwpc_group.i_platform == 11 ) flop += v[2];
+	} else
+	if ( is_unit == 6 ) {
+		flop = v[1];				// TOT_INS
+	}
+	if ( (is_unit == 4) || (is_unit == 5) || (is_unit == 7) ) {
+		percentage = v[n-1];
+	}
+	return true;
+#else
+	return false;
+#endif
+  }
+
+
+  ///	number of the values packed by gatherPack()
+  ///
+  int PerfWatch::gatherPackSize()
+  {
+	int n_pack = 3;
+#ifdef USE_PAPI
+	int is_unit = statsSwitch();
+	if ( (is_unit >= 2) && (my_papi.num_events > 0) ) n_pack += my_papi.num_sorted;
+#endif
+	return n_pack;
+  }
+
+
+  ///	pack the process level m_time, m_flop, m_count and the HWPC sorted values
+  ///
+  void PerfWatch::gatherPack(double* p)
+  {
+	int n_pack = gatherPackSize();
+	p[0] = m_time;
+	p[1] = m_flop;
+	p[2] = (double)m_count;
+	for (int i = 3; i < n_pack; i++) {
+		p[i] = my_papi.v_sorted[i-3];
+	}
+  }
+
+
+  ///	unpack the values of all processes gathered by PerfMonitor::gather_and_stats()
+  ///	This routine is called by rank 0 only.
+  ///
+  void PerfWatch::gatherUnpack(const double* p_all, int stride, int offset)
+  {
+	int m_np = num_process;
+	int n_hwpc = gatherPackSize() - 3;
+
+	// The space should be reserved only once as fixed size arrays
+	if ( m_timeArray == NULL ) {
+		m_timeArray  = new double[m_np];
+		m_flopArray  = new double[m_np];
+		m_countArray  = new long[m_np];
+	}
+	if ( (n_hwpc > 0) && (m_sortedArrayHWPC == NULL) ) {
+		m_sortedArrayHWPC = new double[m_np*n_hwpc];
+	}
+
+	m_gathered = true;
+	m_count_sum = 0;
+	for (int i = 0; i < m_np; i++) {
+		const double* p = p_all + (size_t)i*stride + offset;
+		m_timeArray[i]  = p[0];
+		m_flopArray[i]  = p[1];
+		m_countArray[i] = lround(p[2]);
+		m_count_sum += m_countArray[i];
+		for (int n = 0; n < n_hwpc; n++) {
+			m_sortedArrayHWPC[i*n_hwpc + n] = p[3+n];
+		}
+	}
+  }
+
+
+  ///	pack/unpack the statistics computed by rank 0, so that all ranks share the same values
+  ///
+  void PerfWatch::statsPack(double* p)
+  {
+	p[0] = (double)m_count_sum;
+	p[1] = (double)m_count_av;
+	p[2] = m_time_av;
+	p[3] = m_time_sd;
+	p[4] = m_flop_av;
+	p[5] = m_flop_sd;
+	p[6] = m_time_comm;
+  }
+
+  void PerfWatch::statsUnpack(const double* p)
+  {
+	m_count_sum = lround(p[0]);
+	m_count_av  = lround(p[1]);
+	m_time_av   = p[2];
+	m_time_sd   = p[3];
+	m_flop_av   = p[4];
+	m_flop_sd   = p[5];
+	m_time_comm = p[6];
+  }
+
+
+  ///	pack the record of the process values for the Welford reduction
+  ///
+  void PerfWatch::reducePack(double* p, int n_hwpc)
+  {
+	p[0] = 1.0;					// number of processes
+	p[1] = m_time;				// time mean
+	p[2] = 0.0;					// time M2, the sum of squared deviations
+	p[3] = m_time;				// time max
+	p[4] = m_time;				// time min
+	p[5] = m_flop;				// flop mean
+	p[6] = 0.0;					// flop M2
+	p[7] = (double)m_count;		// count sum
+	int n_sorted = gatherPackSize() - 3;
+	for (int n = 0; n < n_hwpc; n++) {
+		p[Pm_reduce_base_size+n] = (n < n_sorted) ? fabs(my_papi.v_sorted[n]) : 0.0;
+	}
+  }
+
+
+  ///	unpack the reduced record and set the statistics. This routine is called by rank 0 only.
+  ///	The per process arrays are not available after this call.
+  ///
+  void PerfWatch::reduceUnpack(const double* p, int n_hwpc)
+  {
+	double n = p[0];
+	m_gathered = false;
+	m_time_av = p[1];
+	m_flop_av = p[5];
+	m_time_sd = (n > 1.0) ? sqrt(p[2] / (n - 1.0)) : 0.0;
+	m_flop_sd = (n > 1.0) ? sqrt(p[6] / (n - 1.0)) : 0.0;
+	m_count_sum = lround(p[7]);
+	m_count_av = lround(p[7] / n);
+	m_time_comm = (m_typeCalc == 0) ? p[3] : 0.0;
+	for (int i = 0; i < n_hwpc && i < Max_group_events; i++) {
+		m_sortedAverageHWPC[i] = p[Pm_reduce_base_size+i] / n;
+	}
+  }
+
+
   ///	Allgather the process level basic statistics, i.e. m_time, m_flop, m_count
   ///	
   void PerfWatch::gather()
@@ -501,10 +721,21 @@ namespace pm_lib {
       m_countArray[0]= m_count;
       m_count_sum = m_count;
     } else {
-      if (MPI_Allgather(&m_time,  1, MPI_DOUBLE, m_timeArray, 1, MPI_DOUBLE, MPI_COMM_WORLD) != MPI_SUCCESS) PM_Exit(0);
-      if (MPI_Allgather(&m_flop,  1, MPI_DOUBLE, m_flopArray, 1, MPI_DOUBLE, MPI_COMM_WORLD) != MPI_SUCCESS) PM_Exit(0);
-      if (MPI_Allgather(&m_count, 1, MPI_LONG, m_countArray, 1, MPI_LONG, MPI_COMM_WORLD) != MPI_SUCCESS) PM_Exit(0);
-      if (MPI_Allreduce(&m_count, &m_count_sum, 1, MPI_LONG, MPI_SUM, MPI_COMM_WORLD) != MPI_SUCCESS) PM_Exit(0);
+      //	one packed collective instead of three Allgather and one Allreduce
+      double v_send[3];
+      double* v_recv = new double[3*m_np];
+      v_send[0] = m_time;
+      v_send[1] = m_flop;
+      v_send[2] = (double)m_count;
+      if (MPI_Allgather(v_send, 3, MPI_DOUBLE, v_recv, 3, MPI_DOUBLE, MPI_COMM_WORLD) != MPI_SUCCESS) PM_Exit(0);
+      m_count_sum = 0;
+      for (int i = 0; i < m_np; i++) {
+        m_timeArray[i]  = v_recv[3*i];
+        m_flopArray[i]  = v_recv[3*i+1];
+        m_countArray[i] = lround(v_recv[3*i+2]);
+        m_count_sum += m_countArray[i];
+      }
+      delete [] v_recv;
     }
 	// Above arrays will be used by the subsequent routines, and should not be deleted here
 	// i.e. m_timeArray, m_flopArray, m_countArray
@@ -558,6 +789,7 @@ namespace pm_lib {
 	// In the following steps, "papi" shared structureis used as a scratch space.
 	// First, copy the master thread local "my_papi" to shared "papi"
 	if ( is_unit >= 2) { // PMlib HWPC counter mode
+		extrapolateSampledHWPC();
 		for (int j=0; j<num_threads; j++) {
 			for (int i=0; i<my_papi.num_events; i++) {
 				papi.th_accumu[j][i] = my_papi.th_accumu[j][i];
@@ -619,6 +851,7 @@ namespace pm_lib {
     int is_unit = statsSwitch();
 
 	if ( is_unit >= 2) { // PMlib HWPC counter mode
+		extrapolateSampledHWPC();
 		for (int i=0; i<my_papi.num_events; i++) {
 			papi.th_accumu[my_thread][i] = my_papi.th_accumu[my_thread][i];
 			papi.th_v_sorted[my_thread][i] = my_papi.th_v_sorted[my_thread][i];
@@ -897,6 +1130,23 @@ namespace pm_lib {
 
 	if (!m_is_set) {
 		my_papi = papi;
+		allocateThreadArrays(my_papi, num_threads);
+		// HWPC_CHOOSER=ROTATE accumulates the groups in th_sampled[][] as the sampling mode does
+		m_rotated = (hwpc_group.n_rotate > 0) && (my_papi.num_events > 0);
+		if (m_rotated && !allocateSampledArray()) m_rotated = false;
+		for (int k=0; k<Max_hwpc_output_group; k++) {
+			m_rot_time[k] = 0.0;
+			m_rot_calls[k] = 0;
+			m_rot_mean[k] = 0.0;
+			m_rot_m2[k] = 0.0;
+			m_rot_error[k] = 0.0;
+		}
+		setSampleInterval(hwpc_group.sample_interval);
+		for (int i=0; i<Max_group_events; i++) {
+			m_hwpc_child[i] = 0;
+			m_sortedSelfHWPC[i] = 0.0;
+		}
+		m_child_in_parallel = false;
 #ifdef USE_POWER
 		my_power = power;
 		level_POWER = power.level_report;
@@ -919,7 +1169,7 @@ namespace pm_lib {
 
 
     level_OTF = 0;
-#ifdef USE_OTF
+#if defined(USE_OTF) || defined(USE_OTF2)
 	// 環境変数OTF_TRACING が指定された場合
 	// OTF_TRACING = none(default) | yes | on | full
     std::string s;
@@ -1040,7 +1290,7 @@ namespace pm_lib {
   ///
   void PerfWatch::initializeOTF(void)
   {
-#ifdef USE_OTF
+#if defined(USE_OTF) || defined(USE_OTF2)
     if (level_OTF == 0) return;
 
 	// 環境変数 OTF_FILENAME が指定された場合
@@ -1053,7 +1303,12 @@ namespace pm_lib {
       otf_filename = "pmlib_otf_files";
     }
     double baseT = PerfWatch::getTime();
+  #ifdef USE_OTF
     my_otf_initialize(num_process, my_rank, otf_filename.c_str(), baseT);
+  #endif
+  #ifdef USE_OTF2
+    pm_trace_initialize(num_process, my_rank, num_threads, otf_filename.c_str(), baseT);
+  #endif
 #endif
   }
 
@@ -1065,11 +1320,16 @@ namespace pm_lib {
   ///
   void PerfWatch::labelOTF(const std::string& label, int id)
   {
-#ifdef USE_OTF
+#if defined(USE_OTF) || defined(USE_OTF2)
     if (level_OTF == 0) return;
 
 	int i_switch = statsSwitch();
+  #ifdef USE_OTF
     my_otf_event_label(num_process, my_rank, id+1, label.c_str(), m_exclusive, i_switch);
+  #endif
+  #ifdef USE_OTF2
+    pm_trace_label(id, label.c_str());
+  #endif
 
     if (id != 0) {
       level_OTF = 0;
@@ -1088,7 +1348,7 @@ namespace pm_lib {
   ///
   void PerfWatch::finalizeOTF(void)
   {
-#ifdef USE_OTF
+#if defined(USE_OTF) || defined(USE_OTF2)
     if (level_OTF == 0) return;
 
     std::string s_group, s_counter, s_unit;
@@ -1111,9 +1371,14 @@ namespace pm_lib {
 	}
 
 	(void) MPI_Barrier(MPI_COMM_WORLD);
+  #ifdef USE_OTF
 	my_otf_finalize (num_process, my_rank, is_unit,
 		otf_filename.c_str(), s_group.c_str(),
 		s_counter.c_str(), s_unit.c_str());
+  #endif
+  #ifdef USE_OTF2
+	pm_trace_finalize (s_counter.c_str(), s_unit.c_str());
+  #endif
 
     level_OTF = 0;
 
@@ -1135,11 +1400,6 @@ namespace pm_lib {
 	fprintf (stderr, "<PerfWatch::start> [%s] my_thread=%d\n", m_label.c_str(), my_thread);
 #endif
 
-    if (!m_is_healthy) {
-		fprintf (stderr, "\n\t *** PMlib warning <PerfWatch::start> [%s] rank=%d my_thread=%d is marked un_healthy. \n", m_label.c_str(), my_rank, my_thread);
-		//	return;
-	}
-
     if (m_started) {
 		fprintf (stderr, "\n\t *** PMlib warning <PerfWatch::start> [%s] rank=%d my_thread=%d is already marked started. Duplicated start is ignored. \n", m_label.c_str(), my_rank, my_thread);
 		//	return;
@@ -1147,19 +1407,27 @@ namespace pm_lib {
 	if (!m_is_set) {
 		fprintf (stderr, "\n\t *** PMlib internal error. [%s] rank=%d my_thread=%d is marked m_is_set=FALSE. \n",
 			m_label.c_str(), my_rank, my_thread);
-		//	m_is_healthy=false;
 		//	return;
 	}
     m_started = true;
     m_startTime = getTime();
 	m_threads_merged = false;
 
-	if ( m_in_parallel ) {
+	// In the HWPC sampling mode, HWPC is read at every m_sample_interval-th call only.
+	m_sample_now = true;
+	if (m_sample_interval > 1) {
+		m_sample_now = (m_count % m_sample_interval == 0) || (statsSwitch() < 2);
+	}
+	if (!m_sample_now) {
+		;	// the time and the count are measured. HWPC is extrapolated at report.
+	} else if ( m_in_parallel ) {
 		// The threads are active and running in parallel region
 		startSectionParallel();
+		m_rot_mark = m_startTime;
 	} else {
 		// The thread is running in serial region
 		startSectionSerial();
+		m_rot_mark = m_startTime;
 	}
 
 #ifdef USE_OTF
@@ -1167,6 +1435,11 @@ namespace pm_lib {
       int is_unit = statsSwitch();
       my_otf_event_start(my_rank, m_startTime, m_id, is_unit);
 	}
+#endif
+#ifdef USE_OTF2
+    if (level_OTF != 0) {
+      pm_trace_event(Pm_trace_enter, m_startTime, m_id, 0.0);
+	}
 #endif
   }
 
@@ -1205,7 +1478,30 @@ namespace pm_lib {
 
 
 
+  /// read the accumulated energy of the power objects without changing the section
+  ///
+  ///   @param[out] w_joule  energy (J) of my_power.num_power_stats parts
+  ///
+  ///	@note called by the PMLIB_POWER_SAMPLE sampler thread instead of power_start()
+  ///		and power_stop() of each section
+  ///
+  void PerfWatch::power_sample(PWR_Cntxt pacntxt, PWR_Cntxt extcntxt, PWR_Obj obj_array[], PWR_Obj obj_ext[], double w_joule[])
+  {
+#ifdef USE_POWER
+	if ((level_POWER == 0) || (my_power.num_power_stats == 0)) return;
+
+	uint64_t pa64timer[Max_power_stats];
+	(void) my_power_bind_start (pacntxt, extcntxt, obj_array, obj_ext,
+				pa64timer, w_joule);
+#endif
+  }
+
+
+
 ///	Save the data for start/stop pair which is called from serial region
+///
+///	@note HWPC of all the threads are read in a new parallel region, unless
+///		PMLIB_SERIAL_HWPC=MASTER is set or the process has only one thread.
 ///
   void PerfWatch::startSectionSerial()
   {
@@ -1217,26 +1513,37 @@ namespace pm_lib {
     int is_unit = statsSwitch();
 	if ( is_unit >= 2) {
 #ifdef USE_PAPI
+	//	HWPC_CHOOSER=ROTATE reads the events of the current group only
+	int i0 = hwpc_group.read_index;
+	int n_read = hwpc_group.read_number;
+	if (hwpc_group.serial_master_only || (num_threads == 1)) {
+		//	Only the master thread reads its own counters. No thread team is forked.
+		int i_ret = my_papi_bind_read (my_papi.th_values[0] + i0, n_read);
+		if ( i_ret != PAPI_OK ) {
+			fprintf(stderr, "*** error. <my_papi_bind_read> code: %d, thread:0\n", i_ret);
+		}
+	} else {
 	#pragma omp parallel
 	{
 		//	parallel regionの全スレッドの処理
 		int i_thread = omp_get_thread_num();
-		struct pmlib_papi_chooser th_papi = my_papi;
+		long long th_read[Max_chooser_events];	// thread private read buffer
 		int i_ret;
 
 		//	We call my_papi_bind_read() to preserve HWPC events for inclusive sections,
 		//	in stead of calling my_papi_bind_start() which clears out the event counters.
-		i_ret = my_papi_bind_read (th_papi.values, th_papi.num_events);
+		i_ret = my_papi_bind_read (th_read, n_read);
 		if ( i_ret != PAPI_OK ) {
 			fprintf(stderr, "*** error. <my_papi_bind_read> code: %d, thread:%d\n", i_ret, i_thread);
 			//	PM_Exit(0);
 		}
 
 		#pragma ivdep
-		for (int i=0; i<my_papi.num_events; i++) {
-			my_papi.th_values[i_thread][i] = th_papi.values[i];
+		for (int i=0; i<n_read; i++) {
+			my_papi.th_values[i_thread][i0+i] = th_read[i];
 		}
 	}	// end of #pragma omp parallel region
+	}
 
 	#ifdef DEBUG_PRINT_PAPI_THREADS
 		if (my_rank == 0) {
@@ -1269,12 +1576,14 @@ namespace pm_lib {
     int is_unit = statsSwitch();
 	if ( is_unit >= 2) {
 #ifdef USE_PAPI
-	struct pmlib_papi_chooser th_papi = my_papi;
+	long long th_read[Max_chooser_events];	// thread private read buffer
+	int i0 = hwpc_group.read_index;
+	int n_read = hwpc_group.read_number;
 	int i_ret;
 
 	//	we call my_papi_bind_read() to preserve HWPC events for inclusive sections in stead of
 	//	calling my_papi_bind_start() which clears out the event counters.
-	i_ret = my_papi_bind_read (th_papi.values, th_papi.num_events);
+	i_ret = my_papi_bind_read (th_read, n_read);
 	if ( i_ret != PAPI_OK ) {
 		fprintf(stderr, "*** error. <my_papi_bind_read> code: %d, my_thread:%d\n", i_ret, my_thread);
 		//	PM_Exit(0);
@@ -1282,8 +1591,8 @@ namespace pm_lib {
 
 	//	parallel regionの内側で呼ばれた場合は、my_threadはスレッドIDの値を持つ
 	#pragma ivdep
-	for (int i=0; i<my_papi.num_events; i++) {
-		my_papi.th_values[my_thread][i] = th_papi.values[i];
+	for (int i=0; i<n_read; i++) {
+		my_papi.th_values[my_thread][i0+i] = th_read[i];
 	}
 	#ifdef DEBUG_PRINT_PAPI_THREADS
 	//	#pragma omp critical
@@ -1315,30 +1624,29 @@ namespace pm_lib {
   ///
   void PerfWatch::stop(double flopPerTask, unsigned iterationCount)
   {
-    if (!m_is_healthy) {
-      printError("stop()",  "[%s] is marked Not healthy. Corrected. \n", m_label.c_str());
-		m_is_healthy=true;
-		//	return;
-	}
-
     if (!m_started) {
       printError("stop()",  "[%s]  has not been started. Corrected. \n", m_label.c_str());
       m_started=true;
-      //	m_is_healthy=false;
       //	return;
     }
 
     m_stopTime = getTime();
-    m_time += m_stopTime - m_startTime;
+    m_time += overhead_corrected(m_stopTime - m_startTime, m_in_parallel);
     m_count++;
     m_started = false;
 
-	if ( m_in_parallel ) {
+	if (!m_sample_now) {
+		;	// HWPC was not read at start(). see setSampleInterval()
+	} else if ( m_in_parallel ) {
 		// The threads are active and running in parallel region
 		stopSectionParallel(flopPerTask, iterationCount);
+		m_count_sampled++;
+		rotateAccount(m_stopTime);
 	} else {
 		// The thread is running in serial region
 		stopSectionSerial(flopPerTask, iterationCount);
+		m_count_sampled++;
+		rotateAccount(m_stopTime);
 	}
 		// Move the following lines to the end, since sortPapiCounterList() overwrites them.
 		//	my_papi.th_v_sorted[my_thread][0] = (double)m_count;
@@ -1350,7 +1658,7 @@ namespace pm_lib {
 			m_label.c_str(), my_thread, flopPerTask, iterationCount, m_count, m_time, m_flop);
 	fprintf (stderr, "\t\t m_startTime=%f, m_stopTime=%f\n", m_startTime, m_stopTime);
 	#endif
-#ifdef USE_OTF
+#if defined(USE_OTF) || defined(USE_OTF2)
     int is_unit = statsSwitch();
 	double w=0.0;
 	if (level_OTF == 0) {
@@ -1359,7 +1667,12 @@ namespace pm_lib {
 	} else if (level_OTF == 1) {
 		// OTFファイルには時間情報だけを出力し、カウンター値は0.0とする
 		w = 0.0;
+	  #ifdef USE_OTF
 		my_otf_event_stop(my_rank, m_stopTime, m_id, is_unit, w);
+	  #endif
+	  #ifdef USE_OTF2
+		pm_trace_event(Pm_trace_leave, m_stopTime, m_id, w);
+	  #endif
 
 	} else if (level_OTF == 2) {
 		if ( (is_unit == 0) || (is_unit == 1) ) {
@@ -1373,7 +1686,12 @@ namespace pm_lib {
 			// is_unitが4,5の時は...
 			w = my_papi.v_sorted[my_papi.num_sorted-1] ;
 		}
+	  #ifdef USE_OTF
 		my_otf_event_stop(my_rank, m_stopTime, m_id, is_unit, w);
+	  #endif
+	  #ifdef USE_OTF2
+		pm_trace_event(Pm_trace_leave_metric, m_stopTime, m_id, w);
+	  #endif
 	}
 	#ifdef DEBUG_PRINT_OTF
     if (my_rank == 0) {
@@ -1449,22 +1767,43 @@ namespace pm_lib {
 	if ( is_unit >= 2) {
 #ifdef USE_PAPI
 	if (my_papi.num_events > 0) {
+	// the sampled calls are accumulated separately and extrapolated by extrapolateSampledHWPC()
+	pmlib_thread_array<long long> th_acc = is_scaled() ? my_papi.th_sampled : my_papi.th_accumu;
+	int i0 = hwpc_group.read_index;
+	int n_read = hwpc_group.read_number;
+	if (hwpc_group.serial_master_only || (num_threads == 1)) {
+		//	Only the master thread reads its own counters. See startSectionSerial()
+		long long th_read[Max_chooser_events];
+		int i_ret = my_papi_bind_read (th_read, n_read);
+		if ( i_ret != PAPI_OK ) {
+			printError("stop",  "<my_papi_bind_read> code: %d, i_thread:0\n", i_ret);
+		}
+		#pragma ivdep
+		for (int i=0; i<n_read; i++) {
+			long long d = th_read[i] - my_papi.th_values[0][i0+i];
+			th_acc[0][i0+i] += d;
+			my_papi.th_values[0][i0+i] = d;	// kept for lastDelta()
+		}
+	} else {
 	#pragma omp parallel 
 	{
 		int i_thread = omp_get_thread_num();
-		struct pmlib_papi_chooser th_papi = my_papi;
+		long long th_read[Max_chooser_events];	// thread private read buffer
 		int i_ret;
 
-		i_ret = my_papi_bind_read (th_papi.values, th_papi.num_events);
+		i_ret = my_papi_bind_read (th_read, n_read);
 		if ( i_ret != PAPI_OK ) {
 			printError("stop",  "<my_papi_bind_read> code: %d, i_thread:%d\n", i_ret, i_thread);
 		}
 
 		#pragma ivdep
-		for (int i=0; i<my_papi.num_events; i++) {
-			my_papi.th_accumu[i_thread][i] += (th_papi.values[i] - my_papi.th_values[i_thread][i]);
+		for (int i=0; i<n_read; i++) {
+			long long d = th_read[i] - my_papi.th_values[i_thread][i0+i];
+			th_acc[i_thread][i0+i] += d;
+			my_papi.th_values[i_thread][i0+i] = d;	// kept for lastDelta()
 		}
 	}	// end of #pragma omp parallel region
+	}
 
 		#ifdef DEBUG_PRINT_PAPI_THREADS
 		if (my_rank == 0) {
@@ -1512,17 +1851,22 @@ namespace pm_lib {
 	if ( is_unit >= 2) {
 #ifdef USE_PAPI
 	if (my_papi.num_events > 0) {
-	struct pmlib_papi_chooser th_papi = my_papi;
+	long long th_read[Max_chooser_events];	// thread private read buffer
+	int i0 = hwpc_group.read_index;
+	int n_read = hwpc_group.read_number;
 	int i_ret;
 
-	i_ret = my_papi_bind_read (th_papi.values, th_papi.num_events);
+	i_ret = my_papi_bind_read (th_read, n_read);
 	if ( i_ret != PAPI_OK ) {
 		printError("stop",  "<my_papi_bind_read> code: %d, my_thread:%d\n", i_ret, my_thread);
 	}
 
+	long long* th_acc = is_scaled() ? my_papi.th_sampled[my_thread] : my_papi.th_accumu[my_thread];
 	#pragma ivdep
-	for (int i=0; i<my_papi.num_events; i++) {
-		my_papi.th_accumu[my_thread][i] += (th_papi.values[i] - my_papi.th_values[my_thread][i]);
+	for (int i=0; i<n_read; i++) {
+		long long d = th_read[i] - my_papi.th_values[my_thread][i0+i];
+		th_acc[i0+i] += d;
+		my_papi.th_values[my_thread][i0+i] = d;	// kept for lastDelta()
 	}
 
 	#ifdef DEBUG_PRINT_PAPI_THREADS
@@ -1559,6 +1903,19 @@ namespace pm_lib {
     m_time = 0.0;
     m_count = 0;
 	m_flop = 0.0;
+	m_count_sampled = 0;
+	m_time_child = 0.0;
+	for (int i=0; i<Max_group_events; i++) {
+		m_hwpc_child[i] = 0;
+	}
+	m_child_in_parallel = false;
+	for (int k=0; k<Max_hwpc_output_group; k++) {
+		m_rot_time[k] = 0.0;
+		m_rot_calls[k] = 0;
+		m_rot_mean[k] = 0.0;
+		m_rot_m2[k] = 0.0;
+		m_rot_error[k] = 0.0;
+	}
 
 #ifdef USE_PAPI
 	if (my_papi.num_events > 0) {
@@ -1574,6 +1931,7 @@ namespace pm_lib {
 			for (int i=0; i<my_papi.num_events; i++) {
 				my_papi.th_accumu[j][i] = 0.0 ;
 				my_papi.th_v_sorted[j][i] = 0.0 ;
+				if (my_papi.th_sampled.data != NULL) my_papi.th_sampled[j][i] = 0;
 			}
 			}
 	#endif
@@ -1582,6 +1940,209 @@ namespace pm_lib {
   }
 
 
+  /// HWPCのサンプリング間隔を設定する
+  ///
+  ///   @param[in] interval  HWPCを読み取る呼び出し間隔. 1以下は毎回読み取る
+  ///
+  ///   @note  サンプリング中のHWPC測定値は my_papi.th_sampled[][] に積算され、
+  ///          extrapolateSampledHWPC() が my_papi.th_accumu[][] に外挿する。
+  ///          HWPC_CHOOSER=ROTATE では計測時間の比で外挿するので、間隔だけを変更する。
+  ///
+  void PerfWatch::setSampleInterval(int interval)
+  {
+	if (interval < 1) interval = 1;
+	if (interval == m_sample_interval) return;
+	if (m_started) {
+		printError("setSampleInterval",  "[%s] is active. the interval is not changed.\n", m_label.c_str());
+		return;
+	}
+	if (m_rotated) {
+		m_sample_interval = interval;
+		return;
+	}
+
+	// fix the extrapolated values of the previous interval
+	if (m_sample_interval > 1) extrapolateSampledHWPC();
+
+	if ((interval > 1) && (my_papi.num_events > 0)) {
+		if (!allocateSampledArray()) return;
+		pmlib_thread_array<long long>& p = my_papi.th_sampled;
+		// the calls measured so far count as the sampled calls
+		for (int j=0; j<my_papi.th_nthreads; j++) {
+		for (int i=0; i<p.stride; i++) {
+			p[j][i] = my_papi.th_accumu[j][i];
+		}
+		}
+		m_count_sampled = m_count;
+	}
+	m_sample_interval = interval;
+  }
+
+
+  /// サンプリングしたHWPC測定値を積算する my_papi.th_sampled[][] を確保する
+  ///
+  ///   @return 確保できた場合 true
+  ///
+  bool PerfWatch::allocateSampledArray(void)
+  {
+	pmlib_thread_array<long long>& p = my_papi.th_sampled;
+	if (p.data != NULL) return true;
+
+	void* block = NULL;
+	size_t n_bytes = (size_t)my_papi.th_nthreads * my_papi.th_accumu.stride * sizeof(long long);
+	if (posix_memalign(&block, 64, n_bytes) != 0) {
+		printError("allocateSampledArray",  "memory allocation failed. %d threads\n", my_papi.th_nthreads);
+		return false;
+	}
+	p.data = static_cast<long long*>(block);
+	p.stride = my_papi.th_accumu.stride;
+	for (int j=0; j<my_papi.th_nthreads; j++) {
+	for (int i=0; i<p.stride; i++) {
+		p[j][i] = 0;
+	}
+	}
+	return true;
+  }
+
+
+  /// サンプリングしたHWPC測定値を全測定回数に外挿して th_accumu[][] に格納する
+  ///
+  ///	@note th_sampled[][] is left as is, so that this routine can be called
+  ///		at every report. The rows updated by this instance are processed.
+  ///		HWPC_CHOOSER=ROTATE extrapolates each group by the ratio of the section
+  ///		time to the time measured with the group, and estimates the relative
+  ///		error of the extrapolation from the variance of the measured count rate.
+  ///
+  void PerfWatch::extrapolateSampledHWPC(void)
+  {
+	if (!is_scaled()) return;
+	if (my_papi.th_sampled.data == NULL) return;
+
+	int j_begin = m_in_parallel ? my_thread : 0;
+	int j_end = m_in_parallel ? my_thread+1 : num_threads;
+
+	if (m_rotated) {
+		for (int k=0; k<hwpc_group.n_rotate; k++) {
+			int i_begin = hwpc_group.rotate_index[k];
+			int i_end = i_begin + hwpc_group.rotate_number[k];
+			double ratio = (m_rot_time[k] > 0.0) ? m_time / m_rot_time[k] : 0.0;
+			for (int j=j_begin; j<j_end; j++) {
+			for (int i=i_begin; i<i_end; i++) {
+				my_papi.th_accumu[j][i] = llround((double)my_papi.th_sampled[j][i] * ratio);
+			}
+			}
+
+			//	sampling without replacement of the count rate. f is the measured fraction.
+			double f = (m_time > 0.0) ? m_rot_time[k] / m_time : 1.0;
+			long n = m_rot_calls[k];
+			if (f >= 1.0) {
+				m_rot_error[k] = 0.0;
+			} else if (n <= 1) {
+				m_rot_error[k] = 100.0;
+			} else if (m_rot_mean[k] > 0.0) {
+				double cv = sqrt(m_rot_m2[k] / (double)(n-1)) / m_rot_mean[k];
+				m_rot_error[k] = 100.0 * cv * sqrt((1.0 - f) / (double)n);
+			} else {
+				m_rot_error[k] = 0.0;
+			}
+		}
+		return;
+	}
+
+	if (m_count_sampled <= 0) return;
+	double ratio = (double)m_count / (double)m_count_sampled;
+	for (int j=j_begin; j<j_end; j++) {
+	for (int i=0; i<my_papi.num_events; i++) {
+		my_papi.th_accumu[j][i] = llround((double)my_papi.th_sampled[j][i] * ratio);
+	}
+	}
+  }
+
+
+  /// 直前のstart/stopの組で測定した時間とHWPCイベント数
+  ///
+  ///	@note the HWPC deltas are left in th_values[][] by stopSection*().
+  ///		The calls skipped by the sampling mode report no HWPC delta, and the
+  ///		sampled calls are scaled by the sampling interval.
+  ///		HWPC_CHOOSER=ROTATE reads one group at a time, and reports no HWPC delta.
+  ///
+  void PerfWatch::lastDelta(double& t, long long* hwpc)
+  {
+	int n_events = num_child_events();
+	t = overhead_corrected(m_stopTime - m_startTime, m_in_parallel);
+	for (int i=0; i<n_events; i++) {
+		hwpc[i] = 0;
+	}
+#ifdef USE_PAPI
+	if (!m_sample_now) return;
+	if ( (statsSwitch() < 2) || (n_events == 0) ) return;
+
+	int j_begin = 0;
+	int j_end = num_threads;
+	if (m_in_parallel) {
+		j_begin = my_thread;
+		j_end = my_thread+1;
+	} else if (hwpc_group.serial_master_only) {
+		j_end = 1;
+	}
+	long long scale = (m_sample_interval > 1) ? m_sample_interval : 1;
+	for (int j=j_begin; j<j_end; j++) {
+	for (int i=0; i<n_events; i++) {
+		hwpc[i] += my_papi.th_values[j][i] * scale;
+	}
+	}
+#endif
+  }
+
+
+  /// HWPC_CHOOSER=ROTATE で現在のグループを計測した時間と計数率を積算する
+  ///
+  ///   @param[in] t_end  計測を終えた時刻
+  ///
+  ///	@note the deltas of the current group are left in th_values[][] by stopSection*().
+  ///		The count rate of the first event of the group is accumulated with the
+  ///		Welford update for the error estimate of extrapolateSampledHWPC().
+  ///
+  void PerfWatch::rotateAccount(double t_end)
+  {
+	if (!m_rotated) return;
+	int k = hwpc_group.i_rotate;
+	double t = t_end - m_rot_mark;
+	if (t <= 0.0) return;
+
+	int j_begin = 0;
+	int j_end = num_threads;
+	if (m_in_parallel) {
+		j_begin = my_thread;
+		j_end = my_thread+1;
+	} else if (hwpc_group.serial_master_only) {
+		j_end = 1;
+	}
+	long long c = 0;
+	for (int j=j_begin; j<j_end; j++) {
+		c += my_papi.th_values[j][hwpc_group.read_index];
+	}
+
+	m_rot_time[k] += t;
+	m_rot_calls[k]++;
+	double x = (double)c / t;
+	double d = x - m_rot_mean[k];
+	m_rot_mean[k] += d / (double)m_rot_calls[k];
+	m_rot_m2[k] += d * (x - m_rot_mean[k]);
+  }
+
+
+  /// 入れ子区間の測定値を加算する
+  ///
+  void PerfWatch::addChildDelta(double t, const long long* hwpc)
+  {
+	m_time_child += t;
+	for (int i=0; i<num_child_events(); i++) {
+		m_hwpc_child[i] += hwpc[i];
+	}
+  }
+
+
 
   /// MPIランク別測定結果を出力.
   ///
@@ -1767,7 +2328,13 @@ namespace pm_lib {
 	fprintf(fp, "\n# PMlib hardware performance counter (HWPC) report of the averaged process ------- #\n");
 	fprintf(fp, "\n");
 
+	if (hwpc_group.n_rotate > 0) {
+		int k = hwpc_group.i_report;
+		fprintf(fp, "\tReport for option HWPC_CHOOSER=%s, group %s (%d of %d) is generated.\n\n",
+			hwpc_group.env_str_hwpc.c_str(), hwpc_group.rotate_name[k].c_str(), k+1, hwpc_group.n_rotate);
+	} else {
 	fprintf(fp, "\tReport for option HWPC_CHOOSER=%s is generated.\n\n", hwpc_group.env_str_hwpc.c_str());
+	}
 
 	// header line showing event names
 	fprintf(fp, "Section"); for (int i=7; i< maxLabelLen; i++) { fputc(' ', fp); } fputc('|', fp);
@@ -1780,10 +2347,15 @@ namespace pm_lib {
         }
         fprintf (fp, " %10.10s", s.c_str() );
     }
+	int n_column = my_papi.num_sorted;
+	if (hwpc_group.n_rotate > 0) {
+		fprintf (fp, " %10.10s", "err[%]" );
+		n_column++;
+	}
 	fprintf (fp, "\n");
 
 	for (int i=0; i< maxLabelLen; i++) { fputc('-', fp); }  fputc('+', fp);
-	for (int i=0; i<(my_papi.num_sorted*11); i++) { fputc('-', fp); } fprintf(fp, "\n");
+	for (int i=0; i<(n_column*11); i++) { fputc('-', fp); } fprintf(fp, "\n");
 
 #endif
   }
@@ -1817,14 +2389,23 @@ namespace pm_lib {
     //	fprintf(fp, "%s\n", s.c_str());
 	fprintf(fp, "%-*s:", maxLabelLen, s.c_str() );
     for(int n=0; n<my_papi.num_sorted; n++) {
-		dx=0.0;
-		for (int i=0; i<num_process; i++) {
-			dx += fabs(m_sortedArrayHWPC[i*my_papi.num_sorted + n]);
+		if (m_gathered) {
+			dx=0.0;
+			for (int i=0; i<num_process; i++) {
+				dx += fabs(m_sortedArrayHWPC[i*my_papi.num_sorted + n]);
+			}
+			dx = dx / num_process;
+		} else {
+			dx = m_sortedAverageHWPC[n];	// reduced by gather_and_reduce()
 		}
-
-		dx = dx / num_process;
 		fprintf (fp, "  %9.3e", dx);
     }
+	if (m_rotated) {
+		fprintf (fp, "  %9.2f", m_rot_error_max);
+	}
+	if (is_sampled()) {
+		fprintf (fp, " (s)");
+	}
 	if (!m_exclusive) {
 		fprintf (fp, " (*)\n");
 	} else if (m_in_parallel) {
@@ -1833,6 +2414,15 @@ namespace pm_lib {
 		fprintf (fp, "\n");
 	}
 
+	// the exclusive part of the section, excluding the nested sections
+	if (has_self_HWPC()) {
+		fprintf(fp, "%-*s:", maxLabelLen, "  (self)" );
+		for(int n=0; n<my_papi.num_sorted; n++) {
+			fprintf (fp, "  %9.3e", m_sortedSelfHWPC[n]);
+		}
+		fprintf (fp, "\n");
+	}
+
 #endif
   }
 
@@ -1907,6 +2497,8 @@ namespace pm_lib {
 			s_chooser == "CACHE" ||
 			s_chooser == "CYCLE" ||
 			s_chooser == "LOADSTORE" ||
+			s_chooser == "ROTATE" ||
+			s_chooser == "ROOFLINE" ||
 			s_chooser == "USER" ) {
 			fprintf(fp, "\t\tHWPC_CHOOSER=%s \n", s_chooser.c_str());
 			;
@@ -1915,7 +2507,43 @@ namespace pm_lib {
 			//	fprintf(fp, "\tInvalid HWPC_CHOOSER value %s is ignored.\n", s_chooser.c_str());
 		}
 	}
+	cp_env = std::getenv("PMLIB_SAMPLE");
+	if (cp_env != NULL) {
+		fprintf(fp, "\t\tPMLIB_SAMPLE=%d \n", hwpc_group.sample_interval);
+	}
+	cp_env = std::getenv("PMLIB_SERIAL_HWPC");
+	if (cp_env != NULL) {
+		fprintf(fp, "\t\tPMLIB_SERIAL_HWPC=%s \n", hwpc_group.serial_master_only ? "MASTER" : "TEAM");
+	}
+	cp_env = std::getenv("PMLIB_HWPC_PID");
+	if (cp_env != NULL) {
+		if ((hwpc_group.attach_pid > 0) && (my_papi.num_events > 0)) {
+			fprintf(fp, "\t\tPMLIB_HWPC_PID=%d : HWPC counts the process %d and its children\n",
+				hwpc_group.attach_pid, hwpc_group.attach_pid);
+		} else {
+			fprintf(fp, "\t\tPMLIB_HWPC_PID=%s : not attached. HWPC counts the calling process\n", cp_env);
+		}
+	}
+	if (hwpc_group.n_rotate > 0) {
+		if (hwpc_group.rotate_calls > 0) {
+			fprintf(fp, "\t\tPMLIB_ROTATE=%d \n", hwpc_group.rotate_calls);
+		} else {
+			fprintf(fp, "\t\tPMLIB_ROTATE=%gms \n", hwpc_group.rotate_slice*1.0e3);
+		}
+	}
+	cp_env = std::getenv("PMLIB_ROOFLINE_PEAK");
+	if ((cp_env != NULL) && (hwpc_group.env_str_hwpc == "ROOFLINE")) {
+		fprintf(fp, "\t\tPMLIB_ROOFLINE_PEAK=%s \n", cp_env);
+	}
 #endif
+	cp_env = std::getenv("PMLIB_SERIES");
+	if (cp_env != NULL) {
+		fprintf(fp, "\t\tPMLIB_SERIES=%s \n", cp_env);
+		cp_env = std::getenv("PMLIB_SERIES_SECTION");
+		if (cp_env != NULL) fprintf(fp, "\t\tPMLIB_SERIES_SECTION=%s \n", cp_env);
+		cp_env = std::getenv("PMLIB_SERIES_FILE");
+		if (cp_env != NULL) fprintf(fp, "\t\tPMLIB_SERIES_FILE=%s \n", cp_env);
+	}
 
 #ifdef USE_POWER
 	cp_env = std::getenv("POWER_CHOOSER");
@@ -1933,9 +2561,22 @@ namespace pm_lib {
 			//	fprintf(fp, "\tInvalid POWER_CHOOSER value %s is ignored.\n", s_chooser.c_str());
 		}
 	}
+	cp_env = std::getenv("PMLIB_POWER_SAMPLE");
+	if (cp_env != NULL) {
+		fprintf(fp, "\t\tPMLIB_POWER_SAMPLE=%s \n", cp_env);
+	}
+	cp_env = std::getenv("PMLIB_POWER_TUNE");
+	if (cp_env != NULL) {
+		fprintf(fp, "\t\tPMLIB_POWER_TUNE=%s \n", cp_env);
+		const char* s_tune[3] = { "PMLIB_POWER_TUNE_GOAL", "PMLIB_POWER_TUNE_SLOWDOWN", "PMLIB_POWER_TUNE_CALLS" };
+		for (int i=0; i<3; i++) {
+			cp_env = std::getenv(s_tune[i]);
+			if (cp_env != NULL) fprintf(fp, "\t\t%s=%s \n", s_tune[i], cp_env);
+		}
+	}
 #endif
 
-#ifdef USE_OTF
+#if defined(USE_OTF) || defined(USE_OTF2)
     cp_env = std::getenv("OTF_TRACING");
     if (cp_env != NULL) {
 	  fprintf(fp, "\t\tOTF_TRACING=%s \n", cp_env);
@@ -1949,12 +2590,34 @@ namespace pm_lib {
 		s_chooser = cp_env;
 		if (s_chooser == "BASIC" ||
 			s_chooser == "DETAIL" ||
-			s_chooser == "FULL" ) {
+			s_chooser == "FULL" ||
+			s_chooser == "IMBALANCE" ) {
 			fprintf(fp, "\t\tPMLIB_REPORT=%s \n", s_chooser.c_str());
 		} else {
 			; // ignore other values
 		}
 	}
+	cp_env = std::getenv("PMLIB_IMBALANCE_TIMESTEP");
+	if (cp_env != NULL) {
+		fprintf(fp, "\t\tPMLIB_IMBALANCE_TIMESTEP=%s \n", cp_env);
+	}
+	cp_env = std::getenv("PMLIB_REPORT_FORMAT");
+	if (cp_env != NULL) {
+		fprintf(fp, "\t\tPMLIB_REPORT_FORMAT=%s \n", cp_env);
+		cp_env = std::getenv("PMLIB_REPORT_FORMAT_FILE");
+		if (cp_env != NULL) fprintf(fp, "\t\tPMLIB_REPORT_FORMAT_FILE=%s \n", cp_env);
+	}
+
+	cp_env = std::getenv("PMLIB_TIMER");
+	if (cp_env == NULL) {
+		fprintf(fp, "\t\tPMLIB_TIMER is not provided. MONOTONIC is assumed.\n");
+	} else {
+		fprintf(fp, "\t\tPMLIB_TIMER=%s \n", cp_env);
+	}
+	cp_env = std::getenv("PMLIB_OVERHEAD");
+	if (cp_env != NULL) {
+		fprintf(fp, "\t\tPMLIB_OVERHEAD=%s \n", cp_env);
+	}
 
   }
 
@@ -2205,191 +2868,5 @@ namespace pm_lib {
   }
 
 
-#if defined (USE_PRECISE_TIMER) // Platform specific precise timer
-	#if defined (__APPLE__)				// Mac Clang and/or GCC
-		#include <unistd.h>
-		#include <mach/mach.h>
-		#include <mach/mach_time.h>
-	#elif defined (__FUJITSU)			// Fugaku A64FX, FX100, K computer
-		#include <fjcex.h>
-	#endif
-#endif
-
-  /// 時刻を取得
-  ///
-  ///   @return 時刻値(秒)
-  ///
-  double PerfWatch::getTime()
-  {
-#if defined (USE_PRECISE_TIMER) // Platform specific precise timer
-	#if defined (__APPLE__)				// Mac Clang and/or GCC
-		//	printf("[__APPLE__] is defined.\n");
-		//	return ((double)mach_absolute_time() * second_per_cycle);
-		// mach_absolute_time() appears to return nano-second unit value
-		return ((double)mach_absolute_time() * 1.0e-9);
-
-	#elif defined (__FUJITSU)			// Fugaku A64FX, FX100, K computer and Fujitsu compiler/library
-		//	printf("[__FUJITSU] is defined.\n");
-		register double tval;
-		tval = __gettod()*1.0e-6;
-		return (tval);
-
-	#elif defined(__x86_64__)			// Intel Xeon processor
-		#if defined (__INTEL_COMPILER) || (__gnu_linux__)
-		// Can replace the following code segment using inline assembler
-		unsigned long long tsc;
-		unsigned int lo, hi;
-		__asm __volatile__ ( "rdtsc" : "=a"(lo), "=d"(hi) );
-		tsc = ( (unsigned long long)lo)|( ((unsigned long long)hi)<<32 );
-		return ((double)tsc * second_per_cycle);
-
-		#else	// precise timer is not available. use gettimeofday() instead.
-		struct timeval tv;
-		gettimeofday(&tv, 0);
-		return (double)tv.tv_sec + (double)tv.tv_usec * 1.0e-6;
-		#endif
-	#else		// precise timer is not available. use gettimeofday() instead.
-		struct timeval tv;
-		gettimeofday(&tv, 0);
-		return (double)tv.tv_sec + (double)tv.tv_usec * 1.0e-6;
-	#endif
-#else // Portable timer gettimeofday() on Linux, Unix, Macos
-	struct timeval tv;
-	gettimeofday(&tv, 0);
-	return (double)tv.tv_sec + (double)tv.tv_usec * 1.0e-6;
-#endif
-
-  }
-
-
-  void PerfWatch::read_cpu_clock_freq()
-  {
-	cpu_clock_freq = 1.0;
-	second_per_cycle = 1.0;
-#if defined (USE_PRECISE_TIMER)
-	#if defined (__APPLE__)
-		FILE *fp;
-		char buf[256];
-		long long llvalue;
-		char cpuvendor[80], cputype[80];
-		std::string s_cpuvendor, s_cputype;
-
-	// The following block valid for Intel core only. But not for arm core.
-		fp = popen("sysctl -n machdep.cpu.brand_string", "r");
-		if (fp == NULL) {
-			printError("<read_cpu_clock_freq>",  "popen(sysctl) failed. \n");
-			return;
-		}
-		if (fgets(buf, sizeof(buf), fp) != NULL) {
-			//	string "Intel(R) Core(TM) i7-6820HQ CPU @ 2.70GHz"
-			//	string "Apple M1 Max"
-			sscanf(buf, "%s %s", cpuvendor, cputype);
-			s_cpuvendor = cpuvendor;
-			s_cputype = cputype;
-		} else {
-			printError("<read_cpu_clock_freq>",  "unexpected end of record.\n");
-		}
-
-		if (s_cpuvendor == "Intel(R)") {
-			fp = popen("sysctl -n hw.cpufrequency", "r");
-			//		integer 2700000000
-			if (fp == NULL) {
-				printError("<read_cpu_clock_freq>",  "no hw.cpufrequency\n");
-				return;
-			}
-			if (fgets(buf, sizeof(buf), fp) != NULL) {
-				sscanf(buf, "%lld", &llvalue);
-				if (llvalue <= 0) {
-					printError("<read_cpu_clock_freq>",  "hw.cpufrequency value is not valid\n");
-					llvalue=1.0;
-				}
-				cpu_clock_freq = (double)llvalue;
-				second_per_cycle = 1.0/cpu_clock_freq;
-				#ifdef DEBUG_PRINT_WATCH
-				if (my_rank == 0) {
-				fprintf(stderr, "<read_cpu_clock_freq> cpu_clock_freq=%lf, second_per_cycle=%16.12lf \n",
-									cpu_clock_freq, second_per_cycle);
-				}
-				#endif
-			} else {
-				printError("<read_cpu_clock_freq>",  "can not detect Intel hw.cpufrequency \n");
-			}
-		} else
-		if (s_cpuvendor == "Apple") {
-		//	
-		//	Apple M1/M2/M3 silicon does not support sysctl hw.cpufrequency
-		//	Root may try it as: powermetrics -s cpu_power -n 1 | grep -i freq
-		//	But no idea to extract silicon frequency at user level
-		//	So, hard code here, instead.
-		//	
-		//		string "Apple M1 Max"
-			if (s_cputype == "M1") {
-				cpu_clock_freq = 3200000000.0;
-			} else if (s_cputype == "M2") {
-				cpu_clock_freq = 3490000000.0;
-			} else if (s_cputype == "M3") {
-				cpu_clock_freq = 4050000000.0;
-			} else {
-				printError("<read_cpu_clock_freq>",  "Unknown Apple silicon\n");
-				return;
-			}
-			second_per_cycle = 1.0/cpu_clock_freq;
-			#ifdef DEBUG_PRINT_WATCH
-			fprintf(stderr, "<read_cpu_clock_freq> cpu_clock_freq=%lf, second_per_cycle=%16.12lf \n",
-								cpu_clock_freq, second_per_cycle);
-			#endif
-		} else {
-			printError("<read_cpu_clock_freq>",  "unknown Mac cpu vendor %s\n", cpuvendor);
-		}
-
-		pclose(fp);
-		return;
-
-	#elif defined (__FUJITSU)			// Fugaku A64FX, FX100, K computer and Fujitsu compiler/library
-		//	__gettod() on Fujitsu compiler/library doesn't require cpu_clock_freq
-		return;
-
-	#elif defined(__x86_64__)					// Intel Xeon
-		#if defined (__INTEL_COMPILER) || (__gnu_linux__)
-	    // read the cpu freqency from /proc/cpuinfo
-
-	    FILE *fp;
-	    double value;
-	    char buffer[1024];
-	    fp = fopen("/proc/cpuinfo","r");
-	    if (fp == NULL) {
-	    	printError("<read_cpu_clock_freq>",  "Can not open /proc/cpuinfo \n");
-	    	return;
-	    }
-	    while (fgets(buffer, 1024, fp) != NULL) {
-			//	fprintf(stderr, "<read_cpu_clock_freq> buffer=%s \n", buffer);
-	    	if (!strncmp(buffer, "cpu MHz",7)) {
-	    		sscanf(buffer, "cpu MHz\t\t: %lf", &value);
-	    		// sscanf handles regexp such as: sscanf (buffer, "%[^\t:]", value);
-	    		cpu_clock_freq = (value * 1.0e6);
-	    		break;
-	    	}
-	    }
-	    fclose(fp);
-	    if (cpu_clock_freq <= 0.0) {
-	    	printError("<read_cpu_clock_freq>",  "Failed parsing /proc/cpuinfo \n");
-	    	return;
-	    }
-	    second_per_cycle = 1.0/(double)cpu_clock_freq;
-		#ifdef DEBUG_PRINT_WATCH
-	   	if (my_rank == 0 && my_thread == 0) {
-			fprintf(stderr, "<read_cpu_clock_freq> cpu_clock_freq=%lf second_per_cycle=%16.12lf \n",
-								cpu_clock_freq, second_per_cycle);
-	   	 }
-		#endif
-
-		#else
-		return;
-	    #endif
-	#endif
-#endif	// (USE_PRECISE_TIMER)
-    return;
-  }
-
 } /* namespace pm_lib */
 